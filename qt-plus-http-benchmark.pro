@@ -0,0 +1,35 @@
+#-------------------------------------------------
+#
+# HTTP server throughput, latency and allocations against worker thread count
+#
+#-------------------------------------------------
+
+QT += network
+
+CONFIG   += console c++11
+
+TEMPLATE = app
+
+SOURCES += \
+    source/cpp/Test/HTTPBenchmark.cpp
+
+HEADERS += \
+    source/cpp/Test/HTTPBenchmark.h
+
+DEPENDPATH += qt-plus
+
+DESTDIR = $$PWD/bin
+MOC_DIR = $$PWD/moc/qt-plus-http-benchmark
+OBJECTS_DIR = $$PWD/obj/qt-plus-http-benchmark
+
+QMAKE_CLEAN *= $$DESTDIR/*$$TARGET*
+QMAKE_CLEAN *= $$MOC_DIR/*$$TARGET*
+QMAKE_CLEAN *= $$OBJECTS_DIR/*$$TARGET*
+
+CONFIG(debug, debug|release) {
+    TARGET = qt-plus-http-benchmarkd
+    LIBS += -L$$PWD/bin/ -lqt-plusd
+} else {
+    TARGET = qt-plus-http-benchmark
+    LIBS += -L$$PWD/bin/ -lqt-plus
+}
@@ -0,0 +1,35 @@
+#-------------------------------------------------
+#
+# MJPEG streaming benchmark : encode time, latency, client rates, drops and memory over a soak
+#
+#-------------------------------------------------
+
+QT += network
+
+CONFIG   += console c++11
+
+TEMPLATE = app
+
+SOURCES += \
+    source/cpp/Test/MJPEGBenchmark.cpp
+
+HEADERS += \
+    source/cpp/Test/MJPEGBenchmark.h
+
+DEPENDPATH += qt-plus
+
+DESTDIR = $$PWD/bin
+MOC_DIR = $$PWD/moc/qt-plus-mjpeg-benchmark
+OBJECTS_DIR = $$PWD/obj/qt-plus-mjpeg-benchmark
+
+QMAKE_CLEAN *= $$DESTDIR/*$$TARGET*
+QMAKE_CLEAN *= $$MOC_DIR/*$$TARGET*
+QMAKE_CLEAN *= $$OBJECTS_DIR/*$$TARGET*
+
+CONFIG(debug, debug|release) {
+    TARGET = qt-plus-mjpeg-benchmarkd
+    LIBS += -L$$PWD/bin/ -lqt-plusd
+} else {
+    TARGET = qt-plus-mjpeg-benchmark
+    LIBS += -L$$PWD/bin/ -lqt-plus
+}
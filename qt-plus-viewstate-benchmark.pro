@@ -0,0 +1,35 @@
+#-------------------------------------------------
+#
+# View state benchmark : encode and decode time and size, full and delta, for pages of 10, 100 and 1000 controls
+#
+#-------------------------------------------------
+
+QT += network
+
+CONFIG   += console c++11
+
+TEMPLATE = app
+
+SOURCES += \
+    source/cpp/Test/ViewStateBenchmark.cpp
+
+HEADERS += \
+    source/cpp/Test/ViewStateBenchmark.h
+
+DEPENDPATH += qt-plus
+
+DESTDIR = $$PWD/bin
+MOC_DIR = $$PWD/moc/qt-plus-viewstate-benchmark
+OBJECTS_DIR = $$PWD/obj/qt-plus-viewstate-benchmark
+
+QMAKE_CLEAN *= $$DESTDIR/*$$TARGET*
+QMAKE_CLEAN *= $$MOC_DIR/*$$TARGET*
+QMAKE_CLEAN *= $$OBJECTS_DIR/*$$TARGET*
+
+CONFIG(debug, debug|release) {
+    TARGET = qt-plus-viewstate-benchmarkd
+    LIBS += -L$$PWD/bin/ -lqt-plusd
+} else {
+    TARGET = qt-plus-viewstate-benchmark
+    LIBS += -L$$PWD/bin/ -lqt-plus
+}
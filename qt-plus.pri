@@ -7,6 +7,7 @@ HEADERS += \
     source/cpp/CDumpable.h \
     source/cpp/CXMLNodable.h \
     source/cpp/CXMLNode.h \
+    source/cpp/CModelColumns.h \
     source/cpp/QTree.h \
     source/cpp/CPIDController.h \
     source/cpp/CAverager.h \
@@ -17,6 +18,7 @@ HEADERS += \
     source/cpp/Image/CLargeMatrix.h \
     source/cpp/Image/CImageHistogram.h \
     source/cpp/Image/CImageUtilities.h \
+    source/cpp/Image/CJPEGCodec.h \
     source/cpp/CSoundSynth.h \
     source/cpp/CTDMADevice.h \
     source/cpp/CStreamFactory.h \
@@ -25,10 +27,22 @@ HEADERS += \
     source/cpp/CSerialStream.h \
     source/cpp/File/CRollingFiles.h \
     source/cpp/Web/CMJPEGClient.h \
+    source/cpp/Web/CMJPEGPacket.h \
+    source/cpp/Web/CMJPEGRecorder.h \
+    source/cpp/Web/CMJPEGRecording.h \
+    source/cpp/Web/CMJPEGPlaybackServer.h \
     source/cpp/Web/CMJPEGServer.h \
     source/cpp/Web/CWebComposer.h \
+    source/cpp/Web/CWebSessionStore.h \
     source/cpp/Web/CWebContext.h \
     source/cpp/Web/CHTTPServer.h \
+    source/cpp/Web/CHTTPRequestParser.h \
+    source/cpp/Web/CHTTPFileCache.h \
+    source/cpp/Web/CHTTPContentEncoder.h \
+    source/cpp/Web/CHTTPRateLimiter.h \
+    source/cpp/Web/CHTTPMultipartParser.h \
+    source/cpp/Web/CHTTPResponse.h \
+    source/cpp/Web/CHTTPMetrics.h \
     source/cpp/Web/CDynamicHTTPServer.h \
     source/cpp/Web/WebControls/CWebButton.h \
     source/cpp/Web/WebControls/CWebControl.h \
@@ -41,6 +55,8 @@ HEADERS += \
     source/cpp/Web/WebControls/CWebFileInput.h \
     source/cpp/Web/WebControls/CWebModelControl.h \
     source/cpp/Web/WebControls/CWebListView.h \
+    source/cpp/Web/WebControls/CWebSlider.h \
+    source/cpp/Web/WebControls/CWebViewState.h \
     source/cpp/ISerializable.h \
     source/cpp/IJSONModelProvider.h \
     source/cpp/CInterpolator.h \
@@ -90,6 +106,7 @@ SOURCES += \
     source/cpp/CDumpable.cpp \
     source/cpp/CXMLNodable.cpp \
     source/cpp/CXMLNode.cpp \
+    source/cpp/CModelColumns.cpp \
     source/cpp/CPIDController.cpp \
     source/cpp/CLogger.cpp \
     source/cpp/CTracableMutex.cpp \
@@ -98,6 +115,7 @@ SOURCES += \
     source/cpp/Image/CLargeMatrix.cpp \
     source/cpp/Image/CImageHistogram.cpp \
     source/cpp/Image/CImageUtilities.cpp \
+    source/cpp/Image/CJPEGCodec.cpp \
     source/cpp/CSoundSynth.cpp \
     source/cpp/CTDMADevice.cpp \
     source/cpp/CStreamFactory.cpp \
@@ -106,10 +124,22 @@ SOURCES += \
     source/cpp/CSerialStream.cpp \
     source/cpp/File/CRollingFiles.cpp \
     source/cpp/Web/CMJPEGClient.cpp \
+    source/cpp/Web/CMJPEGPacket.cpp \
+    source/cpp/Web/CMJPEGRecorder.cpp \
+    source/cpp/Web/CMJPEGRecording.cpp \
+    source/cpp/Web/CMJPEGPlaybackServer.cpp \
     source/cpp/Web/CMJPEGServer.cpp \
     source/cpp/Web/CWebComposer.cpp \
+    source/cpp/Web/CWebSessionStore.cpp \
     source/cpp/Web/CWebContext.cpp \
     source/cpp/Web/CHTTPServer.cpp \
+    source/cpp/Web/CHTTPRequestParser.cpp \
+    source/cpp/Web/CHTTPFileCache.cpp \
+    source/cpp/Web/CHTTPContentEncoder.cpp \
+    source/cpp/Web/CHTTPRateLimiter.cpp \
+    source/cpp/Web/CHTTPMultipartParser.cpp \
+    source/cpp/Web/CHTTPResponse.cpp \
+    source/cpp/Web/CHTTPMetrics.cpp \
     source/cpp/Web/CDynamicHTTPServer.cpp \
     source/cpp/Web/WebControls/CWebButton.cpp \
     source/cpp/Web/WebControls/CWebControl.cpp \
@@ -122,6 +152,8 @@ SOURCES += \
     source/cpp/Web/WebControls/CWebFileInput.cpp \
     source/cpp/Web/WebControls/CWebModelControl.cpp \
     source/cpp/Web/WebControls/CWebListView.cpp \
+    source/cpp/Web/WebControls/CWebSlider.cpp \
+    source/cpp/Web/WebControls/CWebViewState.cpp \
     source/cpp/ISerializable.cpp \
     source/cpp/GeoTools/coordcnv.cpp \
     source/cpp/GeoTools/geocent.cpp \
@@ -167,3 +199,19 @@ SOURCES += \
 
 RESOURCES += \
     resources.qrc
+
+# Use libjpeg-turbo for JPEG encoding and decoding when it is available
+# Add CONFIG+=no_turbojpeg to keep Qt's image plugin, or set TURBOJPEG_DIR where pkg-config is not available
+!no_turbojpeg {
+    TURBOJPEG_DIR = $$(TURBOJPEG_DIR)
+
+    !isEmpty(TURBOJPEG_DIR):exists($$TURBOJPEG_DIR/include/turbojpeg.h) {
+        DEFINES += QTPLUS_TURBOJPEG
+        INCLUDEPATH += $$TURBOJPEG_DIR/include
+        LIBS += -L$$TURBOJPEG_DIR/lib -lturbojpeg
+    } else:unix:packagesExist(libturbojpeg) {
+        DEFINES += QTPLUS_TURBOJPEG
+        CONFIG += link_pkgconfig
+        PKGCONFIG += libturbojpeg
+    }
+}
@@ -0,0 +1,228 @@
+
+// Library
+#include "CModelColumns.h"
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CModelColumns
+    \inmodule qt-plus
+    \brief A range of model items, stored as one array of values per column.
+
+    This is what IJSONModelProvider::modelColumns() returns. A provider backed by a table can fill the arrays
+    directly, without building one node per item. fromXMLNode() and toXMLNode() convert from and to the tree
+    returned by IJSONModelProvider::modelItems() : a "header" node holding one "property" node per column,
+    with "name" and "type" attributes, and a "data" node holding one "item" node per item, with one attribute per column.
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs an empty CModelColumns.
+*/
+CModelColumns::CModelColumns()
+    : m_iStartIndex(0)
+    , m_iVersion(0)
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CModelColumns with no items. \br\br
+    \a iStartIndex is the index of the first item in the model. \br
+    \a lNames and \a lTypes are the names and types of the columns.
+*/
+CModelColumns::CModelColumns(int iStartIndex, const QStringList& lNames, const QStringList& lTypes)
+    : m_iStartIndex(iStartIndex)
+    , m_iVersion(0)
+    , m_lNames(lNames)
+    , m_lTypes(lTypes)
+    , m_vColumns(lNames.count())
+{
+    while (m_lTypes.count() < m_lNames.count())
+    {
+        m_lTypes << "string";
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the change stamp of the model to \a value.
+*/
+void CModelColumns::setVersion(quint64 value)
+{
+    m_iVersion = value;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the index of the first item in the model.
+*/
+int CModelColumns::startIndex() const
+{
+    return m_iStartIndex;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of items, which is the size of the longest column.
+*/
+int CModelColumns::count() const
+{
+    int iCount = 0;
+
+    foreach (const QStringList& lColumn, m_vColumns)
+    {
+        iCount = qMax(iCount, lColumn.count());
+    }
+
+    return iCount;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the change stamp of the model when the items were read, 0 if the provider does not track changes.
+*/
+quint64 CModelColumns::version() const
+{
+    return m_iVersion;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the column names.
+*/
+const QStringList& CModelColumns::names() const
+{
+    return m_lNames;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the column types, such as \c string or \c button.
+*/
+const QStringList& CModelColumns::types() const
+{
+    return m_lTypes;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the values of the column at \a iColumn.
+*/
+const QStringList& CModelColumns::column(int iColumn) const
+{
+    return m_vColumns[iColumn];
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the values of the column at \a iColumn, so they can be filled.
+*/
+QStringList& CModelColumns::column(int iColumn)
+{
+    return m_vColumns[iColumn];
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the value of the column at \a iColumn for the item at \a iItem, relative to the start index. \br\br
+    Returns an empty string if there is no such value.
+*/
+QString CModelColumns::value(int iItem, int iColumn) const
+{
+    if (iColumn < 0 || iColumn >= m_vColumns.count())
+        return QString();
+
+    return m_vColumns[iColumn].value(iItem);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Converts the items to the tree returned by IJSONModelProvider::modelItems().
+*/
+CXMLNode CModelColumns::toXMLNode() const
+{
+    CXMLNode xModel("model");
+    CXMLNode xHeader("header");
+    CXMLNode xData("data");
+
+    for (int iColumn = 0; iColumn < m_lNames.count(); iColumn++)
+    {
+        CXMLNode xProperty("property");
+
+        xProperty.attributes()["name"] = m_lNames[iColumn];
+        xProperty.attributes()["type"] = m_lTypes[iColumn];
+
+        xHeader << xProperty;
+    }
+
+    int iCount = count();
+
+    xData.nodes().reserve(iCount);
+
+    for (int iItem = 0; iItem < iCount; iItem++)
+    {
+        CXMLNode xItem("item");
+
+        for (int iColumn = 0; iColumn < m_lNames.count(); iColumn++)
+        {
+            xItem.attributes()[m_lNames[iColumn]] = value(iItem, iColumn);
+        }
+
+        xData << xItem;
+    }
+
+    xModel << xHeader;
+    xModel << xData;
+
+    return xModel;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Converts \a xModel, a tree returned by IJSONModelProvider::modelItems(), whose first item is at \a iStartIndex.
+*/
+CModelColumns CModelColumns::fromXMLNode(const CXMLNode& xModel, int iStartIndex)
+{
+    CXMLNode xHeader = xModel.getNodeByTagName("header");
+    QStringList lNames;
+    QStringList lTypes;
+
+    foreach (const CXMLNode& xProperty, xHeader.getNodesByTagName("property"))
+    {
+        lNames << xProperty.attributes()["name"];
+        lTypes << xProperty.attributes()["type"];
+    }
+
+    CModelColumns tColumns(iStartIndex, lNames, lTypes);
+
+    CXMLNode xData = xModel.getNodeByTagName("data");
+    QVector<CXMLNode> xItems = xData.getNodesByTagName("item");
+
+    for (int iColumn = 0; iColumn < lNames.count(); iColumn++)
+    {
+        QStringList& lColumn = tColumns.m_vColumns[iColumn];
+
+        lColumn.reserve(xItems.count());
+
+        foreach (const CXMLNode& xItem, xItems)
+        {
+            lColumn << xItem.attributes()[lNames[iColumn]];
+        }
+    }
+
+    return tColumns;
+}
@@ -0,0 +1,90 @@
+
+#pragma once
+
+#include "qtplus_global.h"
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+
+// Qt
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Library
+#include "CXMLNode.h"
+
+//-------------------------------------------------------------------------------------------------
+
+//! A range of model items, stored as one array of values per column
+class QTPLUSSHARED_EXPORT CModelColumns
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Default constructor
+    CModelColumns();
+
+    //! Constructor with the index of the first item and the columns
+    CModelColumns(int iStartIndex, const QStringList& lNames, const QStringList& lTypes);
+
+    //-------------------------------------------------------------------------------------------------
+    // Setters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Sets the change stamp of the model when the items were read
+    void setVersion(quint64 value);
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the index of the first item in the model
+    int startIndex() const;
+
+    //! Returns the number of items
+    int count() const;
+
+    //! Returns the change stamp of the model, 0 if unknown
+    quint64 version() const;
+
+    //! Returns the column names
+    const QStringList& names() const;
+
+    //! Returns the column types
+    const QStringList& types() const;
+
+    //! Returns the values of a column
+    const QStringList& column(int iColumn) const;
+
+    //! Returns the values of a column
+    QStringList& column(int iColumn);
+
+    //! Returns the value of a column for an item, iItem is relative to the start index
+    QString value(int iItem, int iColumn) const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Converts the items to the tree returned by IJSONModelProvider::modelItems()
+    CXMLNode toXMLNode() const;
+
+    //! Converts a tree returned by IJSONModelProvider::modelItems()
+    static CModelColumns fromXMLNode(const CXMLNode& xModel, int iStartIndex);
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    int                     m_iStartIndex;  // Index of the first item
+    quint64                 m_iVersion;     // Change stamp of the model
+    QStringList             m_lNames;       // Column names
+    QStringList             m_lTypes;       // Column types
+    QVector<QStringList>    m_vColumns;     // Values, by column then by item
+};
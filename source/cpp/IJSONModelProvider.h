@@ -6,6 +6,7 @@
 
 // Application
 #include "CXMLNode.h"
+#include "CModelColumns.h"
 
 //-------------------------------------------------------------------------------------------------
 
@@ -19,4 +20,21 @@ public:
 
     //! Gets the total number of items
     virtual int modelItemCount() const = 0;
+
+    //! Returns the items as one array of values per column
+    //! The default implementation converts the tree of modelItems(), providers backed by tables should override it
+    virtual CModelColumns modelColumns(int iStartIndex, int iCount) const
+    {
+        CModelColumns tColumns = CModelColumns::fromXMLNode(modelItems(iStartIndex, iCount), iStartIndex);
+
+        tColumns.setVersion(modelVersion());
+
+        return tColumns;
+    }
+
+    //! Returns a stamp that changes whenever the items change, 0 if the provider does not track changes
+    virtual quint64 modelVersion() const
+    {
+        return 0;
+    }
 };
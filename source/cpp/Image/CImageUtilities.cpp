@@ -8,6 +8,7 @@
 // Library
 #include "CImageUtilities.h"
 #include "CImageHistogram.h"
+#include "CJPEGCodec.h"
 
 //-------------------------------------------------------------------------------------------------
 
@@ -521,10 +522,16 @@ double CImageUtilities::findDominantValue(const QImage& imgSource, double dPreci
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns a QByteArray to which \a image was saved, using \a szFormat and \a compressionRate.
+    Returns a QByteArray to which \a image was saved, using \a szFormat and \a compressionRate. \br\br
+    JPEG images are encoded by the codec of the calling thread (see CJPEGCodec).
 */
 QByteArray CImageUtilities::convertQImageToByteArray(const QImage& image, const char* szFormat, int compressionRate)
 {
+    if (CJPEGCodec::isJPEGFormat(szFormat))
+    {
+        return CJPEGCodec::forCurrentThread()->encode(image, compressionRate);
+    }
+
     QByteArray baOutput;
     QBuffer buffer(&baOutput);
 
@@ -540,10 +547,16 @@ QByteArray CImageUtilities::convertQImageToByteArray(const QImage& image, const
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns an image loaded from \a baData, using \a szFormat.
+    Returns an image loaded from \a baData, using \a szFormat. \br\br
+    JPEG images are decoded by the codec of the calling thread (see CJPEGCodec).
 */
 QImage CImageUtilities::convertByteArrayToQImage(const QByteArray& baData, const char* szFormat)
 {
+    if (CJPEGCodec::isJPEGFormat(szFormat))
+    {
+        return CJPEGCodec::forCurrentThread()->decode(baData);
+    }
+
     QImage image;
 
     if (image.loadFromData(baData, szFormat))
@@ -0,0 +1,279 @@
+
+// Qt
+#include <QBuffer>
+#include <QThreadStorage>
+#include <QDebug>
+
+// Application
+#include "CJPEGCodec.h"
+
+#ifdef QTPLUS_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+//-------------------------------------------------------------------------------------------------
+
+// Quality used when none is given, same as Qt's JPEG plugin
+#define JPEG_DEFAULT_QUALITY    75
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CJPEGCodec
+    \inmodule qt-plus
+    \brief Encodes and decodes JPEG images.
+
+    When libjpeg-turbo is found at qmake time, QTPLUS_TURBOJPEG is defined and the codec uses the
+    TurboJPEG API: it creates one compressor and one decompressor, and keeps them, along with its
+    compression buffer, for its whole life, so that encoding a frame allocates nothing but its result.
+    RGB888 buffers, like the ones given to CMJPEGServer::sendRaw(), are compressed as they are. \br
+    Otherwise the codec goes through Qt's image format plugin, which ignores the chroma subsampling. \br\br
+    A codec must be used by one thread at a time. forCurrentThread() returns the codec of the calling
+    thread, so that encoding threads keep their handles from a frame to the next.
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CJPEGCodec.
+*/
+CJPEGCodec::CJPEGCodec()
+    : m_hCompressor(nullptr)
+    , m_hDecompressor(nullptr)
+    , m_pBuffer(nullptr)
+    , m_ulBufferSize(0)
+{
+#ifdef QTPLUS_TURBOJPEG
+    m_hCompressor = tjInitCompress();
+    m_hDecompressor = tjInitDecompress();
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CJPEGCodec.
+*/
+CJPEGCodec::~CJPEGCodec()
+{
+#ifdef QTPLUS_TURBOJPEG
+    if (m_pBuffer != nullptr)
+    {
+        tjFree(m_pBuffer);
+    }
+
+    if (m_hCompressor != nullptr)
+    {
+        tjDestroy(m_hCompressor);
+    }
+
+    if (m_hDecompressor != nullptr)
+    {
+        tjDestroy(m_hDecompressor);
+    }
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the JPEG encoding of \a iWidth x \a iHeight RGB888 pixels at \a pPixels. \br\br
+    \a iStride is the size of a line in bytes, \a iQuality goes from 0 to 100 (-1 for the default)
+    and \a eSubsampling is the chroma subsampling. Returns an empty array on error.
+*/
+QByteArray CJPEGCodec::encodeRGB888(const uchar* pPixels, int iWidth, int iHeight, int iStride, int iQuality, ESubsampling eSubsampling)
+{
+    if (pPixels == nullptr || iWidth <= 0 || iHeight <= 0 || iStride < iWidth * 3)
+    {
+        return QByteArray();
+    }
+
+#ifdef QTPLUS_TURBOJPEG
+    if (m_hCompressor != nullptr)
+    {
+        static const int aSubsampling[] = { TJSAMP_444, TJSAMP_422, TJSAMP_420, TJSAMP_GRAY };
+
+        int iSamp = aSubsampling[eSubsampling];
+        ulong ulMaxSize = tjBufSize(iWidth, iHeight, iSamp);
+
+        // Grow the compression buffer if needed, it is kept for the next frames
+        if (ulMaxSize > m_ulBufferSize)
+        {
+            if (m_pBuffer != nullptr)
+            {
+                tjFree(m_pBuffer);
+            }
+
+            m_pBuffer = tjAlloc((int) ulMaxSize);
+            m_ulBufferSize = m_pBuffer != nullptr ? ulMaxSize : 0;
+        }
+
+        ulong ulSize = m_ulBufferSize;
+
+        if (tjCompress2(
+                    m_hCompressor, (uchar*) pPixels, iWidth, iStride, iHeight, TJPF_RGB,
+                    &m_pBuffer, &ulSize, iSamp, iQuality < 0 ? JPEG_DEFAULT_QUALITY : qMin(iQuality, 100),
+                    TJFLAG_NOREALLOC
+                    ) != 0)
+        {
+            qWarning() << QString("CJPEGCodec::encodeRGB888() : %1").arg(tjGetErrorStr());
+            return QByteArray();
+        }
+
+        return QByteArray((const char*) m_pBuffer, (int) ulSize);
+    }
+#endif
+
+    // Wrap the pixels, without copy
+    return encode(QImage(pPixels, iWidth, iHeight, iStride, QImage::Format_RGB888), iQuality, eSubsampling);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the JPEG encoding of \a image, with quality \a iQuality (-1 for the default)
+    and chroma subsampling \a eSubsampling. Returns an empty array on error.
+*/
+QByteArray CJPEGCodec::encode(const QImage& image, int iQuality, ESubsampling eSubsampling)
+{
+    if (image.isNull())
+    {
+        return QByteArray();
+    }
+
+#ifdef QTPLUS_TURBOJPEG
+    if (m_hCompressor != nullptr)
+    {
+        if (image.format() == QImage::Format_RGB888)
+        {
+            return encodeRGB888(image.constBits(), image.width(), image.height(), image.bytesPerLine(), iQuality, eSubsampling);
+        }
+
+        QImage rgbImage = image.convertToFormat(QImage::Format_RGB888);
+
+        return encodeRGB888(rgbImage.constBits(), rgbImage.width(), rgbImage.height(), rgbImage.bytesPerLine(), iQuality, eSubsampling);
+    }
+#endif
+
+    QByteArray baOutput;
+    QBuffer buffer(&baOutput);
+
+    if (buffer.open(QIODevice::WriteOnly))
+    {
+        if (eSubsampling == eGray && image.format() != QImage::Format_Grayscale8)
+        {
+            image.convertToFormat(QImage::Format_Grayscale8).save(&buffer, "JPG", iQuality);
+        }
+        else
+        {
+            image.save(&buffer, "JPG", iQuality);
+        }
+
+        buffer.close();
+    }
+
+    return baOutput;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the RGB888 image decoded from \a baJPEG, or a null image on error.
+*/
+QImage CJPEGCodec::decode(const QByteArray& baJPEG)
+{
+    if (baJPEG.isEmpty())
+    {
+        return QImage();
+    }
+
+#ifdef QTPLUS_TURBOJPEG
+    if (m_hDecompressor != nullptr)
+    {
+        uchar* pData = (uchar*) baJPEG.constData();
+        int iWidth = 0;
+        int iHeight = 0;
+        int iSamp = 0;
+        int iColorSpace = 0;
+
+        if (tjDecompressHeader3(m_hDecompressor, pData, (ulong) baJPEG.size(), &iWidth, &iHeight, &iSamp, &iColorSpace) != 0)
+        {
+            qWarning() << QString("CJPEGCodec::decode() : %1").arg(tjGetErrorStr());
+            return QImage();
+        }
+
+        QImage image(iWidth, iHeight, QImage::Format_RGB888);
+
+        if (image.isNull())
+        {
+            return QImage();
+        }
+
+        if (tjDecompress2(m_hDecompressor, pData, (ulong) baJPEG.size(), image.bits(), iWidth, image.bytesPerLine(), iHeight, TJPF_RGB, 0) != 0)
+        {
+            qWarning() << QString("CJPEGCodec::decode() : %1").arg(tjGetErrorStr());
+            return QImage();
+        }
+
+        return image;
+    }
+#endif
+
+    QImage image;
+
+    if (image.loadFromData(baJPEG, "JPG"))
+    {
+        image = image.convertToFormat(QImage::Format_RGB888);
+    }
+
+    return image;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the codec of the calling thread. \br\br
+    It is created on first use and destroyed when the thread finishes.
+*/
+CJPEGCodec* CJPEGCodec::forCurrentThread()
+{
+    static QThreadStorage<CJPEGCodec*> s_tCodecs;
+
+    if (s_tCodecs.hasLocalData() == false)
+    {
+        s_tCodecs.setLocalData(new CJPEGCodec());
+    }
+
+    return s_tCodecs.localData();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the name of the backend the library was built with : \c "turbojpeg" or \c "qt".
+*/
+const char* CJPEGCodec::backendName()
+{
+#ifdef QTPLUS_TURBOJPEG
+    return "turbojpeg";
+#else
+    return "qt";
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if \a szFormat names the JPEG format (\c "JPG" or \c "JPEG", in any case).
+*/
+bool CJPEGCodec::isJPEGFormat(const char* szFormat)
+{
+    if (szFormat == nullptr)
+    {
+        return false;
+    }
+
+    QByteArray baFormat = QByteArray(szFormat).toUpper();
+
+    return baFormat == "JPG" || baFormat == "JPEG";
+}
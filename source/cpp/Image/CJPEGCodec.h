@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QByteArray>
+#include <QImage>
+
+//-------------------------------------------------------------------------------------------------
+
+//! Encodes and decodes JPEG images, using libjpeg-turbo when the library was built with it
+//! A codec keeps its compressor and decompressor for its whole life, use forCurrentThread() to get the one of a thread
+class QTPLUSSHARED_EXPORT CJPEGCodec
+{
+    // Owns the TurboJPEG handles and the encoding buffer
+    Q_DISABLE_COPY(CJPEGCodec)
+
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Enumerators
+    //-------------------------------------------------------------------------------------------------
+
+    //! Chroma subsampling of encoded images
+    enum ESubsampling
+    {
+        e444,       // No subsampling
+        e422,       // Half horizontal chroma resolution
+        e420,       // Half horizontal and vertical chroma resolution
+        eGray       // Luminance only
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor
+    CJPEGCodec();
+
+    //! Destructor
+    virtual ~CJPEGCodec();
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Encodes tightly or loosely packed RGB888 pixels, iStride being the size of a line in bytes
+    QByteArray encodeRGB888(const uchar* pPixels, int iWidth, int iHeight, int iStride, int iQuality = -1, ESubsampling eSubsampling = e420);
+
+    //! Encodes an image
+    QByteArray encode(const QImage& image, int iQuality = -1, ESubsampling eSubsampling = e420);
+
+    //! Decodes JPEG data to an RGB888 image, returns a null image on error
+    QImage decode(const QByteArray& baJPEG);
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the codec of the calling thread, created on first use and destroyed with the thread
+    static CJPEGCodec* forCurrentThread();
+
+    //! Returns the name of the backend the library was built with
+    static const char* backendName();
+
+    //! Returns true if szFormat names the JPEG format
+    static bool isJPEGFormat(const char* szFormat);
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    void*       m_hCompressor;          // TurboJPEG handles, null with the Qt backend
+    void*       m_hDecompressor;
+    uchar*      m_pBuffer;              // Compression buffer, grown as needed and reused
+    ulong       m_ulBufferSize;
+};
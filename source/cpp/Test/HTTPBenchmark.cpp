@@ -0,0 +1,530 @@
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+#include <QDebug>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "HTTPBenchmark.h"
+
+// Usage : qt-plus-http-benchmark [--threads 0,1,2,4,8] [--keepalive 64] [--close 0] [--mix get,post,multipart] [--warmup 1] [--duration 3]
+// A thread count of 0 is the classic mode : sockets in the server's thread, requests in a thread pool
+// --keepalive and --close give the number of connections of each kind, a close connection opens a new socket for each request
+// --connections is kept as an alias of --keepalive
+
+#define BASE_PORT   18080
+
+//-------------------------------------------------------------------------------------------------
+// Allocation counting
+//-------------------------------------------------------------------------------------------------
+
+static QAtomicInteger<qint64> s_iAllocations;
+static QAtomicInteger<qint64> s_iAllocatedBytes;
+static thread_local bool t_bExcluded = false;
+
+void AllocationCounter::excludeThread()
+{
+    t_bExcluded = true;
+}
+
+void AllocationCounter::record(size_t iSize)
+{
+    if (t_bExcluded == false)
+    {
+        s_iAllocations.fetchAndAddRelaxed(1);
+        s_iAllocatedBytes.fetchAndAddRelaxed((qint64) iSize);
+    }
+}
+
+void AllocationCounter::reset()
+{
+    s_iAllocations.store(0);
+    s_iAllocatedBytes.store(0);
+}
+
+qint64 AllocationCounter::allocations()
+{
+    return s_iAllocations.load();
+}
+
+qint64 AllocationCounter::bytes()
+{
+    return s_iAllocatedBytes.load();
+}
+
+#if defined(__GLIBC__)
+
+// With glibc, malloc is replaced for the whole process, Qt's containers included
+// Every byte allocated by a growing QByteArray or QString is a byte copied into it, so bytes allocated are reported as bytes copied
+
+extern "C" void* __libc_malloc(size_t iSize);
+extern "C" void* __libc_calloc(size_t iCount, size_t iSize);
+extern "C" void* __libc_realloc(void* pMemory, size_t iSize);
+
+extern "C" void* malloc(size_t iSize) __THROW
+{
+    AllocationCounter::record(iSize);
+    return __libc_malloc(iSize);
+}
+
+extern "C" void* calloc(size_t iCount, size_t iSize) __THROW
+{
+    AllocationCounter::record(iCount * iSize);
+    return __libc_calloc(iCount, iSize);
+}
+
+extern "C" void* realloc(void* pMemory, size_t iSize) __THROW
+{
+    AllocationCounter::record(iSize);
+    return __libc_realloc(pMemory, iSize);
+}
+
+#else
+
+// Elsewhere, only operator new can be replaced portably, so allocations of Qt's containers are not seen
+
+void* operator new(size_t iSize)
+{
+    AllocationCounter::record(iSize);
+
+    void* pMemory = std::malloc(iSize > 0 ? iSize : 1);
+
+    if (pMemory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return pMemory;
+}
+
+void* operator new[](size_t iSize)
+{
+    return operator new(iSize);
+}
+
+void operator delete(void* pMemory) noexcept
+{
+    std::free(pMemory);
+}
+
+void operator delete[](void* pMemory) noexcept
+{
+    std::free(pMemory);
+}
+
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// Server
+//-------------------------------------------------------------------------------------------------
+
+BenchmarkServer::BenchmarkServer(quint16 iPort, int iWorkerThreads)
+    : CHTTPServer(iPort)
+{
+    useFloodProtection(false);
+    setWorkerThreadCount(iWorkerThreads);
+}
+
+void BenchmarkServer::getContent(const CWebContext& tContext, QString& sHead, QString& sBody, QString& sCustomResponse, QString& sCustomResponseMIME)
+{
+    Q_UNUSED(sHead);
+    Q_UNUSED(sCustomResponse);
+    Q_UNUSED(sCustomResponseMIME);
+
+    if (tContext.m_lParts.count() > 0)
+    {
+        sBody = QString("<div>%1 parts</div>").arg(tContext.m_lParts.count());
+    }
+    else if (tContext.m_mArguments.count() > 0)
+    {
+        sBody = QString("<div>%1 arguments</div>").arg(tContext.m_mArguments.count());
+    }
+    else
+    {
+        sBody = "<div>Hello world!</div>";
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Client
+//-------------------------------------------------------------------------------------------------
+
+BenchmarkClient::BenchmarkClient(quint16 iPort, bool bKeepAlive, const QStringList& lMix, int iDurationMS)
+    : m_iPort(iPort)
+    , m_bKeepAlive(bKeepAlive)
+    , m_lMix(lMix)
+    , m_iDurationMS(iDurationMS)
+    , m_iRequests(0)
+    , m_iErrors(0)
+{
+}
+
+QByteArray BenchmarkClient::request(const QString& sKind) const
+{
+    QByteArray baConnection = m_bKeepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+
+    if (sKind == "post")
+    {
+        QByteArray baBody = "name=load&count=12&text=hello+world";
+
+        return "POST /bench HTTP/1.1\r\nHost: localhost\r\n" + baConnection
+                + "Content-Type: application/x-www-form-urlencoded\r\n"
+                + "Content-Length: " + QByteArray::number(baBody.count()) + "\r\n\r\n"
+                + baBody;
+    }
+
+    if (sKind == "multipart")
+    {
+        QByteArray baBoundary = "----qtplusbenchboundary";
+        QByteArray baBody;
+
+        baBody += "--" + baBoundary + "\r\n";
+        baBody += "Content-Disposition: form-data; name=\"name\"\r\n\r\n";
+        baBody += "load\r\n";
+        baBody += "--" + baBoundary + "\r\n";
+        baBody += "Content-Disposition: form-data; name=\"file\"; filename=\"data.bin\"\r\n";
+        baBody += "Content-Type: application/octet-stream\r\n\r\n";
+        baBody += QByteArray(4096, 'x') + "\r\n";
+        baBody += "--" + baBoundary + "--\r\n";
+
+        return "POST /upload HTTP/1.1\r\nHost: localhost\r\n" + baConnection
+                + "Content-Type: multipart/form-data; boundary=" + baBoundary + "\r\n"
+                + "Content-Length: " + QByteArray::number(baBody.count()) + "\r\n\r\n"
+                + baBody;
+    }
+
+    return "GET /bench?id=42 HTTP/1.1\r\nHost: localhost\r\n" + baConnection + "\r\n";
+}
+
+bool BenchmarkClient::readResponse(QTcpSocket* pSocket, QByteArray& baBuffer, bool& bClosed)
+{
+    int iHeaderEnd = -1;
+    int iContentLength = -1;
+
+    bClosed = false;
+
+    while (true)
+    {
+        if (iHeaderEnd < 0)
+        {
+            iHeaderEnd = baBuffer.indexOf("\r\n\r\n");
+
+            // Read the header fields once, names are case insensitive
+            if (iHeaderEnd >= 0)
+            {
+                foreach (QByteArray baLine, baBuffer.left(iHeaderEnd).split('\n'))
+                {
+                    int iColon = baLine.indexOf(':');
+
+                    if (iColon < 0)
+                    {
+                        continue;
+                    }
+
+                    QByteArray baName = baLine.left(iColon).trimmed().toLower();
+                    QByteArray baValue = baLine.mid(iColon + 1).trimmed();
+
+                    if (baName == "content-length")
+                    {
+                        iContentLength = baValue.toInt();
+                    }
+                    else if (baName == "connection")
+                    {
+                        bClosed = baValue.toLower() == "close";
+                    }
+                }
+
+                // These have no body
+                if (baBuffer.startsWith("HTTP/1.1 204") || baBuffer.startsWith("HTTP/1.1 304"))
+                {
+                    iContentLength = 0;
+                }
+            }
+        }
+
+        if (iHeaderEnd >= 0 && iContentLength >= 0 && baBuffer.count() >= iHeaderEnd + 4 + iContentLength)
+        {
+            bool bSuccess = baBuffer.startsWith("HTTP/1.1 200");
+
+            baBuffer.remove(0, iHeaderEnd + 4 + iContentLength);
+            return bSuccess;
+        }
+
+        if (pSocket->waitForReadyRead(5000) == false)
+        {
+            // Without a Content-Length, the body ends with the connection
+            if (iHeaderEnd >= 0 && iContentLength < 0 && pSocket->state() == QAbstractSocket::UnconnectedState)
+            {
+                bool bSuccess = baBuffer.startsWith("HTTP/1.1 200");
+
+                bClosed = true;
+                baBuffer.clear();
+                return bSuccess;
+            }
+
+            return false;
+        }
+
+        baBuffer.append(pSocket->readAll());
+    }
+}
+
+void BenchmarkClient::run()
+{
+    AllocationCounter::excludeThread();
+
+    QVector<QByteArray> vRequests;
+    QByteArray baBuffer;
+    QElapsedTimer tTimer;
+    QElapsedTimer tRequestTimer;
+    QTcpSocket* pSocket = nullptr;
+
+    foreach (QString sKind, m_lMix)
+    {
+        vRequests << request(sKind.trimmed());
+    }
+
+    if (vRequests.isEmpty())
+    {
+        return;
+    }
+
+    m_vLatencies.reserve(100000);
+    tTimer.start();
+
+    for (int iIndex = 0; tTimer.elapsed() < m_iDurationMS; iIndex++)
+    {
+        tRequestTimer.start();
+
+        if (pSocket == nullptr)
+        {
+            pSocket = new QTcpSocket();
+            pSocket->connectToHost("127.0.0.1", m_iPort);
+
+            if (pSocket->waitForConnected(5000) == false)
+            {
+                m_iErrors++;
+                break;
+            }
+        }
+
+        pSocket->write(vRequests[iIndex % vRequests.count()]);
+
+        bool bClosed = false;
+        bool bSuccess = readResponse(pSocket, baBuffer, bClosed);
+
+        m_vLatencies << tRequestTimer.nsecsElapsed();
+
+        if (bSuccess)
+        {
+            m_iRequests++;
+        }
+        else
+        {
+            m_iErrors++;
+        }
+
+        if (bSuccess == false || bClosed || m_bKeepAlive == false)
+        {
+            pSocket->abort();
+            delete pSocket;
+            pSocket = nullptr;
+            baBuffer.clear();
+        }
+    }
+
+    if (pSocket != nullptr)
+    {
+        pSocket->disconnectFromHost();
+        delete pSocket;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Runner
+//-------------------------------------------------------------------------------------------------
+
+static QString percentiles(QVector<qint64>& vLatencies)
+{
+    if (vLatencies.isEmpty())
+    {
+        return QString("%1 %2 %3").arg("-", 9).arg("-", 9).arg("-", 9);
+    }
+
+    std::sort(vLatencies.begin(), vLatencies.end());
+
+    int iCount = vLatencies.count();
+    qint64 iP50 = vLatencies[qMin(iCount - 1, (int) (iCount * 0.50))];
+    qint64 iP99 = vLatencies[qMin(iCount - 1, (int) (iCount * 0.99))];
+    qint64 iP999 = vLatencies[qMin(iCount - 1, (int) (iCount * 0.999))];
+
+    return QString("%1 %2 %3")
+            .arg((double) iP50 / 1000.0, 9, 'f', 0)
+            .arg((double) iP99 / 1000.0, 9, 'f', 0)
+            .arg((double) iP999 / 1000.0, 9, 'f', 0);
+}
+
+QVector<BenchmarkClient*> BenchmarkRunner::runClients(quint16 iPort, int iDurationMS)
+{
+    QVector<BenchmarkClient*> vClients;
+
+    for (int iClient = 0; iClient < m_iKeepAliveConnections + m_iCloseConnections; iClient++)
+    {
+        vClients << new BenchmarkClient(iPort, iClient < m_iKeepAliveConnections, m_lMix, iDurationMS);
+    }
+
+    foreach (BenchmarkClient* pClient, vClients)
+    {
+        pClient->start();
+    }
+
+    foreach (BenchmarkClient* pClient, vClients)
+    {
+        pClient->wait();
+    }
+
+    return vClients;
+}
+
+void BenchmarkRunner::run()
+{
+    AllocationCounter::excludeThread();
+
+    qDebug() << QString("%1 keep-alive and %2 close connections, mix %3, %4 ms per run")
+                .arg(m_iKeepAliveConnections)
+                .arg(m_iCloseConnections)
+                .arg(m_lMix.join(","))
+                .arg(m_iDurationMS);
+    qDebug() << "threads connection    requests/s   p50 (us)  p99 (us) p999 (us)    errors allocs/req  bytes/req";
+
+    for (int iIndex = 0; iIndex < m_vPorts.count(); iIndex++)
+    {
+        // Warm up, so that caches, thread pools and reusable buffers are in place
+        if (m_iWarmUpMS > 0)
+        {
+            qDeleteAll(runClients(m_vPorts[iIndex], m_iWarmUpMS));
+        }
+
+        AllocationCounter::reset();
+
+        QElapsedTimer tTimer;
+        tTimer.start();
+
+        QVector<BenchmarkClient*> vClients = runClients(m_vPorts[iIndex], m_iDurationMS);
+
+        double dSeconds = (double) tTimer.elapsed() / 1000.0;
+        qint64 iAllocations = AllocationCounter::allocations();
+        qint64 iBytes = AllocationCounter::bytes();
+
+        QVector<qint64> vKeepAlive;
+        QVector<qint64> vClose;
+        int iKeepAliveRequests = 0;
+        int iCloseRequests = 0;
+        int iErrors = 0;
+
+        foreach (BenchmarkClient* pClient, vClients)
+        {
+            if (pClient->m_bKeepAlive)
+            {
+                vKeepAlive += pClient->m_vLatencies;
+                iKeepAliveRequests += pClient->m_iRequests;
+            }
+            else
+            {
+                vClose += pClient->m_vLatencies;
+                iCloseRequests += pClient->m_iRequests;
+            }
+
+            iErrors += pClient->m_iErrors;
+        }
+
+        qDeleteAll(vClients);
+
+        int iRequests = iKeepAliveRequests + iCloseRequests;
+
+        if (m_iKeepAliveConnections > 0)
+        {
+            qDebug() << QString("%1 keep-alive %2 %3")
+                        .arg(m_vThreadCounts[iIndex], 7)
+                        .arg((double) iKeepAliveRequests / dSeconds, 13, 'f', 0)
+                        .arg(percentiles(vKeepAlive));
+        }
+
+        if (m_iCloseConnections > 0)
+        {
+            qDebug() << QString("%1 close      %2 %3")
+                        .arg(m_vThreadCounts[iIndex], 7)
+                        .arg((double) iCloseRequests / dSeconds, 13, 'f', 0)
+                        .arg(percentiles(vClose));
+        }
+
+        qDebug() << QString("%1 total      %2 %3 %4 %5 %6")
+                    .arg(m_vThreadCounts[iIndex], 7)
+                    .arg((double) iRequests / dSeconds, 13, 'f', 0)
+                    .arg("", 29)
+                    .arg(iErrors, 9)
+                    .arg(iRequests > 0 ? (double) iAllocations / iRequests : 0.0, 10, 'f', 1)
+                    .arg(iRequests > 0 ? (double) iBytes / iRequests : 0.0, 10, 'f', 0);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Application
+//-------------------------------------------------------------------------------------------------
+
+BenchmarkApplication::BenchmarkApplication(int argc, char** argv)
+    : QCoreApplication(argc, argv)
+{
+    QStringList lArguments = arguments();
+    QString sThreads = QString("0,1,2,4,%1").arg(QThread::idealThreadCount());
+
+    runner.m_iKeepAliveConnections = 64;
+    runner.m_iCloseConnections = 0;
+    runner.m_lMix = QStringList() << "get";
+    runner.m_iWarmUpMS = 1000;
+    runner.m_iDurationMS = 3000;
+
+    for (int iIndex = 1; iIndex < lArguments.count() - 1; iIndex++)
+    {
+        if (lArguments[iIndex] == "--threads") sThreads = lArguments[iIndex + 1];
+        else if (lArguments[iIndex] == "--keepalive") runner.m_iKeepAliveConnections = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--connections") runner.m_iKeepAliveConnections = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--close") runner.m_iCloseConnections = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--mix") runner.m_lMix = lArguments[iIndex + 1].split(",");
+        else if (lArguments[iIndex] == "--warmup") runner.m_iWarmUpMS = lArguments[iIndex + 1].toInt() * 1000;
+        else if (lArguments[iIndex] == "--duration") runner.m_iDurationMS = lArguments[iIndex + 1].toInt() * 1000;
+    }
+
+    // One server per configuration, all listening in this thread
+    foreach (QString sCount, sThreads.split(","))
+    {
+        quint16 iPort = BASE_PORT + m_vServers.count();
+        int iThreadCount = sCount.toInt();
+
+        m_vServers << new BenchmarkServer(iPort, iThreadCount);
+        runner.m_vThreadCounts << iThreadCount;
+        runner.m_vPorts << iPort;
+    }
+
+    connect(&runner, SIGNAL(finished()), this, SLOT(onFinished()));
+    runner.start();
+}
+
+BenchmarkApplication::~BenchmarkApplication()
+{
+    qDeleteAll(m_vServers);
+}
+
+void BenchmarkApplication::onFinished()
+{
+    quit();
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkApplication app(argc, argv);
+
+    return app.exec();
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QVector>
+#include <QStringList>
+
+#include "../Web/CHTTPServer.h"
+
+class QTcpSocket;
+
+//! Counts the heap allocations made by the server's threads
+//! Client threads call excludeThread() so that only the server side is measured
+class AllocationCounter
+{
+public:
+
+    //! Excludes the calling thread from the counts
+    static void excludeThread();
+
+    //! Records an allocation of iSize bytes made by the calling thread
+    static void record(size_t iSize);
+
+    //! Resets the counts
+    static void reset();
+
+    //! Returns the number of allocations since the last reset
+    static qint64 allocations();
+
+    //! Returns the number of bytes allocated since the last reset
+    static qint64 bytes();
+};
+
+//! A server answering GET, POST and multipart requests with a small dynamic page
+class BenchmarkServer : public CHTTPServer
+{
+    Q_OBJECT
+
+public:
+
+    BenchmarkServer(quint16 iPort, int iWorkerThreads);
+
+    virtual void getContent(const CWebContext& tContext, QString& sHead, QString& sBody, QString& sCustomResponse, QString& sCustomResponseMIME) Q_DECL_OVERRIDE;
+};
+
+//! A client replaying a mix of requests, over one keep-alive connection or a new connection per request
+class BenchmarkClient : public QThread
+{
+    Q_OBJECT
+
+public:
+
+    BenchmarkClient(quint16 iPort, bool bKeepAlive, const QStringList& lMix, int iDurationMS);
+
+    virtual void run() Q_DECL_OVERRIDE;
+
+    //! Reads one response from pSocket, returns false on error
+    //! bClosed is set if the connection ends with the response
+    static bool readResponse(QTcpSocket* pSocket, QByteArray& baBuffer, bool& bClosed);
+
+    quint16             m_iPort;
+    bool                m_bKeepAlive;
+    QStringList         m_lMix;
+    int                 m_iDurationMS;
+    int                 m_iRequests;
+    int                 m_iErrors;
+    QVector<qint64>     m_vLatencies;       // In nanoseconds
+
+protected:
+
+    //! Returns the raw request for the given kind (get, post or multipart)
+    QByteArray request(const QString& sKind) const;
+};
+
+//! Loads each server in turn and prints requests per second, latencies and server allocations against thread count
+class BenchmarkRunner : public QThread
+{
+    Q_OBJECT
+
+public:
+
+    virtual void run() Q_DECL_OVERRIDE;
+
+    QVector<int>        m_vThreadCounts;
+    QVector<quint16>    m_vPorts;
+    int                 m_iKeepAliveConnections;
+    int                 m_iCloseConnections;
+    QStringList         m_lMix;
+    int                 m_iWarmUpMS;
+    int                 m_iDurationMS;
+
+protected:
+
+    //! Runs the clients against a server for iDurationMS, returns them once finished
+    QVector<BenchmarkClient*> runClients(quint16 iPort, int iDurationMS);
+};
+
+class BenchmarkApplication : public QCoreApplication
+{
+    Q_OBJECT
+
+public:
+
+    BenchmarkApplication(int argc, char** argv);
+
+    virtual ~BenchmarkApplication();
+
+    BenchmarkRunner runner;
+
+protected slots:
+
+    void onFinished();
+
+protected:
+
+    QVector<BenchmarkServer*>   m_vServers;
+};
@@ -0,0 +1,578 @@
+#include <QFile>
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+
+#include "MJPEGBenchmark.h"
+#include "../Image/CJPEGCodec.h"
+
+// Usage : qt-plus-mjpeg-benchmark [--width 1280] [--height 720] [--fps 30] [--input image|raw|both] [--clients 8] [--throttled 2]
+//                                 [--throttle 256] [--quality -1] [--scale 1] [--policy oldest|latest|latency] [--duration 60] [--report 10]
+// --throttled is how many of the clients read their socket slowly, at --throttle KB/s
+// --quality and --scale are passed to the server as query arguments, so the clients receive a variant when they are set
+// --duration and --report are in seconds, a soak is a long duration with a report every few minutes
+
+#define BASE_PORT                   18280
+#define FRAME_NUMBERS               65536       // Frame numbers are 16 bits, they wrap around
+#define STAMP_BLOCKS                17          // 16 bits and a parity bit
+#define STAMP_DIVISOR               48.0        // A block is this fraction of the width, so that the stamp survives downscaling
+#define BACKGROUNDS                 8
+#define ENCODE_SAMPLES              30
+#define LATENCY_BUCKET_US           100
+#define LATENCY_BUCKETS             100000
+#define THROTTLE_TICKS_PER_SECOND   50
+
+static QAtomicInteger<qint64> s_aSendTimes[FRAME_NUMBERS];
+
+QElapsedTimer FrameProducer::s_tClock;
+
+//-------------------------------------------------------------------------------------------------
+// Latency histogram
+//-------------------------------------------------------------------------------------------------
+
+LatencyHistogram::LatencyHistogram()
+    : m_vBuckets(LATENCY_BUCKETS, 0)
+    , m_iCount(0)
+{
+}
+
+void LatencyHistogram::add(qint64 iMicroseconds)
+{
+    m_vBuckets[qBound((qint64) 0, iMicroseconds / LATENCY_BUCKET_US, (qint64) LATENCY_BUCKETS - 1)]++;
+    m_iCount++;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (int iBucket = 0; iBucket < LATENCY_BUCKETS; iBucket++)
+    {
+        m_vBuckets[iBucket] += other.m_vBuckets[iBucket];
+    }
+
+    m_iCount += other.m_iCount;
+}
+
+void LatencyHistogram::clear()
+{
+    m_vBuckets.fill(0);
+    m_iCount = 0;
+}
+
+double LatencyHistogram::percentile(double dRatio) const
+{
+    if (m_iCount == 0)
+    {
+        return -1.0;
+    }
+
+    qint64 iTarget = qMax((qint64) 1, (qint64) (dRatio * (double) m_iCount + 0.5));
+    qint64 iCount = 0;
+
+    for (int iBucket = 0; iBucket < LATENCY_BUCKETS; iBucket++)
+    {
+        iCount += m_vBuckets[iBucket];
+
+        if (iCount >= iTarget)
+        {
+            // Upper edge of the bucket
+            return (double) ((iBucket + 1) * LATENCY_BUCKET_US) / 1000.0;
+        }
+    }
+
+    return (double) (LATENCY_BUCKETS * LATENCY_BUCKET_US) / 1000.0;
+}
+
+static QString milliseconds(double dValue, int iWidth)
+{
+    return dValue < 0.0 ? QString("%1").arg("-", iWidth) : QString("%1").arg(dValue, iWidth, 'f', 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Producer
+//-------------------------------------------------------------------------------------------------
+
+FrameProducer::FrameProducer(CMJPEGServer* pServer, int iWidth, int iHeight, int iFPS, const QString& sInput)
+    : m_pServer(pServer)
+    , m_iWidth(iWidth)
+    , m_iHeight(iHeight)
+    , m_iFPS(qMax(iFPS, 1))
+    , m_sInput(sInput)
+    , m_iRun(1)
+    , m_iFramesSent(0)
+{
+    // A few textured backgrounds, built once so that producing a frame costs a copy
+    for (int iIndex = 0; iIndex < BACKGROUNDS; iIndex++)
+    {
+        QImage image(m_iWidth, m_iHeight, QImage::Format_RGB888);
+
+        for (int y = 0; y < m_iHeight; y++)
+        {
+            uchar* pPixel = image.scanLine(y);
+
+            for (int x = 0; x < m_iWidth; x++, pPixel += 3)
+            {
+                pPixel[0] = (uchar) (x + iIndex * 16);
+                pPixel[1] = (uchar) (y + iIndex * 8);
+                pPixel[2] = (uchar) ((x ^ y) + qrand() % 32);
+            }
+        }
+
+        m_vBackgrounds << image;
+    }
+}
+
+void FrameProducer::stop()
+{
+    m_iRun.store(0);
+}
+
+QImage FrameProducer::frame(int iFrameNumber) const
+{
+    QImage image = m_vBackgrounds[iFrameNumber % m_vBackgrounds.count()].copy();
+
+    stamp(image.bits(), image.width(), image.bytesPerLine(), iFrameNumber % FRAME_NUMBERS);
+
+    return image;
+}
+
+qint64 FrameProducer::sendTime(int iFrameNumber)
+{
+    qint64 iTime = s_aSendTimes[iFrameNumber % FRAME_NUMBERS].load();
+
+    return iTime > 0 ? iTime : -1;
+}
+
+void FrameProducer::stamp(uchar* pPixels, int iWidth, int iStride, int iFrameNumber)
+{
+    double dBlock = (double) iWidth / STAMP_DIVISOR;
+    int iHeight = qMax((int) dBlock, 1);
+    int iParity = 0;
+
+    for (int iBlock = 0; iBlock < STAMP_BLOCKS; iBlock++)
+    {
+        int iBit = iBlock < STAMP_BLOCKS - 1 ? (iFrameNumber >> iBlock) & 1 : iParity;
+        int iStart = (int) (iBlock * dBlock);
+        int iEnd = (int) ((iBlock + 1) * dBlock);
+
+        iParity ^= iBit;
+
+        for (int y = 0; y < iHeight; y++)
+        {
+            memset(pPixels + y * iStride + iStart * 3, iBit ? 255 : 0, (iEnd - iStart) * 3);
+        }
+    }
+}
+
+int FrameProducer::readFrameNumber(const QImage& image)
+{
+    double dBlock = (double) image.width() / STAMP_DIVISOR;
+    int y = (int) (dBlock / 2.0);
+
+    if (dBlock < 2.0 || y >= image.height())
+    {
+        return -1;
+    }
+
+    int iNumber = 0;
+    int iParity = 0;
+
+    for (int iBlock = 0; iBlock < STAMP_BLOCKS; iBlock++)
+    {
+        int iBit = qGray(image.pixel((int) ((iBlock + 0.5) * dBlock), y)) > 127 ? 1 : 0;
+
+        if (iBlock < STAMP_BLOCKS - 1)
+        {
+            iNumber |= iBit << iBlock;
+            iParity ^= iBit;
+        }
+        else if (iBit != iParity)
+        {
+            return -1;
+        }
+    }
+
+    return iNumber;
+}
+
+void FrameProducer::run()
+{
+    qint64 iInterval = 1000000000LL / m_iFPS;
+    QElapsedTimer tTimer;
+
+    tTimer.start();
+
+    for (qint64 iFrame = 0; m_iRun.load() != 0; iFrame++)
+    {
+        qint64 iWait = iFrame * iInterval - tTimer.nsecsElapsed();
+
+        if (iWait > 0)
+        {
+            usleep((unsigned long) (iWait / 1000));
+        }
+
+        int iNumber = (int) (iFrame % FRAME_NUMBERS);
+        const QImage& background = m_vBackgrounds[iFrame % m_vBackgrounds.count()];
+        bool bRaw = m_sInput == "raw" || (m_sInput == "both" && iFrame % 2 == 1);
+
+        if (bRaw)
+        {
+            // Tightly packed pixels, as a capture device would hand them
+            QByteArray baData(m_iWidth * m_iHeight * 3, Qt::Uninitialized);
+
+            for (int y = 0; y < m_iHeight; y++)
+            {
+                memcpy(baData.data() + y * m_iWidth * 3, background.constScanLine(y), m_iWidth * 3);
+            }
+
+            stamp((uchar*) baData.data(), m_iWidth, m_iWidth * 3, iNumber);
+
+            s_aSendTimes[iNumber].store(s_tClock.nsecsElapsed());
+            m_pServer->sendRaw(baData, m_iWidth, m_iHeight);
+        }
+        else
+        {
+            QImage image = background.copy();
+
+            stamp(image.bits(), m_iWidth, image.bytesPerLine(), iNumber);
+
+            s_aSendTimes[iNumber].store(s_tClock.nsecsElapsed());
+            m_pServer->sendImage(image);
+        }
+
+        m_iFramesSent.fetchAndAddRelaxed(1);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Client
+//-------------------------------------------------------------------------------------------------
+
+BenchmarkMJPEGClient::BenchmarkMJPEGClient(int iThrottleBytesPerSecond)
+    : m_bThrottled(iThrottleBytesPerSecond > 0)
+    , m_iImages(0)
+    , m_iUnreadable(0)
+{
+    connect(this, SIGNAL(newImage()), this, SLOT(onNewImage()));
+
+    if (m_bThrottled)
+    {
+        // Read one small chunk per tick, the rest waits in the kernel's buffers until the server sees a slow client
+        disconnect(&m_pClient, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+
+        m_pClient.setReadBufferSize(qMax(iThrottleBytesPerSecond / THROTTLE_TICKS_PER_SECOND, 1024));
+
+        connect(&m_tThrottleTimer, SIGNAL(timeout()), this, SLOT(onThrottleTick()));
+        m_tThrottleTimer.start(1000 / THROTTLE_TICKS_PER_SECOND);
+    }
+}
+
+quint16 BenchmarkMJPEGClient::localPort() const
+{
+    return m_pClient.localPort();
+}
+
+void BenchmarkMJPEGClient::onNewImage()
+{
+    int iNumber = FrameProducer::readFrameNumber(getImage());
+
+    if (iNumber < 0)
+    {
+        m_iUnreadable++;
+        return;
+    }
+
+    qint64 iSendTime = FrameProducer::sendTime(iNumber);
+
+    if (iSendTime > 0)
+    {
+        qint64 iLatency = (FrameProducer::s_tClock.nsecsElapsed() - iSendTime) / 1000;
+
+        m_tLatencies.add(iLatency);
+        m_tIntervalLatencies.add(iLatency);
+    }
+
+    m_iImages++;
+}
+
+void BenchmarkMJPEGClient::onThrottleTick()
+{
+    if (m_pClient.bytesAvailable() > 0)
+    {
+        onReadyRead();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Application
+//-------------------------------------------------------------------------------------------------
+
+MJPEGBenchmarkApplication::MJPEGBenchmarkApplication(int argc, char** argv)
+    : QCoreApplication(argc, argv)
+    , m_iLastFramesSent(0)
+    , m_iLastFramesReceived(0)
+{
+    QStringList lArguments = arguments();
+    int iWidth = 1280;
+    int iHeight = 720;
+    int iFPS = 30;
+    QString sInput = "both";
+    int iClients = 8;
+    int iThrottled = 2;
+    int iThrottleKB = 256;
+    int iQuality = -1;
+    double dScale = 1.0;
+    QString sPolicy = "oldest";
+    int iDurationS = 60;
+    int iReportS = 10;
+
+    for (int iIndex = 1; iIndex < lArguments.count() - 1; iIndex++)
+    {
+        if (lArguments[iIndex] == "--width") iWidth = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--height") iHeight = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--fps") iFPS = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--input") sInput = lArguments[iIndex + 1];
+        else if (lArguments[iIndex] == "--clients") iClients = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--throttled") iThrottled = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--throttle") iThrottleKB = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--quality") iQuality = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--scale") dScale = lArguments[iIndex + 1].toDouble();
+        else if (lArguments[iIndex] == "--policy") sPolicy = lArguments[iIndex + 1];
+        else if (lArguments[iIndex] == "--duration") iDurationS = lArguments[iIndex + 1].toInt();
+        else if (lArguments[iIndex] == "--report") iReportS = lArguments[iIndex + 1].toInt();
+    }
+
+    // The stamp needs blocks of a few pixels
+    iWidth = qMax(iWidth, 160);
+    iHeight = qMax(iHeight, 120);
+
+    FrameProducer::s_tClock.start();
+
+    m_pServer = new CMJPEGServer(BASE_PORT);
+    m_pServer->useFloodProtection(false);
+
+    if (sPolicy == "latest") m_pServer->setDropPolicy(CMJPEGServer::eLatestOnly);
+    else if (sPolicy == "latency") m_pServer->setDropPolicy(CMJPEGServer::eMaxLatency);
+    else m_pServer->setDropPolicy(CMJPEGServer::eDropOldest);
+
+    m_pProducer = new FrameProducer(m_pServer, iWidth, iHeight, iFPS, sInput);
+
+    qDebug() << QString("%1x%2 at %3 fps, input %4, %5 clients (%6 throttled at %7 KB/s), policy %8, %9 s")
+                .arg(iWidth).arg(iHeight).arg(iFPS).arg(sInput)
+                .arg(iClients).arg(qMin(iThrottled, iClients)).arg(iThrottleKB)
+                .arg(sPolicy).arg(iDurationS);
+
+    measureEncoding(iQuality);
+
+    // Ask for a variant only when the arguments differ from the full stream
+    QStringList lQuery;
+
+    if (iQuality > 0) lQuery << QString("quality=%1").arg(iQuality);
+    if (dScale > 0.0 && dScale < 1.0) lQuery << QString("scale=%1").arg(dScale);
+
+    QString sURL = QString("http://127.0.0.1:%1/").arg(BASE_PORT);
+
+    if (lQuery.count() > 0)
+    {
+        sURL += "?" + lQuery.join("&");
+    }
+
+    for (int iClient = 0; iClient < iClients; iClient++)
+    {
+        BenchmarkMJPEGClient* pClient = new BenchmarkMJPEGClient(iClient < iThrottled ? iThrottleKB * 1024 : 0);
+
+        pClient->openURL(sURL);
+        m_vClients << pClient;
+    }
+
+    m_iStartRSS = residentSetSize();
+    m_iPeakRSS = m_iStartRSS;
+
+    qDebug() << "  time (s)   in fps  client fps  p50 (ms)  p99 (ms)  rss (MB)";
+
+    connect(&m_tReportTimer, SIGNAL(timeout()), this, SLOT(onReport()));
+    connect(&m_tEndTimer, SIGNAL(timeout()), this, SLOT(onFinished()));
+
+    m_tEndTimer.setSingleShot(true);
+    m_tReportTimer.start(qMax(iReportS, 1) * 1000);
+    m_tEndTimer.start(qMax(iDurationS, 1) * 1000);
+    m_tElapsed.start();
+    m_tInterval.start();
+
+    m_pProducer->start();
+}
+
+MJPEGBenchmarkApplication::~MJPEGBenchmarkApplication()
+{
+    m_pProducer->stop();
+    m_pProducer->wait();
+
+    foreach (BenchmarkMJPEGClient* pClient, m_vClients)
+    {
+        pClient->closeURL();
+    }
+
+    qDeleteAll(m_vClients);
+
+    delete m_pProducer;
+    delete m_pServer;
+}
+
+void MJPEGBenchmarkApplication::measureEncoding(int iQuality)
+{
+    QByteArray baPartPrefix = CMJPEGPacket::partPrefix("benchmark");
+    QVector<qint64> vTimes;
+    qint64 iBytes = 0;
+
+    for (int iFrame = 0; iFrame < ENCODE_SAMPLES; iFrame++)
+    {
+        QImage image = m_pProducer->frame(iFrame);
+        QElapsedTimer tTimer;
+
+        tTimer.start();
+
+        CMJPEGPacketPtr pPacket = CMJPEGPacket::fromImage(image, iQuality, baPartPrefix, iFrame);
+
+        vTimes << tTimer.nsecsElapsed();
+        iBytes += pPacket->jpegSize();
+    }
+
+    std::sort(vTimes.begin(), vTimes.end());
+
+    qint64 iTotal = 0;
+
+    foreach (qint64 iTime, vTimes)
+    {
+        iTotal += iTime;
+    }
+
+    qDebug() << QString("encoding (%1) : mean %2 ms, p50 %3 ms, max %4 ms, %5 KB per frame")
+                .arg(CJPEGCodec::backendName())
+                .arg((double) iTotal / ENCODE_SAMPLES / 1000000.0, 0, 'f', 2)
+                .arg((double) vTimes[ENCODE_SAMPLES / 2] / 1000000.0, 0, 'f', 2)
+                .arg((double) vTimes.last() / 1000000.0, 0, 'f', 2)
+                .arg((double) iBytes / ENCODE_SAMPLES / 1024.0, 0, 'f', 1);
+}
+
+qint64 MJPEGBenchmarkApplication::residentSetSize()
+{
+#if defined(Q_OS_LINUX)
+    QFile fStatus("/proc/self/status");
+
+    if (fStatus.open(QIODevice::ReadOnly))
+    {
+        foreach (QByteArray baLine, fStatus.readAll().split('\n'))
+        {
+            if (baLine.startsWith("VmRSS:"))
+            {
+                return baLine.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+            }
+        }
+    }
+#endif
+
+    return -1;
+}
+
+void MJPEGBenchmarkApplication::onReport()
+{
+    double dSeconds = (double) m_tInterval.restart() / 1000.0;
+    qint64 iFramesSent = m_pProducer->m_iFramesSent.load();
+    qint64 iFramesReceived = 0;
+    qint64 iRSS = residentSetSize();
+    LatencyHistogram tLatencies;
+
+    foreach (BenchmarkMJPEGClient* pClient, m_vClients)
+    {
+        iFramesReceived += pClient->framesReceived();
+        tLatencies.merge(pClient->m_tIntervalLatencies);
+        pClient->m_tIntervalLatencies.clear();
+    }
+
+    m_iPeakRSS = qMax(m_iPeakRSS, iRSS);
+
+    qDebug() << QString("%1 %2 %3 %4 %5 %6")
+                .arg((double) m_tElapsed.elapsed() / 1000.0, 10, 'f', 0)
+                .arg((double) (iFramesSent - m_iLastFramesSent) / dSeconds, 8, 'f', 1)
+                .arg((double) (iFramesReceived - m_iLastFramesReceived) / dSeconds / qMax(m_vClients.count(), 1), 11, 'f', 1)
+                .arg(milliseconds(tLatencies.percentile(0.50), 9))
+                .arg(milliseconds(tLatencies.percentile(0.99), 9))
+                .arg(iRSS < 0 ? QString("%1").arg("-", 9) : QString("%1").arg((double) iRSS / 1048576.0, 9, 'f', 1));
+
+    m_iLastFramesSent = iFramesSent;
+    m_iLastFramesReceived = iFramesReceived;
+}
+
+void MJPEGBenchmarkApplication::onFinished()
+{
+    m_tReportTimer.stop();
+    m_pProducer->stop();
+    m_pProducer->wait();
+
+    double dSeconds = (double) m_tElapsed.elapsed() / 1000.0;
+    QVector<CMJPEGServer::CSubscriberStats> vStats = m_pServer->subscriberStats();
+    LatencyHistogram tLatencies;
+    qint64 iRSS = residentSetSize();
+
+    m_iPeakRSS = qMax(m_iPeakRSS, iRSS);
+
+    qDebug() << "";
+    qDebug() << "client throttled      fps  decoded  unreadable  client drops  server drops  p50 (ms)  p99 (ms) p999 (ms)";
+
+    for (int iClient = 0; iClient < m_vClients.count(); iClient++)
+    {
+        BenchmarkMJPEGClient* pClient = m_vClients[iClient];
+        qint64 iServerDrops = 0;
+
+        // The server knows the client by the port it connects from
+        foreach (const CMJPEGServer::CSubscriberStats& tStats, vStats)
+        {
+            if (tStats.m_iPeerPort == pClient->localPort())
+            {
+                iServerDrops = tStats.m_iFramesDropped;
+            }
+        }
+
+        tLatencies.merge(pClient->m_tLatencies);
+
+        qDebug() << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10")
+                    .arg(iClient, 6)
+                    .arg(pClient->m_bThrottled ? "yes" : "no", 9)
+                    .arg((double) pClient->framesReceived() / dSeconds, 8, 'f', 1)
+                    .arg(pClient->m_iImages, 8)
+                    .arg(pClient->m_iUnreadable, 11)
+                    .arg(pClient->framesDropped(), 13)
+                    .arg(iServerDrops, 13)
+                    .arg(milliseconds(pClient->m_tLatencies.percentile(0.50), 9))
+                    .arg(milliseconds(pClient->m_tLatencies.percentile(0.99), 9))
+                    .arg(milliseconds(pClient->m_tLatencies.percentile(0.999), 9));
+    }
+
+    qDebug() << "";
+    qDebug() << QString("frames produced : %1 (%2 fps), skipped by the server : %3")
+                .arg(m_pProducer->m_iFramesSent.load())
+                .arg((double) m_pProducer->m_iFramesSent.load() / dSeconds, 0, 'f', 1)
+                .arg(m_pServer->skippedFrames());
+    qDebug() << QString("latency, all clients : p50 %1 ms, p99 %2 ms, p999 %3 ms")
+                .arg(milliseconds(tLatencies.percentile(0.50), 0))
+                .arg(milliseconds(tLatencies.percentile(0.99), 0))
+                .arg(milliseconds(tLatencies.percentile(0.999), 0));
+
+    if (iRSS >= 0)
+    {
+        // Clients run in the same process, so this is an upper bound for the server
+        qDebug() << QString("rss : start %1 MB, end %2 MB, peak %3 MB")
+                    .arg((double) m_iStartRSS / 1048576.0, 0, 'f', 1)
+                    .arg((double) iRSS / 1048576.0, 0, 'f', 1)
+                    .arg((double) m_iPeakRSS / 1048576.0, 0, 'f', 1);
+    }
+
+    quit();
+}
+
+int main(int argc, char** argv)
+{
+    MJPEGBenchmarkApplication app(argc, argv);
+
+    return app.exec();
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <QImage>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+
+#include "../Web/CMJPEGServer.h"
+#include "../Web/CMJPEGClient.h"
+
+//! A histogram of latencies with 100 us buckets up to 10 seconds
+//! Its size is fixed, so a long soak does not grow the memory it measures
+class LatencyHistogram
+{
+public:
+
+    LatencyHistogram();
+
+    //! Adds a latency, in microseconds
+    void add(qint64 iMicroseconds);
+
+    //! Adds the latencies of another histogram
+    void merge(const LatencyHistogram& other);
+
+    //! Removes all latencies
+    void clear();
+
+    //! Returns the latency below which dRatio of the latencies are, in milliseconds
+    double percentile(double dRatio) const;
+
+    QVector<qint64>     m_vBuckets;
+    qint64              m_iCount;
+};
+
+//! Generates synthetic frames, each with its number stamped as a row of blocks, and gives them to the server at a fixed rate
+class FrameProducer : public QThread
+{
+    Q_OBJECT
+
+public:
+
+    FrameProducer(CMJPEGServer* pServer, int iWidth, int iHeight, int iFPS, const QString& sInput);
+
+    virtual void run() Q_DECL_OVERRIDE;
+
+    //! Asks the thread to stop after the current frame
+    void stop();
+
+    //! Returns a frame of the sequence
+    QImage frame(int iFrameNumber) const;
+
+    //! Returns the time at which a frame was given to the server, in nanoseconds on the shared clock, -1 if unknown
+    static qint64 sendTime(int iFrameNumber);
+
+    //! Reads the number stamped in a frame, at any scale, -1 if it can not be read
+    static int readFrameNumber(const QImage& image);
+
+    //! Clock shared by the producer and the clients
+    static QElapsedTimer s_tClock;
+
+    CMJPEGServer*           m_pServer;
+    int                     m_iWidth;
+    int                     m_iHeight;
+    int                     m_iFPS;
+    QString                 m_sInput;           // image, raw or both
+    QVector<QImage>         m_vBackgrounds;
+    QAtomicInt              m_iRun;
+    QAtomicInteger<qint64>  m_iFramesSent;
+
+protected:
+
+    //! Writes the number of a frame in its pixels
+    static void stamp(uchar* pPixels, int iWidth, int iStride, int iFrameNumber);
+};
+
+//! A client measuring the latency and rate of the frames it decodes
+//! A throttled client reads its socket in small chunks on a timer, like a client on a slow link
+class BenchmarkMJPEGClient : public CMJPEGClient
+{
+    Q_OBJECT
+
+public:
+
+    BenchmarkMJPEGClient(int iThrottleBytesPerSecond);
+
+    //! Returns the local port of the connection, to match the server's statistics
+    quint16 localPort() const;
+
+    bool                m_bThrottled;
+    QTimer              m_tThrottleTimer;
+    LatencyHistogram    m_tLatencies;
+    LatencyHistogram    m_tIntervalLatencies;
+    qint64              m_iImages;
+    qint64              m_iUnreadable;      // Images whose frame number could not be read
+
+protected slots:
+
+    void onNewImage();
+
+    void onThrottleTick();
+};
+
+class MJPEGBenchmarkApplication : public QCoreApplication
+{
+    Q_OBJECT
+
+public:
+
+    MJPEGBenchmarkApplication(int argc, char** argv);
+
+    virtual ~MJPEGBenchmarkApplication();
+
+protected slots:
+
+    //! Prints the measures of the last interval
+    void onReport();
+
+    //! Prints the summary and quits
+    void onFinished();
+
+protected:
+
+    //! Measures the time needed to encode a frame of the sequence
+    void measureEncoding(int iQuality);
+
+    //! Returns the resident set size of the process in bytes, -1 if unknown
+    static qint64 residentSetSize();
+
+    CMJPEGServer*                   m_pServer;
+    FrameProducer*                  m_pProducer;
+    QVector<BenchmarkMJPEGClient*>  m_vClients;
+    QTimer                          m_tReportTimer;
+    QTimer                          m_tEndTimer;
+    QElapsedTimer                   m_tElapsed;
+    QElapsedTimer                   m_tInterval;
+    qint64                          m_iLastFramesSent;
+    qint64                          m_iLastFramesReceived;
+    qint64                          m_iStartRSS;
+    qint64                          m_iPeakRSS;
+};
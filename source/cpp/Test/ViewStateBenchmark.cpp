@@ -0,0 +1,173 @@
+
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include "../Web/WebControls/CWebDiv.h"
+#include "../Web/WebControls/CWebLabel.h"
+#include "../Web/WebControls/CWebButton.h"
+#include "../Web/WebControls/CWebTextBox.h"
+
+#include "ViewStateBenchmark.h"
+
+// Usage : qt-plus-viewstate-benchmark [--time 500]
+// --time is the minimum duration of each measure, in milliseconds
+// Legacy is the whole page serialized, compressed and encoded in base 64, as CWebPage::getViewState() does
+// Full and delta are CWebViewState encodings in base 64, the delta follows a change of one caption
+
+//-------------------------------------------------------------------------------------------------
+
+ViewStateBenchmark::ViewStateBenchmark()
+    : m_iMinimumMS(500)
+{
+    append(this);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+CWebPage* ViewStateBenchmark::createPage(int iControls)
+{
+    CWebPage* pPage = new CWebPage("BenchmarkPage");
+    CWebControl* pDiv = nullptr;
+
+    for (int iIndex = 0; iIndex < iControls; iIndex++)
+    {
+        if (iIndex % 10 == 0)
+        {
+            pDiv = pPage->addControl(new CWebDiv(QString("Div%1").arg(iIndex), ""));
+            pDiv->setStyleClass("benchmarkDiv");
+            continue;
+        }
+
+        QString sName = QString("Control%1").arg(iIndex);
+
+        switch (iIndex % 3)
+        {
+            case 0:
+                pDiv->addControl(new CWebLabel(sName, QString("Label number %1").arg(iIndex)));
+                break;
+
+            case 1:
+                pDiv->addControl(new CWebButton(sName, QString("Button %1").arg(iIndex)))->addObserver(pPage);
+                break;
+
+            default:
+                pDiv->addControl(new CWebTextBox(sName, QString("Some text in box %1").arg(iIndex)))->addObserver(pPage);
+                break;
+        }
+    }
+
+    return pPage;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+double ViewStateBenchmark::measure(std::function<void()> fFunction) const
+{
+    QElapsedTimer tTimer;
+    qint64 iCalls = 0;
+
+    tTimer.start();
+
+    do
+    {
+        fFunction();
+        iCalls++;
+    }
+    while (tTimer.elapsed() < m_iMinimumMS || iCalls < 5);
+
+    return (double) tTimer.nsecsElapsed() / 1000.0 / (double) iCalls;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void ViewStateBenchmark::run(int iControls)
+{
+    CWebPage* pPage = createPage(iControls);
+    CObjectTracker* pTracker = this;
+
+    // Legacy format
+
+    QString sLegacy = pPage->getViewState(pTracker);
+
+    double dLegacyEncode = measure([&]() { sLegacy = pPage->getViewState(pTracker); });
+    double dLegacyDecode = measure([&]() { delete CWebPage::fromViewState(sLegacy, pTracker); });
+
+    // Full encoding, sent with the page and by a client whose snapshot is no longer cached
+
+    CWebViewState tBase = CWebViewState::fromPage(pPage, pTracker);
+    QByteArray baFull = tBase.encodeDelta(CWebViewState()).toBase64();
+
+    double dFullEncode = measure([&]() { baFull = CWebViewState::fromPage(pPage, pTracker).encodeDelta(CWebViewState()).toBase64(); });
+    double dFullDecode = measure([&]()
+    {
+        CWebViewState tState;
+
+        if (CWebViewState::applyDelta(CWebViewState(), QByteArray::fromBase64(baFull), tState))
+        {
+            delete tState.toPage(pTracker);
+        }
+    });
+
+    // Delta after an event, the base is found in the cache
+
+    CWebControl* pTarget = pPage->findControlByName(QString("Control%1").arg(iControls / 2 | 1));
+
+    if (pTarget != nullptr)
+    {
+        pTarget->setCaption("Changed");
+    }
+
+    QByteArray baDelta = CWebViewState::fromPage(pPage, pTracker).encodeDelta(tBase).toBase64();
+
+    double dDeltaEncode = measure([&]() { baDelta = CWebViewState::fromPage(pPage, pTracker).encodeDelta(tBase).toBase64(); });
+    double dCachedDecode = measure([&]() { delete tBase.toPage(pTracker); });
+
+    qDebug() << QString("%1 | %2 %3 %4 | %5 %6 %7 | %8 %9 %10")
+                .arg(iControls, 8)
+                .arg(sLegacy.size(), 8)
+                .arg(dLegacyEncode, 9, 'f', 1)
+                .arg(dLegacyDecode, 9, 'f', 1)
+                .arg(baFull.size(), 8)
+                .arg(dFullEncode, 9, 'f', 1)
+                .arg(dFullDecode, 9, 'f', 1)
+                .arg(baDelta.size(), 8)
+                .arg(dDeltaEncode, 9, 'f', 1)
+                .arg(dCachedDecode, 9, 'f', 1);
+
+    delete pPage;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QStringList lArguments = app.arguments();
+    ViewStateBenchmark tBenchmark;
+
+    int iTime = lArguments.indexOf("--time");
+
+    if (iTime >= 0 && iTime + 1 < lArguments.count())
+    {
+        tBenchmark.m_iMinimumMS = qMax(lArguments[iTime + 1].toInt(), 1);
+    }
+
+    qDebug() << "Sizes in bytes, times in microseconds";
+    qDebug() << QString("%1 | %2 %3 %4 | %5 %6 %7 | %8 %9 %10")
+                .arg("controls", 8)
+                .arg("legacy", 8)
+                .arg("encode", 9)
+                .arg("decode", 9)
+                .arg("full", 8)
+                .arg("encode", 9)
+                .arg("decode", 9)
+                .arg("delta", 8)
+                .arg("encode", 9)
+                .arg("decode", 9);
+
+    tBenchmark.run(10);
+    tBenchmark.run(100);
+    tBenchmark.run(1000);
+
+    return 0;
+}
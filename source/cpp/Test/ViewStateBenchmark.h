@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QString>
+#include <functional>
+
+#include "../ISerializable.h"
+#include "../Web/WebControls/CWebPage.h"
+#include "../Web/WebControls/CWebViewState.h"
+
+//! Measures the encoding and decoding of view states, in the legacy and delta formats
+class ViewStateBenchmark : public CObjectTracker
+{
+public:
+
+    ViewStateBenchmark();
+
+    //! Runs all measures for a page with a number of controls
+    void run(int iControls);
+
+    //! Returns a page holding a number of controls, in divs of ten
+    static CWebPage* createPage(int iControls);
+
+    int     m_iMinimumMS;       // Minimum duration of each measure
+
+protected:
+
+    //! Returns the mean time of a function in microseconds, calling it for at least m_iMinimumMS
+    double measure(std::function<void()> fFunction) const;
+};
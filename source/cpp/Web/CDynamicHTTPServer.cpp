@@ -3,6 +3,7 @@
 #include <QDateTime>
 #include <QCoreApplication>
 #include <QDirIterator>
+#include <QDebug>
 
 // Application
 #include "CDynamicHTTPServer.h"
@@ -14,6 +15,13 @@
     \class CDynamicHTTPServer
     \inmodule qt-plus
     \brief A server based on CHTTPServer that can serve pages generated in C++ (like MS ASP).
+
+    By default, a page is deleted once rendered and the client keeps its state in a viewstate
+    (see CWebViewState). With each event, the client sends back the version of its viewstate,
+    the server rebuilds the page from its cached snapshot and answers with a delta. \br
+    When useSessionStore() is called, pages are kept alive on the server in a CWebSessionStore,
+    and the client only sends back a short session token. This saves the serialization of the page
+    at each request and the bandwidth of the viewstate, at the cost of the memory used by the pages.
 */
 
 //-------------------------------------------------------------------------------------------------
@@ -26,8 +34,12 @@ CDynamicHTTPServer::CDynamicHTTPServer(quint16 port, QObject* parent)
     : CHTTPServer(port, parent)
     , m_sLang("fr")
     , m_sLocalizationFolder("")
+    , m_pSessionStore(nullptr)
 {
     append(this);
+
+    // Create the factory now, singletons are not created safely by the worker threads
+    CWebFactory::getInstance();
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -37,6 +49,11 @@ CDynamicHTTPServer::CDynamicHTTPServer(quint16 port, QObject* parent)
 */
 CDynamicHTTPServer::~CDynamicHTTPServer()
 {
+    if (m_pSessionStore != nullptr)
+    {
+        delete m_pSessionStore;
+    }
+
     remove(this);
 }
 
@@ -58,11 +75,34 @@ void CDynamicHTTPServer::setLocalizationFolder(const QString& sRelativeFolder)
 */
 void CDynamicHTTPServer::setLang(const QString& value)
 {
+    QMutexLocker locker(&m_tLangMutex);
+
     m_sLang = value;
 }
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    If \a bUse is \c true, pages are kept alive in a session store after being rendered,
+    and events are handled by the live pages. Otherwise, the pages are sent to the client as viewstates. \br\br
+    The limits of the store can be set through sessionStore(). Turning the store off deletes the pages it holds,
+    so it should be done when no request is being processed.
+*/
+void CDynamicHTTPServer::useSessionStore(bool bUse)
+{
+    if (bUse && m_pSessionStore == nullptr)
+    {
+        m_pSessionStore = new CWebSessionStore(this);
+    }
+    else if (bUse == false && m_pSessionStore != nullptr)
+    {
+        delete m_pSessionStore;
+        m_pSessionStore = nullptr;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Returns a localization string that is mapped to \a sToken, given the current language.
 */
@@ -72,7 +112,14 @@ QString CDynamicHTTPServer::getString(const QString& sToken) const
 
     if (xNode.isEmpty() == false)
     {
-        CXMLNode xLang = xNode.getNodeByTagName(m_sLang);
+        QString sLang;
+
+        {
+            QMutexLocker locker(&m_tLangMutex);
+            sLang = m_sLang;
+        }
+
+        CXMLNode xLang = xNode.getNodeByTagName(sLang);
 
         if (xLang.isEmpty() == false)
         {
@@ -86,7 +133,7 @@ QString CDynamicHTTPServer::getString(const QString& sToken) const
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns the instance of the CWebComposer class.
+    Returns the CWebComposer of the calling thread.
 */
 CWebComposer* CDynamicHTTPServer::composer() const
 {
@@ -105,6 +152,26 @@ CWebFactory* CDynamicHTTPServer::factory() const
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Returns the session store, or \c nullptr if useSessionStore() has not been called.
+*/
+CWebSessionStore* CDynamicHTTPServer::sessionStore() const
+{
+    return m_pSessionStore;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the cache of the view states sent to clients, whose size can be set.
+*/
+CWebViewStateCache* CDynamicHTTPServer::viewStates()
+{
+    return &m_tViewStates;
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Returns some content to the caller (CHTTPServer) by calling getPage(), or by processing an XMLHTTPRequest event. \br\br
     \a tContext contains contextual information for the content generator (the associated socket, resource path, arguments, ...) \br
@@ -116,66 +183,50 @@ void CDynamicHTTPServer::getContent(const CWebContext& tContext, QString& sHead,
 {
     if (tContext.m_mArguments.contains(TOKEN_ACTION))
     {
-        if (tContext.m_mArguments.contains(TOKEN_VIEWSTATE))
+        if (tContext.m_mArguments.contains(TOKEN_SESSION))
         {
-            CWebControl* pControl = CWebPage::fromViewState(tContext.m_mArguments[TOKEN_VIEWSTATE], this);
-
-            if (pControl != nullptr)
-            {
-                QString sEventControlName = tContext.m_mArguments[TOKEN_CONTROL];
-
-                if (tContext.m_mArguments[TOKEN_ACTION] == TOKEN_EVENT)
-                {
-                    pControl->handleEvent(
-                                sEventControlName,
-                                tContext.m_mArguments[TOKEN_EVENT],
-                            tContext.m_mArguments[TOKEN_PARAM]
-                            );
-                }
-                else if (tContext.m_mArguments[TOKEN_ACTION] == TOKEN_UPLOAD)
-                {
-                    pControl->handleEvent(
-                                sEventControlName,
-                                TOKEN_UPLOAD,
-                                tContext.m_mArguments[sEventControlName]
-                                );
-                }
-
-                CWebPage* pPage = dynamic_cast<CWebPage*>(pControl);
-
-                if (pPage != nullptr)
-                {
-                    pPage->setViewstate(pPage->getViewState(this));
-                    sCustomResponse = pPage->getPropertyChanges();
-                    sCustomResponseMIME = MIME_Content_XML;
-                }
-
-                if (sCustomResponse.isEmpty())
-                {
-                    sCustomResponse = "VOID";
-                    sCustomResponseMIME = MIME_Content_XML;
-                }
-
-                delete pControl;
-            }
+            handleSessionEvent(tContext, sCustomResponse, sCustomResponseMIME);
+        }
+        else if (tContext.m_mArguments.contains(TOKEN_VIEWSTATE))
+        {
+            handleViewStateEvent(tContext, sCustomResponse, sCustomResponseMIME);
         }
     }
     else
     {
         if (tContext.m_mArguments.contains(TOKEN_LANG))
         {
-            m_sLang = tContext.m_mArguments[TOKEN_LANG];
+            setLang(tContext.m_mArguments[TOKEN_LANG]);
         }
 
-        CWebComposer::getInstance()->reset();
+        // Each worker thread renders with its own composer
+        CWebComposer* pComposer = composer();
+
+        pComposer->reset();
 
         CWebPage* pPage = getPage(this, tContext);
 
         if (pPage != nullptr)
         {
-            pPage->getContent(this, tContext, sHead, sBody, sCustomResponse);
+            pComposer->reserve(sHead, sBody);
+
+            if (m_pSessionStore != nullptr)
+            {
+                QString sToken = CWebSessionStore::generateToken();
 
-            delete pPage;
+                pPage->setSessionToken(sToken);
+                pPage->getContent(this, tContext, sHead, sBody, sCustomResponse);
+
+                m_pSessionStore->insert(sToken, pPage);
+            }
+            else
+            {
+                pPage->getContent(this, tContext, sHead, sBody, sCustomResponse);
+
+                delete pPage;
+            }
+
+            pComposer->updateCapacity(sHead, sBody);
         }
         else
         {
@@ -201,6 +252,129 @@ CWebPage* CDynamicHTTPServer::getPage(CDynamicHTTPServer* pServer, const CWebCon
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Handles an event on a page kept in the session store. \br\br
+    \a tContext holds the session token and the event. \br
+    \a sCustomResponse is filled with the javascript of the changes, or with a reload of the page if the session is gone.
+*/
+void CDynamicHTTPServer::handleSessionEvent(const CWebContext& tContext, QString& sCustomResponse, QString& sCustomResponseMIME)
+{
+    QString sToken = tContext.m_mArguments[TOKEN_SESSION];
+    CWebPage* pPage = m_pSessionStore != nullptr ? m_pSessionStore->acquire(sToken) : nullptr;
+
+    sCustomResponseMIME = MIME_Content_XML;
+
+    // The session has expired or was evicted, the client gets a new page
+    if (pPage == nullptr)
+    {
+        sCustomResponse = "document.location.reload();";
+        return;
+    }
+
+    QString sEventControlName = tContext.m_mArguments[TOKEN_CONTROL];
+
+    if (tContext.m_mArguments[TOKEN_ACTION] == TOKEN_EVENT)
+    {
+        pPage->handleEvent(
+                    sEventControlName,
+                    tContext.m_mArguments[TOKEN_EVENT],
+                    tContext.m_mArguments[TOKEN_PARAM]
+                    );
+    }
+    else if (tContext.m_mArguments[TOKEN_ACTION] == TOKEN_UPLOAD)
+    {
+        pPage->handleEvent(
+                    sEventControlName,
+                    TOKEN_UPLOAD,
+                    tContext.m_mArguments[sEventControlName]
+                    );
+    }
+
+    sCustomResponse = pPage->getPropertyChanges();
+    pPage->resetPropertyChanges();
+
+    m_pSessionStore->release(sToken);
+
+    if (sCustomResponse.isEmpty())
+    {
+        sCustomResponse = "VOID";
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Handles an event on a page rebuilt from its view state. \br\br
+    \a tContext holds the version of the client's view state and the event. If the snapshot of that version
+    is not cached, the client must send its whole view state : \a sCustomResponse is then filled with
+    a call to resendWebEvent(). Otherwise, it is filled with the javascript of the changes and the view state delta.
+*/
+void CDynamicHTTPServer::handleViewStateEvent(const CWebContext& tContext, QString& sCustomResponse, QString& sCustomResponseMIME)
+{
+    QString sVersion = tContext.m_mArguments[TOKEN_VIEWSTATE];
+    CWebViewState tBase;
+
+    sCustomResponseMIME = MIME_Content_XML;
+
+    if (tContext.m_mArguments.contains(TOKEN_VIEWSTATE_DATA))
+    {
+        QByteArray baData = QByteArray::fromBase64(tContext.m_mArguments[TOKEN_VIEWSTATE_DATA].toLatin1());
+
+        if (CWebViewState::applyDelta(CWebViewState(), baData, tBase) == false)
+        {
+            qWarning() << QString("CDynamicHTTPServer::handleViewStateEvent() : invalid view state");
+            sCustomResponse = "document.location.reload();";
+            return;
+        }
+
+        tBase.m_sVersion = sVersion;
+    }
+    else if (m_tViewStates.find(sVersion, tBase) == false)
+    {
+        sCustomResponse = "resendWebEvent();";
+        return;
+    }
+
+    CWebPage* pPage = tBase.toPage(this);
+
+    if (pPage == nullptr)
+    {
+        sCustomResponse = "document.location.reload();";
+        return;
+    }
+
+    QString sEventControlName = tContext.m_mArguments[TOKEN_CONTROL];
+
+    if (tContext.m_mArguments[TOKEN_ACTION] == TOKEN_EVENT)
+    {
+        pPage->handleEvent(
+                    sEventControlName,
+                    tContext.m_mArguments[TOKEN_EVENT],
+                    tContext.m_mArguments[TOKEN_PARAM]
+                    );
+    }
+    else if (tContext.m_mArguments[TOKEN_ACTION] == TOKEN_UPLOAD)
+    {
+        pPage->handleEvent(
+                    sEventControlName,
+                    TOKEN_UPLOAD,
+                    tContext.m_mArguments[sEventControlName]
+                    );
+    }
+
+    CWebViewState tState = CWebViewState::fromPage(pPage, this);
+
+    m_tViewStates.insert(tState);
+
+    pPage->scriptCall(tState.script(tBase));
+
+    sCustomResponse = pPage->getPropertyChanges();
+
+    delete pPage;
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Reads all localization files.
 */
@@ -8,8 +8,10 @@
 #include "../CXMLNode.h"
 #include "CHTTPServer.h"
 #include "CWebComposer.h"
+#include "CWebSessionStore.h"
 #include "WebControls/CWebFactory.h"
 #include "WebControls/CWebPage.h"
+#include "WebControls/CWebViewState.h"
 
 //-------------------------------------------------------------------------------------------------
 
@@ -43,6 +45,9 @@ public:
     //!
     void setLang(const QString& value);
 
+    //! Keeps the pages alive in a session store instead of sending their viewstate to the client
+    void useSessionStore(bool bUse);
+
     //-------------------------------------------------------------------------------------------------
     // Getters
     //-------------------------------------------------------------------------------------------------
@@ -56,6 +61,12 @@ public:
     //! Returns the factory of this server
     CWebFactory* factory() const;
 
+    //! Returns the session store, nullptr if it is not used
+    CWebSessionStore* sessionStore() const;
+
+    //! Returns the cache of the view states sent to clients
+    CWebViewStateCache* viewStates();
+
     //-------------------------------------------------------------------------------------------------
     // Inherited methods
     //-------------------------------------------------------------------------------------------------
@@ -79,13 +90,22 @@ protected:
     //! Reads the localisation files
     void readLocalization();
 
+    //! Handles an event on a page kept in the session store
+    void handleSessionEvent(const CWebContext& tContext, QString& sCustomResponse, QString& sCustomResponseMIME);
+
+    //! Handles an event on a page rebuilt from its view state
+    void handleViewStateEvent(const CWebContext& tContext, QString& sCustomResponse, QString& sCustomResponseMIME);
+
     //-------------------------------------------------------------------------------------------------
     // Properties
     //-------------------------------------------------------------------------------------------------
 
 protected:
 
+    mutable QMutex      m_tLangMutex;           // Pages are rendered by several threads
     QString				m_sLang;
     QString             m_sLocalizationFolder;
     CXMLNode			m_xStrings;
+    CWebSessionStore*   m_pSessionStore;
+    CWebViewStateCache  m_tViewStates;
 };
@@ -0,0 +1,240 @@
+// Qt
+#include <QDebug>
+#include <QList>
+
+// Application
+#include "CHTTPContentEncoder.h"
+
+//-------------------------------------------------------------------------------------------------
+
+// Layout of a qCompress() buffer : 4 bytes of uncompressed size, then a zlib stream
+// A zlib stream is a 2 bytes header, raw deflate data and a 4 bytes Adler-32 checksum
+#define QCOMPRESS_PREFIX_SIZE   4
+#define ZLIB_HEADER_SIZE        2
+#define ZLIB_TRAILER_SIZE       4
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CHTTPContentEncoder
+    \inmodule qt-plus
+    \brief Implements the gzip and deflate HTTP content encodings.
+
+    Compression is done with qCompress(), so no direct dependency on zlib is needed. \br
+    The deflate encoding is the zlib stream produced by qCompress(). \br
+    The gzip encoding wraps the raw deflate data of this stream in a gzip header and trailer.
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+//! Holds the CRC-32 lookup table, built once
+class CCRC32Table
+{
+public:
+
+    CCRC32Table()
+    {
+        for (quint32 i = 0; i < 256; i++)
+        {
+            quint32 uValue = i;
+
+            for (int j = 0; j < 8; j++)
+            {
+                uValue = (uValue & 1) ? (0xEDB88320 ^ (uValue >> 1)) : (uValue >> 1);
+            }
+
+            m_uValues[i] = uValue;
+        }
+    }
+
+    quint32 m_uValues[256];
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the preferred encoding given \a baAcceptEncoding, the value of an Accept-Encoding header. \br\br
+    gzip is preferred over deflate. Encodings with a quality of zero are refused.
+*/
+CHTTPContentEncoder::EEncoding CHTTPContentEncoder::negotiate(const QByteArray& baAcceptEncoding)
+{
+    double dGzip = -1.0;
+    double dDeflate = -1.0;
+    double dAny = -1.0;
+
+    foreach (QByteArray baItem, baAcceptEncoding.split(','))
+    {
+        QList<QByteArray> lParams = baItem.split(';');
+        QByteArray baName = lParams[0].trimmed().toLower();
+        double dQuality = 1.0;
+
+        for (int iIndex = 1; iIndex < lParams.count(); iIndex++)
+        {
+            QByteArray baParam = lParams[iIndex].trimmed();
+
+            if (baParam.startsWith("q="))
+            {
+                dQuality = baParam.mid(2).toDouble();
+            }
+        }
+
+        if (baName == "gzip" || baName == "x-gzip")
+        {
+            dGzip = dQuality;
+        }
+        else if (baName == "deflate")
+        {
+            dDeflate = dQuality;
+        }
+        else if (baName == "*")
+        {
+            dAny = dQuality;
+        }
+    }
+
+    // The wildcard applies to encodings not explicitly listed
+    if (dGzip < 0.0) dGzip = dAny;
+    if (dDeflate < 0.0) dDeflate = dAny;
+
+    if (dGzip > 0.0 && dGzip >= dDeflate)
+    {
+        return eGzip;
+    }
+
+    if (dDeflate > 0.0)
+    {
+        return eDeflate;
+    }
+
+    return eIdentity;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \a baData encoded with \a eEncoding. \br\br
+    \a iLevel is the compression level, from 0 (none) to 9 (best), -1 selecting zlib's default.
+*/
+QByteArray CHTTPContentEncoder::encode(const QByteArray& baData, EEncoding eEncoding, int iLevel)
+{
+    if (eEncoding == eIdentity)
+    {
+        return baData;
+    }
+
+    QByteArray baCompressed = qCompress(baData, iLevel);
+
+    if (baCompressed.count() < QCOMPRESS_PREFIX_SIZE + ZLIB_HEADER_SIZE + ZLIB_TRAILER_SIZE)
+    {
+        qWarning() << QString("CHTTPContentEncoder::encode() : compression failed");
+        return QByteArray();
+    }
+
+    if (eEncoding == eDeflate)
+    {
+        return baCompressed.mid(QCOMPRESS_PREFIX_SIZE);
+    }
+
+    // gzip : header, raw deflate data, CRC-32 and size of the uncompressed data
+    const char* pDeflate = baCompressed.constData() + QCOMPRESS_PREFIX_SIZE + ZLIB_HEADER_SIZE;
+    int iDeflateLength = baCompressed.count() - QCOMPRESS_PREFIX_SIZE - ZLIB_HEADER_SIZE - ZLIB_TRAILER_SIZE;
+    quint32 uCRC = crc32(baData.constData(), baData.count());
+    quint32 uSize = (quint32) baData.count();
+
+    static const char aHeader[] = { '\x1f', '\x8b', '\x08', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\xff' };
+
+    QByteArray baResult;
+    baResult.reserve(sizeof(aHeader) + iDeflateLength + 8);
+    baResult.append(aHeader, sizeof(aHeader));
+    baResult.append(pDeflate, iDeflateLength);
+
+    for (int iShift = 0; iShift < 32; iShift += 8)
+    {
+        baResult.append((char) ((uCRC >> iShift) & 0xFF));
+    }
+
+    for (int iShift = 0; iShift < 32; iShift += 8)
+    {
+        baResult.append((char) ((uSize >> iShift) & 0xFF));
+    }
+
+    return baResult;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the name of \a eEncoding, as used in the Content-Encoding header.
+*/
+const char* CHTTPContentEncoder::name(EEncoding eEncoding)
+{
+    switch (eEncoding)
+    {
+        case eDeflate:
+            return "deflate";
+
+        case eGzip:
+            return "gzip";
+
+        default:
+            return "identity";
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if contents of MIME type \a sMIMEType are worth compressing. \br\br
+    Images and archives are already compressed and are left as is.
+*/
+bool CHTTPContentEncoder::isCompressible(const QString& sMIMEType)
+{
+    return
+            sMIMEType.startsWith("text/") ||
+            sMIMEType == "application/javascript" ||
+            sMIMEType == "application/json" ||
+            sMIMEType == "application/xml" ||
+            sMIMEType == "application/xhtml+xml" ||
+            sMIMEType == "image/svg+xml";
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the entity tag of the variant of a resource encoded with \a eEncoding, \a baETag being the tag of the resource. \br\br
+    For instance, "1a2b-3c" becomes "1a2b-3c-gzip".
+*/
+QByteArray CHTTPContentEncoder::encodedETag(const QByteArray& baETag, EEncoding eEncoding)
+{
+    if (eEncoding == eIdentity || baETag.endsWith("\"") == false)
+    {
+        return baETag;
+    }
+
+    QByteArray baResult = baETag.left(baETag.count() - 1);
+
+    baResult.append("-");
+    baResult.append(name(eEncoding));
+    baResult.append("\"");
+
+    return baResult;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the CRC-32 of the \a iLength bytes at \a pData.
+*/
+quint32 CHTTPContentEncoder::crc32(const char* pData, int iLength)
+{
+    static CCRC32Table tTable;
+
+    quint32 uCRC = 0xFFFFFFFF;
+
+    for (int iIndex = 0; iIndex < iLength; iIndex++)
+    {
+        uCRC = tTable.m_uValues[(uCRC ^ (quint8) pData[iIndex]) & 0xFF] ^ (uCRC >> 8);
+    }
+
+    return uCRC ^ 0xFFFFFFFF;
+}
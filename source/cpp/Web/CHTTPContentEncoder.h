@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QString>
+#include <QByteArray>
+
+//-------------------------------------------------------------------------------------------------
+
+//! Implements the gzip and deflate HTTP content encodings
+class QTPLUSSHARED_EXPORT CHTTPContentEncoder
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Enumerators
+    //-------------------------------------------------------------------------------------------------
+
+    enum EEncoding
+    {
+        eIdentity,
+        eDeflate,
+        eGzip
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the preferred encoding given the value of an Accept-Encoding header
+    static EEncoding negotiate(const QByteArray& baAcceptEncoding);
+
+    //! Returns baData encoded with eEncoding, iLevel is the compression level (-1 for default, 0 to 9)
+    static QByteArray encode(const QByteArray& baData, EEncoding eEncoding, int iLevel = -1);
+
+    //! Returns the name of an encoding, as used in the Content-Encoding header
+    static const char* name(EEncoding eEncoding);
+
+    //! Returns true if contents of MIME type sMIMEType are worth compressing
+    static bool isCompressible(const QString& sMIMEType);
+
+    //! Returns the entity tag of an encoded variant
+    static QByteArray encodedETag(const QByteArray& baETag, EEncoding eEncoding);
+
+    //! Returns the CRC-32 of a buffer, as used in gzip streams
+    static quint32 crc32(const char* pData, int iLength);
+};
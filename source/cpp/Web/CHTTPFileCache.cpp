@@ -0,0 +1,480 @@
+// Qt
+#include <QFile>
+#include <QFileInfo>
+#include <QLocale>
+#include <QMutexLocker>
+
+// Application
+#include "CHTTPFileCache.h"
+
+//-------------------------------------------------------------------------------------------------
+
+#define HTTP_DATE_FORMAT    "ddd, dd MMM yyyy hh:mm:ss 'GMT'"
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CHTTPFileCache
+    \inmodule qt-plus
+    \brief A bounded, least recently used cache of static files served by CHTTPServer.
+
+    \section1 How it works
+    Files are keyed by their name. Each time a file is requested, its modification time and size are
+    compared to those of the cached copy, which is reloaded if they differ. \br
+    Files bigger than maxFileSize() are never cached: only their metadata is returned so that the caller
+    can stream them from disk. \br
+    When the total size of cached files would exceed maxBytes(), the least recently used files are evicted. \br
+    Each entry also carries an entity tag and a HTTP formatted modification date for conditional requests. \br
+    Compressed variants of cached files are built on demand by getEncodedContent() and kept in the same
+    entry, so they are evicted and invalidated along with it.
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CHTTPFileCache. \br\br
+    \a iMaxBytes is the maximum number of bytes held by the cache. \br
+    \a iMaxFileSize is the size above which a file is not cached.
+*/
+CHTTPFileCache::CHTTPFileCache(qint64 iMaxBytes, qint64 iMaxFileSize)
+    : m_iAccessCounter(0)
+    , m_iMaxBytes(iMaxBytes)
+    , m_iMaxFileSize(iMaxFileSize)
+    , m_iCurrentBytes(0)
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CHTTPFileCache.
+*/
+CHTTPFileCache::~CHTTPFileCache()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the maximum number of bytes held by the cache to \a iValue.
+*/
+void CHTTPFileCache::setMaxBytes(qint64 iValue)
+{
+    QMutexLocker locker(&m_mMutex);
+
+    m_iMaxBytes = iValue;
+
+    makeRoom(0);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the size above which files are streamed from disk instead of being cached to \a iValue.
+*/
+void CHTTPFileCache::setMaxFileSize(qint64 iValue)
+{
+    QMutexLocker locker(&m_mMutex);
+
+    m_iMaxFileSize = iValue;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the maximum number of bytes held by the cache.
+*/
+qint64 CHTTPFileCache::maxBytes() const
+{
+    QMutexLocker locker(&m_mMutex);
+
+    return m_iMaxBytes;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the size above which files are not cached.
+*/
+qint64 CHTTPFileCache::maxFileSize() const
+{
+    QMutexLocker locker(&m_mMutex);
+
+    return m_iMaxFileSize;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of bytes currently held by the cache.
+*/
+qint64 CHTTPFileCache::currentBytes() const
+{
+    QMutexLocker locker(&m_mMutex);
+
+    return m_iCurrentBytes;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of cached files.
+*/
+int CHTTPFileCache::count() const
+{
+    QMutexLocker locker(&m_mMutex);
+
+    return m_hEntries.count();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Fills \a tEntry with the information about \a sFileName. \br\br
+    If the file is small enough, its content is loaded into the cache and shared with \a tEntry. \br
+    Returns \c false if the file does not exist or cannot be read.
+*/
+bool CHTTPFileCache::get(const QString& sFileName, CEntry& tEntry)
+{
+    QFileInfo tInfo(sFileName);
+
+    if (tInfo.exists() == false || tInfo.isFile() == false)
+    {
+        return false;
+    }
+
+    QDateTime tModified = tInfo.lastModified();
+    qint64 iSize = tInfo.size();
+
+    // Look for an up-to-date cached copy
+    {
+        QMutexLocker locker(&m_mMutex);
+
+        if (m_hEntries.contains(sFileName))
+        {
+            CEntry& tCached = m_hEntries[sFileName];
+
+            if (tCached.m_tModified == tModified && tCached.m_iSize == iSize)
+            {
+                // Move the entry to the most recently used end
+                m_mAccessOrder.remove(tCached.m_iLastAccess);
+                tCached.m_iLastAccess = ++m_iAccessCounter;
+                m_mAccessOrder[tCached.m_iLastAccess] = sFileName;
+
+                tEntry = tCached;
+                return true;
+            }
+
+            // The file changed on disk
+            remove(sFileName);
+        }
+    }
+
+    tEntry = CEntry();
+    tEntry.m_sFileName = sFileName;
+    tEntry.m_tModified = tModified;
+    tEntry.m_iSize = iSize;
+    tEntry.m_baETag = QString("\"%1-%2\"")
+            .arg(QString::number(iSize, 16))
+            .arg(QString::number(tModified.toMSecsSinceEpoch(), 16))
+            .toLatin1();
+    tEntry.m_baLastModified = toHTTPDate(tModified);
+
+    qint64 iMaxFileSize = maxFileSize();
+
+    if (iSize > iMaxFileSize || iSize > maxBytes())
+    {
+        // Too big, the caller will stream the file
+        return true;
+    }
+
+    // Read the file outside of the lock
+    QFile tFile(sFileName);
+
+    if (tFile.open(QIODevice::ReadOnly) == false)
+    {
+        return false;
+    }
+
+    tEntry.m_baContent = tFile.readAll();
+    tFile.close();
+
+    if (tEntry.m_baContent.size() != iSize)
+    {
+        // The file changed while being read, serve what was read but do not cache it
+        tEntry.m_iSize = tEntry.m_baContent.size();
+        tEntry.m_bCached = true;
+        return true;
+    }
+
+    tEntry.m_bCached = true;
+
+    QMutexLocker locker(&m_mMutex);
+
+    // Another thread may have loaded the same file meanwhile
+    if (m_hEntries.contains(sFileName))
+    {
+        remove(sFileName);
+    }
+
+    makeRoom(iSize);
+
+    tEntry.m_iLastAccess = ++m_iAccessCounter;
+    m_hEntries[sFileName] = tEntry;
+    m_mAccessOrder[tEntry.m_iLastAccess] = sFileName;
+    m_iCurrentBytes += iSize;
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the content of the file described by \a tEntry, encoded with \a eEncoding. \br\br
+    The encoded variant is built once with compression level \a iLevel and kept in the cache entry,
+    as long as the file does not change on disk. \a tEntry must have been filled by get().
+*/
+QByteArray CHTTPFileCache::getEncodedContent(const CEntry& tEntry, CHTTPContentEncoder::EEncoding eEncoding, int iLevel)
+{
+    if (eEncoding == CHTTPContentEncoder::eIdentity)
+    {
+        return tEntry.m_baContent;
+    }
+
+    // Look for an already encoded variant
+    {
+        QMutexLocker locker(&m_mMutex);
+
+        if (m_hEntries.contains(tEntry.m_sFileName))
+        {
+            const CEntry& tCached = m_hEntries[tEntry.m_sFileName];
+
+            if (tCached.m_baETag == tEntry.m_baETag)
+            {
+                const QByteArray& baVariant = eEncoding == CHTTPContentEncoder::eGzip ? tCached.m_baGzipContent : tCached.m_baDeflateContent;
+
+                if (baVariant.isEmpty() == false)
+                {
+                    return baVariant;
+                }
+            }
+        }
+    }
+
+    // Encode outside of the lock
+    QByteArray baEncoded = CHTTPContentEncoder::encode(tEntry.m_baContent, eEncoding, iLevel);
+
+    QMutexLocker locker(&m_mMutex);
+
+    if (m_hEntries.contains(tEntry.m_sFileName))
+    {
+        CEntry& tCached = m_hEntries[tEntry.m_sFileName];
+
+        if (tCached.m_baETag == tEntry.m_baETag)
+        {
+            QByteArray& baVariant = eEncoding == CHTTPContentEncoder::eGzip ? tCached.m_baGzipContent : tCached.m_baDeflateContent;
+
+            if (baVariant.isEmpty())
+            {
+                baVariant = baEncoded;
+                m_iCurrentBytes += baEncoded.size();
+
+                makeRoom(0);
+            }
+        }
+    }
+
+    return baEncoded;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Removes all entries.
+*/
+void CHTTPFileCache::clear()
+{
+    QMutexLocker locker(&m_mMutex);
+
+    m_hEntries.clear();
+    m_mAccessOrder.clear();
+    m_iCurrentBytes = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Removes the entry of \a sFileName. The mutex must be locked by the caller.
+*/
+void CHTTPFileCache::remove(const QString& sFileName)
+{
+    if (m_hEntries.contains(sFileName))
+    {
+        const CEntry& tEntry = m_hEntries[sFileName];
+
+        m_iCurrentBytes -= tEntry.m_baContent.size();
+        m_iCurrentBytes -= tEntry.m_baGzipContent.size();
+        m_iCurrentBytes -= tEntry.m_baDeflateContent.size();
+        m_mAccessOrder.remove(tEntry.m_iLastAccess);
+        m_hEntries.remove(sFileName);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Evicts least recently used entries until \a iBytes more bytes fit in the cache. The mutex must be locked by the caller.
+*/
+void CHTTPFileCache::makeRoom(qint64 iBytes)
+{
+    while (m_mAccessOrder.isEmpty() == false && m_iCurrentBytes + iBytes > m_iMaxBytes)
+    {
+        QString sOldest = m_mAccessOrder.begin().value();
+
+        remove(sOldest);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \a tDate in HTTP format, for instance "Sun, 06 Nov 1994 08:49:37 GMT".
+*/
+QByteArray CHTTPFileCache::toHTTPDate(const QDateTime& tDate)
+{
+    return QLocale::c().toString(tDate.toUTC(), HTTP_DATE_FORMAT).toLatin1();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the date in HTTP format contained in \a baDate. The returned date is invalid if \a baDate could not be parsed.
+*/
+QDateTime CHTTPFileCache::fromHTTPDate(const QByteArray& baDate)
+{
+    QDateTime tDate = QLocale::c().toDateTime(QString::fromLatin1(baDate.trimmed()), HTTP_DATE_FORMAT);
+
+    tDate.setTimeSpec(Qt::UTC);
+
+    return tDate;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if \a baIfNoneMatch, the value of an If-None-Match header, matches \a baETag. \br\br
+    Weak tags (W/"...") are compared as strong ones, which is what the weak comparison function of RFC 7232 does.
+*/
+bool CHTTPFileCache::matchesETag(const QByteArray& baIfNoneMatch, const QByteArray& baETag)
+{
+    QByteArray baValue = baIfNoneMatch.trimmed();
+
+    if (baValue == "*")
+    {
+        return true;
+    }
+
+    foreach (QByteArray baTag, baValue.split(','))
+    {
+        baTag = baTag.trimmed();
+
+        if (baTag.startsWith("W/"))
+        {
+            baTag = baTag.mid(2);
+        }
+
+        if (baTag == baETag)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Parses \a baRange, the value of a Range header, for a file of \a iSize bytes. \br\br
+    Only single byte ranges are handled ("bytes=a-b", "bytes=a-" and "bytes=-n"). Multiple ranges and
+    malformed values return \c eNoRange, meaning the whole file should be sent. \br
+    On \c eValidRange, \a iStart and \a iEnd are set to the offsets of the first and last bytes.
+*/
+CHTTPFileCache::ERangeResult CHTTPFileCache::parseRange(const QByteArray& baRange, qint64 iSize, qint64& iStart, qint64& iEnd)
+{
+    QByteArray baValue = baRange.trimmed();
+
+    if (baValue.startsWith("bytes=") == false)
+    {
+        return eNoRange;
+    }
+
+    baValue = baValue.mid(6);
+
+    if (baValue.contains(','))
+    {
+        return eNoRange;
+    }
+
+    int iDash = baValue.indexOf('-');
+
+    if (iDash < 0)
+    {
+        return eNoRange;
+    }
+
+    QByteArray baFirst = baValue.left(iDash).trimmed();
+    QByteArray baLast = baValue.mid(iDash + 1).trimmed();
+    bool bOK = false;
+
+    if (baFirst.isEmpty())
+    {
+        // Suffix range : the last n bytes
+        qint64 iSuffix = baLast.toLongLong(&bOK);
+
+        if (bOK == false)
+        {
+            return eNoRange;
+        }
+
+        if (iSuffix <= 0 || iSize == 0)
+        {
+            return eUnsatisfiable;
+        }
+
+        iStart = qMax((qint64) 0, iSize - iSuffix);
+        iEnd = iSize - 1;
+
+        return eValidRange;
+    }
+
+    iStart = baFirst.toLongLong(&bOK);
+
+    if (bOK == false || iStart < 0)
+    {
+        return eNoRange;
+    }
+
+    if (baLast.isEmpty())
+    {
+        iEnd = iSize - 1;
+    }
+    else
+    {
+        iEnd = baLast.toLongLong(&bOK);
+
+        if (bOK == false || iEnd < iStart)
+        {
+            return eNoRange;
+        }
+    }
+
+    if (iStart >= iSize)
+    {
+        return eUnsatisfiable;
+    }
+
+    iEnd = qMin(iEnd, iSize - 1);
+
+    return eValidRange;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+
+// Application
+#include "CHTTPContentEncoder.h"
+
+//-------------------------------------------------------------------------------------------------
+
+//! Defines a bounded, least recently used cache of static files
+//! Entries are keyed by file name and invalidated when the file's modification time or size changes
+class QTPLUSSHARED_EXPORT CHTTPFileCache
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Enumerators
+    //-------------------------------------------------------------------------------------------------
+
+    enum ERangeResult
+    {
+        eNoRange,           // No range, or a range form that is not supported: send the whole file
+        eValidRange,        // A satisfiable single range
+        eUnsatisfiable      // A range outside the file
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Inner classes
+    //-------------------------------------------------------------------------------------------------
+
+    //! Information about a file, with its content if it fits in the cache
+    class CEntry
+    {
+    public:
+
+        CEntry()
+            : m_iSize(0)
+            , m_iLastAccess(0)
+            , m_bCached(false)
+        {
+        }
+
+        QString     m_sFileName;
+        QByteArray  m_baContent;        // File content, empty if the file is too big to be cached
+        QByteArray  m_baGzipContent;    // gzip encoded variant, built on first request
+        QByteArray  m_baDeflateContent; // deflate encoded variant, built on first request
+        QByteArray  m_baETag;           // Entity tag, built from size and modification time
+        QByteArray  m_baLastModified;   // Modification time, HTTP date format
+        QDateTime   m_tModified;
+        qint64      m_iSize;
+        quint64     m_iLastAccess;      // Key of this entry in the LRU order map
+        bool        m_bCached;          // True if m_baContent holds the file
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor
+    CHTTPFileCache(qint64 iMaxBytes = 32 * 1024 * 1024, qint64 iMaxFileSize = 4 * 1024 * 1024);
+
+    //! Destructor
+    virtual ~CHTTPFileCache();
+
+    //-------------------------------------------------------------------------------------------------
+    // Setters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Sets the maximum number of bytes held by the cache
+    void setMaxBytes(qint64 iValue);
+
+    //! Sets the size above which files are not cached but streamed from disk
+    void setMaxFileSize(qint64 iValue);
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the maximum number of bytes held by the cache
+    qint64 maxBytes() const;
+
+    //! Returns the size above which files are not cached
+    qint64 maxFileSize() const;
+
+    //! Returns the number of bytes currently held by the cache
+    qint64 currentBytes() const;
+
+    //! Returns the number of cached files
+    int count() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Fills tEntry for sFileName, loading it into the cache if needed
+    //! Returns false if the file does not exist or cannot be read
+    bool get(const QString& sFileName, CEntry& tEntry);
+
+    //! Returns the content of a cached file encoded with eEncoding, building and caching it if needed
+    QByteArray getEncodedContent(const CEntry& tEntry, CHTTPContentEncoder::EEncoding eEncoding, int iLevel);
+
+    //! Removes all entries
+    void clear();
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns a date in HTTP format (RFC 7231, IMF-fixdate)
+    static QByteArray toHTTPDate(const QDateTime& tDate);
+
+    //! Returns a date parsed from HTTP format, invalid if the format is not recognized
+    static QDateTime fromHTTPDate(const QByteArray& baDate);
+
+    //! Returns true if an If-None-Match header value matches baETag
+    static bool matchesETag(const QByteArray& baIfNoneMatch, const QByteArray& baETag);
+
+    //! Parses the value of a Range header for a file of iSize bytes
+    //! On eValidRange, iStart and iEnd contain the first and last byte offsets
+    static ERangeResult parseRange(const QByteArray& baRange, qint64 iSize, qint64& iStart, qint64& iEnd);
+
+    //-------------------------------------------------------------------------------------------------
+    // Protected methods
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Removes an entry
+    void remove(const QString& sFileName);
+
+    //! Removes least recently used entries until iBytes more bytes fit
+    void makeRoom(qint64 iBytes);
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    mutable QMutex              m_mMutex;
+    QHash<QString, CEntry>      m_hEntries;         // Cached files
+    QMap<quint64, QString>      m_mAccessOrder;     // File names by last access, oldest first
+    quint64                     m_iAccessCounter;
+    qint64                      m_iMaxBytes;
+    qint64                      m_iMaxFileSize;
+    qint64                      m_iCurrentBytes;
+};
@@ -0,0 +1,308 @@
+
+// Application
+#include "CHTTPMetrics.h"
+#include "CHTTPResponse.h"
+
+//-------------------------------------------------------------------------------------------------
+
+// Upper bounds of the histogram buckets, in microseconds
+static const qint64 s_aBucketBounds[METRICS_HISTOGRAM_BUCKETS] =
+{
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+// Bucket bounds as written in the text format, in seconds
+static const char* s_aBucketLabels[METRICS_HISTOGRAM_BUCKETS] =
+{
+    "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05",
+    "0.1", "0.25", "0.5", "1", "2.5", "5", "10"
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CHTTPMetrics
+    \inmodule qt-plus
+    \brief Runtime counters of a CHTTPServer.
+
+    The server updates these counters as it accepts connections and serves requests: connections
+    accepted and rejected, requests by method, responses by status, bytes in and out, depth of the
+    thread pool's queue, and histograms of the time spent in requests and in content generation. \br
+    Counters are atomics, so updating them takes no lock. toText() renders them in the Prometheus
+    text format, which CHTTPServer serves at the path given to CHTTPServer::setMetricsPath().
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records a duration of \a iMicroseconds.
+*/
+void CHTTPMetrics::CHistogram::observe(qint64 iMicroseconds)
+{
+    int iBucket = 0;
+
+    while (iBucket < METRICS_HISTOGRAM_BUCKETS && iMicroseconds > s_aBucketBounds[iBucket])
+    {
+        iBucket++;
+    }
+
+    m_aBuckets[iBucket].fetchAndAddRelaxed(1);
+    m_iSum.fetchAndAddRelaxed(iMicroseconds);
+    m_iCount.fetchAndAddRelaxed(1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Appends the histogram to \a baText, as metric \a szName described by \a szHelp. \br\br
+    Buckets are written cumulated, as the format requires.
+*/
+void CHTTPMetrics::CHistogram::toText(QByteArray& baText, const char* szName, const char* szHelp) const
+{
+    qint64 iCumulated = 0;
+
+    baText.append("# HELP ").append(szName).append(' ').append(szHelp).append('\n');
+    baText.append("# TYPE ").append(szName).append(" histogram\n");
+
+    for (int iBucket = 0; iBucket <= METRICS_HISTOGRAM_BUCKETS; iBucket++)
+    {
+        iCumulated += m_aBuckets[iBucket].load();
+
+        baText.append(szName).append("_bucket{le=\"");
+        baText.append(iBucket < METRICS_HISTOGRAM_BUCKETS ? s_aBucketLabels[iBucket] : "+Inf");
+        baText.append("\"} ");
+        CHTTPResponse::appendNumber(baText, iCumulated);
+        baText.append('\n');
+    }
+
+    baText.append(szName).append("_sum ").append(QByteArray::number((double) m_iSum.load() / 1000000.0, 'f', 6)).append('\n');
+    baText.append(szName).append("_count ");
+    CHTTPResponse::appendNumber(baText, m_iCount.load());
+    baText.append('\n');
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CHTTPMetrics with all counters at zero.
+*/
+CHTTPMetrics::CHTTPMetrics()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CHTTPMetrics.
+*/
+CHTTPMetrics::~CHTTPMetrics()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records an accepted connection.
+*/
+void CHTTPMetrics::addAcceptedConnection()
+{
+    m_iAcceptedConnections.fetchAndAddRelaxed(1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records a connection dropped because its peer is blacklisted by the rate limiter.
+*/
+void CHTTPMetrics::addBlockedConnection()
+{
+    m_iBlockedConnections.fetchAndAddRelaxed(1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records a connection refused because the server has too many open connections.
+*/
+void CHTTPMetrics::addRefusedConnection()
+{
+    m_iRefusedConnections.fetchAndAddRelaxed(1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records a request over the rate limit of its client.
+*/
+void CHTTPMetrics::addRateLimitedRequest()
+{
+    m_iRateLimitedRequests.fetchAndAddRelaxed(1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records a request with method \a baMethod.
+*/
+void CHTTPMetrics::addRequest(const QByteArray& baMethod)
+{
+    if (baMethod == "GET")
+    {
+        m_aRequests[eGET].fetchAndAddRelaxed(1);
+    }
+    else if (baMethod == "POST")
+    {
+        m_aRequests[ePOST].fetchAndAddRelaxed(1);
+    }
+    else
+    {
+        m_aRequests[eOtherMethod].fetchAndAddRelaxed(1);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records a response with status \a iStatus.
+*/
+void CHTTPMetrics::addResponse(int iStatus)
+{
+    if (iStatus > 0 && iStatus < METRICS_MAX_STATUS)
+    {
+        m_aResponses[iStatus].fetchAndAddRelaxed(1);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records \a iBytes read from clients.
+*/
+void CHTTPMetrics::addBytesIn(qint64 iBytes)
+{
+    m_iBytesIn.fetchAndAddRelaxed(iBytes);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records \a iBytes written to clients.
+*/
+void CHTTPMetrics::addBytesOut(qint64 iBytes)
+{
+    m_iBytesOut.fetchAndAddRelaxed(iBytes);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records a request handed to the thread pool.
+*/
+void CHTTPMetrics::addQueuedRequest()
+{
+    m_iQueuedRequests.fetchAndAddRelaxed(1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records a request taken from the thread pool's queue by one of its threads.
+*/
+void CHTTPMetrics::removeQueuedRequest()
+{
+    m_iQueuedRequests.fetchAndSubRelaxed(1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the histogram of the time spent in CHTTPServer::getContent() and CHTTPServer::getRawContent().
+*/
+CHTTPMetrics::CHistogram& CHTTPMetrics::contentTime()
+{
+    return m_tContentTime;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the histogram of the time spent processing requests, from parsing to sending the response.
+*/
+CHTTPMetrics::CHistogram& CHTTPMetrics::requestTime()
+{
+    return m_tRequestTime;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the metrics in the Prometheus text format. \br\br
+    \a iActiveConnections is the number of open connections and \a tPool the server's request thread pool.
+*/
+QByteArray CHTTPMetrics::toText(int iActiveConnections, const QThreadPool& tPool) const
+{
+    QByteArray baText;
+
+    baText.reserve(4096);
+
+    appendMetric(baText, "http_connections_accepted_total", "counter", "Connections accepted.", m_iAcceptedConnections.load());
+    appendMetric(baText, "http_connections_blocked_total", "counter", "Connections dropped because the client is blacklisted.", m_iBlockedConnections.load());
+    appendMetric(baText, "http_connections_refused_total", "counter", "Connections refused because of the connection limit.", m_iRefusedConnections.load());
+    appendMetric(baText, "http_connections_active", "gauge", "Open connections.", iActiveConnections);
+    appendMetric(baText, "http_requests_rate_limited_total", "counter", "Requests over the rate limit of their client.", m_iRateLimitedRequests.load());
+
+    baText.append("# HELP http_requests_total Requests by method.\n");
+    baText.append("# TYPE http_requests_total counter\n");
+
+    static const char* aMethods[eMethodCount] = { "GET", "POST", "other" };
+
+    for (int iMethod = 0; iMethod < eMethodCount; iMethod++)
+    {
+        baText.append("http_requests_total{method=\"").append(aMethods[iMethod]).append("\"} ");
+        CHTTPResponse::appendNumber(baText, m_aRequests[iMethod].load());
+        baText.append('\n');
+    }
+
+    baText.append("# HELP http_responses_total Responses by status code.\n");
+    baText.append("# TYPE http_responses_total counter\n");
+
+    for (int iStatus = 0; iStatus < METRICS_MAX_STATUS; iStatus++)
+    {
+        qint64 iCount = m_aResponses[iStatus].load();
+
+        if (iCount > 0)
+        {
+            baText.append("http_responses_total{code=\"");
+            CHTTPResponse::appendNumber(baText, iStatus);
+            baText.append("\"} ");
+            CHTTPResponse::appendNumber(baText, iCount);
+            baText.append('\n');
+        }
+    }
+
+    appendMetric(baText, "http_received_bytes_total", "counter", "Bytes read from clients.", m_iBytesIn.load());
+    appendMetric(baText, "http_sent_bytes_total", "counter", "Bytes written to clients.", m_iBytesOut.load());
+    appendMetric(baText, "http_pool_queued_requests", "gauge", "Requests waiting for a thread of the pool.", m_iQueuedRequests.load());
+    appendMetric(baText, "http_pool_active_threads", "gauge", "Threads of the pool executing requests.", tPool.activeThreadCount());
+    appendMetric(baText, "http_pool_max_threads", "gauge", "Maximum number of threads of the pool.", tPool.maxThreadCount());
+
+    m_tRequestTime.toText(baText, "http_request_duration_seconds", "Time spent processing requests.");
+    m_tContentTime.toText(baText, "http_content_duration_seconds", "Time spent generating dynamic content.");
+
+    return baText;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Appends to \a baText the metric \a szName of type \a szType, described by \a szHelp, with value \a iValue.
+*/
+void CHTTPMetrics::appendMetric(QByteArray& baText, const char* szName, const char* szType, const char* szHelp, qint64 iValue)
+{
+    baText.append("# HELP ").append(szName).append(' ').append(szHelp).append('\n');
+    baText.append("# TYPE ").append(szName).append(' ').append(szType).append('\n');
+    baText.append(szName).append(' ');
+    CHTTPResponse::appendNumber(baText, iValue);
+    baText.append('\n');
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QByteArray>
+#include <QAtomicInteger>
+#include <QThreadPool>
+
+//-------------------------------------------------------------------------------------------------
+
+#define METRICS_HISTOGRAM_BUCKETS   16
+#define METRICS_MAX_STATUS          600
+
+//-------------------------------------------------------------------------------------------------
+
+//! Defines the runtime counters of a CHTTPServer
+//! All counters are atomics updated without locks, they can be rendered in the Prometheus text format
+class QTPLUSSHARED_EXPORT CHTTPMetrics
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Enumerators
+    //-------------------------------------------------------------------------------------------------
+
+    enum EMethod
+    {
+        eGET,
+        ePOST,
+        eOtherMethod,
+        eMethodCount
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Inner classes
+    //-------------------------------------------------------------------------------------------------
+
+    //! A latency histogram with fixed buckets, from 100 microseconds to 10 seconds
+    class QTPLUSSHARED_EXPORT CHistogram
+    {
+    public:
+
+        //! Records a duration, in microseconds
+        void observe(qint64 iMicroseconds);
+
+        //! Appends the histogram to baText in the Prometheus text format
+        void toText(QByteArray& baText, const char* szName, const char* szHelp) const;
+
+        QAtomicInteger<qint64>  m_aBuckets[METRICS_HISTOGRAM_BUCKETS + 1];  // Non cumulative counts, the last one is +Inf
+        QAtomicInteger<qint64>  m_iSum;                                     // Sum of the durations, in microseconds
+        QAtomicInteger<qint64>  m_iCount;
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor
+    CHTTPMetrics();
+
+    //! Destructor
+    virtual ~CHTTPMetrics();
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Records an accepted connection
+    void addAcceptedConnection();
+
+    //! Records a connection dropped because its peer is blacklisted
+    void addBlockedConnection();
+
+    //! Records a connection refused because the server has too many open connections
+    void addRefusedConnection();
+
+    //! Records a request over the rate limit of its client
+    void addRateLimitedRequest();
+
+    //! Records a request with method baMethod
+    void addRequest(const QByteArray& baMethod);
+
+    //! Records a response with status iStatus
+    void addResponse(int iStatus);
+
+    //! Records bytes read from clients
+    void addBytesIn(qint64 iBytes);
+
+    //! Records bytes written to clients
+    void addBytesOut(qint64 iBytes);
+
+    //! Records a request handed to the thread pool
+    void addQueuedRequest();
+
+    //! Records a request taken from the thread pool's queue
+    void removeQueuedRequest();
+
+    //! Returns the histogram of the time spent generating dynamic content
+    CHistogram& contentTime();
+
+    //! Returns the histogram of the time spent processing requests
+    CHistogram& requestTime();
+
+    //! Returns the metrics in the Prometheus text format
+    QByteArray toText(int iActiveConnections, const QThreadPool& tPool) const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Protected methods
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Appends a single-valued metric to baText
+    static void appendMetric(QByteArray& baText, const char* szName, const char* szType, const char* szHelp, qint64 iValue);
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    QAtomicInteger<qint64>  m_iAcceptedConnections;
+    QAtomicInteger<qint64>  m_iBlockedConnections;
+    QAtomicInteger<qint64>  m_iRefusedConnections;
+    QAtomicInteger<qint64>  m_iRateLimitedRequests;
+    QAtomicInteger<qint64>  m_aRequests[eMethodCount];
+    QAtomicInteger<qint64>  m_aResponses[METRICS_MAX_STATUS];      // Indexed by status code
+    QAtomicInteger<qint64>  m_iBytesIn;
+    QAtomicInteger<qint64>  m_iBytesOut;
+    QAtomicInteger<int>     m_iQueuedRequests;                      // Requests waiting for a thread of the pool
+    CHistogram              m_tContentTime;
+    CHistogram              m_tRequestTime;
+};
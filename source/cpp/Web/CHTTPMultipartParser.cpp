@@ -0,0 +1,366 @@
+
+// Qt
+#include <QDebug>
+#include <QFile>
+
+// Application
+#include "CHTTPMultipartParser.h"
+#include "CHTTPRequestParser.h"
+
+//-------------------------------------------------------------------------------------------------
+
+// Maximum size of the headers of a part
+#define MAX_PART_HEADER_SIZE    (16 * 1024)
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CHTTPMultipartParser
+    \inmodule qt-plus
+    \brief An incremental parser for multipart/form-data request bodies.
+
+    The body is fed in chunks as it arrives with parse(). Boundaries are searched in the raw bytes,
+    so binary content is preserved, and only a boundary's length worth of bytes is kept between chunks. \br
+    The content of a part stays in memory until it grows beyond the memory threshold, it is then written
+    to a QTemporaryFile. The memory used is therefore bounded whatever the size of the upload.
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the content of the part, reading its temporary file if it was spooled to disk.
+*/
+QByteArray CHTTPMultipartParser::CPart::content() const
+{
+    if (isInFile())
+    {
+        QFile tFile(m_pFile->fileName());
+
+        if (tFile.open(QIODevice::ReadOnly))
+        {
+            return tFile.readAll();
+        }
+
+        qWarning() << QString("CHTTPMultipartParser::CPart::content() : could not read %1").arg(tFile.fileName());
+
+        return QByteArray();
+    }
+
+    return m_baData;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CHTTPMultipartParser for a body whose parts are separated by \a baBoundary. \br\br
+    Parts bigger than \a iMemoryThreshold bytes are spooled to temporary files.
+*/
+CHTTPMultipartParser::CHTTPMultipartParser(const QByteArray& baBoundary, qint64 iMemoryThreshold)
+    : m_eState(ePreamble)
+    , m_baDelimiter("\r\n--" + baBoundary)
+    , m_baPending("\r\n")
+    , m_iMemoryThreshold(iMemoryThreshold)
+{
+    // m_baPending starts with a line ending so that a boundary at the very start of the body is found like the others
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CHTTPMultipartParser. Temporary files of parts that were not taken are removed.
+*/
+CHTTPMultipartParser::~CHTTPMultipartParser()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the current state of the parser.
+*/
+CHTTPMultipartParser::EState CHTTPMultipartParser::state() const
+{
+    return m_eState;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the parts completely received so far.
+*/
+const QList<CHTTPMultipartParser::CPart>& CHTTPMultipartParser::parts() const
+{
+    return m_lParts;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the completed parts and removes them from the parser.
+*/
+QList<CHTTPMultipartParser::CPart> CHTTPMultipartParser::takeParts()
+{
+    QList<CPart> lParts = m_lParts;
+    m_lParts.clear();
+    return lParts;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Parses \a baData, the next chunk of the body.
+*/
+CHTTPMultipartParser::EState CHTTPMultipartParser::parse(const QByteArray& baData)
+{
+    return parse(baData.constData(), baData.size());
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Parses \a iLength bytes at \a pData, the next chunk of the body. \br\br
+    Returns eEnd once the closing boundary is found, eError if the body is malformed or if a part
+    could not be written to disk.
+*/
+CHTTPMultipartParser::EState CHTTPMultipartParser::parse(const char* pData, int iLength)
+{
+    if (m_eState == eEnd || m_eState == eError)
+    {
+        return m_eState;
+    }
+
+    m_baPending.append(pData, iLength);
+
+    const char* pPending = m_baPending.constData();
+    int iSize = m_baPending.size();
+    int iKeep = m_baDelimiter.size() - 1;
+    int iPosition = 0;
+    bool bProgress = true;
+
+    while (bProgress && m_eState != eEnd && m_eState != eError)
+    {
+        switch (m_eState)
+        {
+            case ePreamble:
+            {
+                int iIndex = m_baPending.indexOf(m_baDelimiter, iPosition);
+
+                if (iIndex < 0)
+                {
+                    // Discard the preamble, except what may be the start of a boundary
+                    iPosition = qMax(iPosition, iSize - iKeep);
+                    bProgress = false;
+                }
+                else
+                {
+                    iPosition = iIndex + m_baDelimiter.size();
+                    m_eState = eDelimiter;
+                }
+                break;
+            }
+
+            case eDelimiter:
+            {
+                if (iSize - iPosition < 2)
+                {
+                    bProgress = false;
+                }
+                else if (pPending[iPosition] == '-' && pPending[iPosition + 1] == '-')
+                {
+                    // Closing boundary : the epilogue is ignored
+                    iPosition = iSize;
+                    m_eState = eEnd;
+                }
+                else
+                {
+                    // Skip the transport padding up to the line ending
+                    int iIndex = m_baPending.indexOf("\r\n", iPosition);
+
+                    if (iIndex < 0)
+                    {
+                        if (iSize - iPosition > MAX_PART_HEADER_SIZE) m_eState = eError;
+                        bProgress = false;
+                    }
+                    else
+                    {
+                        iPosition = iIndex + 2;
+                        m_tPart = CPart();
+                        m_eState = eHeaders;
+                    }
+                }
+                break;
+            }
+
+            case eHeaders:
+            {
+                if (iSize - iPosition >= 2 && pPending[iPosition] == '\r' && pPending[iPosition + 1] == '\n')
+                {
+                    // A part without headers
+                    iPosition += 2;
+                    m_eState = eContent;
+                    break;
+                }
+
+                int iIndex = m_baPending.indexOf("\r\n\r\n", iPosition);
+
+                if (iIndex < 0)
+                {
+                    if (iSize - iPosition > MAX_PART_HEADER_SIZE) m_eState = eError;
+                    bProgress = false;
+                }
+                else
+                {
+                    parsePartHeaders(pPending + iPosition, iIndex - iPosition);
+                    iPosition = iIndex + 4;
+                    m_eState = eContent;
+                }
+                break;
+            }
+
+            case eContent:
+            {
+                int iIndex = m_baPending.indexOf(m_baDelimiter, iPosition);
+
+                if (iIndex < 0)
+                {
+                    // Write all but what may be the start of a boundary
+                    int iSafe = iSize - iKeep;
+
+                    if (iSafe > iPosition)
+                    {
+                        if (write(pPending + iPosition, iSafe - iPosition) == false)
+                        {
+                            m_eState = eError;
+                        }
+
+                        iPosition = iSafe;
+                    }
+
+                    bProgress = false;
+                }
+                else
+                {
+                    if (write(pPending + iPosition, iIndex - iPosition) == false)
+                    {
+                        m_eState = eError;
+                        break;
+                    }
+
+                    endPart();
+
+                    iPosition = iIndex + m_baDelimiter.size();
+                    m_eState = eDelimiter;
+                }
+                break;
+            }
+
+            default:
+                bProgress = false;
+                break;
+        }
+    }
+
+    if (m_eState == eEnd || m_eState == eError)
+    {
+        m_baPending.clear();
+    }
+    else
+    {
+        m_baPending.remove(0, iPosition);
+    }
+
+    return m_eState;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Parses the \a iLength bytes of part headers at \a pData.
+*/
+void CHTTPMultipartParser::parsePartHeaders(const char* pData, int iLength)
+{
+    QByteArray baHeaders = QByteArray::fromRawData(pData, iLength);
+
+    foreach (QByteArray baLine, baHeaders.split('\n'))
+    {
+        int iColon = baLine.indexOf(':');
+
+        if (iColon > 0)
+        {
+            QByteArray baName = baLine.left(iColon).trimmed();
+            QByteArray baValue = baLine.mid(iColon + 1).trimmed();
+
+            if (CHTTPRequestParser::isEqual(baName, "Content-Disposition"))
+            {
+                m_tPart.m_sName = QString::fromUtf8(CHTTPRequestParser::subValue(baValue, "name"));
+                m_tPart.m_sFileName = QString::fromUtf8(CHTTPRequestParser::subValue(baValue, "filename"));
+            }
+            else if (CHTTPRequestParser::isEqual(baName, "Content-Type"))
+            {
+                m_tPart.m_sContentType = QString::fromLatin1(baValue);
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Appends \a iLength bytes at \a pData to the current part. \br\br
+    The part is moved to a temporary file when it grows beyond the memory threshold. \br
+    Returns \c false if the temporary file could not be written.
+*/
+bool CHTTPMultipartParser::write(const char* pData, int iLength)
+{
+    if (iLength <= 0)
+    {
+        return true;
+    }
+
+    if (m_tPart.isInFile() == false && m_tPart.m_iSize + iLength > m_iMemoryThreshold)
+    {
+        m_tPart.m_pFile = QSharedPointer<QTemporaryFile>(new QTemporaryFile());
+
+        if (m_tPart.m_pFile->open() == false || m_tPart.m_pFile->write(m_tPart.m_baData) != m_tPart.m_baData.size())
+        {
+            qWarning() << QString("CHTTPMultipartParser::write() : could not spool part %1 to disk : %2").arg(m_tPart.m_sName).arg(m_tPart.m_pFile->errorString());
+            return false;
+        }
+
+        m_tPart.m_baData.clear();
+    }
+
+    if (m_tPart.isInFile())
+    {
+        if (m_tPart.m_pFile->write(pData, iLength) != iLength)
+        {
+            qWarning() << QString("CHTTPMultipartParser::write() : could not spool part %1 to disk : %2").arg(m_tPart.m_sName).arg(m_tPart.m_pFile->errorString());
+            return false;
+        }
+    }
+    else
+    {
+        m_tPart.m_baData.append(pData, iLength);
+    }
+
+    m_tPart.m_iSize += iLength;
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Ends the current part and adds it to the completed parts.
+*/
+void CHTTPMultipartParser::endPart()
+{
+    if (m_tPart.isInFile())
+    {
+        // The file stays on disk until the QTemporaryFile is destroyed
+        m_tPart.m_pFile->close();
+    }
+
+    m_lParts << m_tPart;
+    m_tPart = CPart();
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QSharedPointer>
+#include <QTemporaryFile>
+
+//-------------------------------------------------------------------------------------------------
+
+//! Defines an incremental multipart/form-data parser
+//! Boundaries are searched in raw bytes as data arrives, and part contents above a threshold are spooled to temporary files
+class QTPLUSSHARED_EXPORT CHTTPMultipartParser
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Enumerators
+    //-------------------------------------------------------------------------------------------------
+
+    enum EState
+    {
+        ePreamble,          // Looking for the first boundary
+        eDelimiter,         // After a boundary, expecting a line ending or the closing "--"
+        eHeaders,           // Reading the headers of a part
+        eContent,           // Reading the content of a part
+        eEnd,               // The closing boundary was found
+        eError
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Inner classes
+    //-------------------------------------------------------------------------------------------------
+
+    //! A part of a multipart body
+    //! Its content is either in memory or, if too big, in a temporary file removed when the last copy of the part is destroyed
+    class QTPLUSSHARED_EXPORT CPart
+    {
+    public:
+
+        CPart()
+            : m_iSize(0)
+        {
+        }
+
+        //! Returns true if the content is in a temporary file
+        bool isInFile() const { return m_pFile.isNull() == false; }
+
+        //! Returns the name of the temporary file holding the content, empty if the content is in memory
+        QString tempFileName() const { return isInFile() ? m_pFile->fileName() : QString(); }
+
+        //! Returns the whole content, reading the temporary file if needed
+        QByteArray content() const;
+
+        QString                         m_sName;            // Form field name
+        QString                         m_sFileName;        // File name given by the client, if any
+        QString                         m_sContentType;
+        QByteArray                      m_baData;           // Content, if in memory
+        QSharedPointer<QTemporaryFile>  m_pFile;            // Content, if spooled to disk
+        qint64                          m_iSize;            // Size of the content
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor
+    CHTTPMultipartParser(const QByteArray& baBoundary, qint64 iMemoryThreshold = 256 * 1024);
+
+    //! Destructor
+    virtual ~CHTTPMultipartParser();
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the current state
+    EState state() const;
+
+    //! Returns the parts completely received so far
+    const QList<CPart>& parts() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Parses a chunk of the body, returns the new state
+    EState parse(const char* pData, int iLength);
+
+    //! Parses a chunk of the body, returns the new state
+    EState parse(const QByteArray& baData);
+
+    //! Returns the parts and removes them from the parser
+    QList<CPart> takeParts();
+
+    //-------------------------------------------------------------------------------------------------
+    // Protected methods
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Parses the headers of the current part
+    void parsePartHeaders(const char* pData, int iLength);
+
+    //! Appends content to the current part
+    bool write(const char* pData, int iLength);
+
+    //! Ends the current part
+    void endPart();
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    EState          m_eState;
+    QByteArray      m_baDelimiter;          // CRLF, "--" and the boundary
+    QByteArray      m_baPending;            // Received bytes not yet processed
+    CPart           m_tPart;                // Part being received
+    QList<CPart>    m_lParts;               // Completed parts
+    qint64          m_iMemoryThreshold;     // Size above which a part is spooled to disk
+};
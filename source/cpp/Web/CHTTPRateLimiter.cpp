@@ -0,0 +1,403 @@
+// Qt
+#include <QDebug>
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
+
+// Application
+#include "CHTTPRateLimiter.h"
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CHTTPRateLimiter
+    \inmodule qt-plus
+    \brief A per-IP token bucket rate limiter, used by CHTTPServer as flood protection.
+
+    \section1 How it works
+    Each client address owns a bucket of window() * requestsPerSecond() tokens, refilled at
+    requestsPerSecond() tokens per second. Each request takes one token. \br
+    A client that empties its bucket, or that has more than maxConcurrentRequests() requests in process,
+    is blacklisted, for ten minutes by default (see setBanDuration()). \br
+    Clients are spread over RATE_LIMITER_SHARDS hash tables keyed by numeric address, each with its own
+    mutex, so that requests from different clients seldom wait for each other. \br
+    Clients that have been idle for longer than the idle timeout are forgotten once their ban is over, so memory use
+    does not grow with the number of distinct addresses ever seen, even during a flood from many addresses. \br
+    Addresses of the static black list are always rejected.
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CHTTPRateLimiter. \br\br
+    \a iWindowSeconds is the window over which bursts are allowed. \br
+    \a iRequestsPerSecond is the sustained request rate allowed for a client. \br
+    \a iMaxConcurrentRequests is the number of requests a client may have in process at the same time.
+*/
+CHTTPRateLimiter::CHTTPRateLimiter(int iWindowSeconds, int iRequestsPerSecond, int iMaxConcurrentRequests)
+    : m_iWindowSeconds(iWindowSeconds)
+    , m_iRequestsPerSecond(iRequestsPerSecond)
+    , m_iMaxConcurrentRequests(iMaxConcurrentRequests)
+    , m_iIdleTimeoutMS(60 * 1000)
+    , m_iBanDurationMS(10 * 60 * 1000)
+{
+    m_tClock.start();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CHTTPRateLimiter.
+*/
+CHTTPRateLimiter::~CHTTPRateLimiter()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the window over which bursts are allowed to \a iSeconds.
+*/
+void CHTTPRateLimiter::setWindow(int iSeconds)
+{
+    m_iWindowSeconds = qMax(1, iSeconds);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the sustained number of requests per second allowed for a client to \a iValue.
+*/
+void CHTTPRateLimiter::setRequestsPerSecond(int iValue)
+{
+    m_iRequestsPerSecond = qMax(1, iValue);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the number of requests a client may have in process at the same time to \a iValue.
+*/
+void CHTTPRateLimiter::setMaxConcurrentRequests(int iValue)
+{
+    m_iMaxConcurrentRequests = qMax(1, iValue);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the time after which an idle client is forgotten to \a iSeconds.
+*/
+void CHTTPRateLimiter::setIdleTimeout(int iSeconds)
+{
+    m_iIdleTimeoutMS = qMax(1, iSeconds) * 1000;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the time a flooding client stays blacklisted to \a iSeconds, ten minutes by default. \br\br
+    0 keeps it blacklisted forever : banned clients are then never forgotten, so a flood from many addresses
+    makes memory use grow without bound.
+*/
+void CHTTPRateLimiter::setBanDuration(int iSeconds)
+{
+    m_iBanDurationMS = qMax(0, iSeconds) * 1000;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the window over which bursts are allowed, in seconds.
+*/
+int CHTTPRateLimiter::window() const
+{
+    return m_iWindowSeconds;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the sustained number of requests per second allowed for a client.
+*/
+int CHTTPRateLimiter::requestsPerSecond() const
+{
+    return m_iRequestsPerSecond;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of requests a client may have in process at the same time.
+*/
+int CHTTPRateLimiter::maxConcurrentRequests() const
+{
+    return m_iMaxConcurrentRequests;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of clients currently tracked, blacklisted ones included.
+*/
+int CHTTPRateLimiter::count() const
+{
+    int iCount = 0;
+
+    for (int iIndex = 0; iIndex < RATE_LIMITER_SHARDS; iIndex++)
+    {
+        QMutexLocker locker(&m_aShards[iIndex].m_mMutex);
+
+        iCount += m_aShards[iIndex].m_hClients.count();
+    }
+
+    return iCount;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Adds \a tAddress to the static black list.
+*/
+void CHTTPRateLimiter::addToBlackList(const QHostAddress& tAddress)
+{
+    QWriteLocker locker(&m_lStaticLock);
+
+    m_sStaticBlackList.insert(normalize(tAddress));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Removes \a tAddress from the static black list.
+*/
+void CHTTPRateLimiter::removeFromBlackList(const QHostAddress& tAddress)
+{
+    QWriteLocker locker(&m_lStaticLock);
+
+    m_sStaticBlackList.remove(normalize(tAddress));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if requests from \a tAddress must be rejected, either because it is in the static
+    black list or because it has been blacklisted for flooding.
+*/
+bool CHTTPRateLimiter::isBlocked(const QHostAddress& tAddress)
+{
+    QHostAddress tKey = normalize(tAddress);
+
+    {
+        QReadLocker locker(&m_lStaticLock);
+
+        if (m_sStaticBlackList.contains(tKey))
+        {
+            return true;
+        }
+    }
+
+    CShard& tShard = shardOf(tKey);
+    QMutexLocker locker(&tShard.m_mMutex);
+
+    QHash<QHostAddress, CClient>::const_iterator iClient = tShard.m_hClients.constFind(tKey);
+
+    if (iClient != tShard.m_hClients.constEnd())
+    {
+        qint64 iBannedUntil = iClient.value().m_iBannedUntil;
+
+        return iBannedUntil == 0 || (iBannedUntil > 0 && m_tClock.elapsed() < iBannedUntil);
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records the start of a request from \a tAddress. \br\br
+    Returns \c false if the client has exceeded its request rate or its number of concurrent requests.
+    The client is then blacklisted. \br
+    Each call must be matched by a call to requestOut().
+*/
+bool CHTTPRateLimiter::requestIn(const QHostAddress& tAddress)
+{
+    QHostAddress tKey = normalize(tAddress);
+    CShard& tShard = shardOf(tKey);
+    qint64 iNow = m_tClock.elapsed();
+
+    QMutexLocker locker(&tShard.m_mMutex);
+
+    // Forget idle clients from time to time
+    if (iNow - tShard.m_iLastSweep > m_iIdleTimeoutMS)
+    {
+        sweep(tShard, iNow);
+    }
+
+    bool bNew = tShard.m_hClients.contains(tKey) == false;
+    CClient& tClient = tShard.m_hClients[tKey];
+
+    if (bNew)
+    {
+        tClient.m_dTokens = (double) (m_iWindowSeconds * m_iRequestsPerSecond);
+        tClient.m_iLastRefill = iNow;
+    }
+
+    tClient.m_iLastSeen = iNow;
+    tClient.m_iConcurrentRequests++;
+
+    // Is the client banned?
+    if (tClient.m_iBannedUntil == 0 || (tClient.m_iBannedUntil > 0 && iNow < tClient.m_iBannedUntil))
+    {
+        return false;
+    }
+
+    if (tClient.m_iBannedUntil > 0)
+    {
+        // The ban is over, start again with a full bucket
+        tClient.m_iBannedUntil = -1;
+        tClient.m_dTokens = (double) (m_iWindowSeconds * m_iRequestsPerSecond);
+        tClient.m_iLastRefill = iNow;
+    }
+
+    refill(tClient, iNow);
+
+    tClient.m_dTokens -= 1.0;
+
+    if (tClient.m_dTokens < 0.0 || tClient.m_iConcurrentRequests > m_iMaxConcurrentRequests)
+    {
+        qDebug() << QString("Blacklisting %1").arg(tKey.toString());
+
+        tClient.m_iBannedUntil = m_iBanDurationMS > 0 ? iNow + m_iBanDurationMS : 0;
+
+        return false;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Records the end of a request from \a tAddress.
+*/
+void CHTTPRateLimiter::requestOut(const QHostAddress& tAddress)
+{
+    QHostAddress tKey = normalize(tAddress);
+    CShard& tShard = shardOf(tKey);
+
+    QMutexLocker locker(&tShard.m_mMutex);
+
+    QHash<QHostAddress, CClient>::iterator iClient = tShard.m_hClients.find(tKey);
+
+    if (iClient != tShard.m_hClients.end() && iClient.value().m_iConcurrentRequests > 0)
+    {
+        iClient.value().m_iConcurrentRequests--;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Forgets all clients that have been idle for longer than the idle timeout.
+*/
+void CHTTPRateLimiter::expire()
+{
+    qint64 iNow = m_tClock.elapsed();
+
+    for (int iIndex = 0; iIndex < RATE_LIMITER_SHARDS; iIndex++)
+    {
+        QMutexLocker locker(&m_aShards[iIndex].m_mMutex);
+
+        sweep(m_aShards[iIndex], iNow);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Forgets all clients, including blacklisted ones. The static black list is kept.
+*/
+void CHTTPRateLimiter::clear()
+{
+    for (int iIndex = 0; iIndex < RATE_LIMITER_SHARDS; iIndex++)
+    {
+        QMutexLocker locker(&m_aShards[iIndex].m_mMutex);
+
+        m_aShards[iIndex].m_hClients.clear();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \a tAddress as a plain IPv4 address if it is an IPv4-mapped IPv6 address (::ffff:a.b.c.d),
+    so that a client gets the same entry whatever the socket's protocol.
+*/
+QHostAddress CHTTPRateLimiter::normalize(const QHostAddress& tAddress)
+{
+    if (tAddress.protocol() == QAbstractSocket::IPv6Protocol)
+    {
+        bool bIsIPv4 = false;
+        quint32 uIPv4 = tAddress.toIPv4Address(&bIsIPv4);
+
+        if (bIsIPv4)
+        {
+            return QHostAddress(uIPv4);
+        }
+    }
+
+    return tAddress;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the shard holding \a tAddress.
+*/
+CHTTPRateLimiter::CShard& CHTTPRateLimiter::shardOf(const QHostAddress& tAddress)
+{
+    return m_aShards[qHash(tAddress) % RATE_LIMITER_SHARDS];
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Adds to the bucket of \a tClient the tokens earned since its last refill, \a iNow being the current time.
+*/
+void CHTTPRateLimiter::refill(CClient& tClient, qint64 iNow) const
+{
+    double dCapacity = (double) (m_iWindowSeconds * m_iRequestsPerSecond);
+    double dEarned = (double) (iNow - tClient.m_iLastRefill) * (double) m_iRequestsPerSecond / 1000.0;
+
+    tClient.m_dTokens = qMin(dCapacity, tClient.m_dTokens + dEarned);
+    tClient.m_iLastRefill = iNow;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Removes from \a tShard the clients that are idle, have no request in process and are not blacklisted.
+    \a iNow is the current time. The shard's mutex must be locked by the caller.
+*/
+void CHTTPRateLimiter::sweep(CShard& tShard, qint64 iNow)
+{
+    QHash<QHostAddress, CClient>::iterator iClient = tShard.m_hClients.begin();
+
+    while (iClient != tShard.m_hClients.end())
+    {
+        const CClient& tClient = iClient.value();
+        bool bBanned = tClient.m_iBannedUntil == 0 || (tClient.m_iBannedUntil > 0 && iNow < tClient.m_iBannedUntil);
+
+        if (bBanned == false && tClient.m_iConcurrentRequests == 0 && iNow - tClient.m_iLastSeen > m_iIdleTimeoutMS)
+        {
+            iClient = tShard.m_hClients.erase(iClient);
+        }
+        else
+        {
+            ++iClient;
+        }
+    }
+
+    tShard.m_iLastSweep = iNow;
+}
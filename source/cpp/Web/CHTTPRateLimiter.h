@@ -0,0 +1,172 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QHostAddress>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QElapsedTimer>
+
+//-------------------------------------------------------------------------------------------------
+
+#define RATE_LIMITER_SHARDS     16
+
+//-------------------------------------------------------------------------------------------------
+
+//! Defines a per-IP token bucket rate limiter, used by CHTTPServer as flood protection
+//! Clients are spread over independently locked shards so that concurrent requests rarely contend
+class QTPLUSSHARED_EXPORT CHTTPRateLimiter
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Inner classes
+    //-------------------------------------------------------------------------------------------------
+
+    //! State of one client address
+    class CClient
+    {
+    public:
+
+        CClient()
+            : m_dTokens(0.0)
+            , m_iLastRefill(0)
+            , m_iLastSeen(0)
+            , m_iBannedUntil(-1)
+            , m_iConcurrentRequests(0)
+        {
+        }
+
+        double  m_dTokens;                  // Requests the client may still issue
+        qint64  m_iLastRefill;              // Time of the last refill of m_dTokens, in milliseconds
+        qint64  m_iLastSeen;                // Time of the last request, in milliseconds
+        qint64  m_iBannedUntil;             // -1 if not banned, 0 if banned forever, else end of ban in milliseconds
+        int     m_iConcurrentRequests;      // Requests currently being processed
+    };
+
+    //! A part of the client table, with its own lock
+    class CShard
+    {
+    public:
+
+        CShard()
+            : m_iLastSweep(0)
+        {
+        }
+
+        mutable QMutex                  m_mMutex;
+        QHash<QHostAddress, CClient>    m_hClients;
+        qint64                          m_iLastSweep;
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor
+    CHTTPRateLimiter(int iWindowSeconds = 4, int iRequestsPerSecond = 15, int iMaxConcurrentRequests = 15);
+
+    //! Destructor
+    virtual ~CHTTPRateLimiter();
+
+    //-------------------------------------------------------------------------------------------------
+    // Setters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Sets the window over which bursts are allowed, in seconds
+    void setWindow(int iSeconds);
+
+    //! Sets the sustained number of requests per second allowed for a client
+    void setRequestsPerSecond(int iValue);
+
+    //! Sets the number of requests a client may have in process at the same time
+    void setMaxConcurrentRequests(int iValue);
+
+    //! Sets the time after which an idle client is forgotten, in seconds
+    void setIdleTimeout(int iSeconds);
+
+    //! Sets the time a flooding client stays blacklisted, in seconds (600 by default), 0 meaning forever
+    void setBanDuration(int iSeconds);
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the window over which bursts are allowed, in seconds
+    int window() const;
+
+    //! Returns the sustained number of requests per second allowed for a client
+    int requestsPerSecond() const;
+
+    //! Returns the number of requests a client may have in process at the same time
+    int maxConcurrentRequests() const;
+
+    //! Returns the number of clients currently tracked
+    int count() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Adds an address to the static black list
+    void addToBlackList(const QHostAddress& tAddress);
+
+    //! Removes an address from the static black list
+    void removeFromBlackList(const QHostAddress& tAddress);
+
+    //! Returns true if requests from tAddress must be rejected
+    bool isBlocked(const QHostAddress& tAddress);
+
+    //! Records the start of a request, returns false if the client exceeds its limits (it is then blacklisted)
+    bool requestIn(const QHostAddress& tAddress);
+
+    //! Records the end of a request
+    void requestOut(const QHostAddress& tAddress);
+
+    //! Forgets all idle clients
+    void expire();
+
+    //! Forgets all clients, including blacklisted ones
+    void clear();
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns tAddress as a plain IPv4 address if it is an IPv4-mapped IPv6 address
+    static QHostAddress normalize(const QHostAddress& tAddress);
+
+    //-------------------------------------------------------------------------------------------------
+    // Protected methods
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Returns the shard holding tAddress
+    CShard& shardOf(const QHostAddress& tAddress);
+
+    //! Refills the token bucket of a client
+    void refill(CClient& tClient, qint64 iNow) const;
+
+    //! Removes the idle clients of a shard, its mutex must be locked
+    void sweep(CShard& tShard, qint64 iNow);
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    QElapsedTimer           m_tClock;                   // Monotonic time base
+    QReadWriteLock          m_lStaticLock;              // Protects m_sStaticBlackList
+    QSet<QHostAddress>      m_sStaticBlackList;         // Addresses always rejected
+    CShard                  m_aShards[RATE_LIMITER_SHARDS];
+    int                     m_iWindowSeconds;
+    int                     m_iRequestsPerSecond;
+    int                     m_iMaxConcurrentRequests;
+    int                     m_iIdleTimeoutMS;
+    int                     m_iBanDurationMS;
+};
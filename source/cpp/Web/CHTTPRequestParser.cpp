@@ -0,0 +1,758 @@
+
+// Std
+#include <cstring>
+
+// Application
+#include "CHTTPRequestParser.h"
+#include "CHTTPServer.h"
+
+//-------------------------------------------------------------------------------------------------
+
+// Maximum size of request line and headers
+#define MAX_HEADER_SIZE     (1024 * 64)
+
+// Maximum number of headers in a request
+#define MAX_HEADER_COUNT    100
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CHTTPRequestParser
+    \inmodule qt-plus
+    \brief An incremental HTTP request parser.
+
+    The parser is fed with a client's receive buffer each time new bytes arrive, and resumes where it
+    stopped on the previous call. It never copies the buffer: the method, path, query, headers and body
+    are stored as offsets and returned as views (see QByteArray::fromRawData()) into the buffer given to
+    the getters. \br\br
+    The views are valid as long as the buffer is not modified, so callers that need to keep a value
+    must make a deep copy of it. \br\br
+    Both "\r\n" and "\n" line endings are accepted. A request line without HTTP version (like "GET /path")
+    is treated as a complete HTTP/0.9 simple request.
+    \sa CHTTPServer
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+static bool isSpace(char cValue)
+{
+    return cValue == ' ' || cValue == '\t';
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CHTTPRequestParser.
+*/
+CHTTPRequestParser::CHTTPRequestParser()
+{
+    reset();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CHTTPRequestParser.
+*/
+CHTTPRequestParser::~CHTTPRequestParser()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Resets the parser so that it is ready for a new request.
+*/
+void CHTTPRequestParser::reset()
+{
+    m_eState = eRequestLine;
+    m_iPosition = 0;
+    m_iHeaderLength = 0;
+    m_iContentLength = -1;
+    m_iBodyLength = 0;
+    m_iBodyConsumed = 0;
+    m_iSearchPosition = 0;
+    m_tMethod = CSpan();
+    m_tTarget = CSpan();
+    m_tPath = CSpan();
+    m_tQuery = CSpan();
+    m_tVersion = CSpan();
+    m_vHeaders.resize(0);
+    m_baClosingBoundary.clear();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Parses the bytes of \a baBuffer that were not parsed yet and returns the new state. \br\br
+    \a baBuffer must hold the bytes given in previous calls, unchanged, followed by new bytes.
+*/
+CHTTPRequestParser::EState CHTTPRequestParser::parse(const QByteArray& baBuffer)
+{
+    const char* pData = baBuffer.constData();
+    int iSize = baBuffer.size();
+
+    while (m_eState == eRequestLine || m_eState == eHeaders)
+    {
+        // Look for the end of the current line
+        const char* pEndOfLine = (const char*) memchr(pData + m_iPosition, '\n', iSize - m_iPosition);
+
+        if (pEndOfLine == nullptr)
+        {
+            // Wait for more bytes, unless the header is too big
+            if (iSize > MAX_HEADER_SIZE)
+            {
+                m_eState = eError;
+            }
+
+            return m_eState;
+        }
+
+        int iLineStart = m_iPosition;
+        int iLineEnd = (int) (pEndOfLine - pData);
+
+        m_iPosition = iLineEnd + 1;
+
+        if (iLineEnd > iLineStart && pData[iLineEnd - 1] == '\r')
+        {
+            iLineEnd--;
+        }
+
+        if (m_eState == eRequestLine)
+        {
+            parseRequestLine(pData, iLineStart, iLineEnd);
+        }
+        else
+        {
+            parseHeaderLine(baBuffer, iLineStart, iLineEnd);
+        }
+    }
+
+    if (m_eState == eBody)
+    {
+        parseBody(baBuffer);
+    }
+
+    return m_eState;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Tells the parser that the first \a iBytes bytes of the body were removed from the buffer. \br\br
+    This lets a consumer process a large body as it arrives instead of keeping it in the buffer.
+    The offsets of the request line and headers are not affected.
+*/
+void CHTTPRequestParser::consumeBody(int iBytes)
+{
+    m_iBodyConsumed += iBytes;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Parses the request line located between \a iStart and \a iEnd in \a pData.
+*/
+void CHTTPRequestParser::parseRequestLine(const char* pData, int iStart, int iEnd)
+{
+    // Empty lines before the request line are ignored
+    if (iStart == iEnd)
+    {
+        return;
+    }
+
+    int iPosition = iStart;
+
+    // Method
+    while (iPosition < iEnd && isSpace(pData[iPosition]) == false) iPosition++;
+    m_tMethod = CSpan(iStart, iPosition - iStart);
+    while (iPosition < iEnd && isSpace(pData[iPosition])) iPosition++;
+
+    // Target
+    int iTargetStart = iPosition;
+    while (iPosition < iEnd && isSpace(pData[iPosition]) == false) iPosition++;
+    m_tTarget = CSpan(iTargetStart, iPosition - iTargetStart);
+    while (iPosition < iEnd && isSpace(pData[iPosition])) iPosition++;
+
+    // Version
+    int iVersionEnd = iEnd;
+    while (iVersionEnd > iPosition && isSpace(pData[iVersionEnd - 1])) iVersionEnd--;
+    m_tVersion = CSpan(iPosition, iVersionEnd - iPosition);
+
+    if (m_tMethod.m_iLength == 0 || m_tTarget.m_iLength == 0)
+    {
+        m_eState = eError;
+        return;
+    }
+
+    // Split the target in path and query
+    const char* pTarget = pData + m_tTarget.m_iOffset;
+    const char* pQuestion = (const char*) memchr(pTarget, '?', m_tTarget.m_iLength);
+
+    if (pQuestion != nullptr)
+    {
+        int iPathLength = (int) (pQuestion - pTarget);
+
+        m_tPath = CSpan(m_tTarget.m_iOffset, iPathLength);
+        m_tQuery = CSpan(m_tTarget.m_iOffset + iPathLength + 1, m_tTarget.m_iLength - iPathLength - 1);
+    }
+    else
+    {
+        m_tPath = m_tTarget;
+        m_tQuery = CSpan(m_tTarget.m_iOffset + m_tTarget.m_iLength, 0);
+    }
+
+    if (m_tVersion.m_iLength == 0)
+    {
+        // No version : this is a simple request, without headers nor body
+        m_iHeaderLength = m_iPosition;
+        m_eState = eComplete;
+    }
+    else
+    {
+        m_eState = eHeaders;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Parses the header line located between \a iStart and \a iEnd in \a baBuffer.
+*/
+void CHTTPRequestParser::parseHeaderLine(const QByteArray& baBuffer, int iStart, int iEnd)
+{
+    const char* pData = baBuffer.constData();
+
+    // An empty line ends the headers
+    if (iStart == iEnd)
+    {
+        endOfHeaders(baBuffer);
+        return;
+    }
+
+    // A line starting with a space continues the previous value (obsolete line folding)
+    if (isSpace(pData[iStart]) && m_vHeaders.count() > 0)
+    {
+        while (iEnd > iStart && isSpace(pData[iEnd - 1])) iEnd--;
+
+        CSpan& tValue = m_vHeaders.last().m_tValue;
+        tValue.m_iLength = iEnd - tValue.m_iOffset;
+        return;
+    }
+
+    const char* pColon = (const char*) memchr(pData + iStart, ':', iEnd - iStart);
+
+    if (pColon == nullptr || m_vHeaders.count() >= MAX_HEADER_COUNT)
+    {
+        m_eState = eError;
+        return;
+    }
+
+    int iNameEnd = (int) (pColon - pData);
+    int iValueStart = iNameEnd + 1;
+
+    while (iNameEnd > iStart && isSpace(pData[iNameEnd - 1])) iNameEnd--;
+    while (iValueStart < iEnd && isSpace(pData[iValueStart])) iValueStart++;
+    while (iEnd > iValueStart && isSpace(pData[iEnd - 1])) iEnd--;
+
+    CHeader tHeader;
+    tHeader.m_tName = CSpan(iStart, iNameEnd - iStart);
+    tHeader.m_tValue = CSpan(iValueStart, iEnd - iValueStart);
+
+    m_vHeaders.append(tHeader);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Decides how the body of the request in \a baBuffer is delimited.
+*/
+void CHTTPRequestParser::endOfHeaders(const QByteArray& baBuffer)
+{
+    m_iHeaderLength = m_iPosition;
+    m_iSearchPosition = m_iPosition;
+
+    QByteArray baContentLength = headerValue(baBuffer, Token_ContentLength);
+
+    if (baContentLength.isEmpty() == false)
+    {
+        bool bOK = false;
+
+        m_iContentLength = baContentLength.toInt(&bOK);
+
+        if (bOK == false || m_iContentLength < 0)
+        {
+            m_eState = eError;
+            return;
+        }
+    }
+
+    if (m_iContentLength > 0)
+    {
+        m_eState = eBody;
+    }
+    else if (m_iContentLength < 0 && multipartBoundary(baBuffer).isEmpty() == false)
+    {
+        // No content length : the body ends with the closing boundary
+        m_baClosingBoundary = "--" + multipartBoundary(baBuffer) + "--";
+        m_eState = eBody;
+    }
+    else
+    {
+        m_iBodyLength = 0;
+        m_eState = eComplete;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Checks whether the body of the request is entirely in \a baBuffer.
+*/
+void CHTTPRequestParser::parseBody(const QByteArray& baBuffer)
+{
+    int iAvailable = baBuffer.size() - m_iHeaderLength + m_iBodyConsumed;
+
+    if (m_iContentLength >= 0)
+    {
+        if (iAvailable >= m_iContentLength)
+        {
+            m_iBodyLength = m_iContentLength;
+            m_eState = eComplete;
+        }
+    }
+    else
+    {
+        int iIndex = baBuffer.indexOf(m_baClosingBoundary, m_iSearchPosition);
+
+        if (iIndex >= 0)
+        {
+            int iEnd = iIndex + m_baClosingBoundary.size();
+
+            // Include the line ending after the closing boundary, if present
+            if (iEnd < baBuffer.size() && baBuffer[iEnd] == '\r') iEnd++;
+            if (iEnd < baBuffer.size() && baBuffer[iEnd] == '\n') iEnd++;
+
+            m_iBodyLength = iEnd - m_iHeaderLength;
+            m_eState = eComplete;
+        }
+        else
+        {
+            // Resume the search where a partial marker may start
+            m_iSearchPosition = qMax(m_iHeaderLength, baBuffer.size() - m_baClosingBoundary.size() + 1);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the current state of the parser.
+*/
+CHTTPRequestParser::EState CHTTPRequestParser::state() const
+{
+    return m_eState;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if the request line and all headers have been parsed.
+*/
+bool CHTTPRequestParser::isHeaderComplete() const
+{
+    return m_eState == eBody || m_eState == eComplete;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if the whole request has been received.
+*/
+bool CHTTPRequestParser::isComplete() const
+{
+    return m_eState == eComplete;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if the request line had no HTTP version.
+*/
+bool CHTTPRequestParser::isSimpleRequest() const
+{
+    return isHeaderComplete() && m_tVersion.m_iLength == 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of bytes used by the request line and the headers.
+*/
+int CHTTPRequestParser::headerLength() const
+{
+    return m_iHeaderLength;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the value of the Content-Length header, or -1 if there is none.
+*/
+int CHTTPRequestParser::contentLength() const
+{
+    return m_iContentLength;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of bytes in the body. Valid when the request is complete.
+*/
+int CHTTPRequestParser::bodyLength() const
+{
+    return m_iBodyLength;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of body bytes that were removed from the buffer with consumeBody().
+*/
+int CHTTPRequestParser::bodyConsumed() const
+{
+    return m_iBodyConsumed;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of bytes used by the whole request in the buffer, that is without the body bytes
+    removed with consumeBody(). Valid when the request is complete.
+*/
+int CHTTPRequestParser::requestLength() const
+{
+    return m_iHeaderLength + m_iBodyLength - m_iBodyConsumed;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the request method in \a baBuffer.
+*/
+QByteArray CHTTPRequestParser::method(const QByteArray& baBuffer) const
+{
+    return view(baBuffer, m_tMethod);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the request target in \a baBuffer.
+*/
+QByteArray CHTTPRequestParser::target(const QByteArray& baBuffer) const
+{
+    return view(baBuffer, m_tTarget);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the path of the request target in \a baBuffer.
+*/
+QByteArray CHTTPRequestParser::path(const QByteArray& baBuffer) const
+{
+    return view(baBuffer, m_tPath);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the query of the request target in \a baBuffer (what follows the '?').
+*/
+QByteArray CHTTPRequestParser::query(const QByteArray& baBuffer) const
+{
+    return view(baBuffer, m_tQuery);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the HTTP version of the request in \a baBuffer.
+*/
+QByteArray CHTTPRequestParser::version(const QByteArray& baBuffer) const
+{
+    return view(baBuffer, m_tVersion);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of parsed headers.
+*/
+int CHTTPRequestParser::headerCount() const
+{
+    return m_vHeaders.count();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the name of the header at \a iIndex in \a baBuffer.
+*/
+QByteArray CHTTPRequestParser::headerName(const QByteArray& baBuffer, int iIndex) const
+{
+    if (iIndex >= 0 && iIndex < m_vHeaders.count())
+    {
+        return view(baBuffer, m_vHeaders[iIndex].m_tName);
+    }
+
+    return QByteArray();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the value of the header at \a iIndex in \a baBuffer.
+*/
+QByteArray CHTTPRequestParser::headerValue(const QByteArray& baBuffer, int iIndex) const
+{
+    if (iIndex >= 0 && iIndex < m_vHeaders.count())
+    {
+        return view(baBuffer, m_vHeaders[iIndex].m_tValue);
+    }
+
+    return QByteArray();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the value of the header named \a szName in \a baBuffer. \br\br
+    The name is case insensitive and may end with a colon, so that the \c Token_ constants
+    of CHTTPServer can be used.
+*/
+QByteArray CHTTPRequestParser::headerValue(const QByteArray& baBuffer, const char* szName) const
+{
+    int iNameLength = (int) qstrlen(szName);
+
+    if (iNameLength > 0 && szName[iNameLength - 1] == ':')
+    {
+        iNameLength--;
+    }
+
+    const char* pData = baBuffer.constData();
+
+    foreach (const CHeader& tHeader, m_vHeaders)
+    {
+        if (tHeader.m_tName.m_iLength == iNameLength)
+        {
+            if (qstrnicmp(pData + tHeader.m_tName.m_iOffset, szName, (uint) iNameLength) == 0)
+            {
+                return view(baBuffer, tHeader.m_tValue);
+            }
+        }
+    }
+
+    return QByteArray();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if the request in \a baBuffer has a header named \a szName.
+*/
+bool CHTTPRequestParser::hasHeader(const QByteArray& baBuffer, const char* szName) const
+{
+    return headerValue(baBuffer, szName).isNull() == false;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the body of the request in \a baBuffer. Valid when the request is complete.
+*/
+QByteArray CHTTPRequestParser::body(const QByteArray& baBuffer) const
+{
+    return view(baBuffer, CSpan(m_iHeaderLength, m_iBodyLength - m_iBodyConsumed));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the bytes of the body that are in \a baBuffer and were not consumed yet. \br\br
+    Only bodies with a content length can be consumed while they arrive, an empty array is returned for others.
+*/
+QByteArray CHTTPRequestParser::pendingBody(const QByteArray& baBuffer) const
+{
+    if (isHeaderComplete() == false || m_iContentLength < 0)
+    {
+        return QByteArray();
+    }
+
+    int iLength = qMin(baBuffer.size() - m_iHeaderLength, m_iContentLength - m_iBodyConsumed);
+
+    return view(baBuffer, CSpan(m_iHeaderLength, qMax(iLength, 0)));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the multipart boundary of the request in \a baBuffer, or an empty array if the
+    request is not multipart.
+*/
+QByteArray CHTTPRequestParser::multipartBoundary(const QByteArray& baBuffer) const
+{
+    QByteArray baContentType = headerValue(baBuffer, Token_ContentType);
+
+    if (baContentType.startsWith(MIME_Content_MultiPart))
+    {
+        return subValue(baContentType, Token_boundary);
+    }
+
+    return QByteArray();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Fills \a lPath with the components of the requested path in \a baBuffer, and \a mArguments with
+    the URL arguments.
+*/
+void CHTTPRequestParser::getPathAndArguments(const QByteArray& baBuffer, QStringList& lPath, QMap<QString, QString>& mArguments) const
+{
+    const char* pPath = baBuffer.constData() + m_tPath.m_iOffset;
+    int iLength = m_tPath.m_iLength;
+    int iStart = 0;
+
+    for (int iIndex = 0; iIndex <= iLength; iIndex++)
+    {
+        if (iIndex == iLength || pPath[iIndex] == '/')
+        {
+            if (iIndex > iStart)
+            {
+                lPath << QString::fromUtf8(pPath + iStart, iIndex - iStart);
+            }
+
+            iStart = iIndex + 1;
+        }
+    }
+
+    parseArguments(baBuffer.constData() + m_tQuery.m_iOffset, m_tQuery.m_iLength, mArguments);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns a view on the bytes of \a baBuffer designated by \a tSpan. \br\br
+    The returned array does not own its data.
+*/
+QByteArray CHTTPRequestParser::view(const QByteArray& baBuffer, const CSpan& tSpan)
+{
+    if (tSpan.m_iOffset < 0 || tSpan.m_iLength < 0 || tSpan.m_iOffset + tSpan.m_iLength > baBuffer.size())
+    {
+        return QByteArray();
+    }
+
+    if (tSpan.m_iLength == 0)
+    {
+        return QByteArray("");
+    }
+
+    return QByteArray::fromRawData(baBuffer.constData() + tSpan.m_iOffset, tSpan.m_iLength);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the value of the sub-token named \a szName in \a baValue. \br\br
+    For instance, with \a baValue equal to 'multipart/form-data; boundary="xyz"' and \a szName
+    equal to 'boundary', returns 'xyz'.
+*/
+QByteArray CHTTPRequestParser::subValue(const QByteArray& baValue, const char* szName)
+{
+    const char* pData = baValue.constData();
+    int iSize = baValue.size();
+    int iNameLength = (int) qstrlen(szName);
+    int iPosition = 0;
+
+    while (iPosition < iSize)
+    {
+        // Find the end of this sub-token
+        int iEnd = iPosition;
+        while (iEnd < iSize && pData[iEnd] != ';') iEnd++;
+
+        int iStart = iPosition;
+        while (iStart < iEnd && isSpace(pData[iStart])) iStart++;
+
+        if (iEnd - iStart > iNameLength && qstrnicmp(pData + iStart, szName, (uint) iNameLength) == 0)
+        {
+            int iEqual = iStart + iNameLength;
+            while (iEqual < iEnd && isSpace(pData[iEqual])) iEqual++;
+
+            if (iEqual < iEnd && pData[iEqual] == '=')
+            {
+                int iValueStart = iEqual + 1;
+                int iValueEnd = iEnd;
+
+                while (iValueStart < iValueEnd && isSpace(pData[iValueStart])) iValueStart++;
+                while (iValueEnd > iValueStart && isSpace(pData[iValueEnd - 1])) iValueEnd--;
+
+                if (iValueEnd - iValueStart >= 2 && pData[iValueStart] == '"' && pData[iValueEnd - 1] == '"')
+                {
+                    iValueStart++;
+                    iValueEnd--;
+                }
+
+                return QByteArray::fromRawData(pData + iValueStart, iValueEnd - iValueStart);
+            }
+        }
+
+        iPosition = iEnd + 1;
+    }
+
+    return QByteArray();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if \a baValue is equal to \a szText, ignoring case. \br\br
+    \a baValue does not need to be null-terminated.
+*/
+bool CHTTPRequestParser::isEqual(const QByteArray& baValue, const char* szText)
+{
+    int iLength = (int) qstrlen(szText);
+
+    return baValue.size() == iLength && qstrnicmp(baValue.constData(), szText, (uint) iLength) == 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Parses the URL encoded arguments in \a pData, which has a size of \a iLength. \br\br
+    Each argument found is inserted in \a mArguments.
+*/
+void CHTTPRequestParser::parseArguments(const char* pData, int iLength, QMap<QString, QString>& mArguments)
+{
+    int iStart = 0;
+
+    for (int iIndex = 0; iIndex <= iLength; iIndex++)
+    {
+        if (iIndex == iLength || pData[iIndex] == '&')
+        {
+            const char* pArgument = pData + iStart;
+            int iArgumentLength = iIndex - iStart;
+            const char* pEqual = (const char*) memchr(pArgument, '=', iArgumentLength);
+
+            if (pEqual != nullptr)
+            {
+                int iNameLength = (int) (pEqual - pArgument);
+
+                mArguments[QString::fromUtf8(pArgument, iNameLength)] = QString::fromUtf8(pEqual + 1, iArgumentLength - iNameLength - 1);
+            }
+
+            iStart = iIndex + 1;
+        }
+    }
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QMap>
+
+//-------------------------------------------------------------------------------------------------
+
+//! Defines an incremental HTTP request parser
+//! The parser works on a client's receive buffer and never copies it,
+//! all parsed items are kept as offsets into that buffer
+class QTPLUSSHARED_EXPORT CHTTPRequestParser
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Enumerators
+    //-------------------------------------------------------------------------------------------------
+
+    enum EState
+    {
+        eRequestLine,
+        eHeaders,
+        eBody,
+        eComplete,
+        eError
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Inner classes
+    //-------------------------------------------------------------------------------------------------
+
+    //! A range of bytes in the parsed buffer
+    class CSpan
+    {
+    public:
+
+        CSpan()
+            : m_iOffset(0)
+            , m_iLength(0)
+        {
+        }
+
+        CSpan(int iOffset, int iLength)
+            : m_iOffset(iOffset)
+            , m_iLength(iLength)
+        {
+        }
+
+        int m_iOffset;
+        int m_iLength;
+    };
+
+    //! A header name and its value
+    class CHeader
+    {
+    public:
+
+        CSpan   m_tName;
+        CSpan   m_tValue;
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Default constructor
+    CHTTPRequestParser();
+
+    //! Destructor
+    virtual ~CHTTPRequestParser();
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Resets the parser, ready to parse a new request
+    void reset();
+
+    //! Parses any new bytes in baBuffer, resuming where the previous call stopped
+    EState parse(const QByteArray& baBuffer);
+
+    //! Tells the parser that iBytes at the start of the body were removed from the buffer by a streaming consumer
+    void consumeBody(int iBytes);
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the current state
+    EState state() const;
+
+    //! Returns true if the request line and headers are parsed
+    bool isHeaderComplete() const;
+
+    //! Returns true if the whole request is available
+    bool isComplete() const;
+
+    //! Returns true if the request has no HTTP version (HTTP/0.9 simple request)
+    bool isSimpleRequest() const;
+
+    //! Returns the size of the request line and headers
+    int headerLength() const;
+
+    //! Returns the announced content length, -1 if none
+    int contentLength() const;
+
+    //! Returns the size of the body, once the request is complete
+    int bodyLength() const;
+
+    //! Returns the number of body bytes removed from the buffer with consumeBody()
+    int bodyConsumed() const;
+
+    //! Returns the size of the whole request in the buffer, once complete
+    int requestLength() const;
+
+    //! Returns the method
+    QByteArray method(const QByteArray& baBuffer) const;
+
+    //! Returns the request target (path and query)
+    QByteArray target(const QByteArray& baBuffer) const;
+
+    //! Returns the path part of the target
+    QByteArray path(const QByteArray& baBuffer) const;
+
+    //! Returns the query part of the target
+    QByteArray query(const QByteArray& baBuffer) const;
+
+    //! Returns the HTTP version
+    QByteArray version(const QByteArray& baBuffer) const;
+
+    //! Returns the number of headers
+    int headerCount() const;
+
+    //! Returns the name of a header
+    QByteArray headerName(const QByteArray& baBuffer, int iIndex) const;
+
+    //! Returns the value of a header
+    QByteArray headerValue(const QByteArray& baBuffer, int iIndex) const;
+
+    //! Returns the value of a header given its name
+    QByteArray headerValue(const QByteArray& baBuffer, const char* szName) const;
+
+    //! Returns true if a header exists
+    bool hasHeader(const QByteArray& baBuffer, const char* szName) const;
+
+    //! Returns the body
+    QByteArray body(const QByteArray& baBuffer) const;
+
+    //! Returns the bytes of the body received so far and not consumed, if the body has a content length
+    QByteArray pendingBody(const QByteArray& baBuffer) const;
+
+    //! Returns the multipart boundary, if any
+    QByteArray multipartBoundary(const QByteArray& baBuffer) const;
+
+    //! Fills the path components and URL arguments
+    void getPathAndArguments(const QByteArray& baBuffer, QStringList& lPath, QMap<QString, QString>& mArguments) const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns a view on a span of a buffer
+    static QByteArray view(const QByteArray& baBuffer, const CSpan& tSpan);
+
+    //! Returns a sub-value in a header value (like 'boundary' in 'multipart/form-data; boundary=xxx')
+    static QByteArray subValue(const QByteArray& baValue, const char* szName);
+
+    //! Returns true if baValue is equal to szText, case insensitive
+    static bool isEqual(const QByteArray& baValue, const char* szText);
+
+    //! Parses URL encoded arguments (name1=value1&name2=value2)
+    static void parseArguments(const char* pData, int iLength, QMap<QString, QString>& mArguments);
+
+    //-------------------------------------------------------------------------------------------------
+    // Protected methods
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Parses the request line
+    void parseRequestLine(const char* pData, int iStart, int iEnd);
+
+    //! Parses a header line
+    void parseHeaderLine(const QByteArray& baBuffer, int iStart, int iEnd);
+
+    //! Called when the empty line that ends the headers is found
+    void endOfHeaders(const QByteArray& baBuffer);
+
+    //! Checks if the body is complete
+    void parseBody(const QByteArray& baBuffer);
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    EState              m_eState;               // Current state
+    int                 m_iPosition;            // Offset of the next byte to parse
+    int                 m_iHeaderLength;        // Size of request line and headers
+    int                 m_iContentLength;       // Announced content length, -1 if none
+    int                 m_iBodyLength;          // Size of the body when complete
+    int                 m_iBodyConsumed;        // Bytes of the body removed from the buffer by a streaming consumer
+    int                 m_iSearchPosition;      // Offset where to resume the search for the closing boundary
+    CSpan               m_tMethod;
+    CSpan               m_tTarget;
+    CSpan               m_tPath;
+    CSpan               m_tQuery;
+    CSpan               m_tVersion;
+    QVector<CHeader>    m_vHeaders;
+    QByteArray          m_baClosingBoundary;    // Used when a multipart body has no content length
+};
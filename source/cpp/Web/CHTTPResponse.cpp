@@ -0,0 +1,295 @@
+
+// Qt
+#include <QHash>
+#include <QReadWriteLock>
+
+// Application
+#include "CHTTPResponse.h"
+#include "CHTTPServer.h"
+#include "CHTTPMetrics.h"
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CHTTPResponse
+    \inmodule qt-plus
+    \brief Writes the status line and headers of a HTTP response into a reusable byte buffer.
+
+    CHTTPServer gives each connection its own buffer, which keeps its capacity from one response
+    to the next. Header values are appended in place, numbers are formatted without temporary strings,
+    and the Content-Type line of each MIME type is built once and shared (see contentTypeBlock()). \br
+    send() writes the headers and the body to the socket one after the other, so the body is never
+    concatenated to the headers.
+
+    \code
+    CHTTPResponse tResponse;
+
+    tResponse.begin(HTTP_200_OK, MIME_Content_JSON);
+    tResponse.addContentLength(baJSON.size());
+    tResponse.addConnection(true);
+    tResponse.end();
+    tResponse.send(pSocket, baJSON);
+    \endcode
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CHTTPResponse writing into \a pBuffer, which is cleared but keeps its capacity. \br\br
+    If \a pBuffer is \c nullptr, an internal buffer is used. \br
+    If \a pMetrics is not \c nullptr, the status of the response is recorded in it by send().
+*/
+CHTTPResponse::CHTTPResponse(QByteArray* pBuffer, CHTTPMetrics* pMetrics)
+    : m_pBuffer(pBuffer)
+    , m_pMetrics(pMetrics)
+    , m_iStatus(0)
+{
+    if (m_pBuffer == nullptr)
+    {
+        m_baOwnBuffer.reserve(512);
+        m_pBuffer = &m_baOwnBuffer;
+    }
+    else
+    {
+        m_pBuffer->resize(0);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CHTTPResponse.
+*/
+CHTTPResponse::~CHTTPResponse()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the status line and headers written so far.
+*/
+const QByteArray& CHTTPResponse::headers() const
+{
+    return *m_pBuffer;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the numeric status code given to begin(), 0 if begin() was not called.
+*/
+int CHTTPResponse::status() const
+{
+    return m_iStatus;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes the status line with status \a szStatus. \br\br
+    If \a sMIMEType is not empty, the Content-Type header is written too.
+*/
+void CHTTPResponse::begin(const char* szStatus, const QString& sMIMEType)
+{
+    // The status starts with its code
+    m_iStatus = 0;
+
+    for (const char* pChar = szStatus; *pChar >= '0' && *pChar <= '9'; pChar++)
+    {
+        m_iStatus = m_iStatus * 10 + (*pChar - '0');
+    }
+
+    m_pBuffer->append(HTTP_HEADER);
+    m_pBuffer->append(szStatus);
+    m_pBuffer->append(HTML_NL);
+
+    if (sMIMEType.isEmpty() == false)
+    {
+        m_pBuffer->append(contentTypeBlock(sMIMEType));
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes a header named \a szToken (including its colon) with the value \a szValue.
+*/
+void CHTTPResponse::addHeader(const char* szToken, const char* szValue)
+{
+    m_pBuffer->append(szToken);
+    m_pBuffer->append(' ');
+    m_pBuffer->append(szValue);
+    m_pBuffer->append(HTML_NL);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes a header named \a szToken (including its colon) with the value \a baValue.
+*/
+void CHTTPResponse::addHeader(const char* szToken, const QByteArray& baValue)
+{
+    m_pBuffer->append(szToken);
+    m_pBuffer->append(' ');
+    m_pBuffer->append(baValue);
+    m_pBuffer->append(HTML_NL);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes a header named \a szToken (including its colon) with the numeric value \a iValue.
+*/
+void CHTTPResponse::addHeader(const char* szToken, qint64 iValue)
+{
+    m_pBuffer->append(szToken);
+    m_pBuffer->append(' ');
+    appendNumber(*m_pBuffer, iValue);
+    m_pBuffer->append(HTML_NL);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes the Content-Length header with the value \a iLength.
+*/
+void CHTTPResponse::addContentLength(qint64 iLength)
+{
+    addHeader(Token_ContentLength, iLength);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes the Content-Encoding and Vary headers if \a eEncoding is not \c CHTTPContentEncoder::eIdentity.
+*/
+void CHTTPResponse::addContentEncoding(CHTTPContentEncoder::EEncoding eEncoding)
+{
+    if (eEncoding != CHTTPContentEncoder::eIdentity)
+    {
+        addHeader(Token_ContentEncoding, CHTTPContentEncoder::name(eEncoding));
+        addHeader(Token_Vary, "Accept-Encoding");
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes the Connection header, \c keep-alive if \a bKeepAlive is \c true, else \c close.
+*/
+void CHTTPResponse::addConnection(bool bKeepAlive)
+{
+    addHeader(Token_Connection, bKeepAlive ? "keep-alive" : "close");
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes the empty line that ends the headers.
+*/
+void CHTTPResponse::end()
+{
+    m_pBuffer->append(HTML_NL);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes the headers, then \a baBody, to \a pDevice. \br\br
+    Returns the number of bytes written, or -1 on error.
+*/
+qint64 CHTTPResponse::send(QIODevice* pDevice, const QByteArray& baBody)
+{
+    return send(pDevice, baBody.constData(), baBody.size());
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes the headers, then \a iLength bytes at \a pBody, to \a pDevice. \br\br
+    The two are written separately, the device's write buffer takes care of sending them together. \br
+    Returns the number of bytes written, or -1 on error.
+*/
+qint64 CHTTPResponse::send(QIODevice* pDevice, const char* pBody, qint64 iLength)
+{
+    qint64 iWritten = pDevice->write(m_pBuffer->constData(), m_pBuffer->size());
+
+    if (m_pMetrics != nullptr)
+    {
+        m_pMetrics->addResponse(m_iStatus);
+    }
+
+    if (iWritten >= 0 && iLength > 0)
+    {
+        qint64 iBodyWritten = pDevice->write(pBody, iLength);
+
+        iWritten = iBodyWritten < 0 ? -1 : iWritten + iBodyWritten;
+    }
+
+    return iWritten;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the Content-Type header line, including the line ending, for \a sMIMEType. \br\br
+    Lines are built on first use and shared afterwards, so no allocation occurs for known MIME types.
+*/
+QByteArray CHTTPResponse::contentTypeBlock(const QString& sMIMEType)
+{
+    static QReadWriteLock lBlocksLock;
+    static QHash<QString, QByteArray> hBlocks;
+
+    {
+        QReadLocker locker(&lBlocksLock);
+
+        QHash<QString, QByteArray>::const_iterator iBlock = hBlocks.constFind(sMIMEType);
+
+        if (iBlock != hBlocks.constEnd())
+        {
+            return iBlock.value();
+        }
+    }
+
+    QByteArray baBlock;
+
+    baBlock.append(Token_ContentType);
+    baBlock.append(' ');
+    baBlock.append(sMIMEType.toLatin1());
+    baBlock.append("; charset=\"utf-8\"");
+    baBlock.append(HTML_NL);
+
+    QWriteLocker locker(&lBlocksLock);
+
+    hBlocks[sMIMEType] = baBlock;
+
+    return baBlock;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Appends the decimal representation of \a iValue to \a baBuffer, without temporary strings.
+*/
+void CHTTPResponse::appendNumber(QByteArray& baBuffer, qint64 iValue)
+{
+    char aDigits[24];
+    int iPosition = sizeof(aDigits);
+    bool bNegative = iValue < 0;
+    quint64 uValue = bNegative ? (quint64) 0 - (quint64) iValue : (quint64) iValue;
+
+    do
+    {
+        aDigits[--iPosition] = (char) ('0' + (uValue % 10));
+        uValue /= 10;
+    }
+    while (uValue > 0);
+
+    if (bNegative)
+    {
+        aDigits[--iPosition] = '-';
+    }
+
+    baBuffer.append(aDigits + iPosition, (int) sizeof(aDigits) - iPosition);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QString>
+#include <QByteArray>
+#include <QIODevice>
+
+// Application
+#include "CHTTPContentEncoder.h"
+
+//-------------------------------------------------------------------------------------------------
+
+class CHTTPMetrics;
+
+//-------------------------------------------------------------------------------------------------
+
+//! Defines a HTTP response writer
+//! The status line and headers are written straight into a byte buffer, which can be reused from one response to the next
+//! so that no allocation occurs once it is big enough
+class QTPLUSSHARED_EXPORT CHTTPResponse
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor, writes into pBuffer if not null, else into an internal buffer
+    //! If pMetrics is not null, the response's status is recorded in it when sent
+    CHTTPResponse(QByteArray* pBuffer = nullptr, CHTTPMetrics* pMetrics = nullptr);
+
+    //! Destructor
+    virtual ~CHTTPResponse();
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the status line and headers written so far
+    const QByteArray& headers() const;
+
+    //! Returns the status code given to begin(), 0 if not begun
+    int status() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Writes the status line and, if sMIMEType is not empty, the Content-Type header
+    void begin(const char* szStatus, const QString& sMIMEType = QString());
+
+    //! Writes a header
+    void addHeader(const char* szToken, const char* szValue);
+
+    //! Writes a header
+    void addHeader(const char* szToken, const QByteArray& baValue);
+
+    //! Writes a header with a numeric value
+    void addHeader(const char* szToken, qint64 iValue);
+
+    //! Writes the Content-Length header
+    void addContentLength(qint64 iLength);
+
+    //! Writes the Content-Encoding and Vary headers if eEncoding is not identity
+    void addContentEncoding(CHTTPContentEncoder::EEncoding eEncoding);
+
+    //! Writes the Connection header
+    void addConnection(bool bKeepAlive);
+
+    //! Writes the empty line that ends the headers
+    void end();
+
+    //! Writes the headers, then the body, to pDevice
+    qint64 send(QIODevice* pDevice, const QByteArray& baBody = QByteArray());
+
+    //! Writes the headers, then iLength bytes of body at pBody, to pDevice
+    qint64 send(QIODevice* pDevice, const char* pBody, qint64 iLength);
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the Content-Type header line for sMIMEType, built once per MIME type
+    static QByteArray contentTypeBlock(const QString& sMIMEType);
+
+    //! Appends the decimal representation of iValue to baBuffer
+    static void appendNumber(QByteArray& baBuffer, qint64 iValue);
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    QByteArray      m_baOwnBuffer;      // Used when no buffer is given
+    QByteArray*     m_pBuffer;          // Buffer receiving the status line and headers
+    CHTTPMetrics*   m_pMetrics;         // Records the status when sent, if not null
+    int             m_iStatus;
+};
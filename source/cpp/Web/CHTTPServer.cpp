@@ -2,6 +2,7 @@
 // Qt
 #include <QCoreApplication>
 #include <QFile>
+#include <QMutexLocker>
 
 // Application
 #include "CHTTPServer.h"
@@ -11,6 +12,9 @@
 // #define DEBUG_RECORD_REQUESTS
 #define THREADED_SERVER
 
+// Size of the chunks used to stream files that are too big for the cache
+#define FILE_CHUNK_SIZE     (64 * 1024)
+
 //-------------------------------------------------------------------------------------------------
 
 /*!
@@ -25,7 +29,22 @@
     return some HTML content to the client. \br
     The disk access will be limited to cetrain folders, which are specified using the addAuthorizedFolder()
     method. \br
+    Files are kept in a bounded LRU cache (see CHTTPFileCache) and served with ETag and Last-Modified headers,
+    so that browsers can revalidate them with a 304 response. Byte ranges are honored, and files too big
+    for the cache are streamed in chunks. \br
+    Text responses are compressed with gzip or deflate when the client accepts it (see useCompression()).
+    Compressed variants of static files are cached along with the files. \br
+    By default, sockets are read in the server's thread and requests are executed by a thread pool.
+    With setWorkerThreadCount(), connections are instead spread over several threads which own their sockets. \br
+    Connections are persistent (HTTP/1.1 keep-alive) and pipelined requests are answered in order, one at a time.
+    Idle connections are closed after a timeout (see setKeepAliveTimeout()), a connection serves a limited number
+    of requests (see setMaxRequestsPerConnection()) and the number of open connections can be capped (see setMaxConnections()). \br
+    Multipart uploads are parsed as they arrive, big parts being written to temporary files (see setUploadMemoryThreshold()). \br
+    Subclasses producing JSON, XML or binary data can override getRawContent() instead of getContent(). Response headers
+    are written into a buffer reused by each connection (see CHTTPResponse). \br
     There is a flood protection mechanism which can be disabled with the useFloodProtection() method.
+    It limits the request rate of each client IP (see CHTTPRateLimiter, available through rateLimiter()). \br
+    Runtime counters are kept in a CHTTPMetrics (see metrics()) and can be served to a Prometheus scraper (see setMetricsPath()).
 
     \section1 Sample
     The following will create a HTTP server that listens on port 8080 and greets clients with "Hello world!"
@@ -55,9 +74,16 @@ CHTTPServer::CHTTPServer(quint16 port, QObject* parent)
     : QTcpServer(parent)
     , m_mMutex(QMutex::Recursive)
     , m_iRequestCount(0)
-    , m_iMaxRequestPerSeconds(15)
     , m_bDisabled(false)
     , m_bUseFloodProtection(true)
+    , m_bUseCompression(true)
+    , m_iCompressionLevel(6)
+    , m_iCompressionThreshold(1024)
+    , m_iConnectionCount(0)
+    , m_iKeepAliveTimeoutMS(15000)
+    , m_iMaxRequestsPerConnection(1000)
+    , m_iMaxConnections(0)
+    , m_iUploadMemoryThreshold(256 * 1024)
 {
     // Fill MIME array
 
@@ -78,15 +104,21 @@ CHTTPServer::CHTTPServer(quint16 port, QObject* parent)
 
     // Fill static IP black list
 
-    m_lStaticIPBlackList << "0.0.0.0";
-    m_lStaticIPBlackList << "10.0.0.0";
-    m_lStaticIPBlackList << "127.0.0.0";
-    m_lStaticIPBlackList << "224.0.0.0";
-    m_lStaticIPBlackList << "240.0.0.0";
-    m_lStaticIPBlackList << "169.254.0.0";
-    m_lStaticIPBlackList << "172.16.0.0";
-    m_lStaticIPBlackList << "192.0.2.0";
-    m_lStaticIPBlackList << "192.168.0.0";
+    m_tRateLimiter.addToBlackList(QHostAddress("0.0.0.0"));
+    m_tRateLimiter.addToBlackList(QHostAddress("10.0.0.0"));
+    m_tRateLimiter.addToBlackList(QHostAddress("127.0.0.0"));
+    m_tRateLimiter.addToBlackList(QHostAddress("224.0.0.0"));
+    m_tRateLimiter.addToBlackList(QHostAddress("240.0.0.0"));
+    m_tRateLimiter.addToBlackList(QHostAddress("169.254.0.0"));
+    m_tRateLimiter.addToBlackList(QHostAddress("172.16.0.0"));
+    m_tRateLimiter.addToBlackList(QHostAddress("192.0.2.0"));
+    m_tRateLimiter.addToBlackList(QHostAddress("192.168.0.0"));
+
+    // Check idle connections every second
+
+    m_tIdleTimer.setInterval(1000);
+    connect(&m_tIdleTimer, SIGNAL(timeout()), this, SLOT(onIdleTimeout()));
+    m_tIdleTimer.start();
 
     // Listen
 
@@ -112,6 +144,28 @@ CHTTPServer::~CHTTPServer()
 {
     // Fermeture du serveur
     close();
+
+    stopWorkers();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Called by QTcpServer when a connection is accepted, with \a iSocketDescriptor being the new socket's descriptor. \br\br
+    If the server has worker threads, the descriptor is handed to the next one in round robin order, which creates
+    and owns the socket. Otherwise QTcpServer's default behavior is used and the socket lives in the server's thread.
+*/
+void CHTTPServer::incomingConnection(qintptr iSocketDescriptor)
+{
+    if (m_vWorkers.isEmpty())
+    {
+        QTcpServer::incomingConnection(iSocketDescriptor);
+        return;
+    }
+
+    int iWorker = (m_iNextWorker.fetchAndAddRelaxed(1) & 0x7FFFFFFF) % m_vWorkers.count();
+
+    QMetaObject::invokeMethod(m_vWorkers[iWorker], "onNewConnection", Qt::QueuedConnection, Q_ARG(qintptr, iSocketDescriptor));
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -121,40 +175,103 @@ CHTTPServer::~CHTTPServer()
 */
 void CHTTPServer::onNewConnection()
 {
-    // Rcupration socket entrante
-    QTcpSocket* pSocket = nextPendingConnection();
-    QString sIPAddress = cleanIP(pSocket->peerAddress().toString());
-    bool bRejected = false;
+    QTcpSocket* pSocket = nullptr;
 
-    // Check static black list
-    if (m_lStaticIPBlackList.contains(sIPAddress))
-    {
-        bRejected = true;
-    }
-    // Check dynamic black list
-    else if (m_lDynamicIPBlackList.contains(sIPAddress))
+    // Rcupration socket entrante
+    while ((pSocket = nextPendingConnection()) != nullptr)
     {
-        bRejected = true;
+        acceptSocket(pSocket, this);
     }
-    // Check monitors
-    else if (m_mMonitors[sIPAddress].shouldBeBlocked())
-    {
-        qDebug() << QString("Blacklisting %1").arg(sIPAddress);
+}
 
-        // Blacklist and reject this connection
-        m_lDynamicIPBlackList << sIPAddress;
+//-------------------------------------------------------------------------------------------------
 
-        bRejected = true;
-    }
+/*!
+    Handles a socket disconnection.
+*/
+void CHTTPServer::onSocketDisconnected()
+{
+    // Rcupration de l'objet metteur du signal
+    socketDisconnected(dynamic_cast<QTcpSocket*>(QObject::sender()));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Handles data reading when a socket emits the readyRead signal.
+*/
+void CHTTPServer::onSocketReadyRead()
+{
+    // Get the emitting socket
+    socketReadyRead(dynamic_cast<QTcpSocket*>(QObject::sender()));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Handles the bytesWritten signal of a socket. \br\br
+    \a iBytes contains the number of written bytes.
+*/
+void CHTTPServer::onSocketBytesWritten(qint64 iBytes)
+{
+    // Rcupration de l'objet metteur du signal
+    socketBytesWritten(dynamic_cast<QTcpSocket*>(QObject::sender()), iBytes);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Called when a client socket is destroyed. \br\br
+    This is a direct connection, called from the thread owning the socket.
+*/
+void CHTTPServer::onSocketDestroyed()
+{
+    m_iConnectionCount.deref();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Closes the idle keep-alive connections owned by the server.
+*/
+void CHTTPServer::onIdleTimeout()
+{
+    closeIdleSockets(this);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets up \a pSocket, a newly connected socket. \br\br
+    The socket is rejected if its peer is blacklisted. Otherwise its client data is created and its
+    signals are connected to \a pReceiver, which is either the server or the CHTTPWorker owning the socket.
+*/
+void CHTTPServer::acceptSocket(QTcpSocket* pSocket, QObject* pReceiver)
+{
+    // Check static and dynamic black lists
+    bool bRejected = m_tRateLimiter.isBlocked(pSocket->peerAddress());
 
     if (bRejected)
     {
+        m_tMetrics.addBlockedConnection();
+
         // Reject this connection
         pSocket->disconnect();
         pSocket->deleteLater();
     }
+    else if (m_iMaxConnections > 0 && m_iConnectionCount.load() >= m_iMaxConnections)
+    {
+        // Too many open connections
+        m_tMetrics.addRefusedConnection();
+        sendErrorAndClose(pSocket, HTTP_503_SERVICE_UNAVAILABLE);
+    }
     else
     {
+        // Count the connection until the socket is destroyed, whichever way it is closed
+        m_iConnectionCount.ref();
+        m_tMetrics.addAcceptedConnection();
+        connect(pSocket, SIGNAL(destroyed()), this, SLOT(onSocketDestroyed()), Qt::DirectConnection);
+
         pSocket->setReadBufferSize(1024 * 20);
 
         // Create custom client data
@@ -162,23 +279,20 @@ void CHTTPServer::onNewConnection()
         new CClientData(pSocket);
 
         // Connexion des signaux
-        connect(pSocket, SIGNAL(readyRead()), this, SLOT(onSocketReadyRead()));
-        connect(pSocket, SIGNAL(bytesWritten(qint64)), this, SLOT(onSocketBytesWritten(qint64)));
-        connect(pSocket, SIGNAL(disconnected()), this, SLOT(onSocketDisconnected()));
+        connect(pSocket, SIGNAL(readyRead()), pReceiver, SLOT(onSocketReadyRead()));
+        connect(pSocket, SIGNAL(bytesWritten(qint64)), pReceiver, SLOT(onSocketBytesWritten(qint64)));
+        connect(pSocket, SIGNAL(disconnected()), pReceiver, SLOT(onSocketDisconnected()));
     }
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Handles a socket disconnection. \br\br
+    Handles the disconnection of \a pSocket. \br\br
     Calls the handleSocketDisconnection() method.
 */
-void CHTTPServer::onSocketDisconnected()
+void CHTTPServer::socketDisconnected(QTcpSocket* pSocket)
 {
-    // Rcupration de l'objet metteur du signal
-    QTcpSocket* pSocket = dynamic_cast<QTcpSocket*>(QObject::sender());
-
     // Appel du gestionnaire implment (ou non) par les sous-classes
     handleSocketDisconnection(pSocket);
 
@@ -192,18 +306,16 @@ void CHTTPServer::onSocketDisconnected()
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Handles data reading when a socket emits the readyRead signal. \br\br
-    Calls the handleSocketBytesRead() method.
+    Reads the bytes available on \a pSocket and executes the request once it is complete. \br\br
+    Calls the handleSocketBytesRead() method if the socket is not connected.
 */
-void CHTTPServer::onSocketReadyRead()
+void CHTTPServer::socketReadyRead(QTcpSocket* pSocket)
 {
-    // Get the emitting socket
-    QTcpSocket* pSocket = dynamic_cast<QTcpSocket*>(QObject::sender());
-    QString sIPAddress = cleanIP(pSocket->peerAddress().toString());
-
     // If the connection is rejected, free socket and its client data
-    if (m_mMonitors[sIPAddress].shouldBeBlocked())
+    if (m_tRateLimiter.isBlocked(pSocket->peerAddress()))
     {
+        m_tMetrics.addBlockedConnection();
+
         CClientData::deleteFromSocket(pSocket);
         pSocket->disconnect();
         pSocket->deleteLater();
@@ -224,80 +336,25 @@ void CHTTPServer::onSocketReadyRead()
 
         // Get the client data from the socket
         CClientData* pData = CClientData::getFromSocket(pSocket);
-        QString sIPAddress = cleanIP(pSocket->peerAddress().toString());
 
         if (pData != nullptr)
         {
             // Si la socket est en tat connect
             if (pSocket->state() == QTcpSocket::ConnectedState)
             {
-                // Lecture de toutes les donnes disponibles
-                QByteArray baData = pSocket->readAll();
-
-                // Ajout des octets arrivant au buffer
-                pData->m_baBuffer.append(baData);
-
-                // Est-ce que l'entte a t lue?
-                if (pData->m_bHeaderRead == false)
                 {
-                    QStringList lTokens = getHeaderTokens(baData);
-
-                    pData->m_bHeaderRead = true;
-                    pData->m_iExpectedBytes = getExpectedBytes(lTokens);
+                    QMutexLocker locker(&pData->m_mRequestMutex);
 
-                    // Rcupration du type de contenu
-                    QString sContentType = getTokenValue(lTokens, Token_ContentType);
-
-                    if (sContentType.startsWith(MIME_Content_MultiPart))
-                    {
-                        pData->m_sMultipartBoundary = getSubTokenValue(lTokens, Token_ContentType, Token_boundary);
-                    }
-                }
-
-                // Dcrmentation du nombre d'octets attendus
-                pData->m_iExpectedBytes -= baData.count();
-
-                if (pData->m_sMultipartBoundary.isEmpty() == false)
-                {
-                    QString sText = QString(baData);
-                    QString sClosingBoundary = QString("--%1--").arg(pData->m_sMultipartBoundary);
-
-                    if (sText.contains(sClosingBoundary))
-                    {
-                        // Mark header as not read
-                        pData->m_bHeaderRead = false;
+                    int iPreviousSize = pData->m_baBuffer.size();
 
-                        // Execute the client request
-                        if (m_mMonitors[sIPAddress].shouldBeBlocked() == false)
-                        {
-#ifdef THREADED_SERVER
-                            CRequestProcessor* pProcessor = new CRequestProcessor(this, pSocket);
-                            pProcessor->setAutoDelete(true);
-                            m_pProcessors.start(pProcessor);
-#else
-                            processRequest(pSocket);
-#endif
-                        }
-                    }
+                    // Ajout des octets arrivant au buffer
+                    pData->m_baBuffer.append(pSocket->readAll());
+                    m_tMetrics.addBytesIn(pData->m_baBuffer.size() - iPreviousSize);
+                    pData->m_tLastActivity.restart();
                 }
-                else
-                if (pData->m_iExpectedBytes <= 0)
-                {
-                    // L'entte n'a pas t lue
-                    pData->m_bHeaderRead = false;
 
-                    // Execute the client request
-                    if (m_mMonitors[sIPAddress].shouldBeBlocked() == false)
-                    {
-#ifdef THREADED_SERVER
-                        CRequestProcessor* pProcessor = new CRequestProcessor(this, pSocket);
-                        pProcessor->setAutoDelete(true);
-                        m_pProcessors.start(pProcessor);
-#else
-                        processRequest(pSocket);
-#endif
-                    }
-                }
+                // Execute the complete requests, in order
+                processPendingRequests(pSocket);
             }
             else
             {
@@ -311,14 +368,42 @@ void CHTTPServer::onSocketReadyRead()
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Handles the bytesWritten signal of a socket. \br\br
-    \a iBytes contains the number of written bytes. \br\br
-    Calls the handleSocketBytesWritten() method.
+    Called when \a iBytes bytes have been written to \a pSocket. \br\br
+    Continues streaming a file if needed, then calls the handleSocketBytesWritten() method.
 */
-void CHTTPServer::onSocketBytesWritten(qint64 iBytes)
+void CHTTPServer::socketBytesWritten(QTcpSocket* pSocket, qint64 iBytes)
 {
-    // Rcupration de l'objet metteur du signal
-    QTcpSocket* pSocket = dynamic_cast<QTcpSocket*>(QObject::sender());
+    CClientData* pData = CClientData::getFromSocket(pSocket);
+
+    m_tMetrics.addBytesOut(iBytes);
+
+    // Continue streaming a file, if any
+    if (pData != nullptr)
+    {
+        pData->m_mRequestMutex.lock();
+        pData->m_tLastActivity.restart();
+        pData->m_mRequestMutex.unlock();
+
+        QMutexLocker locker(&pData->m_mTransferMutex);
+
+        if (pData->m_pTransferFile != nullptr && pData->m_bTransferStarted)
+        {
+            if (continueFileTransfer(pSocket) == false)
+            {
+                locker.unlock();
+
+                if (pData->m_bCloseAfterTransfer)
+                {
+                    // Close once the pending data is written, socketDisconnected() then frees the socket and its user data
+                    pSocket->disconnectFromHost();
+                    return;
+                }
+
+                // The file is sent, go on with the requests that were pipelined behind it
+                processPendingRequests(pSocket);
+            }
+        }
+    }
 
     // Appel du gestionnaire implment (ou non) par les sous-classes
     handleSocketBytesWritten(pSocket, iBytes);
@@ -327,236 +412,343 @@ void CHTTPServer::onSocketBytesWritten(qint64 iBytes)
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns the tokens in a HTTP header. \br\br
-    \a baData contains the header.
+    Executes the complete requests waiting in the buffer of \a pSocket. \br\br
+    A connection has at most one request in process, so that responses to pipelined requests are sent in order.
+    The next request is started when the previous one is done and, if it streams a file, when the file is sent. \br
+    In threaded mode the request is handed to the thread pool, which calls this method again when done.
 */
-QStringList CHTTPServer::getHeaderTokens(QByteArray baData)
+void CHTTPServer::processPendingRequests(QTcpSocket* pSocket)
 {
-    QStringList lReturnValue;
-    QString sText(baData);
+    while (true)
+    {
+        CClientData* pData = CClientData::getFromSocket(pSocket);
+
+        if (pData == nullptr)
+        {
+            return;
+        }
+
+        // Wait for the end of a file transfer
+        {
+            QMutexLocker locker(&pData->m_mTransferMutex);
+
+            if (pData->m_pTransferFile != nullptr)
+            {
+                return;
+            }
+        }
+
+        CHTTPRequestParser::EState eState = CHTTPRequestParser::eError;
+
+        {
+            QMutexLocker locker(&pData->m_mRequestMutex);
+
+            if (pData->m_bProcessing || pData->m_baBuffer.isEmpty())
+            {
+                return;
+            }
+
+            // Resume parsing where the previous chunk stopped
+            eState = pData->m_tParser.parse(pData->m_baBuffer);
+
+            // Multipart bodies are parsed as they arrive instead of being kept in the buffer
+            if (eState == CHTTPRequestParser::eBody || eState == CHTTPRequestParser::eComplete)
+            {
+                if (consumeMultipartBody(pSocket) == false)
+                {
+                    eState = CHTTPRequestParser::eError;
+                }
+            }
+
+            if (eState == CHTTPRequestParser::eComplete)
+            {
+                pData->m_bProcessing = true;
+            }
+        }
+
+        if (eState == CHTTPRequestParser::eError)
+        {
+            sendErrorAndClose(pSocket, HTTP_400_BAD_REQUEST);
+            return;
+        }
+
+        if (eState != CHTTPRequestParser::eComplete)
+        {
+            return;
+        }
+
+        // Drop the connection if the client got blacklisted
+        if (m_tRateLimiter.isBlocked(pSocket->peerAddress()))
+        {
+            m_tMetrics.addBlockedConnection();
 
-    // Rcupration du header
-    QString sHeader = getRequestHeader(sText);
+            CClientData::deleteFromSocket(pSocket);
+            pSocket->disconnect();
+            pSocket->deleteLater();
+            return;
+        }
+
+        bool bUsePool = false;
+
+#ifdef THREADED_SERVER
+        // The worker thread owning the socket processes its requests, else the thread pool does
+        bUsePool = m_vWorkers.isEmpty();
+#endif
 
-    // Rcupration des tokens du header HTTP
-    lReturnValue = sHeader.split(QRegExp("[\r\n][\r\n]*"));
+        if (bUsePool)
+        {
+            CRequestProcessor* pProcessor = new CRequestProcessor(this, pSocket);
+            pProcessor->setAutoDelete(true);
+            m_tMetrics.addQueuedRequest();
+            m_pProcessors.start(pProcessor);
+            return;
+        }
 
-    return lReturnValue;
+        // Execute the client request
+        if (processRequest(pSocket) == false)
+        {
+            return;
+        }
+    }
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns the number of expected bytes to follow a HTTP header. \br\br
-    \a lTokens contains the header tokens.
+    Feeds the multipart body bytes received in the buffer of \a pSocket to its multipart parser,
+    then removes them from the buffer. \br\br
+    The multipart parser is created when the headers of a multipart request with a content length are complete.
+    The request mutex of the socket's client data must be locked. \br
+    Returns \c false if the body is malformed or could not be spooled to disk.
 */
-int CHTTPServer::getExpectedBytes(QStringList lTokens)
+bool CHTTPServer::consumeMultipartBody(QTcpSocket* pSocket)
 {
-    int iExpectedBytes = 0;
+    CClientData* pData = CClientData::getFromSocket(pSocket);
+    CHTTPRequestParser& tParser = pData->m_tParser;
 
-    if (lTokens.count() > 0)
+    if (pData->m_pMultipartParser == nullptr)
     {
-        if (lTokens[0].startsWith(HTTP_POST))
+        if (tParser.contentLength() <= 0 || tParser.bodyConsumed() > 0)
         {
-            // Rcupration du type de contenu
-            QString sContentType = getTokenValue(lTokens, Token_ContentType);
+            return true;
+        }
 
-            // Rcupration du type de contenu
-            QString sContentLength = getTokenValue(lTokens, Token_ContentLength);
+        QByteArray baBoundary = tParser.multipartBoundary(pData->m_baBuffer);
 
-            if (sContentLength.isEmpty() == false)
-            {
-                iExpectedBytes = sContentLength.toInt();
-            }
+        if (tParser.headerValue(pData->m_baBuffer, Token_ContentType).startsWith(MIME_Content_MultiPart) == false || baBoundary.isEmpty())
+        {
+            return true;
         }
+
+        pData->m_pMultipartParser = new CHTTPMultipartParser(baBoundary, m_iUploadMemoryThreshold);
+    }
+
+    QByteArray baBody = tParser.pendingBody(pData->m_baBuffer);
+
+    if (baBody.isEmpty() == false)
+    {
+        int iLength = baBody.size();
+
+        pData->m_pMultipartParser->parse(baBody);
+        pData->m_baBuffer.remove(tParser.headerLength(), iLength);
+        tParser.consumeBody(iLength);
     }
 
-    return iExpectedBytes;
+    return pData->m_pMultipartParser->state() != CHTTPMultipartParser::eError;
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Processes a request from \a pSocket.
+    Processes the request at the start of the buffer of \a pSocket. \br\br
+    Returns \c true if the connection remains open and ready for the next request, \c false if it was
+    closed or if it is busy streaming a file.
 */
-void CHTTPServer::processRequest(QTcpSocket* pSocket)
+bool CHTTPServer::processRequest(QTcpSocket* pSocket)
 {
     CClientData* pData = CClientData::getFromSocket(pSocket);
-    QString sIPAddress = cleanIP(pSocket->peerAddress().toString());
+    QHostAddress tPeerAddress = pSocket->peerAddress();
+    QString sIPAddress = cleanIP(tPeerAddress.toString());
+    bool bReady = false;
+    QElapsedTimer tRequestTimer;
 
-    // Log the request
-    LogRequest(sIPAddress, QString(pData->m_baBuffer));
+    tRequestTimer.start();
 
-    if (lock())
-    {
-        // Increment total request count
-        m_iRequestCount++;
+    // Increment total request count
+    m_iRequestCount.fetchAndAddRelaxed(1);
 
-        if (m_bUseFloodProtection)
+    if (m_bUseFloodProtection)
+    {
+        // Update the client's rate limiter, it will be blocked from now on if flooding
+        if (m_tRateLimiter.requestIn(tPeerAddress) == false)
         {
-            // Process request monitors
-            m_mMonitors[sIPAddress].processIn();
+            m_tMetrics.addRateLimitedRequest();
         }
-
-        unlock();
-    }
-
-#ifdef DEBUG_RECORD_REQUESTS
-    QFile outFile(QString("Request_%1.txt").arg(QString::number(m_iRequestCount)));
-    if (outFile.open(QFile::WriteOnly))
-    {
-        outFile.write(pData->m_baBuffer);
-        outFile.close();
     }
-#endif
 
     if (pData != nullptr)
     {
-        bool bKeepAlive = false;
+        pData->m_mRequestMutex.lock();
 
-        QString sText(pData->m_baBuffer);
-        QStringList lTokens = getHeaderTokens(pData->m_baBuffer);
+        // Take shallow copies of the buffer and the parser
+        // The views returned by the parser remain valid even if the socket's thread appends data to the buffer
+        QByteArray baBuffer = pData->m_baBuffer;
+        CHTTPRequestParser tParser = pData->m_tParser;
+        int iRequestsServed = pData->m_iRequestsServed;
 
-        QStringList lPath;						// Client requested path (route)
-        QMap<QString, QString> mArguments;		// Arguments coming from the URI
-        QString sHost;							// Host name (ie this server)
-        QString sContentType;					// Content type in case of a POST
-        QByteArray baPostContent;				// Content in case of a POST
-        bool bForceKeepAlive = false;
+        // Take the parts of a multipart body parsed while it arrived, if any
+        CHTTPMultipartParser* pMultipartParser = pData->m_pMultipartParser;
+        pData->m_pMultipartParser = nullptr;
 
-        // Process if we get at least one token
-        if (lTokens.count() > 0)
-        {
-            // For now, only GET and POST are processed
-            if (lTokens[0].startsWith(HTTP_GET) || lTokens[0].startsWith(HTTP_POST))
-            {
-                // Do we have more than one token?
-                if (lTokens.count() > 1)
-                {
-                    // Get the request path (route) and arguments
-                    getRequestPathAndArgs(lTokens, lPath, mArguments);
+        pData->m_mRequestMutex.unlock();
 
-                    // Get the host name
-                    sHost = getTokenValue(lTokens, Token_Host);
+        QByteArray baMethod = tParser.method(baBuffer);
 
-                    // Check if client request a keep-alive connection
-                    QString sKeepAlive = getTokenValue(lTokens, Token_Connection);
+        m_tMetrics.addRequest(baMethod);
 
-                    if (sKeepAlive.toLower() == "keep-alive")
-                    {
-                        bKeepAlive = true;
-                    }
+        // Log the request
+        LogRequest(sIPAddress, QString("%1 %2").arg(QString(baMethod)).arg(QString(tParser.target(baBuffer))));
 
-                    // Get the content type and content
-                    sContentType = getTokenValue(lTokens, Token_ContentType);
+#ifdef DEBUG_RECORD_REQUESTS
+        QFile outFile(QString("Request_%1.txt").arg(QString::number(m_iRequestCount.load())));
+        if (outFile.open(QFile::WriteOnly))
+        {
+            outFile.write(baBuffer);
+            outFile.close();
+        }
+#endif
 
-                    if (sContentType.isEmpty() == false)
-                    {
-                        getRequestPostContent(sText, baPostContent);
-                    }
-                }
+        bool bKeepAlive = false;
+        bool bForceKeepAlive = false;
+        bool bTransferPending = false;
 
-                // Create a web context in order for subclasses to generate content
-                CWebContext tContext(pSocket, sIPAddress, sHost, lPath, mArguments);
+        // For now, only GET and POST are processed
+        if (baMethod == HTTP_GET || baMethod == HTTP_POST)
+        {
+            QStringList lPath;                      // Client requested path (route)
+            QMap<QString, QString> mArguments;      // Arguments coming from the URI
 
-                if (sContentType.startsWith(MIME_Content_URLForm))
-                {
-                    QStringList lArgs = QString(baPostContent).split("&");
+            // Get the request path (route) and arguments
+            tParser.getPathAndArguments(baBuffer, lPath, mArguments);
 
-                    foreach(QString sArg, lArgs)
-                    {
-                        QStringList lCurrentArg = sArg.split("=");
+            // HTTP/1.1 connections are persistent unless the client asks otherwise, HTTP/1.0 ones only on request
+            QByteArray baConnection = tParser.headerValue(baBuffer, Token_Connection);
 
-                        if (lCurrentArg.count() > 1)
-                        {
-                            tContext.m_mArguments[lCurrentArg[0]] = lCurrentArg[1];
-                        }
-                    }
-                }
-                else if (sContentType.startsWith(MIME_Content_MultiPart))
-                {
-                    if (pData->m_sMultipartBoundary.isEmpty() == false)
-                    {
-                        QString sActualBoundary = QString("--%1").arg(pData->m_sMultipartBoundary);
-                        QString sContent = QString(baPostContent);
-                        QStringList lParts = sContent.split(sActualBoundary);
+            if (CHTTPRequestParser::isEqual(tParser.version(baBuffer), "HTTP/1.1"))
+            {
+                bKeepAlive = CHTTPRequestParser::isEqual(baConnection, "close") == false;
+            }
+            else
+            {
+                bKeepAlive = CHTTPRequestParser::isEqual(baConnection, "keep-alive");
+            }
 
-                        if (lParts.count() > 0)
-                        {
-                            int iIndex = 0;
+            // Close the connection after its last allowed request
+            if (m_iMaxRequestsPerConnection > 0 && iRequestsServed + 1 >= m_iMaxRequestsPerConnection)
+            {
+                bKeepAlive = false;
+            }
 
-                            foreach (QString sPart, lParts)
-                            {
-                                if (sPart.startsWith("--") == false)
-                                {
-#ifdef DEBUG_RECORD_REQUESTS
-                                    QFile outFile(QString("Part_%1.txt").arg(QString::number(iIndex)));
-                                    if (outFile.open(QFile::WriteOnly))
-                                    {
-                                        outFile.write(sPart.toLatin1());
-                                        outFile.close();
-                                    }
-#endif
+            // Get the host name (ie this server) and the content type in case of a POST
+            QString sHost = QString(tParser.headerValue(baBuffer, Token_Host));
+            QByteArray baContentType = tParser.headerValue(baBuffer, Token_ContentType);
+
+            // Create a web context in order for subclasses to generate content
+            CWebContext tContext(pSocket, sIPAddress, sHost, lPath, mArguments);
+            tContext.m_baRequest = baBuffer;
+            tContext.m_tRequest = tParser;
+            tContext.m_bKeepAlive = bKeepAlive;
 
-                                    if (sContentType.startsWith(MIME_Content_MultiPart_FormData))
-                                    {
-                                        // Get the part's tokens
-                                        QStringList lPartTokens = sPart.split(QRegExp("[\r\n][\r\n]*"));
+            if (baContentType.isEmpty() == false)
+            {
+                // The context gets its own copy of the body, since it may outlive the buffer
+                QByteArray baBody = tParser.body(baBuffer);
+                tContext.m_baPostContent = QByteArray(baBody.constData(), baBody.size());
+            }
 
-                                        // Get the part's content type and name
-                                        QString sPartContentType = getTokenValue(lPartTokens, Token_ContentType);
-                                        QString sName = getSubTokenValue(lPartTokens, Token_ContentDisposition, Token_name);
+            if (baContentType.startsWith(MIME_Content_URLForm))
+            {
+                CHTTPRequestParser::parseArguments(tContext.m_baPostContent.constData(), tContext.m_baPostContent.size(), tContext.m_mArguments);
+            }
+            else if (baContentType.startsWith(MIME_Content_MultiPart))
+            {
+                QByteArray baBoundary = tParser.multipartBoundary(baBuffer);
 
-                                        if (sName.isEmpty() == false)
-                                        {
-                                            QByteArray baPartData;
-                                            getRequestPostContent(sPart, baPartData);
+                // A body without content length was not parsed while it arrived, parse it now
+                if (pMultipartParser == nullptr && baBoundary.isEmpty() == false)
+                {
+                    pMultipartParser = new CHTTPMultipartParser(baBoundary, m_iUploadMemoryThreshold);
+                    pMultipartParser->parse(tParser.body(baBuffer));
+                }
 
-#ifdef DEBUG_RECORD_REQUESTS
-                                            QFile outFile(QString("Content_%1.txt").arg(sName));
-                                            if (outFile.open(QFile::WriteOnly))
-                                            {
-                                                outFile.write(baPartData);
-                                                outFile.close();
-                                            }
-#endif
+                if (pMultipartParser != nullptr)
+                {
+                    if (pMultipartParser->state() != CHTTPMultipartParser::eEnd)
+                    {
+                        qWarning() << QString("CHTTPServer::processRequest() : incomplete multipart body from %1").arg(sIPAddress);
+                    }
 
-                                            tContext.m_mArguments[sName] = QString(baPartData);
-                                        }
-                                    }
-                                }
+                    tContext.m_lParts = pMultipartParser->takeParts();
 
-                                iIndex++;
-                            }
+                    // Parts held in memory are also given as arguments
+                    foreach (CHTTPMultipartParser::CPart tPart, tContext.m_lParts)
+                    {
+                        if (tPart.m_sName.isEmpty() == false && tPart.isInFile() == false)
+                        {
+                            tContext.m_mArguments[tPart.m_sName] = QString(tPart.m_baData);
                         }
                     }
                 }
+            }
 
-                // Assign the POST content to the context
-                tContext.m_baPostContent = baPostContent;
+            // Serve the metrics if asked for
+            // Else, if a file exists for the requested route, return it
+            // Else return dynamic content
+            if (m_baMetricsPath.isEmpty() == false && tParser.path(baBuffer) == m_baMetricsPath)
+            {
+                sendContent(tContext, pSocket, m_tMetrics.toText(m_iConnectionCount.load(), m_pProcessors), MIME_Content_PlainText);
+            }
+            else if (getResponseFile(tContext, pSocket) == true)
+            {
+                QMutexLocker locker(&pData->m_mTransferMutex);
 
-                // If a file exists for the requested route, return it
-                // Else return dynamic content
-                if (getResponseFile(tContext, pSocket) == true)
+                // If a file is being streamed, start the transfer now that we know what to do with the connection
+                if (pData->m_pTransferFile != nullptr)
                 {
-                }
-                else
-                {
-                    bForceKeepAlive = getResponseDynamicContent(tContext, pSocket);
+                    pData->m_bCloseAfterTransfer = (bKeepAlive == false);
+                    pData->m_bTransferStarted = true;
+
+                    bTransferPending = continueFileTransfer(pSocket);
+
+                    // The transfer may have failed
+                    if (pData->m_bCloseAfterTransfer)
+                    {
+                        bKeepAlive = false;
+                    }
                 }
             }
             else
             {
+                bForceKeepAlive = getResponseDynamicContent(tContext, pSocket);
             }
         }
-        else
+
+        if (pMultipartParser != nullptr)
         {
-            qWarning() << QString("CHTTPServer::processRequest() : No token to read");
+            delete pMultipartParser;
         }
 
-        // Clear the input buffer in the sockect's associated data
-        pData->m_baBuffer.clear();
-        pData->m_sMultipartBoundary.clear();
+        // Consume the request, keeping the bytes of the requests pipelined behind it
+        pData->m_mRequestMutex.lock();
+
+        pData->m_baBuffer.remove(0, tParser.requestLength());
+        pData->m_tParser.reset();
+        pData->m_iRequestsServed++;
+        pData->m_bProcessing = false;
+        pData->m_bStreaming = pData->m_bStreaming || bForceKeepAlive;
+        pData->m_tLastActivity.restart();
+
+        pData->m_mRequestMutex.unlock();
 
         // If the socket is still connected...
         if (pSocket->state() == QAbstractSocket::ConnectedState)
@@ -565,273 +757,368 @@ void CHTTPServer::processRequest(QTcpSocket* pSocket)
             pSocket->flush();
 
             // In case we don't have a keep-alive connection, free the socket and its user data
-            if (bKeepAlive == false && bForceKeepAlive == false)
+            // When a file is still being streamed, this is done at the end of the transfer
+            if (bKeepAlive == false && bForceKeepAlive == false && bTransferPending == false)
             {
                 CClientData::deleteFromSocket(pSocket);
                 pSocket->disconnect();
                 pSocket->deleteLater();
             }
+            else
+            {
+                bReady = (bTransferPending == false);
+            }
         }
         else
         {
             qWarning() << QString("CHTTPServer::processRequest() : Socket is not in connected state");
         }
+
+        m_tMetrics.requestTime().observe(tRequestTimer.nsecsElapsed() / 1000);
     }
 
-    if (lock())
+    if (m_bUseFloodProtection)
     {
-        if (m_bUseFloodProtection)
-        {
-            // Process request monitors
-            m_mMonitors[sIPAddress].processOut();
-        }
-
-        unlock();
+        m_tRateLimiter.requestOut(tPeerAddress);
     }
+
+    return bReady;
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns the header of a HTTP request parsed from \a sText.
+    Closes the keep-alive connections owned by \a pOwner that have been idle for longer than the keep-alive timeout. \br\br
+    Must be called from the thread of \a pOwner.
 */
-QString CHTTPServer::getRequestHeader(const QString& sText)
+void CHTTPServer::closeIdleSockets(QObject* pOwner)
 {
-    // In order to locate the header's termination, we look for a double new line, ie either "\n\n" or "\r\n\r\n"
-
-    int iPos = sText.indexOf("\n\n");
-
-    if (iPos > 0)
+    if (m_iKeepAliveTimeoutMS <= 0)
     {
-        iPos += 2;
+        return;
     }
-    else
+
+    foreach (QTcpSocket* pSocket, pOwner->findChildren<QTcpSocket*>(QString(), Qt::FindDirectChildrenOnly))
     {
-        iPos = sText.indexOf("\r\n\r\n");
+        CClientData* pData = CClientData::getFromSocket(pSocket);
+
+        if (pData == nullptr || pSocket->bytesToWrite() > 0)
+        {
+            continue;
+        }
+
+        bool bIdle = false;
+
+        {
+            QMutexLocker locker(&pData->m_mRequestMutex);
+
+            bIdle = pData->m_bProcessing == false && pData->m_bStreaming == false && pData->m_tLastActivity.hasExpired(m_iKeepAliveTimeoutMS);
+        }
 
-        if (iPos > 0)
+        if (bIdle)
         {
-            iPos += 4;
+            QMutexLocker locker(&pData->m_mTransferMutex);
+
+            bIdle = (pData->m_pTransferFile == nullptr);
+        }
+
+        if (bIdle)
+        {
+            // Appel du gestionnaire implment (ou non) par les sous-classes
+            handleSocketDisconnection(pSocket);
+
+            CClientData::deleteFromSocket(pSocket);
+            pSocket->disconnect();
+            pSocket->close();
+            pSocket->deleteLater();
         }
     }
+}
+
+//-------------------------------------------------------------------------------------------------
 
-    if (iPos > 0)
+/*!
+    Sends an error response with status \a szStatus to \a pSocket, then frees the socket and its user data.
+*/
+void CHTTPServer::sendErrorAndClose(QTcpSocket* pSocket, const char* szStatus)
+{
+    if (pSocket->state() == QAbstractSocket::ConnectedState)
     {
-        return sText.left(iPos);
+        QByteArray baHTML;
+        CHTTPResponse tResponse(CClientData::responseBufferFromSocket(pSocket), &m_tMetrics);
+
+        baHTML.append("<!doctype html>"HTML_NL);
+        baHTML.append("<html>"HTML_NL);
+        baHTML.append("<body>"HTML_NL);
+        baHTML.append(szStatus);
+        baHTML.append("</body>"HTML_NL);
+        baHTML.append("</html>"HTML_NL);
+
+        tResponse.begin(szStatus, MIME_Content_HTML);
+        tResponse.addContentLength(baHTML.count());
+        tResponse.addConnection(false);
+        tResponse.end();
+        tResponse.send(pSocket, baHTML);
+
+        pSocket->flush();
     }
 
-    return sText;
+    CClientData::deleteFromSocket(pSocket);
+    pSocket->disconnect();
+    pSocket->deleteLater();
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Parses the requested resource and arguments. \br\br
-    \a lTokens contains the request tokens. \br
-    \a lPath will be filled the requested resource. \br
-    \a mArguments will be filled with the requested arguments.
+    Returns the content type associated with a file extension. \br\br
+    \a sExtention contains the extension.
 */
-void CHTTPServer::getRequestPathAndArgs(const QStringList& lTokens, QStringList& lPath, QMap<QString, QString>& mArguments)
+QString CHTTPServer::getContentTypeByExtension(const QString& sExtention) const
 {
-    // The path immediately follows the GET or POST token
+    QString sLowerExtention = sExtention.toLower();
 
-    if (lTokens.count() > 0)
+    if (m_vExtensionToContentType.contains(sLowerExtention))
     {
-        QStringList lGetAndPath = lTokens[0].split(" ");
+        return m_vExtensionToContentType[sLowerExtention];
+    }
 
-        if (lGetAndPath.count() > 1)
-        {
-            QStringList lPathAndArgs = lGetAndPath[1].split("?");
+    return MIME_Content_Stream;
+}
 
-            // Split the path and get its components
+//-------------------------------------------------------------------------------------------------
 
-            if (lPathAndArgs.count() > 0)
-            {
-                lPath = lPathAndArgs[0].split("/", QString::SkipEmptyParts);
-            }
+/*!
+    Activates or deactivates flood protection according to \a bUse.
+*/
+void CHTTPServer::useFloodProtection(bool bUse)
+{
+    m_bUseFloodProtection = bUse;
+}
 
-            if (lPathAndArgs.count() > 1)
-            {
-                // Get the arguments
+//-------------------------------------------------------------------------------------------------
 
-                QStringList lArgs = lPathAndArgs[1].split("&");
+/*!
+    Returns the rate limiter used for flood protection, in order to change its policy or its black list.
+*/
+CHTTPRateLimiter& CHTTPServer::rateLimiter()
+{
+    return m_tRateLimiter;
+}
 
-                foreach(QString sArg, lArgs)
-                {
-                    QStringList lCurrentArg = sArg.split("=");
+//-------------------------------------------------------------------------------------------------
 
-                    if (lCurrentArg.count() > 1)
-                    {
-                        mArguments[lCurrentArg[0]] = lCurrentArg[1];
-                    }
-                }
-            }
-        }
-    }
+/*!
+    Returns the runtime counters of the server.
+*/
+CHTTPMetrics& CHTTPServer::metrics()
+{
+    return m_tMetrics;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the path at which the metrics are served to \a sPath, for instance \c /metrics. \br\br
+    The metrics are then returned in the Prometheus text format to GET requests for this path,
+    before authorized folders and getContent() are looked at. An empty path, the default, disables this.
+*/
+void CHTTPServer::setMetricsPath(const QString& sPath)
+{
+    m_baMetricsPath = sPath.toUtf8();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the path at which the metrics are served, empty if they are not.
+*/
+QString CHTTPServer::metricsPath() const
+{
+    return QString::fromUtf8(m_baMetricsPath);
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Gets the post content from a request header. \br\br
-    \a sText contains the request. \br
-    \a baContent will be filled the post content.
+    Sets the number of threads that own and serve client sockets to \a iCount. \br\br
+    When \a iCount is greater than zero, accepted connections are spread round robin over \a iCount threads,
+    each with its own event loop. A socket is read, parsed, processed and written in the thread that owns it,
+    so that throughput scales with the number of cores. getContent() and the handleSocket*() methods are then
+    called from these threads. \br
+    When \a iCount is zero, sockets live in the server's thread (the default). \br
+    This should be called before clients connect: existing worker threads and their sockets are destroyed.
 */
-void CHTTPServer::getRequestPostContent(const QString& sText, QByteArray& baContent)
+void CHTTPServer::setWorkerThreadCount(int iCount)
 {
-    // In order to locate the POST content's termination, we look for a double new line, ie either "\n\n" or "\r\n\r\n"
+    stopWorkers();
+
+    qRegisterMetaType<qintptr>("qintptr");
 
-    // if (sText.contains(Token_ContentLength))
+    for (int iIndex = 0; iIndex < iCount; iIndex++)
     {
-        int iPos = sText.indexOf("\n\n");
+        QThread* pThread = new QThread();
+        CHTTPWorker* pWorker = new CHTTPWorker(this);
 
-        if (iPos > 0)
-        {
-            iPos += 2;
-        }
-        else
-        {
-            iPos = sText.indexOf("\r\n\r\n");
+        pWorker->moveToThread(pThread);
+        connect(pThread, SIGNAL(finished()), pWorker, SLOT(deleteLater()));
 
-            if (iPos > 0)
-            {
-                iPos += 4;
-            }
-        }
+        pThread->start();
 
-        if (iPos > 0)
-        {
-            QString sContent = sText.mid(iPos);
-            baContent = sContent.toLatin1();
-        }
+        m_vWorkerThreads << pThread;
+        m_vWorkers << pWorker;
     }
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns the value associated with a token. \br\br
-    \a lTokens contains the token list. \br
-    \a sTokenName contains the name of the value to return.
+    Returns the number of threads that own and serve client sockets.
 */
-QString CHTTPServer::getTokenValue(const QStringList& lTokens, QString sTokenName)
+int CHTTPServer::workerThreadCount() const
 {
-    QString sReturnValue;
+    return m_vWorkers.count();
+}
 
-    foreach (QString sToken, lTokens)
-    {
-        if (sToken.startsWith(sTokenName))
-        {
-            QStringList split = sToken.split(sTokenName, QString::SkipEmptyParts);
+//-------------------------------------------------------------------------------------------------
 
-            if (split.count() > 0)
-            {
-                sReturnValue = split[0];
-            }
-        }
-    }
+/*!
+    Sets the time after which an idle keep-alive connection is closed to \a iSeconds. \br\br
+    A connection is idle when no request is in process and nothing was read or written during that time.
+    Connections kept open for a streamed response are never considered idle. 0 disables the timeout.
+*/
+void CHTTPServer::setKeepAliveTimeout(int iSeconds)
+{
+    m_iKeepAliveTimeoutMS = qMax(iSeconds, 0) * 1000;
+}
+
+//-------------------------------------------------------------------------------------------------
 
-    return sReturnValue.trimmed();
+/*!
+    Sets the number of requests served on a connection before it is closed to \a iValue. \br\br
+    The last response tells the client that the connection closes. 0 means no limit.
+*/
+void CHTTPServer::setMaxRequestsPerConnection(int iValue)
+{
+    m_iMaxRequestsPerConnection = qMax(iValue, 0);
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns the value associated with a sub-token. \br\br
-    \a lTokens contains the token list. \br
-    \a sTokenName. \br
-    \a sSubTokenName contains the name of the value to return.
+    Sets the maximum number of open connections to \a iValue. \br\br
+    Clients connecting beyond this number get a 503 response and are disconnected. 0 means no limit.
 */
-QString CHTTPServer::getSubTokenValue(const QStringList& lTokens, QString sTokenName, QString sSubTokenName)
+void CHTTPServer::setMaxConnections(int iValue)
 {
-    QString sReturnValue;
+    m_iMaxConnections = qMax(iValue, 0);
+}
 
-    foreach (QString sToken, lTokens)
-    {
-        if (sToken.startsWith(sTokenName))
-        {
-            QStringList split = sToken.split(sTokenName, QString::SkipEmptyParts);
+//-------------------------------------------------------------------------------------------------
 
-            if (split.count() > 0)
-            {
-                sReturnValue = split[0];
-                break;
-            }
-        }
-    }
+/*!
+    Returns the number of open connections.
+*/
+int CHTTPServer::connectionCount() const
+{
+    return m_iConnectionCount.load();
+}
 
-    if (sReturnValue.isEmpty() == false)
-    {
-        QStringList lSubTokens = sReturnValue.split(";", QString::SkipEmptyParts);
+//-------------------------------------------------------------------------------------------------
 
-        foreach (QString sSubToken, lSubTokens)
-        {
-            sSubToken = sSubToken.trimmed();
+/*!
+    Sets the size above which a part of a multipart upload is written to a temporary file to \a iBytes. \br\br
+    Multipart bodies are parsed as they arrive, so the memory used by an upload does not depend on its size.
+    The parts are given to getContent() in CWebContext::m_lParts.
+*/
+void CHTTPServer::setUploadMemoryThreshold(qint64 iBytes)
+{
+    m_iUploadMemoryThreshold = qMax(iBytes, (qint64) 0);
+}
 
-            if (sSubToken.startsWith(sSubTokenName))
-            {
-                QStringList lSubTokenNameValue = sSubToken.split("=", QString::SkipEmptyParts);
+//-------------------------------------------------------------------------------------------------
 
-                if (lSubTokenNameValue.count() > 1)
-                {
-                    sReturnValue = lSubTokenNameValue[1];
-                    break;
-                }
-            }
-        }
+/*!
+    Stops and deletes all worker threads. Their workers, and the sockets they own, are deleted.
+*/
+void CHTTPServer::stopWorkers()
+{
+    m_vWorkers.clear();
+
+    foreach (QThread* pThread, m_vWorkerThreads)
+    {
+        pThread->quit();
+        pThread->wait();
+
+        delete pThread;
     }
 
-    sReturnValue = sReturnValue.trimmed();
+    m_vWorkerThreads.clear();
+}
+
+//-------------------------------------------------------------------------------------------------
 
-    if (sReturnValue.startsWith("\"") && sReturnValue.endsWith("\""))
+/*!
+    Adds a folder to the list of authorized folders. \br\br
+    \a sFolderName contains the name of the folder to add.
+*/
+void CHTTPServer::addAuthorizedFolder(QString sFolderName)
+{
+    if (m_vAuthorizedFolders.contains(sFolderName) == false)
     {
-        sReturnValue = sReturnValue.mid(1);
-        sReturnValue.chop(1);
+        m_vAuthorizedFolders.append(sFolderName);
     }
+}
 
-    return sReturnValue;
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the maximum number of bytes used to cache static files to \a iMaxBytes.
+*/
+void CHTTPServer::setFileCacheSize(qint64 iMaxBytes)
+{
+    m_tFileCache.setMaxBytes(iMaxBytes);
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns the content type associated with a file extension. \br\br
-    \a sExtention contains the extension.
+    Sets the size above which static files are streamed from disk instead of cached to \a iMaxFileSize.
 */
-QString CHTTPServer::getContentTypeByExtension(const QString& sExtention) const
+void CHTTPServer::setFileCacheMaxFileSize(qint64 iMaxFileSize)
 {
-    QString sLowerExtention = sExtention.toLower();
+    m_tFileCache.setMaxFileSize(iMaxFileSize);
+}
 
-    if (m_vExtensionToContentType.contains(sLowerExtention))
-    {
-        return m_vExtensionToContentType[sLowerExtention];
-    }
+//-------------------------------------------------------------------------------------------------
 
-    return MIME_Content_Stream;
+/*!
+    Activates or deactivates compression of text responses according to \a bUse. \br\br
+    When activated, responses are compressed with gzip or deflate if the client's Accept-Encoding header allows it.
+*/
+void CHTTPServer::useCompression(bool bUse)
+{
+    m_bUseCompression = bUse;
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Activates or deactivates flood protection according to \a bUse.
+    Sets the compression level to \a iLevel, from 0 (fastest) to 9 (smallest), -1 selecting zlib's default.
 */
-void CHTTPServer::useFloodProtection(bool bUse)
+void CHTTPServer::setCompressionLevel(int iLevel)
 {
-    m_bUseFloodProtection = bUse;
+    m_iCompressionLevel = qBound(-1, iLevel, 9);
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Adds a folder to the list of authorized folders. \br\br
-    \a sFolderName contains the name of the folder to add.
+    Sets the size under which dynamic responses are sent uncompressed to \a iBytes.
 */
-void CHTTPServer::addAuthorizedFolder(QString sFolderName)
+void CHTTPServer::setCompressionThreshold(int iBytes)
 {
-    if (m_vAuthorizedFolders.contains(sFolderName) == false)
-    {
-        m_vAuthorizedFolders.append(sFolderName);
-    }
+    m_iCompressionThreshold = iBytes;
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -913,70 +1200,169 @@ bool CHTTPServer::getResponseFile(const CWebContext& tContext, QTcpSocket* pSock
                 sFileName += "/" + sPathName;
             }
 
-            // Does the file exist on disk?
-            if (QFile::exists(sFileName))
+            CHTTPFileCache::CEntry tEntry;
+
+            // Does the file exist on disk? (the cache checks its modification time)
+            // Only authorized files are read into the cache, the others are just checked for existence
+            bool bExists = bAuthorized ? m_tFileCache.get(sFileName, tEntry) : QFile::exists(sFileName);
+
+            if (bExists)
             {
                 // Is the access authorized?
                 if (bAuthorized)
                 {
-                    QFile tFile(sFileName);
+                    QString sType = getContentTypeByExtension(sFileName.split(".").last());
+                    QByteArray baRange = tContext.header(Token_Range);
+                    QByteArray baContent = tEntry.m_baContent;
+                    CHTTPContentEncoder::EEncoding eEncoding = CHTTPContentEncoder::eIdentity;
+
+                    // Use a compressed variant of the file if possible (ranges are served from the identity variant)
+                    if (tEntry.m_bCached && baRange.isEmpty())
+                    {
+                        eEncoding = getResponseEncoding(tContext, sType, tEntry.m_iSize);
+
+                        if (eEncoding != CHTTPContentEncoder::eIdentity)
+                        {
+                            QByteArray baEncoded = m_tFileCache.getEncodedContent(tEntry, eEncoding, m_iCompressionLevel);
+
+                            if (baEncoded.isEmpty() == false && baEncoded.count() < baContent.count())
+                            {
+                                baContent = baEncoded;
+                                tEntry.m_baETag = CHTTPContentEncoder::encodedETag(tEntry.m_baETag, eEncoding);
+                            }
+                            else
+                            {
+                                eEncoding = CHTTPContentEncoder::eIdentity;
+                            }
+                        }
+                    }
+
+                    // Conditional request : does the client already have this version of the file?
+                    bool bNotModified = false;
+                    QByteArray baIfNoneMatch = tContext.header(Token_IfNoneMatch);
+
+                    if (baIfNoneMatch.isEmpty() == false)
+                    {
+                        bNotModified = CHTTPFileCache::matchesETag(baIfNoneMatch, tEntry.m_baETag);
+                    }
+                    else
+                    {
+                        QDateTime tSince = CHTTPFileCache::fromHTTPDate(tContext.header(Token_IfModifiedSince));
+
+                        if (tSince.isValid())
+                        {
+                            // HTTP dates have a one second resolution
+                            bNotModified = tEntry.m_tModified.toUTC().toTime_t() <= tSince.toTime_t();
+                        }
+                    }
+
+                    if (bNotModified)
+                    {
+                        CHTTPResponse tResponse(CClientData::responseBufferFromSocket(pSocket), &m_tMetrics);
+
+                        getFileResponseHeader(tResponse, HTTP_304_NOT_MODIFIED, QString(), tEntry, -1, QByteArray(), eEncoding, tContext.m_bKeepAlive);
+                        tResponse.send(pSocket);
+                        return true;
+                    }
+
+                    // Range request
+                    const char* szStatus = HTTP_200_OK;
+                    QByteArray baContentRange;
+                    qint64 iStart = 0;
+                    qint64 iEnd = tEntry.m_iSize - 1;
+                    QByteArray baIfRange = tContext.header(Token_IfRange).trimmed();
+
+                    // If-Range : the range applies only to the version of the file the client has
+                    if (baRange.isEmpty() == false && (baIfRange.isEmpty() || baIfRange == tEntry.m_baETag || baIfRange == tEntry.m_baLastModified))
+                    {
+                        switch (CHTTPFileCache::parseRange(baRange, tEntry.m_iSize, iStart, iEnd))
+                        {
+                            case CHTTPFileCache::eValidRange:
+                                szStatus = HTTP_206_PARTIAL_CONTENT;
+                                baContentRange = QString("bytes %1-%2/%3").arg(iStart).arg(iEnd).arg(tEntry.m_iSize).toLatin1();
+                                break;
+
+                            case CHTTPFileCache::eUnsatisfiable:
+                            {
+                                CHTTPResponse tResponse(CClientData::responseBufferFromSocket(pSocket), &m_tMetrics);
+
+                                baContentRange = QString("bytes */%1").arg(tEntry.m_iSize).toLatin1();
+                                getFileResponseHeader(tResponse, HTTP_416_RANGE_NOT_SATISFIABLE, sType, tEntry, 0, baContentRange, eEncoding, tContext.m_bKeepAlive);
+                                tResponse.send(pSocket);
+                                return true;
+                            }
+
+                            default:
+                                iStart = 0;
+                                iEnd = tEntry.m_iSize - 1;
+                                break;
+                        }
+                    }
+
+                    qint64 iLength = iEnd - iStart + 1;
+
+                    if (tEntry.m_bCached)
+                    {
+                        if (eEncoding != CHTTPContentEncoder::eIdentity)
+                        {
+                            iLength = baContent.count();
+                        }
+
+                        CHTTPResponse tResponse(CClientData::responseBufferFromSocket(pSocket), &m_tMetrics);
+
+                        // Send the cached content, straight from the cache entry
+                        getFileResponseHeader(tResponse, szStatus, sType, tEntry, iLength, baContentRange, eEncoding, tContext.m_bKeepAlive);
+                        tResponse.send(pSocket, baContent.constData() + iStart, iLength);
+
+                        return true;
+                    }
+
+                    // The file is too big to be cached : stream it from disk
+                    CClientData* pData = CClientData::getFromSocket(pSocket);
+                    QFile* pFile = new QFile(sFileName);
 
-                    // Open the file for reading and send it
-                    if (tFile.open(QIODevice::ReadOnly))
+                    if (pData != nullptr && pFile->open(QIODevice::ReadOnly) && pFile->seek(iStart))
                     {
-                        QString sType = getContentTypeByExtension(sFileName.split(".").last());
+                        QMutexLocker locker(&pData->m_mTransferMutex);
 
-                        QByteArray baData;
+                        if (pData->m_pTransferFile != nullptr)
+                        {
+                            delete pData->m_pTransferFile;
+                        }
 
-                        baData.append(HTTP_HEADER);
-                        baData.append(HTTP_200_OK);
-                        baData.append(HTML_NL);
-                        baData.append(Token_ContentType);
-                        baData.append(" ");
-                        baData.append(sType.toLatin1());
-                        baData.append("; charset=\"utf-8\"");
-                        baData.append(HTML_NL);
-                        baData.append(Token_ContentLength);
-                        baData.append(QString(" %1").arg(tFile.size()).toLatin1());
-                        baData.append(HTML_NL);
-                        baData.append(HTML_NL);
-                        baData.append(tFile.readAll());
+                        // The transfer is started by processRequest() once it knows what to do with the connection
+                        pData->m_pTransferFile = pFile;
+                        pData->m_iTransferRemaining = iLength;
+                        pData->m_bTransferStarted = false;
 
-                        pSocket->write(baData);
+                        CHTTPResponse tResponse(&pData->m_baResponse, &m_tMetrics);
 
-                        tFile.close();
+                        getFileResponseHeader(tResponse, szStatus, sType, tEntry, iLength, baContentRange, eEncoding, tContext.m_bKeepAlive);
+                        tResponse.send(pSocket);
 
                         return true;
                     }
+
+                    delete pFile;
                 }
                 else
                 {
                     // Send a FORBIDDEN response to the client
                     QByteArray baHTML;
-                    QByteArray baData;
+                    CHTTPResponse tResponse(CClientData::responseBufferFromSocket(pSocket), &m_tMetrics);
 
                     baHTML.append("<!doctype html>\r\n");
                     baHTML.append("<html>"HTML_NL);
                     baHTML.append("<body>"HTML_NL);
-                    baHTML.append(QString("%1").arg(HTTP_403_FORBIDDEN));
+                    baHTML.append(HTTP_403_FORBIDDEN);
                     baHTML.append("</body>"HTML_NL);
                     baHTML.append("</html>"HTML_NL);
 
-                    baData.append(HTTP_HEADER);
-                    baData.append(HTTP_403_FORBIDDEN);
-                    baData.append(HTML_NL);
-                    baData.append(Token_ContentType);
-                    baData.append(" ");
-                    baData.append(MIME_Content_HTML);
-                    baData.append("; charset=\"utf-8\"");
-                    baData.append(HTML_NL);
-                    baData.append(Token_ContentLength);
-                    baData.append(QString(" %1").arg(baHTML.count()));
-                    baData.append(HTML_NL);
-                    baData.append(HTML_NL);
-                    baData.append(baHTML);
-
-                    pSocket->write(baData);
+                    tResponse.begin(HTTP_403_FORBIDDEN, MIME_Content_HTML);
+                    tResponse.addContentLength(baHTML.count());
+                    tResponse.addConnection(tContext.m_bKeepAlive);
+                    tResponse.end();
+                    tResponse.send(pSocket, baHTML);
 
                     return true;
                 }
@@ -989,12 +1375,150 @@ bool CHTTPServer::getResponseFile(const CWebContext& tContext, QTcpSocket* pSock
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Writes the header of a static file response to \a tResponse. \br\br
+    \a szStatus is the HTTP status. \br
+    \a sType is the MIME type of the file, omitted if empty. \br
+    \a tEntry contains the file's validators (ETag and Last-Modified). \br
+    \a iLength is the number of bytes in the body, omitted if negative. \br
+    \a baContentRange is the value of the Content-Range header, omitted if empty. \br
+    \a eEncoding is the content encoding of the body. \br
+    \a bKeepAlive tells if the connection stays open after the response.
+*/
+void CHTTPServer::getFileResponseHeader(CHTTPResponse& tResponse, const char* szStatus, const QString& sType, const CHTTPFileCache::CEntry& tEntry, qint64 iLength, const QByteArray& baContentRange, CHTTPContentEncoder::EEncoding eEncoding, bool bKeepAlive)
+{
+    tResponse.begin(szStatus, sType);
+
+    if (iLength >= 0)
+    {
+        tResponse.addContentLength(iLength);
+    }
+
+    if (baContentRange.isEmpty() == false)
+    {
+        tResponse.addHeader(Token_ContentRange, baContentRange);
+    }
+
+    if (eEncoding != CHTTPContentEncoder::eIdentity)
+    {
+        tResponse.addContentEncoding(eEncoding);
+    }
+    else if (CHTTPContentEncoder::isCompressible(sType))
+    {
+        tResponse.addHeader(Token_Vary, "Accept-Encoding");
+    }
+
+    tResponse.addHeader(Token_AcceptRanges, "bytes");
+    tResponse.addHeader(Token_ETag, tEntry.m_baETag);
+    tResponse.addHeader(Token_LastModified, tEntry.m_baLastModified);
+    tResponse.addConnection(bKeepAlive);
+    tResponse.end();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the encoding to use for a response of type \a sMIMEType and size \a iSize. \br\br
+    \a tContext gives access to the client's Accept-Encoding header. \br
+    Returns \c CHTTPContentEncoder::eIdentity if compression is disabled, if the content is not text,
+    or if it is smaller than the compression threshold.
+*/
+CHTTPContentEncoder::EEncoding CHTTPServer::getResponseEncoding(const CWebContext& tContext, const QString& sMIMEType, qint64 iSize) const
+{
+    if (m_bUseCompression == false || iSize < m_iCompressionThreshold || CHTTPContentEncoder::isCompressible(sMIMEType) == false)
+    {
+        return CHTTPContentEncoder::eIdentity;
+    }
+
+    return CHTTPContentEncoder::negotiate(tContext.header(Token_AcceptEncoding));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sends the next chunks of the file being streamed to \a pSocket. \br\br
+    Chunks are read only while the socket's output buffer is below FILE_CHUNK_SIZE, so a large
+    file is never held in memory as a whole. The method is called again on each bytesWritten signal. \br
+    Returns \c true if the transfer is not finished.
+*/
+bool CHTTPServer::continueFileTransfer(QTcpSocket* pSocket)
+{
+    CClientData* pData = CClientData::getFromSocket(pSocket);
+
+    if (pData == nullptr)
+    {
+        return false;
+    }
+
+    QMutexLocker locker(&pData->m_mTransferMutex);
+
+    if (pData->m_pTransferFile == nullptr)
+    {
+        return false;
+    }
+
+    if (pData->m_bTransferStarted == false)
+    {
+        return true;
+    }
+
+    while (pData->m_iTransferRemaining > 0 && pSocket->bytesToWrite() < FILE_CHUNK_SIZE)
+    {
+        QByteArray baChunk = pData->m_pTransferFile->read(qMin(pData->m_iTransferRemaining, (qint64) FILE_CHUNK_SIZE));
+
+        if (baChunk.isEmpty())
+        {
+            // The file was truncated, the response can not be completed
+            qWarning() << QString("CHTTPServer::continueFileTransfer() : could not read %1").arg(pData->m_pTransferFile->fileName());
+
+            pData->m_bCloseAfterTransfer = true;
+            pData->m_iTransferRemaining = 0;
+            break;
+        }
+
+        pSocket->write(baChunk);
+        pData->m_iTransferRemaining -= baChunk.size();
+    }
+
+    if (pData->m_iTransferRemaining <= 0)
+    {
+        delete pData->m_pTransferFile;
+        pData->m_pTransferFile = nullptr;
+        pData->m_bTransferStarted = false;
+
+        return false;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Returns \c true if dynamic content was generated and sent to \a pSocket. \br\br
     \a tContext contains contextual information for the content generator.
 */
 bool CHTTPServer::getResponseDynamicContent(const CWebContext& tContext, QTcpSocket* pSocket)
 {
+    QByteArray baContent;
+    QString sContentMIME;
+
+    QElapsedTimer tContentTimer;
+    tContentTimer.start();
+
+    // Raw content first, it needs no conversion
+    if (getRawContent(tContext, baContent, sContentMIME))
+    {
+        m_tMetrics.contentTime().observe(tContentTimer.nsecsElapsed() / 1000);
+
+        if (pSocket->state() == QAbstractSocket::ConnectedState)
+        {
+            sendContent(tContext, pSocket, baContent, sContentMIME.isEmpty() ? QString(MIME_Content_Stream) : sContentMIME);
+        }
+
+        return false;
+    }
+
     QString sHead;
     QString sBody;
     QString sCustomResponse;
@@ -1003,69 +1527,55 @@ bool CHTTPServer::getResponseDynamicContent(const CWebContext& tContext, QTcpSoc
     // Appel de la mthode virtuelle pour remplir la page
     getContent(tContext, sHead, sBody, sCustomResponse, sCustomResponseMIME);
 
+    m_tMetrics.contentTime().observe(tContentTimer.nsecsElapsed() / 1000);
+
     // On ne traite que si la socket est en tat connect
     if (pSocket->state() == QAbstractSocket::ConnectedState)
     {
         // Au cas o la rponse customise est non-vide, on l'envoie tel quel au client
-        if (sCustomResponse.isEmpty() == false && sCustomResponseMIME == MIME_Content_Custom)
+        // Si elle est vide, la sous-classe a dj crit sa rponse dans la socket
+        if (sCustomResponseMIME == MIME_Content_Custom)
         {
-            QByteArray baData;
+            if (sCustomResponse.isEmpty() == false)
+            {
+                QByteArray baData;
 
-            baData.append(HTTP_HEADER);
-            baData.append(HTTP_200_OK);
-            baData.append(sCustomResponse);
+                baData.append(HTTP_HEADER);
+                baData.append(HTTP_200_OK);
+                baData.append(sCustomResponse);
 
-            pSocket->write(baData);
+                pSocket->write(baData);
+                m_tMetrics.addResponse(200);
+            }
 
             return true;
         }
         // Sinon, si la rponse au format XML est non-vide, c'est elle qu'on envoie au client
         else if (sCustomResponse.isEmpty() == false)
         {
-            QByteArray baData;
-            QByteArray utf8Response = sCustomResponse.toUtf8();
-
-            baData.append(HTTP_HEADER);
-            baData.append(HTTP_200_OK);
-            baData.append(HTML_NL);
-            baData.append(QString("%1 %2; charset=\"utf-8\"").arg(Token_ContentType).arg(sCustomResponseMIME));
-            baData.append(HTML_NL);
-            baData.append(QString("%1 %2").arg(Token_ContentLength).arg(utf8Response.count()));
-            baData.append(HTML_NL);
-            baData.append(HTML_NL);
-            baData.append(utf8Response);
-
-            pSocket->write(baData);
+            sendContent(tContext, pSocket, sCustomResponse.toUtf8(), sCustomResponseMIME);
         }
         // Sinon, les contenus HTML de sHead et sBody sont retourns au client
         else
         {
             // Streaming de la page
 
+            QByteArray baHead = sHead.toUtf8();
+            QByteArray baBody = sBody.toUtf8();
             QByteArray baHTML;
-            QByteArray baData;
 
+            baHTML.reserve(baHead.size() + baBody.size() + 80);
             baHTML.append("<!doctype html>"HTML_NL);
             baHTML.append("<html>"HTML_NL);
             baHTML.append("<head>"HTML_NL);
-            baHTML.append(sHead);
+            baHTML.append(baHead);
             baHTML.append("</head>"HTML_NL);
             baHTML.append("<body>"HTML_NL);
-            baHTML.append(sBody);
+            baHTML.append(baBody);
             baHTML.append("</body>"HTML_NL);
             baHTML.append("</html>"HTML_NL);
 
-            baData.append(HTTP_HEADER);
-            baData.append(HTTP_200_OK);
-            baData.append(HTML_NL);
-            baData.append(QString("%1 %2; charset=\"utf-8\"").arg(Token_ContentType).arg(MIME_Content_HTML));
-            baData.append(HTML_NL);
-            baData.append(QString("%1 %2").arg(Token_ContentLength).arg(baHTML.count()));
-            baData.append(HTML_NL);
-            baData.append(HTML_NL);
-            baData.append(baHTML);
-
-            pSocket->write(baData);
+            sendContent(tContext, pSocket, baHTML, MIME_Content_HTML);
         }
     }
 
@@ -1074,12 +1584,47 @@ bool CHTTPServer::getResponseDynamicContent(const CWebContext& tContext, QTcpSoc
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Sends a 200 response with \a baContent as body, of type \a sMIMEType, to \a pSocket. \br\br
+    The content is compressed if the client accepts it (see getResponseEncoding()). The headers are written
+    into the connection's response buffer and the body is written after them, without being copied to it.
+*/
+void CHTTPServer::sendContent(const CWebContext& tContext, QTcpSocket* pSocket, const QByteArray& baContent, const QString& sMIMEType)
+{
+    CHTTPResponse tResponse(CClientData::responseBufferFromSocket(pSocket), &m_tMetrics);
+    CHTTPContentEncoder::EEncoding eEncoding = getResponseEncoding(tContext, sMIMEType, baContent.count());
+
+    if (eEncoding != CHTTPContentEncoder::eIdentity)
+    {
+        QByteArray baEncoded = CHTTPContentEncoder::encode(baContent, eEncoding, m_iCompressionLevel);
+
+        tResponse.begin(HTTP_200_OK, sMIMEType);
+        tResponse.addContentLength(baEncoded.count());
+        tResponse.addContentEncoding(eEncoding);
+        tResponse.addConnection(tContext.m_bKeepAlive);
+        tResponse.end();
+        tResponse.send(pSocket, baEncoded);
+    }
+    else
+    {
+        tResponse.begin(HTTP_200_OK, sMIMEType);
+        tResponse.addContentLength(baContent.count());
+        tResponse.addConnection(tContext.m_bKeepAlive);
+        tResponse.end();
+        tResponse.send(pSocket, baContent);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     This method returns dynamic content. It is meant to be overridden by subclasses. \br\br
     \a tContext contains contextual information for the content generator (the associated socket, resource path, arguments, ...) \br
     \a sHead can be filled with the HTML page header. \br
     \a sBody can be filled with the HTML page body. \br
-    If \a sCustomResponse and \a sCustomResponseMIME are filled, it will override \a sHead and \a sBody and will be sent as is.
+    If \a sCustomResponse and \a sCustomResponseMIME are filled, it will override \a sHead and \a sBody and will be sent as is. \br
+    If \a sCustomResponseMIME is \c MIME_Content_Custom and \a sCustomResponse is empty, the response is considered
+    already written to the socket, and the connection is kept open.
 */
 void CHTTPServer::getContent(const CWebContext& tContext, QString& sHead, QString& sBody, QString& sCustomResponse, QString& sCustomResponseMIME)
 {
@@ -1096,6 +1641,26 @@ void CHTTPServer::getContent(const CWebContext& tContext, QString& sHead, QStrin
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    This method returns dynamic content as bytes. It is meant to be overridden by subclasses
+    that produce JSON, XML or binary data, and avoids the conversions of getContent(). \br\br
+    \a tContext contains contextual information for the content generator. \br
+    \a baContent is to be filled with the response body. \br
+    \a sContentMIME is to be filled with its MIME type, \c application/octet-stream if left empty. \br
+    Returns \c true if the response was produced, in which case getContent() is not called.
+    The default implementation returns \c false.
+*/
+bool CHTTPServer::getRawContent(const CWebContext& tContext, QByteArray& baContent, QString& sContentMIME)
+{
+    Q_UNUSED(tContext);
+    Q_UNUSED(baContent);
+    Q_UNUSED(sContentMIME);
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     This method is meant to be overridden by subclasses in order to react to a socket being disconnected. \br\br
     \a pSocket contains the disconnected socket. \br\br
@@ -1240,3 +1805,108 @@ void CHTTPServer::LogRequest(QString sIP, QString sText)
 
     Deletes the CClientData object that has been attached to \a pSocket.
 */
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CHTTPWorker
+    \inmodule qt-plus
+    \brief Owns and serves a share of a CHTTPServer's connections in a dedicated thread.
+
+    See CHTTPServer::setWorkerThreadCount().
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CHTTPWorker serving connections of \a pServer.
+*/
+CHTTPWorker::CHTTPWorker(CHTTPServer* pServer)
+    : m_pServer(pServer)
+    , m_tIdleTimer(this)
+{
+    // The timer is a child so that it moves to the worker's thread along with it
+    m_tIdleTimer.setInterval(1000);
+    connect(&m_tIdleTimer, SIGNAL(timeout()), this, SLOT(onIdleTimeout()));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CHTTPWorker. The sockets it owns are deleted along with their client data.
+*/
+CHTTPWorker::~CHTTPWorker()
+{
+    foreach (QTcpSocket* pSocket, findChildren<QTcpSocket*>())
+    {
+        pSocket->disconnect();
+        CHTTPServer::CClientData::deleteFromSocket(pSocket);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Creates a socket for \a iSocketDescriptor, a connection accepted by the server. \br\br
+    The socket is a child of this worker and lives in its thread.
+*/
+void CHTTPWorker::onNewConnection(qintptr iSocketDescriptor)
+{
+    // Start checking idle connections, from this worker's thread
+    if (m_tIdleTimer.isActive() == false)
+    {
+        m_tIdleTimer.start();
+    }
+
+    QTcpSocket* pSocket = new QTcpSocket(this);
+
+    if (pSocket->setSocketDescriptor(iSocketDescriptor) == false)
+    {
+        qWarning() << QString("CHTTPWorker::onNewConnection() : could not use socket descriptor : %1").arg(pSocket->errorString());
+
+        delete pSocket;
+        return;
+    }
+
+    m_pServer->acceptSocket(pSocket, this);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Handles a socket disconnection.
+*/
+void CHTTPWorker::onSocketDisconnected()
+{
+    m_pServer->socketDisconnected(dynamic_cast<QTcpSocket*>(QObject::sender()));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Handles data reading when a socket emits the readyRead signal.
+*/
+void CHTTPWorker::onSocketReadyRead()
+{
+    m_pServer->socketReadyRead(dynamic_cast<QTcpSocket*>(QObject::sender()));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Handles the bytesWritten signal of a socket, \a iBytes being the number of written bytes.
+*/
+void CHTTPWorker::onSocketBytesWritten(qint64 iBytes)
+{
+    m_pServer->socketBytesWritten(dynamic_cast<QTcpSocket*>(QObject::sender()), iBytes);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Closes the idle keep-alive connections owned by this worker.
+*/
+void CHTTPWorker::onIdleTimeout()
+{
+    m_pServer->closeIdleSockets(this);
+}
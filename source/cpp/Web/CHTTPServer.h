@@ -10,11 +10,23 @@
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QThreadPool>
+#include <QThread>
 #include <QRunnable>
 #include <QMutex>
+#include <QAtomicInt>
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
 
 // Application
 #include "CWebContext.h"
+#include "CHTTPRequestParser.h"
+#include "CHTTPMultipartParser.h"
+#include "CHTTPFileCache.h"
+#include "CHTTPContentEncoder.h"
+#include "CHTTPRateLimiter.h"
+#include "CHTTPResponse.h"
+#include "CHTTPMetrics.h"
 
 //-------------------------------------------------------------------------------------------------
 
@@ -39,6 +51,8 @@
 #define HTTP_205_RESET_CONTENT          "205 Reset Content"
 #define HTTP_206_PARTIAL_CONTENT        "206 Partial Content"
 
+#define HTTP_304_NOT_MODIFIED           "304 Not Modified"
+
 #define HTTP_400_BAD_REQUEST            "400 Bad Request"
 #define HTTP_401_UNAUTHORIZED           "401 Unauthorized"
 #define HTTP_402_PAYMENT_REQUIRED       "402 Payment Required"
@@ -50,6 +64,7 @@
 #define HTTP_408_REQUEST_TIMEOUT        "408 Request Timeout"
 #define HTTP_409_CONFLICT               "409 Conflict"
 #define HTTP_410_GONE                   "410 Gone"
+#define HTTP_416_RANGE_NOT_SATISFIABLE  "416 Range Not Satisfiable"
 
 #define HTTP_500_INTERNAL_SERVER_ERROR  "500 Internal Server Error"
 #define HTTP_501_NOT_IMPLEMENTED        "501 Not Implemented"
@@ -65,6 +80,17 @@
 #define Token_ContentType               "Content-Type:"
 #define Token_ContentLength             "Content-Length:"
 #define Token_ContentDisposition        "Content-Disposition:"
+#define Token_ContentRange              "Content-Range:"
+#define Token_AcceptRanges              "Accept-Ranges:"
+#define Token_Range                     "Range:"
+#define Token_IfRange                   "If-Range:"
+#define Token_ETag                      "ETag:"
+#define Token_LastModified              "Last-Modified:"
+#define Token_IfNoneMatch               "If-None-Match:"
+#define Token_IfModifiedSince           "If-Modified-Since:"
+#define Token_AcceptEncoding            "Accept-Encoding:"
+#define Token_ContentEncoding           "Content-Encoding:"
+#define Token_Vary                      "Vary:"
 #define Token_boundary                  "boundary"
 #define Token_name                      "name"
 
@@ -90,11 +116,51 @@
 
 //-------------------------------------------------------------------------------------------------
 
+class CHTTPServer;
+
+//! Owns the sockets of a share of the server's connections, in its own thread
+//! Used when the server has worker threads (see CHTTPServer::setWorkerThreadCount())
+class QTPLUSSHARED_EXPORT CHTTPWorker : public QObject
+{
+    Q_OBJECT
+
+    friend class CHTTPServer;
+
+public:
+
+    //! Constructor
+    CHTTPWorker(CHTTPServer* pServer);
+
+    //! Destructor
+    virtual ~CHTTPWorker();
+
+public slots:
+
+    //! Creates a socket for an accepted connection
+    void onNewConnection(qintptr iSocketDescriptor);
+
+protected slots:
+
+    void onSocketDisconnected();
+    void onSocketReadyRead();
+    void onSocketBytesWritten(qint64 iBytes);
+    void onIdleTimeout();
+
+protected:
+
+    CHTTPServer*    m_pServer;
+    QTimer          m_tIdleTimer;       // Closes idle keep-alive connections
+};
+
+//-------------------------------------------------------------------------------------------------
+
 //! Defines a HTTP server
 class QTPLUSSHARED_EXPORT CHTTPServer : public QTcpServer
 {
     Q_OBJECT
 
+    friend class CHTTPWorker;
+
 public:
 
     //-------------------------------------------------------------------------------------------------
@@ -114,9 +180,57 @@ public:
     //! Activates or deactivates flood protection (activated by default)
     void useFloodProtection(bool bUse);
 
+    //! Returns the rate limiter used for flood protection
+    CHTTPRateLimiter& rateLimiter();
+
+    //! Returns the runtime counters of the server
+    CHTTPMetrics& metrics();
+
+    //! Sets the path at which the metrics are served in the Prometheus text format, empty to not serve them (the default)
+    void setMetricsPath(const QString& sPath);
+
+    //! Returns the path at which the metrics are served
+    QString metricsPath() const;
+
+    //! Sets the number of threads that own and serve client sockets, 0 to serve them in the server's thread
+    void setWorkerThreadCount(int iCount);
+
+    //! Returns the number of worker threads
+    int workerThreadCount() const;
+
+    //! Sets the time after which an idle keep-alive connection is closed, in seconds, 0 to never close it (15 by default)
+    void setKeepAliveTimeout(int iSeconds);
+
+    //! Sets the number of requests served on a connection before it is closed, 0 for no limit (1000 by default)
+    void setMaxRequestsPerConnection(int iValue);
+
+    //! Sets the maximum number of open connections, 0 for no limit (the default)
+    void setMaxConnections(int iValue);
+
+    //! Returns the number of open connections
+    int connectionCount() const;
+
+    //! Sets the size above which a part of a multipart upload is spooled to a temporary file (256 KB by default)
+    void setUploadMemoryThreshold(qint64 iBytes);
+
     //!  Adds a folder to the list of authorized folders
     void addAuthorizedFolder(QString sFolderName);
 
+    //! Sets the maximum number of bytes used to cache static files (32 MB by default)
+    void setFileCacheSize(qint64 iMaxBytes);
+
+    //! Sets the size above which static files are streamed from disk instead of cached (4 MB by default)
+    void setFileCacheMaxFileSize(qint64 iMaxFileSize);
+
+    //! Activates or deactivates gzip/deflate compression of text responses (activated by default)
+    void useCompression(bool bUse);
+
+    //! Sets the compression level, from 0 to 9, -1 for zlib's default
+    void setCompressionLevel(int iLevel);
+
+    //! Sets the size under which dynamic responses are not compressed (1024 bytes by default)
+    void setCompressionThreshold(int iBytes);
+
     //! Pauses the server. When paused, the server will not serve any request
     void pause();
 
@@ -132,6 +246,9 @@ public:
     //! To be overridden by subclasses in order to feed content to the client
     virtual void getContent(const CWebContext& tContext, QString& sHead, QString& sBody, QString& sCustomResponse, QString& sCustomResponseMIME);
 
+    //! To be overridden by subclasses in order to feed raw bytes to the client, returns true if content was produced
+    virtual bool getRawContent(const CWebContext& tContext, QByteArray& baContent, QString& sContentMIME);
+
     //! To be overridden by subclasses in order to react after sending data to the client
     virtual void handleSocketBytesWritten(QTcpSocket* pSocket, qint64 iBytes);
 
@@ -159,40 +276,63 @@ public:
 
 protected:
 
-    //!
-    QStringList getHeaderTokens(QByteArray baData);
+    //! Dispatches a new connection to a worker thread, if any
+    virtual void incomingConnection(qintptr iSocketDescriptor) Q_DECL_OVERRIDE;
+
+    //! Sets up a newly connected socket, its signals being handled by pReceiver
+    void acceptSocket(QTcpSocket* pSocket, QObject* pReceiver);
+
+    //! Reads and parses incoming bytes of a socket
+    void socketReadyRead(QTcpSocket* pSocket);
+
+    //! Called when bytes have been written to a socket
+    void socketBytesWritten(QTcpSocket* pSocket, qint64 iBytes);
+
+    //! Called when a socket is disconnected
+    void socketDisconnected(QTcpSocket* pSocket);
+
+    //! Stops and deletes all worker threads
+    void stopWorkers();
 
-    //! Returns the request's excpected byte count
-    int getExpectedBytes(QStringList lTokens);
+    //! Executes the complete requests waiting in a socket's buffer, one at a time
+    void processPendingRequests(QTcpSocket* pSocket);
+
+    //! Feeds the received part of a multipart body to its parser and removes it from the buffer
+    bool consumeMultipartBody(QTcpSocket* pSocket);
 
     //! Handles a client request
-    void processRequest(QTcpSocket* pSocket);
+    //! Returns true if the connection remains open and ready for the next request
+    bool processRequest(QTcpSocket* pSocket);
+
+    //! Closes the idle keep-alive connections among the sockets owned by pOwner
+    void closeIdleSockets(QObject* pOwner);
 
     //! Sends to the client a requested file if found
     bool getResponseFile(const CWebContext& tContext, QTcpSocket* pSocket);
 
-    //! Gets some dynamic content (i.e generated)
-    //! Returns true if the connection must remain keep-alive
-    bool getResponseDynamicContent(const CWebContext& tContext, QTcpSocket* pSocket);
-
-    //! Returns the header of a HTTP request parsed from sText
-    QString getRequestHeader(const QString& sText);
+    //! Writes the header of a static file response
+    void getFileResponseHeader(CHTTPResponse& tResponse, const char* szStatus, const QString& sType, const CHTTPFileCache::CEntry& tEntry, qint64 iLength, const QByteArray& baContentRange, CHTTPContentEncoder::EEncoding eEncoding, bool bKeepAlive);
 
-    //! Splits up the URL path and arguments
-    void getRequestPathAndArgs(const QStringList& lTokens, QStringList& lPath, QMap<QString, QString>& mArguments);
+    //! Returns the encoding to use for a response, given the client's Accept-Encoding header
+    CHTTPContentEncoder::EEncoding getResponseEncoding(const CWebContext& tContext, const QString& sMIMEType, qint64 iSize) const;
 
-    //! Gets the post content from a request header
-    void getRequestPostContent(const QString& sText, QByteArray& baContent);
+    //! Sends the next chunks of a file being streamed to pSocket
+    //! Returns true if the transfer is not finished
+    bool continueFileTransfer(QTcpSocket* pSocket);
 
-    //! Returns the value associated with a token
-    QString getTokenValue(const QStringList& lTokens, QString sTokenName);
+    //! Gets some dynamic content (i.e generated)
+    //! Returns true if the connection must remain keep-alive
+    bool getResponseDynamicContent(const CWebContext& tContext, QTcpSocket* pSocket);
 
-    //!
-    QString getSubTokenValue(const QStringList& lTokens, QString sTokenName, QString sSubTokenName);
+    //! Sends a 200 response with the given body, compressed if possible
+    void sendContent(const CWebContext& tContext, QTcpSocket* pSocket, const QByteArray& baContent, const QString& sMIMEType);
 
     //! Returns the content type associated with a file extension
     QString getContentTypeByExtension(const QString& sExtension) const;
 
+    //! Sends an error response and closes the connection
+    void sendErrorAndClose(QTcpSocket* pSocket, const char* szStatus);
+
     //! Logs an incoming HTTP request
     void LogRequest(QString sIP, QString sText);
 
@@ -206,6 +346,8 @@ protected slots:
     void onSocketDisconnected();
     void onSocketReadyRead();
     void onSocketBytesWritten(qint64 iBytes);
+    void onSocketDestroyed();
+    void onIdleTimeout();
 
     //-------------------------------------------------------------------------------------------------
     // Inner classes
@@ -223,18 +365,51 @@ public:
 
         //!
         CClientData(QTcpSocket* pSocket)
-            : m_bHeaderRead(false)
-            , m_iExpectedBytes(0)
+            : m_mTransferMutex(QMutex::Recursive)
+            , m_pTransferFile(nullptr)
+            , m_iTransferRemaining(0)
+            , m_bTransferStarted(false)
+            , m_bCloseAfterTransfer(false)
+            , m_bProcessing(false)
+            , m_bStreaming(false)
+            , m_iRequestsServed(0)
+            , m_pMultipartParser(nullptr)
         {
+            m_tLastActivity.start();
+
+            // Reserved capacity is kept when the buffer is cleared for the next response
+            m_baResponse.reserve(1024);
             pSocket->setProperty(PROP_DATA, (qulonglong) this);
         }
 
+        //!
+        ~CClientData()
+        {
+            if (m_pTransferFile != nullptr)
+            {
+                delete m_pTransferFile;
+            }
+
+            if (m_pMultipartParser != nullptr)
+            {
+                delete m_pMultipartParser;
+            }
+        }
+
         //!
         static CClientData* getFromSocket(QTcpSocket* pSocket)
         {
             return (CClientData*) pSocket->property(PROP_DATA).toULongLong();
         }
 
+        //!
+        static QByteArray* responseBufferFromSocket(QTcpSocket* pSocket)
+        {
+            CClientData* pData = getFromSocket(pSocket);
+
+            return pData != nullptr ? &pData->m_baResponse : nullptr;
+        }
+
         //!
         static void deleteFromSocket(QTcpSocket* pSocket)
         {
@@ -246,11 +421,21 @@ public:
             }
         }
 
-        bool                    m_bHeaderRead;
-        QString                 m_sMultipartBoundary;
-        int                     m_iExpectedBytes;
+        CHTTPRequestParser      m_tParser;
         QByteArray              m_baBuffer;
         QMap<QString, QVariant> m_vUserData;
+        QMutex                  m_mTransferMutex;       // Protects the file transfer members
+        QFile*                  m_pTransferFile;        // File being streamed to the client, if any
+        qint64                  m_iTransferRemaining;   // Bytes of m_pTransferFile still to send
+        bool                    m_bTransferStarted;     // True once the request processor has released the transfer
+        bool                    m_bCloseAfterTransfer;  // True if the connection must be closed at the end of the transfer
+        QMutex                  m_mRequestMutex;        // Protects the buffer, the parser and the request state members
+        bool                    m_bProcessing;          // True while a request of this connection is being processed
+        bool                    m_bStreaming;           // True if the connection was kept open for a streamed response
+        int                     m_iRequestsServed;      // Number of requests processed on this connection
+        QElapsedTimer           m_tLastActivity;        // Restarted each time bytes are read or written
+        CHTTPMultipartParser*   m_pMultipartParser;     // Parses a multipart body as it arrives, if any
+        QByteArray              m_baResponse;           // Reused buffer for the status line and headers of responses
     };
 
     //! This class executes requests in threaded mode
@@ -266,78 +451,19 @@ public:
 
         virtual void run() Q_DECL_OVERRIDE
         {
-            m_pServer->processRequest(m_pSocket);
-        }
-
-    protected:
-
-        CHTTPServer*    m_pServer;
-        QTcpSocket*     m_pSocket;
-    };
-
-    //! This class monitors request to detect flood attacks
-    class CRequestMonitor
-    {
-    public:
-
-        CRequestMonitor()
-            : m_dSampleStartTime(QDateTime::currentDateTime())
-            , m_iSampleRequestCount(0)
-            , m_iSimultaneousRequestCount(0)
-            , m_bFlooding(false)
-        {
-        }
-
-        void reset()
-        {
-            m_dSampleStartTime = QDateTime::currentDateTime();
-            m_iSampleRequestCount = 0;
-            m_iSimultaneousRequestCount = 0;
-            m_bFlooding = false;
-        }
-
-        void processIn()
-        {
-            const int iSampleMillis = 4000;
-
-            m_iSampleRequestCount++;
-            m_iSimultaneousRequestCount++;
+            m_pServer->m_tMetrics.removeQueuedRequest();
 
-            QDateTime dNow = QDateTime::currentDateTime();
-
-            if (m_dSampleStartTime.msecsTo(dNow) > iSampleMillis)
+            // Go on with pipelined requests, if any
+            if (m_pServer->processRequest(m_pSocket))
             {
-                if (m_iSampleRequestCount > (15 * (iSampleMillis / 1000)))
-                {
-                    m_bFlooding = true;
-                }
-
-                m_dSampleStartTime = dNow;
-                m_iSampleRequestCount = 0;
-            }
-
-            if (m_iSimultaneousRequestCount > 15)
-            {
-                m_bFlooding = true;
+                m_pServer->processPendingRequests(m_pSocket);
             }
         }
 
-        void processOut()
-        {
-            m_iSimultaneousRequestCount--;
-        }
-
-        bool shouldBeBlocked() const
-        {
-            return m_bFlooding;
-        }
-
     protected:
 
-        QDateTime   m_dSampleStartTime;
-        int         m_iSampleRequestCount;
-        int         m_iSimultaneousRequestCount;
-        bool        m_bFlooding;
+        CHTTPServer*    m_pServer;
+        QTcpSocket*     m_pSocket;
     };
 
     //-------------------------------------------------------------------------------------------------
@@ -347,14 +473,26 @@ public:
 protected:
 
     QMutex                          m_mMutex;                   // Data protection
-    int                             m_iRequestCount;            // Total request count
-    int                             m_iMaxRequestPerSeconds;    //
+    QAtomicInt                      m_iRequestCount;            // Total request count
     bool                            m_bDisabled;                // Tells if the server should ignore requests
     bool                            m_bUseFloodProtection;
+    bool                            m_bUseCompression;          // Tells if text responses may be compressed
+    int                             m_iCompressionLevel;        // zlib compression level
+    int                             m_iCompressionThreshold;    // Size under which dynamic responses are sent as is
     QVector<QString>                m_vAuthorizedFolders;       // Tells which folders users can access
     QMap<QString, QString>          m_vExtensionToContentType;  // Used to converta file extension to a MIME type
+    CHTTPFileCache                  m_tFileCache;               // Static files cache
     QThreadPool                     m_pProcessors;              // Threaded request processors
-    QMap<QString, CRequestMonitor>  m_mMonitors;                // Anti-flooding monitor
-    QStringList                     m_lStaticIPBlackList;
-    QStringList                     m_lDynamicIPBlackList;
+    CHTTPRateLimiter                m_tRateLimiter;             // Anti-flooding monitor and black lists
+    CHTTPMetrics                    m_tMetrics;                 // Runtime counters
+    QByteArray                      m_baMetricsPath;            // Path serving the metrics, empty if not served
+    QVector<QThread*>               m_vWorkerThreads;           // Threads owning client sockets, if any
+    QVector<CHTTPWorker*>           m_vWorkers;                 // Socket owners, one per worker thread
+    QAtomicInt                      m_iNextWorker;              // Round robin index of the next worker to use
+    QAtomicInt                      m_iConnectionCount;         // Number of open connections
+    QTimer                          m_tIdleTimer;               // Closes idle keep-alive connections owned by the server
+    int                             m_iKeepAliveTimeoutMS;      // Time after which an idle keep-alive connection is closed
+    int                             m_iMaxRequestsPerConnection;
+    int                             m_iMaxConnections;
+    qint64                          m_iUploadMemoryThreshold;   // Size above which an uploaded part goes to disk
 };
@@ -1,9 +1,11 @@
 
 // Qt
 #include <QRegExp>
+#include <QMetaObject>
 
 // Application
 #include "CMJPEGClient.h"
+#include "../Image/CJPEGCodec.h"
 
 //-------------------------------------------------------------------------------------------------
 
@@ -11,6 +13,21 @@
     \class CMJPEGClient
     \inmodule qt-plus
     \brief A client for MJPEG streams.
+
+    Received data is appended to a buffer that is parsed in place : the parser searches the end of the
+    headers and reads the Content-Length of each part, or searches the next boundary when a part has none,
+    resuming each search where the previous one stopped. The JPEG data of a frame is copied once, out of the buffer. \br
+    Frames are decoded by a thread pool shared by all clients (see decodePool()). Each client keeps only the
+    latest frame waiting for decoding, so a client that receives frames faster than they can be decoded skips
+    frames instead of queueing them. Decoded images are handed back to the client's thread, which emits newImage(). \br
+    Consumers that do not need pixels can turn decoding off with setDecodeImages() and use the newJPEG() signal
+    (see setEmitJPEG()). \br\br
+    Nothing blocks : connecting, host name lookup included, and reading are driven by the socket's signals,
+    so many clients can share a thread. A watchdog restarts the connection when connecting takes too long,
+    when the server stops sending data or when data arrives without complete frames (see setConnectTimeout(),
+    setReadTimeout() and setStallTimeout()). Attempts are spaced by a delay that doubles after each failure,
+    up to a maximum (see setReconnectDelay()), and is reset once frames are received.
+    State changes are reported by stateChanged().
 */
 
 /*!
@@ -19,12 +36,69 @@
     This signal is emitted when an new image is ready.
 */
 
+/*!
+    \fn void CMJPEGClient::stateChanged(CMJPEGClient::EState eState)
+
+    This signal is emitted when the state of the connection changes to \a eState.
+*/
+
+/*!
+    \fn void CMJPEGClient::newJPEG(const QByteArray& baJPEG)
+
+    This signal is emitted with \a baJPEG, the JPEG data of each frame, when enabled with setEmitJPEG().
+*/
+
 //-------------------------------------------------------------------------------------------------
 
-#define HTTP_HEADER			"http/1.1"
 #define HTTP_BOUNDARY		"boundary="
-#define HTTP_CONTENT_TYPE	"content-type"
-#define HTTP_CONTENT_LENGTH	"content-length"
+#define HTTP_CONTENT_TYPE	"Content-Type"
+#define HTTP_CONTENT_LENGTH	"Content-Length"
+
+// Maximum amount of data kept while waiting for the end of a part
+#define MAX_BUFFER_SIZE		(16 * 1024 * 1024)
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CMJPEGDecodeTask for \a pClient.
+*/
+CMJPEGDecodeTask::CMJPEGDecodeTask(CMJPEGClient* pClient)
+    : m_pClient(pClient)
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Decodes the latest frame of the client until it has no frame waiting.
+*/
+void CMJPEGDecodeTask::run()
+{
+    forever
+    {
+        QByteArray baJPEG;
+
+        {
+            QMutexLocker locker(&m_pClient->m_tDecodeMutex);
+
+            if (m_pClient->m_baPendingJPEG.isEmpty())
+            {
+                m_pClient->m_bDecoding = false;
+                m_pClient->m_tDecodeDone.wakeAll();
+                return;
+            }
+
+            baJPEG.swap(m_pClient->m_baPendingJPEG);
+        }
+
+        QImage image = CJPEGCodec::forCurrentThread()->decode(baJPEG);
+
+        if (image.isNull() == false)
+        {
+            QMetaObject::invokeMethod(m_pClient, "onImageDecoded", Qt::QueuedConnection, Q_ARG(QImage, image));
+        }
+    }
+}
 
 //-------------------------------------------------------------------------------------------------
 
@@ -33,11 +107,35 @@
 */
 CMJPEGClient::CMJPEGClient()
     : m_pClient(this)
+    , m_tReconnectTimer(this)
+    , m_tWatchdog(this)
+    , m_eState(eDisconnected)
+    , m_iConnectTimeoutMS(5000)
+    , m_iReadTimeoutMS(5000)
+    , m_iStallTimeoutMS(10000)
+    , m_iMinReconnectDelayMS(500)
+    , m_iMaxReconnectDelayMS(30000)
+    , m_iReconnectDelayMS(500)
+    , m_eParseState(eResponseHeaders)
+    , m_iParsePos(0)
+    , m_iSearchPos(0)
+    , m_iContentLength(-1)
+    , m_iPort(0)
     , m_bKeepAlive(false)
-    , m_bReadingImage(false)
+    , m_bDecodeImages(true)
+    , m_bEmitJPEG(false)
+    , m_iFramesReceived(0)
+    , m_bDecoding(false)
+    , m_iFramesDropped(0)
 {
+    m_tReconnectTimer.setSingleShot(true);
+
+    connect(&m_pClient, SIGNAL(connected()), this, SLOT(onConnected()));
     connect(&m_pClient, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
     connect(&m_pClient, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    connect(&m_pClient, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onError(QAbstractSocket::SocketError)));
+    connect(&m_tReconnectTimer, SIGNAL(timeout()), this, SLOT(onDoConnection()));
+    connect(&m_tWatchdog, SIGNAL(timeout()), this, SLOT(onWatchdog()));
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -47,6 +145,19 @@ CMJPEGClient::CMJPEGClient()
 */
 CMJPEGClient::~CMJPEGClient()
 {
+    // The socket must not call back into a client being destroyed
+    m_pClient.disconnect(this);
+    m_pClient.abort();
+
+    QMutexLocker locker(&m_tDecodeMutex);
+
+    // Let the decoding task finish its current frame
+    m_baPendingJPEG.clear();
+
+    while (m_bDecoding)
+    {
+        m_tDecodeDone.wait(&m_tDecodeMutex);
+    }
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -65,7 +176,15 @@ void CMJPEGClient::openURL(const QString& sURL, bool bKeepAlive)
         m_iPort = tExp.cap(2).toInt();
         m_sResource = tExp.cap(3);
 
+        if (m_sResource.isEmpty())
+        {
+            m_sResource = "/";
+        }
+
         m_bKeepAlive = bKeepAlive;
+        m_iReconnectDelayMS = m_iMinReconnectDelayMS;
+
+        m_tReconnectTimer.stop();
 
         onDoConnection();
     }
@@ -83,7 +202,66 @@ void CMJPEGClient::openURL(const QString& sURL, bool bKeepAlive)
 void CMJPEGClient::closeURL()
 {
     m_bKeepAlive = false;
-    m_pClient.disconnectFromHost();
+    m_tReconnectTimer.stop();
+    m_tWatchdog.stop();
+
+    // Change the state first, aborting may emit disconnected()
+    setState(eDisconnected);
+
+    m_pClient.abort();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the state of the connection.
+*/
+CMJPEGClient::EState CMJPEGClient::state() const
+{
+    return m_eState;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the time allowed to connect to \a iMilliseconds.
+*/
+void CMJPEGClient::setConnectTimeout(int iMilliseconds)
+{
+    m_iConnectTimeoutMS = iMilliseconds;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iMilliseconds the time without receiving data after which the connection is restarted.
+*/
+void CMJPEGClient::setReadTimeout(int iMilliseconds)
+{
+    m_iReadTimeoutMS = iMilliseconds;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iMilliseconds the time without receiving a complete frame after which the connection is restarted.
+*/
+void CMJPEGClient::setStallTimeout(int iMilliseconds)
+{
+    m_iStallTimeoutMS = iMilliseconds;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the delay before the first reconnection attempt to \a iMinimumMS. The delay doubles after each
+    failed attempt, up to \a iMaximumMS.
+*/
+void CMJPEGClient::setReconnectDelay(int iMinimumMS, int iMaximumMS)
+{
+    m_iMinReconnectDelayMS = qMax(iMinimumMS, 1);
+    m_iMaxReconnectDelayMS = qMax(iMaximumMS, m_iMinReconnectDelayMS);
+    m_iReconnectDelayMS = m_iMinReconnectDelayMS;
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -99,47 +277,228 @@ const QImage& CMJPEGClient::getImage() const
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Handles connection to the server.
+    Sets whether frames are decoded and signaled with newImage() to \a bDecode.
+*/
+void CMJPEGClient::setDecodeImages(bool bDecode)
+{
+    m_bDecodeImages = bDecode;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets whether the JPEG data of each frame is signaled with newJPEG() to \a bEmit.
+*/
+void CMJPEGClient::setEmitJPEG(bool bEmit)
+{
+    m_bEmitJPEG = bEmit;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of frames received.
+*/
+qint64 CMJPEGClient::framesReceived() const
+{
+    return m_iFramesReceived;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of frames that were not decoded because a newer frame arrived before decoding started.
+*/
+qint64 CMJPEGClient::framesDropped() const
+{
+    QMutexLocker locker(&m_tDecodeMutex);
+
+    return m_iFramesDropped;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the thread pool that decodes the frames of all clients. \br\br
+    It has as many threads as there are cores by default, its threads do not expire so that they keep their JPEG codec.
+*/
+QThreadPool* CMJPEGClient::decodePool()
+{
+    static QThreadPool s_tPool;
+    static bool s_bInitialized = false;
+
+    if (s_bInitialized == false)
+    {
+        s_bInitialized = true;
+        s_tPool.setExpiryTimeout(-1);
+    }
+
+    return &s_tPool;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Starts connecting to the server. The request is sent by onConnected().
 */
 void CMJPEGClient::onDoConnection()
 {
-    // qDebug() << QString("CMJPEGClient::onDoConnection() : connecting to %1:%2").arg(m_sIP).arg(m_iPort);
+    resetParser();
 
-    QHostAddress address(m_sIP);
+    setState(eConnecting);
 
-    m_pClient.connectToHost(address, m_iPort);
+    // The host name lookup and the connection are asynchronous
+    m_pClient.abort();
+    m_pClient.connectToHost(m_sIP, m_iPort);
 
-    // Attente de connexion au serveur HTTP
-    if (m_pClient.waitForConnected(20000))
+    m_tWatchdog.start(qBound(100, qMin(m_iConnectTimeoutMS, qMin(m_iReadTimeoutMS, m_iStallTimeoutMS)) / 4, 1000));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sends the request for the stream, once connected.
+*/
+void CMJPEGClient::onConnected()
+{
+    QString sGet = QString(
+                "GET %1 HTTP/1.1\r\n"
+                "Host: %2:%3\r\n"
+                "Connection: close\r\n"
+                "\r\n"
+                ).arg(m_sResource).arg(m_sIP).arg(m_iPort);
+
+    // Envoi d'un GET au serveur HTTP
+    m_pClient.write(sGet.toLatin1());
+
+    m_tLastData.start();
+    m_tLastFrame.start();
+
+    setState(eConnected);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Handles disconnection from the server. Schedules a new connection if the keep alive flag was set to \c true.
+*/
+void CMJPEGClient::onDisconnected()
+{
+    if (m_eState == eConnected || m_eState == eStreaming)
     {
-        QString sGet = QString("GET %1\r\n").arg(m_sResource);
+        restart("disconnected by the server");
+    }
+}
 
-        // qDebug() << QString("CMJPEGClient::onDoConnection() : getting %1").arg(sGet);
+//-------------------------------------------------------------------------------------------------
 
-        // Envoi d'un GET au serveur HTTP
-        m_pClient.write(sGet.toLatin1());
+/*!
+    Handles the socket error \a eError, which ends the current connection attempt or connection.
+*/
+void CMJPEGClient::onError(QAbstractSocket::SocketError eError)
+{
+    Q_UNUSED(eError);
+
+    if (m_eState == eConnecting || m_eState == eConnected || m_eState == eStreaming)
+    {
+        restart(m_pClient.errorString());
     }
-    else
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Restarts the connection when connecting, receiving data or receiving frames takes too long.
+*/
+void CMJPEGClient::onWatchdog()
+{
+    switch (m_eState)
     {
-        qWarning() << "CMJPEGClient::onDoConnection() : Unable to connect, retrying in 2 seconds";
+        case eConnecting:
+            if (m_tStateTime.elapsed() > m_iConnectTimeoutMS)
+            {
+                restart("connection timed out");
+            }
+            break;
+
+        case eConnected:
+        case eStreaming:
+            if (m_tLastData.elapsed() > m_iReadTimeoutMS)
+            {
+                restart("no data received");
+            }
+            else if (m_tLastFrame.elapsed() > m_iStallTimeoutMS)
+            {
+                restart("no frame received");
+            }
+            break;
 
-        // On retente la connexion dans deux secondes
-        QTimer::singleShot(2000, this, SLOT(onDoConnection()));
+        default:
+            m_tWatchdog.stop();
+            break;
     }
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Handles disconnection from the server. Triggers onDoConnection() if the keep alive flag was set to \c true.
+    Sets the state to \a eState and emits stateChanged() if it changed.
 */
-void CMJPEGClient::onDisconnected()
+void CMJPEGClient::setState(EState eState)
 {
-    // Si une connexion permanente est demande, tentative de reconnexion au serveur HTTP
+    m_tStateTime.start();
+
+    if (m_eState != eState)
+    {
+        m_eState = eState;
+
+        emit stateChanged(m_eState);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Drops the connection, logging \a sReason, and schedules a new attempt if the stream is kept alive.
+*/
+void CMJPEGClient::restart(const QString& sReason)
+{
+    qWarning() << QString("CMJPEGClient::restart() : %1:%2 : %3").arg(m_sIP).arg(m_iPort).arg(sReason);
+
+    // Change the state first, aborting may emit disconnected()
     if (m_bKeepAlive)
     {
-        QTimer::singleShot(2000, this, SLOT(onDoConnection()));
+        scheduleReconnect();
+    }
+    else
+    {
+        m_tWatchdog.stop();
+        setState(eDisconnected);
+    }
+
+    m_pClient.abort();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Schedules a connection attempt after the current delay, then doubles the delay for the next one.
+    A random part, up to a quarter of the delay, keeps clients that failed together from retrying together.
+*/
+void CMJPEGClient::scheduleReconnect()
+{
+    if (m_eState == eReconnecting)
+    {
+        return;
     }
+
+    m_tWatchdog.stop();
+
+    setState(eReconnecting);
+
+    m_tReconnectTimer.start(m_iReconnectDelayMS + qrand() % (m_iReconnectDelayMS / 4 + 1));
+
+    m_iReconnectDelayMS = qMin(m_iReconnectDelayMS * 2, m_iMaxReconnectDelayMS);
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -149,97 +508,283 @@ void CMJPEGClient::onDisconnected()
 */
 void CMJPEGClient::onReadyRead()
 {
-#define MAX_BYTES_READ 2000000
-
-    QTcpSocket* pSocket = dynamic_cast<QTcpSocket*>(QObject::sender());
+    // The socket is not taken from sender(), so that subclasses can pace the reads
+    QTcpSocket* pSocket = &m_pClient;
 
     // Test d'intgrit de la socket
-    if (pSocket != nullptr)
+    if (pSocket->state() == QTcpSocket::ConnectedState)
     {
-        // Est-on en tat connect?
-        if (pSocket->state() == QTcpSocket::ConnectedState)
+        m_tLastData.start();
+
+        if (m_baBuffer.isEmpty())
         {
-            // On boucle tant qu'il existe des donnes entrantes
-            while (pSocket->bytesAvailable() > 0)
+            m_baBuffer = pSocket->readAll();
+        }
+        else
+        {
+            m_baBuffer.append(pSocket->readAll());
+        }
+
+        parseBuffer();
+
+        // Drop the parsed data, once per read
+        if (m_iParsePos > 0)
+        {
+            m_baBuffer.remove(0, m_iParsePos);
+            m_iSearchPos -= m_iParsePos;
+            m_iParsePos = 0;
+        }
+
+        if (m_baBuffer.size() > MAX_BUFFER_SIZE)
+        {
+            qWarning() << QString("CMJPEGClient::onReadyRead() : no frame found in %1 bytes, resynchronizing").arg(m_baBuffer.size());
+
+            m_baBuffer.clear();
+            m_iSearchPos = 0;
+            m_iContentLength = -1;
+
+            if (m_eParseState != eResponseHeaders)
             {
-                // Cas o on ne lit pas une image
-                if (m_bReadingImage == false)
+                m_eParseState = ePartHeaders;
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Handles an image decoded by the pool : stores it as current image, \a image, and emits newImage().
+*/
+void CMJPEGClient::onImageDecoded(QImage image)
+{
+    m_Image = image;
+
+    emit newImage();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Resets the parser, before a new connection.
+*/
+void CMJPEGClient::resetParser()
+{
+    m_baBuffer.clear();
+    m_baDelimiter.clear();
+    m_eParseState = eResponseHeaders;
+    m_iParsePos = 0;
+    m_iSearchPos = 0;
+    m_iContentLength = -1;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Extracts the frames from the receive buffer, as far as it goes. \br\br
+    The buffer is only searched, the data of each frame is copied once, when it is complete.
+*/
+void CMJPEGClient::parseBuffer()
+{
+    forever
+    {
+        int iSearchFrom = qMax(m_iSearchPos, m_iParsePos);
+
+        if (m_eParseState == eResponseHeaders || m_eParseState == ePartHeaders)
+        {
+            int iEnd = m_baBuffer.indexOf("\r\n\r\n", iSearchFrom);
+
+            if (iEnd == -1)
+            {
+                // The end of the headers may straddle the next read
+                m_iSearchPos = qMax(m_iParsePos, m_baBuffer.size() - 3);
+                return;
+            }
+
+            if (m_eParseState == eResponseHeaders)
+            {
+                parseResponseHeaders(m_iParsePos, iEnd);
+
+                m_eParseState = ePartHeaders;
+            }
+            else
+            {
+                QByteArray baLength = headerValue(m_iParsePos, iEnd, HTTP_CONTENT_LENGTH);
+
+                bool bOk = false;
+                m_iContentLength = baLength.toInt(&bOk);
+
+                if (bOk == false || m_iContentLength < 0)
                 {
-                    // On lit une ligne dans la socket et on prpare le marqueur
-                    QString sLine = pSocket->readLine().toLower();
-                    QStringList vTokens = QString(sLine).split(" ", QString::SkipEmptyParts);
-                    QString sMarker = QString("--%1").arg(m_sBoundary);
-
-                    // Il y a quelque chose  analyser?
-                    if (vTokens.count() > 0)
-                    {
-                        // Cas du header HTTP
-                        if (vTokens[0] == HTTP_HEADER)
-                        {
-                            QString sHeader = vTokens[0];
-                        }
-                        // Cas du descripteur de contenu HTTP
-                        else if (vTokens[0].startsWith(HTTP_CONTENT_TYPE))
-                        {
-                            if (m_sBoundary == "")
-                            {
-                                for (int iIndex = 1; iIndex < vTokens.count(); iIndex++)
-                                {
-                                    if (vTokens[iIndex].contains(HTTP_BOUNDARY))
-                                    {
-                                        int iBoundaryIndex = vTokens[iIndex].indexOf(HTTP_BOUNDARY) + QString(HTTP_BOUNDARY).length();
-                                        m_sBoundary = vTokens[iIndex].mid(iBoundaryIndex);
-                                        break;
-                                    }
-                                }
-                            }
-                        }
-                        // Cas du marqueur, on ne fait rien
-                        else if (vTokens[0] == sMarker)
-                        {
-                        }
-                        // Cas de la longueur du contenu
-                        else if (vTokens[0].startsWith(HTTP_CONTENT_LENGTH))
-                        {
-                            QString sExp = QString("%1:[ ]*([0-9]*)").arg(HTTP_CONTENT_LENGTH);
-                            QRegExp tExp(sExp);
-
-                            if (tExp.indexIn(sLine) != -1)
-                            {
-                                m_iImageRemainToRead = tExp.cap(1).toInt();
-                            }
-
-                            m_bReadingImage = true;
-
-                            sLine = pSocket->readLine();
-                        }
-                    }
+                    m_iContentLength = -1;
                 }
-                else
-                {
-                    QByteArray baData = pSocket->read(m_iImageRemainToRead);
 
-                    if (baData.count() > 0)
-                    {
-                        m_iImageRemainToRead -= baData.count();
-                        m_baIncomingData.append(baData);
-                    }
+                m_eParseState = ePartBody;
+            }
 
-                    if (m_iImageRemainToRead <= 0)
-                    {
-                        m_bReadingImage = false;
+            m_iParsePos = iEnd + 4;
+            m_iSearchPos = m_iParsePos;
+        }
+        else
+        {
+            QByteArray baJPEG;
 
-                        if (m_Image.loadFromData(m_baIncomingData, "JPG"))
-                        {
-                            m_Image = m_Image.convertToFormat(QImage::Format_RGB888);
-                        }
+            if (m_iContentLength >= 0)
+            {
+                if (m_baBuffer.size() - m_iParsePos < m_iContentLength)
+                {
+                    return;
+                }
 
-                        m_baIncomingData.clear();
+                baJPEG = m_baBuffer.mid(m_iParsePos, m_iContentLength);
+                m_iParsePos += m_iContentLength;
+            }
+            else
+            {
+                if (m_baDelimiter.isEmpty())
+                {
+                    qWarning() << QString("CMJPEGClient::parseBuffer() : part without Content-Length nor boundary");
+
+                    m_iParsePos = m_baBuffer.size();
+                    return;
+                }
 
-                        emit newImage();
-                    }
+                int iEnd = m_baBuffer.indexOf(m_baDelimiter, iSearchFrom);
+
+                if (iEnd == -1)
+                {
+                    m_iSearchPos = qMax(m_iParsePos, m_baBuffer.size() - m_baDelimiter.size() + 1);
+                    return;
                 }
+
+                baJPEG = m_baBuffer.mid(m_iParsePos, iEnd - m_iParsePos);
+
+                // Keep the boundary for the part headers
+                m_iParsePos = iEnd;
             }
+
+            m_eParseState = ePartHeaders;
+            m_iSearchPos = m_iParsePos;
+
+            handleFrame(baJPEG);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Reads the boundary marker from the response headers, located between \a iStart and \a iEnd in the receive buffer.
+*/
+void CMJPEGClient::parseResponseHeaders(int iStart, int iEnd)
+{
+    if (m_baBuffer.mid(iStart, 5).toUpper() != "HTTP/" || m_baBuffer.mid(iStart, iEnd - iStart).contains(" 200") == false)
+    {
+        qWarning() << QString("CMJPEGClient::parseResponseHeaders() : unexpected response %1")
+                      .arg(QString(m_baBuffer.mid(iStart, m_baBuffer.indexOf('\r', iStart) - iStart)));
+    }
+
+    QByteArray baContentType = headerValue(iStart, iEnd, HTTP_CONTENT_TYPE);
+    int iBoundary = baContentType.toLower().indexOf(HTTP_BOUNDARY);
+
+    m_baDelimiter.clear();
+
+    if (iBoundary != -1)
+    {
+        QByteArray baBoundary = baContentType.mid(iBoundary + int(strlen(HTTP_BOUNDARY)));
+
+        int iSeparator = baBoundary.indexOf(';');
+
+        if (iSeparator != -1)
+        {
+            baBoundary.truncate(iSeparator);
+        }
+
+        baBoundary = baBoundary.trimmed();
+
+        if (baBoundary.startsWith('"') && baBoundary.endsWith('"') && baBoundary.size() >= 2)
+        {
+            baBoundary = baBoundary.mid(1, baBoundary.size() - 2);
+        }
+
+        m_baDelimiter = "\r\n--" + baBoundary;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Counts the frame \a baJPEG, emits it with newJPEG() if asked to and puts it in the latest-frame slot
+    for decoding. A frame still waiting in the slot is dropped.
+*/
+void CMJPEGClient::handleFrame(const QByteArray& baJPEG)
+{
+    if (baJPEG.isEmpty())
+    {
+        return;
+    }
+
+    m_iFramesReceived++;
+    m_tLastFrame.start();
+
+    if (m_eState != eStreaming)
+    {
+        m_iReconnectDelayMS = m_iMinReconnectDelayMS;
+        setState(eStreaming);
+    }
+
+    if (m_bEmitJPEG)
+    {
+        emit newJPEG(baJPEG);
+    }
+
+    if (m_bDecodeImages)
+    {
+        QMutexLocker locker(&m_tDecodeMutex);
+
+        if (m_baPendingJPEG.isEmpty() == false)
+        {
+            m_iFramesDropped++;
         }
+
+        m_baPendingJPEG = baJPEG;
+
+        if (m_bDecoding == false)
+        {
+            m_bDecoding = true;
+            decodePool()->start(new CMJPEGDecodeTask(this));
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the value of header \a szName, compared without case, in the headers located between \a iStart
+    and \a iEnd in the receive buffer. Returns an empty array if the header is not found.
+*/
+QByteArray CMJPEGClient::headerValue(int iStart, int iEnd, const char* szName) const
+{
+    const char* pData = m_baBuffer.constData();
+    int iNameLength = int(strlen(szName));
+    int iLine = iStart;
+
+    while (iLine < iEnd)
+    {
+        int iLineEnd = m_baBuffer.indexOf("\r\n", iLine);
+
+        if (iLineEnd == -1 || iLineEnd > iEnd)
+        {
+            iLineEnd = iEnd;
+        }
+
+        if (iLineEnd - iLine > iNameLength && pData[iLine + iNameLength] == ':' && qstrnicmp(pData + iLine, szName, uint(iNameLength)) == 0)
+        {
+            return QByteArray(pData + iLine + iNameLength + 1, iLineEnd - iLine - iNameLength - 1).trimmed();
+        }
+
+        iLine = iLineEnd + 2;
     }
+
+    return QByteArray();
 }
@@ -9,14 +9,67 @@
 #include <QTcpSocket>
 #include <QHostAddress>
 #include <QImage>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QElapsedTimer>
+
+//-------------------------------------------------------------------------------------------------
+
+class CMJPEGClient;
+
+//! Decodes the latest frame received by a CMJPEGClient, in a thread of the decoding pool
+class CMJPEGDecodeTask : public QRunnable
+{
+public:
+
+    //! Constructor
+    CMJPEGDecodeTask(CMJPEGClient* pClient);
+
+    //! Decodes frames until the client has none waiting
+    virtual void run() Q_DECL_OVERRIDE;
+
+protected:
+
+    CMJPEGClient*   m_pClient;
+};
+
+//-------------------------------------------------------------------------------------------------
 
 //! Defines a MJPEG client
 class QTPLUSSHARED_EXPORT CMJPEGClient : public QObject
 {
     Q_OBJECT
 
+    friend class CMJPEGDecodeTask;
+
 public:
 
+    //-----------------------------------------------------------------------------------------------
+    // Enumerators
+    //-----------------------------------------------------------------------------------------------
+
+    //! State of the connection
+    enum EState
+    {
+        eDisconnected,      // No stream open
+        eConnecting,        // Connecting to the server
+        eConnected,         // Request sent, waiting for the first frame
+        eStreaming,         // Receiving frames
+        eReconnecting       // Waiting before the next connection attempt
+    };
+
+    Q_ENUM(EState)
+
+    //! State of the stream parser
+    enum EParseState
+    {
+        eResponseHeaders,
+        ePartHeaders,
+        ePartBody
+    };
+
     //-----------------------------------------------------------------------------------------------
     // Constructors and destructor
     //-----------------------------------------------------------------------------------------------
@@ -37,24 +90,100 @@ public:
     //! Closees the URL
     void closeURL();
 
+    //! Returns the state of the connection
+    EState state() const;
+
+    //! Sets the time allowed to connect, in milliseconds (5 seconds by default)
+    void setConnectTimeout(int iMilliseconds);
+
+    //! Sets the time without data after which the connection is restarted, in milliseconds (5 seconds by default)
+    void setReadTimeout(int iMilliseconds);
+
+    //! Sets the time without a complete frame after which the connection is restarted, in milliseconds (10 seconds by default)
+    void setStallTimeout(int iMilliseconds);
+
+    //! Sets the first and the maximum delays between connection attempts, in milliseconds (500 ms and 30 seconds by default)
+    void setReconnectDelay(int iMinimumMS, int iMaximumMS);
+
     //! Returns the current image
     const QImage& getImage() const;
 
+    //! Sets whether frames are decoded to images and signaled with newImage() (true by default)
+    void setDecodeImages(bool bDecode);
+
+    //! Sets whether the JPEG data of frames is signaled with newJPEG() (false by default)
+    void setEmitJPEG(bool bEmit);
+
+    //! Returns the number of frames received
+    qint64 framesReceived() const;
+
+    //! Returns the number of frames not decoded because a newer one arrived first
+    qint64 framesDropped() const;
+
+    //-----------------------------------------------------------------------------------------------
+    // Static methods
+    //-----------------------------------------------------------------------------------------------
+
+    //! Returns the thread pool decoding the frames of all clients
+    static QThreadPool* decodePool();
+
+    //-----------------------------------------------------------------------------------------------
+    // Protected methods
+    //-----------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Changes the state and emits stateChanged()
+    void setState(EState eState);
+
+    //! Drops the connection and schedules a new attempt if the client keeps the stream alive
+    void restart(const QString& sReason);
+
+    //! Schedules a connection attempt after the current backoff delay
+    void scheduleReconnect();
+
+    //! Resets the parser for a new response
+    void resetParser();
+
+    //! Extracts the frames from the receive buffer
+    void parseBuffer();
+
+    //! Reads the boundary from the response headers
+    void parseResponseHeaders(int iStart, int iEnd);
+
+    //! Hands a frame to the consumers
+    void handleFrame(const QByteArray& baJPEG);
+
+    //! Returns the value of a header found between two offsets of the receive buffer
+    QByteArray headerValue(int iStart, int iEnd, const char* szName) const;
+
     //-----------------------------------------------------------------------------------------------
     // Protected slots
     //-----------------------------------------------------------------------------------------------
 
 protected slots:
 
-    //!
+    //! Starts a connection attempt, without waiting for it
     void onDoConnection();
 
+    //! Sends the request once connected
+    void onConnected();
+
+    //! Handles connection and socket errors
+    void onError(QAbstractSocket::SocketError eError);
+
+    //! Checks the connection, read and stall timeouts
+    void onWatchdog();
+
     //!
     void onReadyRead();
 
     //!
     void onDisconnected();
 
+    //! Stores an image decoded by the pool and signals it
+    void onImageDecoded(QImage image);
+
     //-----------------------------------------------------------------------------------------------
     // Signaux
     //-----------------------------------------------------------------------------------------------
@@ -64,6 +193,12 @@ signals:
     //! This signal is emitted when a new image is available
     void newImage();
 
+    //! This signal is emitted with the JPEG data of each frame, see setEmitJPEG()
+    void newJPEG(const QByteArray& baJPEG);
+
+    //! This signal is emitted when the state of the connection changes
+    void stateChanged(CMJPEGClient::EState eState);
+
     //-----------------------------------------------------------------------------------------------
     // Proprits
     //-----------------------------------------------------------------------------------------------
@@ -73,11 +208,35 @@ protected:
     QString		m_sIP;					// IP address of the server to which we connect
     QString     m_sResource;            // Name of the video resource (may be empty)
     QTcpSocket	m_pClient;				// Socket for the connection
+    QTimer		m_tReconnectTimer;
+    QTimer		m_tWatchdog;			// Checks the timeouts while a connection is open or opening
+    QElapsedTimer	m_tStateTime;		// Time since the last state change
+    QElapsedTimer	m_tLastData;		// Time since data was last received
+    QElapsedTimer	m_tLastFrame;		// Time since a frame was last received
+    EState		m_eState;
+    int			m_iConnectTimeoutMS;
+    int			m_iReadTimeoutMS;
+    int			m_iStallTimeoutMS;
+    int			m_iMinReconnectDelayMS;
+    int			m_iMaxReconnectDelayMS;
+    int			m_iReconnectDelayMS;	// Delay before the next attempt, doubled after each failure
     QImage		m_Image;				// LAst received image if any
-    QString		m_sBoundary;			// HTTP boundary marker
-    QByteArray	m_baIncomingData;		// Raw incoming data from socket
+    QByteArray	m_baBuffer;				// Data received from the socket and not parsed yet
+    QByteArray	m_baDelimiter;			// CRLF followed by the boundary marker
+    EParseState	m_eParseState;
+    int			m_iParsePos;			// Start of the unparsed data in m_baBuffer
+    int			m_iSearchPos;			// Where the search for the next delimiter resumes
+    int			m_iContentLength;		// Size of the part being read, -1 if unknown
     int			m_iPort;				// Port du serveur auquel on se connecte
-    int			m_iImageRemainToRead;	// Conteur indiquant combien d'octets il reste  lire pour une image
     bool		m_bKeepAlive;           // Si ce flag est vrai, le client tentera des connexions au serveur continuellement
-    bool		m_bReadingImage;		// Flag indiquant si on est en train de lire une image (sinon un header ou une marque de limite)
+    bool		m_bDecodeImages;
+    bool		m_bEmitJPEG;
+    qint64		m_iFramesReceived;
+
+    // Latest-frame slot, shared with the decoding pool
+    mutable QMutex	m_tDecodeMutex;
+    QWaitCondition	m_tDecodeDone;		// Signaled when the decoding task ends
+    QByteArray	m_baPendingJPEG;		// Latest frame waiting to be decoded
+    bool		m_bDecoding;			// Tells if a decoding task is running
+    qint64		m_iFramesDropped;
 };
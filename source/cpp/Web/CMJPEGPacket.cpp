@@ -0,0 +1,138 @@
+
+// Qt
+#include <QDateTime>
+
+// Application
+#include "CMJPEGPacket.h"
+#include "CHTTPResponse.h"
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CMJPEGPacket
+    \inmodule qt-plus
+    \brief An encoded MJPEG frame, ready to be written to clients.
+
+    A packet holds a JPEG image preceded by its part headers (boundary, Content-Type and Content-Length)
+    and followed by the line ending that precedes the next boundary, all in one buffer. \br
+    Packets are never modified once built and are handed around as CMJPEGPacketPtr, so a frame
+    is encoded and framed once and then shared by every client of the stream.
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CMJPEGPacket holding \a baJPEG, sequence number \a iSequence. \br\br
+    \a baPartPrefix is the start of the part headers, as returned by partPrefix().
+*/
+CMJPEGPacket::CMJPEGPacket(const QByteArray& baJPEG, const QByteArray& baPartPrefix, qint64 iSequence)
+    : m_iHeaderSize(0)
+    , m_iJPEGSize(baJPEG.size())
+    , m_iSequence(iSequence)
+    , m_iTimestamp(QDateTime::currentMSecsSinceEpoch())
+{
+    m_baPart.reserve(baPartPrefix.size() + 16 + baJPEG.size() + 2);
+    m_baPart.append(baPartPrefix);
+    CHTTPResponse::appendNumber(m_baPart, baJPEG.size());
+    m_baPart.append("\r\n\r\n");
+
+    m_iHeaderSize = m_baPart.size();
+
+    m_baPart.append(baJPEG);
+    m_baPart.append("\r\n");
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CMJPEGPacket.
+*/
+CMJPEGPacket::~CMJPEGPacket()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the whole part : boundary, part headers, JPEG data and line ending.
+*/
+const QByteArray& CMJPEGPacket::part() const
+{
+    return m_baPart;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the JPEG data. \br\br
+    The returned array does not own its data, it is valid as long as the packet exists.
+*/
+QByteArray CMJPEGPacket::jpeg() const
+{
+    return QByteArray::fromRawData(m_baPart.constData() + m_iHeaderSize, m_iJPEGSize);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the size of the JPEG data.
+*/
+int CMJPEGPacket::jpegSize() const
+{
+    return m_iJPEGSize;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the sequence number of the frame.
+*/
+qint64 CMJPEGPacket::sequence() const
+{
+    return m_iSequence;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the time at which the packet was built, in milliseconds since epoch.
+*/
+qint64 CMJPEGPacket::timestamp() const
+{
+    return m_iTimestamp;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the start of a part for boundary \a baBoundary, up to the Content-Length value. \br\br
+    It is meant to be built once per stream and given to the packets of this stream.
+*/
+QByteArray CMJPEGPacket::partPrefix(const QByteArray& baBoundary)
+{
+    return "--" + baBoundary + "\r\nContent-Type: image/jpeg\r\nContent-Length: ";
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns a packet holding \a baJPEG, sequence number \a iSequence, framed with \a baPartPrefix.
+*/
+CMJPEGPacketPtr CMJPEGPacket::fromJPEG(const QByteArray& baJPEG, const QByteArray& baPartPrefix, qint64 iSequence)
+{
+    return CMJPEGPacketPtr(new CMJPEGPacket(baJPEG, baPartPrefix, iSequence));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Encodes \a image as JPEG with quality \a iQuality (-1 for the default) and chroma subsampling \a eSubsampling,
+    and returns a packet holding it, sequence number \a iSequence, framed with \a baPartPrefix. \br\br
+    The image is encoded by the codec of the calling thread.
+*/
+CMJPEGPacketPtr CMJPEGPacket::fromImage(const QImage& image, int iQuality, const QByteArray& baPartPrefix, qint64 iSequence, CJPEGCodec::ESubsampling eSubsampling)
+{
+    QByteArray baJPEG = CJPEGCodec::forCurrentThread()->encode(image, iQuality, eSubsampling);
+
+    return fromJPEG(baJPEG, baPartPrefix, iSequence);
+}
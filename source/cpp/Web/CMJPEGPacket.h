@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QImage>
+
+// Application
+#include "../Image/CJPEGCodec.h"
+
+//-------------------------------------------------------------------------------------------------
+
+class CMJPEGPacket;
+
+typedef QSharedPointer<const CMJPEGPacket> CMJPEGPacketPtr;
+
+//-------------------------------------------------------------------------------------------------
+
+//! Defines an encoded MJPEG frame, framed as a multipart part
+//! A packet is immutable once built and shared by all the clients it is sent to
+class QTPLUSSHARED_EXPORT CMJPEGPacket
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor, frames baJPEG with baPartPrefix (see partPrefix())
+    CMJPEGPacket(const QByteArray& baJPEG, const QByteArray& baPartPrefix, qint64 iSequence);
+
+    //! Destructor
+    virtual ~CMJPEGPacket();
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the whole part : boundary, part headers, JPEG data and line ending
+    const QByteArray& part() const;
+
+    //! Returns the JPEG data, without copy
+    QByteArray jpeg() const;
+
+    //! Returns the size of the JPEG data
+    int jpegSize() const;
+
+    //! Returns the sequence number of the frame
+    qint64 sequence() const;
+
+    //! Returns the time at which the packet was built, in milliseconds since epoch
+    qint64 timestamp() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the start of a part for the given boundary, up to the Content-Length value
+    static QByteArray partPrefix(const QByteArray& baBoundary);
+
+    //! Builds a packet from JPEG data
+    static CMJPEGPacketPtr fromJPEG(const QByteArray& baJPEG, const QByteArray& baPartPrefix, qint64 iSequence);
+
+    //! Encodes an image and builds a packet from it
+    static CMJPEGPacketPtr fromImage(const QImage& image, int iQuality, const QByteArray& baPartPrefix, qint64 iSequence, CJPEGCodec::ESubsampling eSubsampling = CJPEGCodec::e420);
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    QByteArray  m_baPart;           // Part headers followed by the JPEG data
+    int         m_iHeaderSize;      // Size of the part headers
+    int         m_iJPEGSize;
+    qint64      m_iSequence;
+    qint64      m_iTimestamp;
+};
@@ -0,0 +1,141 @@
+
+// Std
+#include <limits>
+
+// Qt
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+// Application
+#include "CMJPEGPlaybackServer.h"
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CMJPEGPlaybackServer
+    \inmodule qt-plus
+    \brief A HTTP server giving access to MJPEG recordings.
+
+    The server reads a recording written by CMJPEGRecorder, possibly while it is being written,
+    and answers the following requests, timestamps being in milliseconds since epoch :
+    \list
+    \li \c {/index} returns a JSON object with the first and last timestamps and the segments of the recording.
+    \li \c {/frame?t=<timestamp>} returns the JPEG image of the last frame at or before the timestamp,
+        the last frame of the recording if \c t is missing.
+    \li \c {/range?from=<timestamp>&to=<timestamp>} returns the frames between the two timestamps as a
+        multipart/x-mixed-replace stream, read from the segments without being decoded.
+    \endlist
+    Frames are located with binary searches in the indexes, so a request costs the same at the start
+    and at the end of a long recording.
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CMJPEGPlaybackServer with \a iPort as binding port, serving the recording \a sBaseName.
+*/
+CMJPEGPlaybackServer::CMJPEGPlaybackServer(int iPort, const QString& sBaseName)
+    : CHTTPServer(iPort)
+    , m_tRecording(sBaseName)
+    , m_iMaximumRangeSize(64 * 1024 * 1024)
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CMJPEGPlaybackServer.
+*/
+CMJPEGPlaybackServer::~CMJPEGPlaybackServer()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the maximum size of a range response to \a iBytes. Longer ranges are cut after the last whole frame that fits.
+*/
+void CMJPEGPlaybackServer::setMaximumRangeSize(qint64 iBytes)
+{
+    m_iMaximumRangeSize.store(iBytes);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the recording served.
+*/
+CMJPEGRecording& CMJPEGPlaybackServer::recording()
+{
+    return m_tRecording;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Fills \a baContent and \a sContentMIME for the request held by \a tContext. \br\br
+    Returns \c false for unknown paths and when no frame matches, leaving the request to getContent().
+*/
+bool CMJPEGPlaybackServer::getRawContent(const CWebContext& tContext, QByteArray& baContent, QString& sContentMIME)
+{
+    QString sRoute = tContext.m_lPath.isEmpty() ? QString() : tContext.m_lPath.last();
+
+    // See the segments written since the last request
+    m_tRecording.refresh();
+
+    if (sRoute == "index")
+    {
+        QJsonObject jIndex;
+        QJsonArray jSegments;
+
+        foreach (const CMJPEGRecording::CSegment& tSegment, m_tRecording.segments())
+        {
+            QJsonObject jSegment;
+
+            jSegment["file"] = QFileInfo(tSegment.m_sFileName).fileName();
+            jSegment["first"] = tSegment.m_iFirstTimestamp;
+
+            jSegments << jSegment;
+        }
+
+        jIndex["first"] = m_tRecording.firstTimestamp();
+        jIndex["last"] = m_tRecording.lastTimestamp();
+        jIndex["segments"] = jSegments;
+
+        baContent = QJsonDocument(jIndex).toJson(QJsonDocument::Compact);
+        sContentMIME = MIME_Content_JSON;
+
+        return true;
+    }
+
+    if (sRoute == "frame")
+    {
+        qint64 iTimestamp = tContext.m_mArguments.contains("t") ? tContext.m_mArguments["t"].toLongLong() : std::numeric_limits<qint64>::max();
+        CMJPEGRecording::CFrame tFrame;
+
+        if (m_tRecording.findFrame(iTimestamp, tFrame))
+        {
+            baContent = m_tRecording.readFrame(tFrame);
+            sContentMIME = MIME_Content_JPG;
+
+            return baContent.isEmpty() == false;
+        }
+
+        return false;
+    }
+
+    if (sRoute == "range")
+    {
+        qint64 iFrom = tContext.m_mArguments["from"].toLongLong();
+        qint64 iTo = tContext.m_mArguments.contains("to") ? tContext.m_mArguments["to"].toLongLong() : std::numeric_limits<qint64>::max();
+
+        baContent = m_tRecording.readParts(iFrom, iTo, m_iMaximumRangeSize.load());
+        sContentMIME = QString("multipart/x-mixed-replace;boundary=%1").arg(QString(m_tRecording.boundary()));
+
+        return baContent.isEmpty() == false;
+    }
+
+    return false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Application
+#include "CHTTPServer.h"
+#include "CMJPEGRecording.h"
+
+//-------------------------------------------------------------------------------------------------
+
+//! Defines a HTTP server giving access to a recording written by CMJPEGRecorder
+//! Serves the list of segments, single frames and time ranges, found through the recording's indexes
+class QTPLUSSHARED_EXPORT CMJPEGPlaybackServer : public CHTTPServer
+{
+    Q_OBJECT
+
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor, sBaseName is the base name given to the CMJPEGRecorder
+    CMJPEGPlaybackServer(int iPort, const QString& sBaseName);
+
+    //! Destructor
+    virtual ~CMJPEGPlaybackServer();
+
+    //-------------------------------------------------------------------------------------------------
+    // Setters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Sets the maximum size of a range response, in bytes (64 MB by default)
+    void setMaximumRangeSize(qint64 iBytes);
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the recording
+    CMJPEGRecording& recording();
+
+    //-------------------------------------------------------------------------------------------------
+    // Protected methods
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Serves the index, frames and ranges of the recording
+    virtual bool getRawContent(const CWebContext& tContext, QByteArray& baContent, QString& sContentMIME) Q_DECL_OVERRIDE;
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    CMJPEGRecording         m_tRecording;
+    QAtomicInteger<qint64>  m_iMaximumRangeSize;       // Bytes
+};
@@ -0,0 +1,314 @@
+
+// Qt
+#include <QDateTime>
+#include <QFileInfo>
+#include <QDir>
+#include <QRegExp>
+#include <QtEndian>
+#include <QDebug>
+
+// Application
+#include "CMJPEGRecorder.h"
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CMJPEGRecorder
+    \inmodule qt-plus
+    \brief Writes MJPEG recordings that can be searched by time.
+
+    A recording is cut in segments, files named after the base name and the timestamp of their first frame,
+    for instance \c {camera.1700000000000.mjpeg}. A segment holds the parts of a multipart/x-mixed-replace
+    stream, one per frame, so it can be sent as is after a HTTP header. \br
+    Each segment has an index, in a file of the same name ending with \c .idx : an 8 byte signature followed
+    by one 24 byte record per frame, in little endian : the timestamp in milliseconds since epoch (8 bytes),
+    the offset of the part in the segment (8 bytes), the size of the part headers (4 bytes) and the size of
+    the JPEG data (4 bytes). Records have a fixed size and increasing timestamps, so CMJPEGRecording finds
+    a frame with a binary search in the index file. \br\br
+    Data and index are flushed periodically (see setFlushInterval()), the data first, so that the index
+    never refers to data that is not on disk. A new segment is started when the current one gets too long
+    or too big, and the oldest segments can be deleted (see setMaximumSegments()).
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CMJPEGRecorder writing the recording \a sBaseName, a path without extension. \br\br
+    Segments are created when frames are written.
+*/
+CMJPEGRecorder::CMJPEGRecorder(const QString& sBaseName)
+    : m_sBaseName(sBaseName)
+    , m_iSegmentStart(0)
+    , m_iSegmentSize(0)
+    , m_iLastTimestamp(0)
+    , m_iLastFlush(0)
+    , m_iSegmentDurationMS(10 * 60 * 1000)
+    , m_iMaxSegmentSize(256 * 1024 * 1024)
+    , m_iFlushIntervalMS(1000)
+    , m_iMaximumSegments(0)
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CMJPEGRecorder, closing the current segment.
+*/
+CMJPEGRecorder::~CMJPEGRecorder()
+{
+    close();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iMilliseconds the duration after which a new segment is started.
+*/
+void CMJPEGRecorder::setSegmentDuration(qint64 iMilliseconds)
+{
+    m_iSegmentDurationMS = iMilliseconds;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iBytes the size after which a new segment is started.
+*/
+void CMJPEGRecorder::setSegmentSize(qint64 iBytes)
+{
+    m_iMaxSegmentSize = iBytes;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iMilliseconds the interval between flushes of the segment and its index.
+*/
+void CMJPEGRecorder::setFlushInterval(qint64 iMilliseconds)
+{
+    m_iFlushIntervalMS = iMilliseconds;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iSegments the number of segments kept. When a segment is started, the oldest ones above
+    this number are deleted. 0 keeps all segments.
+*/
+void CMJPEGRecorder::setMaximumSegments(int iSegments)
+{
+    m_iMaximumSegments = iSegments;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the base name of the recording.
+*/
+QString CMJPEGRecorder::baseName() const
+{
+    return m_sBaseName;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the file name of the segment being written, or an empty string if none is open.
+*/
+QString CMJPEGRecorder::currentSegment() const
+{
+    return m_fData.isOpen() ? m_fData.fileName() : QString();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Appends the frame held by \a pPacket to the recording. Returns \c false if it could not be written.
+*/
+bool CMJPEGRecorder::write(const CMJPEGPacketPtr& pPacket)
+{
+    if (pPacket.isNull())
+    {
+        return false;
+    }
+
+    // Timestamps must not decrease, the index is searched by dichotomy
+    qint64 iTimestamp = qMax(pPacket->timestamp(), m_iLastTimestamp);
+
+    if (m_fData.isOpen())
+    {
+        if (iTimestamp - m_iSegmentStart >= m_iSegmentDurationMS || (m_iSegmentSize > 0 && m_iSegmentSize + pPacket->part().size() > m_iMaxSegmentSize))
+        {
+            close();
+        }
+    }
+
+    if (m_fData.isOpen() == false)
+    {
+        if (openSegment(iTimestamp) == false)
+        {
+            return false;
+        }
+    }
+
+    const QByteArray& baPart = pPacket->part();
+
+    if (m_fData.write(baPart) != baPart.size())
+    {
+        qWarning() << QString("CMJPEGRecorder::write() : could not write to %1").arg(m_fData.fileName());
+        return false;
+    }
+
+    uchar aRecord[MJPEG_INDEX_RECORD_SIZE];
+
+    qToLittleEndian<qint64>(iTimestamp, aRecord);
+    qToLittleEndian<qint64>(m_iSegmentSize, aRecord + 8);
+    qToLittleEndian<qint32>(baPart.size() - pPacket->jpegSize() - 2, aRecord + 16);
+    qToLittleEndian<qint32>(pPacket->jpegSize(), aRecord + 20);
+
+    m_baIndexRecords.append((const char*) aRecord, MJPEG_INDEX_RECORD_SIZE);
+
+    m_iSegmentSize += baPart.size();
+    m_iLastTimestamp = iTimestamp;
+
+    if (iTimestamp - m_iLastFlush >= m_iFlushIntervalMS)
+    {
+        flush();
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes the buffered data, then the index records that refer to it, to disk.
+*/
+void CMJPEGRecorder::flush()
+{
+    if (m_fData.isOpen())
+    {
+        m_fData.flush();
+
+        if (m_baIndexRecords.isEmpty() == false)
+        {
+            m_fIndex.write(m_baIndexRecords);
+            m_baIndexRecords.clear();
+        }
+
+        m_fIndex.flush();
+    }
+
+    m_iLastFlush = m_iLastTimestamp;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Flushes and closes the current segment. The next frame will start a new one.
+*/
+void CMJPEGRecorder::close()
+{
+    if (m_fData.isOpen())
+    {
+        flush();
+
+        m_fData.close();
+        m_fIndex.close();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the segment files of the recording \a sBaseName, oldest first.
+*/
+QStringList CMJPEGRecorder::segments(const QString& sBaseName)
+{
+    QFileInfo tInfo(sBaseName);
+    QDir tDirectory = tInfo.absoluteDir();
+    QStringList lSegments;
+
+    // Timestamps in names have the same number of digits, so the name order is the time order
+    QStringList lNames = tDirectory.entryList(QStringList() << tInfo.fileName() + ".*" + MJPEG_SEGMENT_EXTENSION, QDir::Files, QDir::Name);
+
+    // The wildcard also matches the segments of a recording whose base name extends this one
+    // (camera.front.1700000000000.mjpeg for camera), so keep only names whose middle part is a timestamp
+    QRegExp rSegment(QRegExp::escape(tInfo.fileName()) + "\\.\\d+" + QRegExp::escape(MJPEG_SEGMENT_EXTENSION));
+
+    foreach (const QString& sName, lNames)
+    {
+        if (rSegment.exactMatch(sName))
+        {
+            lSegments << tDirectory.absoluteFilePath(sName);
+        }
+    }
+
+    return lSegments;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the file name of the index of the segment \a sSegmentFileName.
+*/
+QString CMJPEGRecorder::indexFileName(const QString& sSegmentFileName)
+{
+    return sSegmentFileName + MJPEG_INDEX_EXTENSION;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Starts a new segment whose first frame has timestamp \a iTimestamp. Returns \c false on error.
+*/
+bool CMJPEGRecorder::openSegment(qint64 iTimestamp)
+{
+    QString sFileName = QString("%1.%2%3").arg(m_sBaseName).arg(iTimestamp, 13, 10, QChar('0')).arg(MJPEG_SEGMENT_EXTENSION);
+
+    m_fData.setFileName(sFileName);
+    m_fIndex.setFileName(indexFileName(sFileName));
+
+    if (m_fData.open(QIODevice::WriteOnly | QIODevice::Truncate) == false)
+    {
+        qWarning() << QString("CMJPEGRecorder::openSegment() : could not open %1").arg(sFileName);
+        return false;
+    }
+
+    if (m_fIndex.open(QIODevice::WriteOnly | QIODevice::Truncate) == false)
+    {
+        qWarning() << QString("CMJPEGRecorder::openSegment() : could not open %1").arg(m_fIndex.fileName());
+        m_fData.close();
+        return false;
+    }
+
+    m_fIndex.write(MJPEG_INDEX_MAGIC, MJPEG_INDEX_HEADER_SIZE);
+
+    m_baIndexRecords.clear();
+    m_iSegmentStart = iTimestamp;
+    m_iSegmentSize = 0;
+    m_iLastFlush = iTimestamp;
+
+    removeOldSegments();
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Deletes the oldest segments and their index, keeping the number of segments set by setMaximumSegments().
+*/
+void CMJPEGRecorder::removeOldSegments()
+{
+    if (m_iMaximumSegments > 0)
+    {
+        QStringList lSegments = segments(m_sBaseName);
+
+        for (int iIndex = 0; iIndex < lSegments.count() - m_iMaximumSegments; iIndex++)
+        {
+            QFile::remove(lSegments[iIndex]);
+            QFile::remove(indexFileName(lSegments[iIndex]));
+        }
+    }
+}
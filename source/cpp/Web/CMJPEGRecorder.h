@@ -0,0 +1,119 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QFile>
+
+// Application
+#include "CMJPEGPacket.h"
+
+//-------------------------------------------------------------------------------------------------
+
+#define MJPEG_SEGMENT_EXTENSION     ".mjpeg"
+#define MJPEG_INDEX_EXTENSION       ".idx"
+#define MJPEG_INDEX_MAGIC           "MJPGIDX1"
+#define MJPEG_INDEX_HEADER_SIZE     8
+#define MJPEG_INDEX_RECORD_SIZE     24
+
+//-------------------------------------------------------------------------------------------------
+
+//! Defines a writer of indexed MJPEG recordings
+//! A recording is a series of segment files, each with a sidecar index of its frames, read by CMJPEGRecording
+class QTPLUSSHARED_EXPORT CMJPEGRecorder
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor, sBaseName is the path of the recording without extension
+    CMJPEGRecorder(const QString& sBaseName);
+
+    //! Destructor
+    virtual ~CMJPEGRecorder();
+
+    //-------------------------------------------------------------------------------------------------
+    // Setters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Sets the duration after which a new segment is started, in milliseconds (10 minutes by default)
+    void setSegmentDuration(qint64 iMilliseconds);
+
+    //! Sets the size after which a new segment is started, in bytes (256 MB by default)
+    void setSegmentSize(qint64 iBytes);
+
+    //! Sets the interval between flushes of the files, in milliseconds (1 second by default)
+    void setFlushInterval(qint64 iMilliseconds);
+
+    //! Sets the number of segments kept, 0 keeps them all (the default)
+    void setMaximumSegments(int iSegments);
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the base name of the recording
+    QString baseName() const;
+
+    //! Returns the file name of the segment being written, empty if none
+    QString currentSegment() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Appends a frame to the recording
+    bool write(const CMJPEGPacketPtr& pPacket);
+
+    //! Writes the buffered data and index records to disk
+    void flush();
+
+    //! Closes the current segment
+    void close();
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the segments of a recording, oldest first
+    static QStringList segments(const QString& sBaseName);
+
+    //! Returns the file name of the index of a segment
+    static QString indexFileName(const QString& sSegmentFileName);
+
+    //-------------------------------------------------------------------------------------------------
+    // Protected methods
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Starts a new segment whose first frame has the given timestamp
+    bool openSegment(qint64 iTimestamp);
+
+    //! Deletes the oldest segments above the maximum
+    void removeOldSegments();
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    QString     m_sBaseName;
+    QFile       m_fData;                    // Current segment
+    QFile       m_fIndex;                   // Index of the current segment
+    QByteArray  m_baIndexRecords;           // Index records not yet written
+    qint64      m_iSegmentStart;            // Timestamp of the first frame of the segment
+    qint64      m_iSegmentSize;             // Bytes written to the segment
+    qint64      m_iLastTimestamp;
+    qint64      m_iLastFlush;
+    qint64      m_iSegmentDurationMS;
+    qint64      m_iMaxSegmentSize;
+    qint64      m_iFlushIntervalMS;
+    int         m_iMaximumSegments;
+};
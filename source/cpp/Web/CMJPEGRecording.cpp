@@ -0,0 +1,376 @@
+
+// Std
+#include <limits>
+
+// Qt
+#include <QFileInfo>
+#include <QtEndian>
+#include <QDebug>
+
+// Application
+#include "CMJPEGRecording.h"
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CMJPEGRecording
+    \inmodule qt-plus
+    \brief Reads the recordings written by CMJPEGRecorder.
+
+    The segments are listed when the recording is constructed and when refresh() is called, which allows
+    reading a recording while it is written. The first timestamp of a segment is taken from its name,
+    so finding a frame reads no more than the index records visited by two binary searches, one among
+    the segments and one in the index of the segment. \br\br
+    The methods can be called from several threads at once, each call opens its own files.
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CMJPEGRecording reading the recording \a sBaseName.
+*/
+CMJPEGRecording::CMJPEGRecording(const QString& sBaseName)
+    : m_sBaseName(sBaseName)
+{
+    refresh();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CMJPEGRecording.
+*/
+CMJPEGRecording::~CMJPEGRecording()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the segments of the recording, oldest first.
+*/
+QVector<CMJPEGRecording::CSegment> CMJPEGRecording::segments() const
+{
+    QMutexLocker locker(&m_tMutex);
+
+    return m_vSegments;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the boundary marker of the parts, read from the first segment.
+*/
+QByteArray CMJPEGRecording::boundary() const
+{
+    QMutexLocker locker(&m_tMutex);
+
+    return m_baBoundary;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the timestamp of the first frame, or 0 if the recording is empty.
+*/
+qint64 CMJPEGRecording::firstTimestamp() const
+{
+    CFrame tFrame;
+
+    return findFrame(0, tFrame) ? tFrame.m_iTimestamp : 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the timestamp of the last frame, or 0 if the recording is empty.
+*/
+qint64 CMJPEGRecording::lastTimestamp() const
+{
+    CFrame tFrame;
+
+    return findFrame(std::numeric_limits<qint64>::max(), tFrame) ? tFrame.m_iTimestamp : 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Lists the segments of the recording again.
+*/
+void CMJPEGRecording::refresh()
+{
+    QVector<CSegment> vSegments;
+
+    foreach (const QString& sFileName, CMJPEGRecorder::segments(m_sBaseName))
+    {
+        CSegment tSegment;
+
+        // The name ends with the timestamp of the first frame, before the extension
+        tSegment.m_sFileName = sFileName;
+        tSegment.m_iFirstTimestamp = QFileInfo(sFileName).completeBaseName().section('.', -1).toLongLong();
+
+        vSegments << tSegment;
+    }
+
+    QByteArray baBoundary;
+
+    if (vSegments.count() > 0)
+    {
+        QFile fData(vSegments[0].m_sFileName);
+
+        if (fData.open(QIODevice::ReadOnly))
+        {
+            QByteArray baLine = fData.readLine(256).trimmed();
+
+            if (baLine.startsWith("--"))
+            {
+                baBoundary = baLine.mid(2);
+            }
+        }
+    }
+
+    QMutexLocker locker(&m_tMutex);
+
+    m_vSegments = vSegments;
+    m_baBoundary = baBoundary;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Finds the last frame whose timestamp is at or before \a iTimestamp and stores its location in \a tFrame.
+    If \a iTimestamp is older than the recording, the first frame is returned. \br\br
+    Returns \c false if the recording has no frame.
+*/
+bool CMJPEGRecording::findFrame(qint64 iTimestamp, CFrame& tFrame) const
+{
+    QVector<CSegment> vSegments = segments();
+
+    // Find the last segment starting at or before the timestamp
+    int iLow = 0;
+    int iHigh = vSegments.count();
+
+    while (iLow < iHigh)
+    {
+        int iMiddle = (iLow + iHigh) / 2;
+
+        if (vSegments[iMiddle].m_iFirstTimestamp <= iTimestamp)
+        {
+            iLow = iMiddle + 1;
+        }
+        else
+        {
+            iHigh = iMiddle;
+        }
+    }
+
+    int iSegment = qMax(iLow - 1, 0);
+
+    // A segment that has just been started may have no record on disk yet, the frame is then in a previous one
+    for (; iSegment >= 0 && iSegment < vSegments.count(); iSegment--)
+    {
+        QFile fIndex(CMJPEGRecorder::indexFileName(vSegments[iSegment].m_sFileName));
+
+        if (fIndex.open(QIODevice::ReadOnly) == false)
+        {
+            continue;
+        }
+
+        int iCount = recordCount(fIndex);
+
+        if (iCount > 0)
+        {
+            int iRecord = qMax(upperBound(fIndex, iCount, iTimestamp) - 1, 0);
+
+            if (readRecord(fIndex, iRecord, tFrame))
+            {
+                tFrame.m_sSegment = vSegments[iSegment].m_sFileName;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the JPEG data of the frame located by \a tFrame, or an empty array on error.
+*/
+QByteArray CMJPEGRecording::readFrame(const CFrame& tFrame) const
+{
+    QFile fData(tFrame.m_sSegment);
+
+    if (fData.open(QIODevice::ReadOnly) == false || fData.seek(tFrame.m_iOffset + tFrame.m_iHeaderSize) == false)
+    {
+        qWarning() << QString("CMJPEGRecording::readFrame() : could not read %1").arg(tFrame.m_sSegment);
+        return QByteArray();
+    }
+
+    QByteArray baJPEG = fData.read(tFrame.m_iJPEGSize);
+
+    return baJPEG.size() == tFrame.m_iJPEGSize ? baJPEG : QByteArray();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the parts of the frames whose timestamps are between \a iFrom and \a iTo, both included,
+    as they are stored : the result is the body of a multipart/x-mixed-replace response. \br\br
+    The result is cut after the last whole part that fits in \a iMaxBytes.
+*/
+QByteArray CMJPEGRecording::readParts(qint64 iFrom, qint64 iTo, qint64 iMaxBytes) const
+{
+    QVector<CSegment> vSegments = segments();
+    QByteArray baParts;
+
+    for (int iSegment = 0; iSegment < vSegments.count(); iSegment++)
+    {
+        // Skip the segments that end before the range, stop at the first one that starts after it
+        if (iSegment + 1 < vSegments.count() && vSegments[iSegment + 1].m_iFirstTimestamp <= iFrom)
+        {
+            continue;
+        }
+
+        if (vSegments[iSegment].m_iFirstTimestamp > iTo)
+        {
+            break;
+        }
+
+        QFile fIndex(CMJPEGRecorder::indexFileName(vSegments[iSegment].m_sFileName));
+
+        if (fIndex.open(QIODevice::ReadOnly) == false)
+        {
+            continue;
+        }
+
+        int iCount = recordCount(fIndex);
+        int iFirst = upperBound(fIndex, iCount, iFrom - 1);
+        int iEnd = upperBound(fIndex, iCount, iTo);
+        qint64 iRemaining = iMaxBytes - baParts.size();
+
+        CFrame tFirst;
+        CFrame tLast;
+
+        if (iFirst >= iEnd || readRecord(fIndex, iFirst, tFirst) == false || readRecord(fIndex, iEnd - 1, tLast) == false)
+        {
+            continue;
+        }
+
+        // Keep the parts that fit, offsets grow with the records
+        if (tLast.m_iOffset + tLast.partSize() - tFirst.m_iOffset > iRemaining)
+        {
+            int iLow = iFirst;
+            int iHigh = iEnd - 1;
+
+            while (iLow < iHigh)
+            {
+                int iMiddle = (iLow + iHigh) / 2;
+                CFrame tMiddle;
+
+                if (readRecord(fIndex, iMiddle, tMiddle) && tMiddle.m_iOffset + tMiddle.partSize() - tFirst.m_iOffset <= iRemaining)
+                {
+                    iLow = iMiddle + 1;
+                }
+                else
+                {
+                    iHigh = iMiddle;
+                }
+            }
+
+            iEnd = iLow;
+
+            if (iEnd <= iFirst || readRecord(fIndex, iEnd - 1, tLast) == false)
+            {
+                break;
+            }
+        }
+
+        QFile fData(vSegments[iSegment].m_sFileName);
+
+        if (fData.open(QIODevice::ReadOnly) && fData.seek(tFirst.m_iOffset))
+        {
+            baParts.append(fData.read(tLast.m_iOffset + tLast.partSize() - tFirst.m_iOffset));
+        }
+
+        if (baParts.size() >= iMaxBytes)
+        {
+            break;
+        }
+    }
+
+    return baParts;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of complete records in the open index \a fIndex. \br\br
+    A record being written is not counted.
+*/
+int CMJPEGRecording::recordCount(QFile& fIndex)
+{
+    if (fIndex.size() < MJPEG_INDEX_HEADER_SIZE || fIndex.peek(MJPEG_INDEX_HEADER_SIZE) != QByteArray(MJPEG_INDEX_MAGIC))
+    {
+        return 0;
+    }
+
+    return (int) ((fIndex.size() - MJPEG_INDEX_HEADER_SIZE) / MJPEG_INDEX_RECORD_SIZE);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Reads the record \a iRecord of the open index \a fIndex into \a tFrame. Returns \c false on error.
+*/
+bool CMJPEGRecording::readRecord(QFile& fIndex, int iRecord, CFrame& tFrame)
+{
+    uchar aRecord[MJPEG_INDEX_RECORD_SIZE];
+
+    if (fIndex.seek(MJPEG_INDEX_HEADER_SIZE + (qint64) iRecord * MJPEG_INDEX_RECORD_SIZE) == false)
+    {
+        return false;
+    }
+
+    if (fIndex.read((char*) aRecord, MJPEG_INDEX_RECORD_SIZE) != MJPEG_INDEX_RECORD_SIZE)
+    {
+        return false;
+    }
+
+    tFrame.m_iTimestamp = qFromLittleEndian<qint64>(aRecord);
+    tFrame.m_iOffset = qFromLittleEndian<qint64>(aRecord + 8);
+    tFrame.m_iHeaderSize = qFromLittleEndian<qint32>(aRecord + 16);
+    tFrame.m_iJPEGSize = qFromLittleEndian<qint32>(aRecord + 20);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the index of the first of the \a iCount records of \a fIndex whose timestamp is greater
+    than \a iTimestamp, or \a iCount if there is none.
+*/
+int CMJPEGRecording::upperBound(QFile& fIndex, int iCount, qint64 iTimestamp)
+{
+    int iLow = 0;
+    int iHigh = iCount;
+
+    while (iLow < iHigh)
+    {
+        int iMiddle = (iLow + iHigh) / 2;
+        CFrame tFrame;
+
+        if (readRecord(fIndex, iMiddle, tFrame) && tFrame.m_iTimestamp <= iTimestamp)
+        {
+            iLow = iMiddle + 1;
+        }
+        else
+        {
+            iHigh = iMiddle;
+        }
+    }
+
+    return iLow;
+}
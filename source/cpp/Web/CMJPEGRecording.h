@@ -0,0 +1,131 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QFile>
+#include <QMutex>
+
+// Application
+#include "CMJPEGRecorder.h"
+
+//-------------------------------------------------------------------------------------------------
+
+//! Defines a reader of the recordings written by CMJPEGRecorder
+//! Frames are found by timestamp with a binary search in the segment indexes
+class QTPLUSSHARED_EXPORT CMJPEGRecording
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Inner classes
+    //-------------------------------------------------------------------------------------------------
+
+    //! The location of a frame in a recording
+    class QTPLUSSHARED_EXPORT CFrame
+    {
+    public:
+
+        CFrame()
+            : m_iTimestamp(0)
+            , m_iOffset(0)
+            , m_iHeaderSize(0)
+            , m_iJPEGSize(0)
+        {
+        }
+
+        //! Returns the size of the whole part
+        qint64 partSize() const { return m_iHeaderSize + m_iJPEGSize + 2; }
+
+        QString     m_sSegment;         // Segment file holding the frame
+        qint64      m_iTimestamp;       // Milliseconds since epoch
+        qint64      m_iOffset;          // Offset of the part in the segment
+        int         m_iHeaderSize;      // Size of the part headers
+        int         m_iJPEGSize;
+    };
+
+    //! A segment of a recording
+    class QTPLUSSHARED_EXPORT CSegment
+    {
+    public:
+
+        CSegment()
+            : m_iFirstTimestamp(0)
+        {
+        }
+
+        QString     m_sFileName;
+        qint64      m_iFirstTimestamp;
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor, sBaseName is the base name given to the CMJPEGRecorder
+    CMJPEGRecording(const QString& sBaseName);
+
+    //! Destructor
+    virtual ~CMJPEGRecording();
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the segments of the recording, oldest first
+    QVector<CSegment> segments() const;
+
+    //! Returns the boundary marker of the parts, read from the first segment
+    QByteArray boundary() const;
+
+    //! Returns the timestamp of the first frame, 0 if the recording is empty
+    qint64 firstTimestamp() const;
+
+    //! Returns the timestamp of the last frame, 0 if the recording is empty
+    qint64 lastTimestamp() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Lists the segments again, to see those written since the last call
+    void refresh();
+
+    //! Finds the last frame at or before iTimestamp, or the first frame if iTimestamp is older
+    bool findFrame(qint64 iTimestamp, CFrame& tFrame) const;
+
+    //! Returns the JPEG data of a frame
+    QByteArray readFrame(const CFrame& tFrame) const;
+
+    //! Returns the parts of the frames between two timestamps, at most iMaxBytes
+    QByteArray readParts(qint64 iFrom, qint64 iTo, qint64 iMaxBytes) const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Protected methods
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Returns the number of complete records in an open index
+    static int recordCount(QFile& fIndex);
+
+    //! Reads a record of an open index
+    static bool readRecord(QFile& fIndex, int iRecord, CFrame& tFrame);
+
+    //! Returns the first record of an open index whose timestamp is greater than iTimestamp
+    static int upperBound(QFile& fIndex, int iCount, qint64 iTimestamp);
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    mutable QMutex      m_tMutex;
+    QString             m_sBaseName;
+    QVector<CSegment>   m_vSegments;
+    QByteArray          m_baBoundary;
+};
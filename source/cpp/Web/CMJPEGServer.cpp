@@ -3,11 +3,11 @@
 #include <QString>
 #include <QVariant>
 #include <QImage>
-#include <QBuffer>
+#include <QDateTime>
+#include <QMetaObject>
 
 // Application
 #include "CMJPEGServer.h"
-#include "../Image/CImageUtilities.h"
 
 //-------------------------------------------------------------------------------------------------
 
@@ -15,6 +15,26 @@
     \class CMJPEGServer
     \inmodule qt-plus
     \brief A server for MJPEG streams.
+
+    Images given to sendImage() or sendRaw() are encoded once, in a background thread, into a CMJPEGPacket
+    that holds the JPEG data already framed with its part headers. The same packet is then written to every
+    connected client, so adding viewers adds socket writes but no encoding. \br
+    Each client has a small ring of frames. A frame is written to a client only when its socket has sent
+    the previous one, so a slow client skips frames, according to the drop policy (see setDropPolicy()),
+    instead of delaying the others or piling up data. Every frame of an MJPEG stream is a keyframe,
+    so a client that skips frames simply resumes with the newest one. \br
+    Nothing polls : the encoding thread sleeps on a wait condition until images are added, new packets post
+    a single queued call to onFramesReady() in the server's thread, and a client's next frame is written
+    from its socket's bytesWritten() signal. An idle server does not wake up. \br
+    The frames can also be recorded in indexed segments, searchable by time (see startRecording()). \br\br
+    Clients may ask for a smaller, lighter or slower stream with query arguments : \c scale (a fraction of the
+    size, for instance \c {?scale=0.25}), \c quality (1 to 100) and \c fps (a maximum frame rate). Clients
+    asking for the same arguments share a variant, encoded once per frame like the full stream, from an image
+    downscaled by an integer factor. The number of variants is limited (see setMaximumVariants()). Frames
+    given already encoded to send() go to all clients as they are. \br\br
+    A governor drops the frames nobody needs before they are copied or encoded : all of them while there is
+    no client, recording or output file, and enough of them to keep the highest frame rate asked for by the
+    clients (see requiredFrameRate()) otherwise. requiredFrameRateChanged() lets the producer capture less.
 */
 
 //-------------------------------------------------------------------------------------------------
@@ -35,7 +55,13 @@ CMJPEGThread::CMJPEGThread(CMJPEGServer* pParent)
 
 CMJPEGThread::~CMJPEGThread()
 {
-    m_bRun = false;
+    {
+        QMutexLocker locker(&m_pParent->m_tImagesMutex);
+
+        m_bRun = false;
+        m_pParent->m_tImagesAdded.wakeAll();
+    }
+
     wait();
 }
 
@@ -43,10 +69,114 @@ CMJPEGThread::~CMJPEGThread()
 
 void CMJPEGThread::run()
 {
-    while (m_bRun)
+    forever
     {
+        {
+            QMutexLocker locker(&m_pParent->m_tImagesMutex);
+
+            // Sleep until there are images to encode
+            while (m_bRun && m_pParent->m_vOutputImages.isEmpty())
+            {
+                m_pParent->m_tImagesAdded.wait(&m_pParent->m_tImagesMutex);
+            }
+
+            if (m_bRun == false)
+            {
+                return;
+            }
+        }
+
         m_pParent->processOutputImages();
-        msleep(20);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a subscriber for \a pSocket, receiving the variant \a tVariant, with room for \a iRingSize frames.
+*/
+CMJPEGServer::CSubscriber::CSubscriber(QTcpSocket* pSocket, int iRingSize, const CVariant& tVariant)
+    : m_pSocket(pSocket)
+    , m_iVariant(tVariant.key())
+    , m_vRing(qMax(iRingSize, 1))
+    , m_iHead(0)
+    , m_iCount(0)
+{
+    m_tStats.m_sPeer = CHTTPServer::cleanIP(pSocket->peerAddress().toString());
+    m_tStats.m_iPeerPort = pSocket->peerPort();
+    m_tStats.m_iScaleDivisor = tVariant.m_iScaleDivisor;
+    m_tStats.m_iQuality = tVariant.m_iQuality;
+    m_tStats.m_iMaxFPS = tVariant.m_iMaxFPS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Adds \a pPacket to the ring. \br\br
+    With \c eLatestOnly, the frames still waiting are dropped. Otherwise the oldest frame is dropped if the ring is full.
+*/
+void CMJPEGServer::CSubscriber::push(const CMJPEGPacketPtr& pPacket, EDropPolicy ePolicy)
+{
+    if (ePolicy == eLatestOnly)
+    {
+        while (m_iCount > 0)
+        {
+            dropOldest();
+        }
+    }
+    else if (m_iCount == m_vRing.count())
+    {
+        dropOldest();
+    }
+
+    m_vRing[(m_iHead + m_iCount) % m_vRing.count()] = pPacket;
+    m_iCount++;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Removes and returns the oldest frame of the ring, or a null pointer if the ring is empty. \br\br
+    With \c eMaxLatency, frames older than \a iMaxLatencyMS at time \a iNow are dropped,
+    unless they are the newest.
+*/
+CMJPEGPacketPtr CMJPEGServer::CSubscriber::pop(EDropPolicy ePolicy, int iMaxLatencyMS, qint64 iNow)
+{
+    if (ePolicy == eMaxLatency)
+    {
+        while (m_iCount > 1 && iNow - m_vRing[m_iHead]->timestamp() > iMaxLatencyMS)
+        {
+            dropOldest();
+        }
+    }
+
+    if (m_iCount == 0)
+    {
+        return CMJPEGPacketPtr();
+    }
+
+    CMJPEGPacketPtr pPacket = m_vRing[m_iHead];
+
+    m_vRing[m_iHead].clear();
+    m_iHead = (m_iHead + 1) % m_vRing.count();
+    m_iCount--;
+
+    return pPacket;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Drops the oldest frame of the ring and counts it in the statistics.
+*/
+void CMJPEGServer::CSubscriber::dropOldest()
+{
+    if (m_iCount > 0)
+    {
+        m_vRing[m_iHead].clear();
+        m_iHead = (m_iHead + 1) % m_vRing.count();
+        m_iCount--;
+        m_tStats.m_iFramesDropped++;
     }
 }
 
@@ -57,18 +187,25 @@ void CMJPEGThread::run()
 */
 CMJPEGServer::CMJPEGServer(int iPort)
     : CHTTPServer(iPort)
-    , m_tTimer(this)
     , m_tMutex(QMutex::Recursive)
     , m_pOutputFile(nullptr)
+    , m_pRecorder(nullptr)
+    , m_baPartPrefix(CMJPEGPacket::partPrefix(MJPEGBoundaryMarker.toLatin1()))
+    , m_iSequence(0)
+    , m_eDropPolicy(eDropOldest)
+    , m_iRingSize(4)
+    , m_iMaxLatencyMS(500)
+    , m_eSubsampling(CJPEGCodec::e420)
+    , m_iMaxVariants(8)
+    , m_iMaxFPS(0)
+    , m_iRequiredFPS(0)
+    , m_iNextInputTime(0)
+    , m_iSkippedFrames(0)
 {
     m_iCompressionRate = -1;
 
     if (m_iCompressionRate >= 0) m_iCompressionRate = 100 - m_iCompressionRate;
 
-    connect(&m_tTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
-
-    m_tTimer.start(20);
-
     m_pThread = new CMJPEGThread(this);
 }
 
@@ -79,9 +216,21 @@ CMJPEGServer::CMJPEGServer(int iPort)
 */
 CMJPEGServer::CMJPEGServer(QString sFileName)
     : CHTTPServer(0)
-    , m_tTimer(this)
     , m_tMutex(QMutex::Recursive)
     , m_pOutputFile(nullptr)
+    , m_pRecorder(nullptr)
+    , m_baPartPrefix(CMJPEGPacket::partPrefix(MJPEGBoundaryMarker.toLatin1()))
+    , m_iCompressionRate(-1)
+    , m_iSequence(0)
+    , m_eDropPolicy(eDropOldest)
+    , m_iRingSize(4)
+    , m_iMaxLatencyMS(500)
+    , m_eSubsampling(CJPEGCodec::e420)
+    , m_iMaxVariants(8)
+    , m_iMaxFPS(0)
+    , m_iRequiredFPS(0)
+    , m_iNextInputTime(0)
+    , m_iSkippedFrames(0)
 {
     m_sFileName = sFileName;
 
@@ -98,9 +247,7 @@ CMJPEGServer::CMJPEGServer(QString sFileName)
         m_pOutputFile = nullptr;
     }
 
-    connect(&m_tTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
-
-    m_tTimer.start(10);
+    updateRequiredFrameRate();
 
     m_pThread = new CMJPEGThread(this);
 }
@@ -112,8 +259,6 @@ CMJPEGServer::CMJPEGServer(QString sFileName)
 */
 CMJPEGServer::~CMJPEGServer()
 {
-    m_tTimer.stop();
-
     delete m_pThread;
 
     QMutexLocker locker(&m_tMutex);
@@ -123,17 +268,22 @@ CMJPEGServer::~CMJPEGServer()
         m_pOutputFile->close();
         delete m_pOutputFile;
     }
+
+    delete m_pRecorder;
+
+    qDeleteAll(m_mSubscribers);
+    m_mSubscribers.clear();
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    \a baData.
+    Sends \a baData, an already encoded JPEG image, to connected clients.
 */
 void CMJPEGServer::send(const QByteArray& baData)
 {
-    // Si on crit dans un fichier ou qu'on a des connections actives
-    if (m_pOutputFile != nullptr || hasConnections())
+    // Si on crit dans un fichier ou qu'on a des connections actives, au rythme demand
+    if (admitFrame())
     {
         // Si les donnes entrantes existent
         if (baData.count() > 0)
@@ -144,8 +294,10 @@ void CMJPEGServer::send(const QByteArray& baData)
             // On ajoute les donnes dans notre buffer de sortie
             if (m_vOutput.count() < 10)
             {
-                m_vOutput.append(baData);
+                m_vOutput.append(COutputPacket(MJPEG_ALL_VARIANTS, CMJPEGPacket::fromJPEG(baData, m_baPartPrefix, m_iSequence++)));
             }
+
+            notifyFramesReady();
         }
     }
 }
@@ -153,27 +305,33 @@ void CMJPEGServer::send(const QByteArray& baData)
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    \a baData. \br
-    \a iWidth. \br
-    \a iHeight.
+    Sends \a baData, \a iWidth x \a iHeight tightly packed RGB888 pixels, to connected clients. \br\br
+    The pixels are not copied : the image queued for encoding shares \a baData.
 */
 void CMJPEGServer::sendRaw(const QByteArray& baData, int iWidth, int iHeight)
 {
-    // Si on crit dans un fichier ou qu'on a des connections actives
-    if (m_pOutputFile != nullptr || hasConnections())
+    // Si on crit dans un fichier ou qu'on a des connections actives, au rythme demand
+    if (admitFrame())
     {
-        // Cration d'une image  la taille spcifie
-        QImage image(QSize(iWidth, iHeight), QImage::Format_RGB888);
+        if (iWidth <= 0 || iHeight <= 0 || baData.count() < iWidth * iHeight * 3)
+        {
+            qWarning() << QString("CMJPEGServer::sendRaw() : %1 bytes is not enough for a %2x%3 image").arg(baData.count()).arg(iWidth).arg(iHeight);
+            return;
+        }
 
-        // Recopie des donnes brutes d'image dans la QImage
-        memcpy(image.bits(), baData.constData(), baData.count());
+        // Cration d'une image qui partage les donnes brutes, libres avec elle
+        QImage image(
+                    (const uchar*) baData.constData(), iWidth, iHeight, iWidth * 3, QImage::Format_RGB888,
+                    releaseRawData, new QByteArray(baData)
+                    );
 
-        // Verrouillage du mutex de buffer
-        QMutexLocker locker(&m_tMutex);
+        // Verrouillage du mutex des images
+        QMutexLocker locker(&m_tImagesMutex);
 
         if (m_vOutputImages.count() < 10)
         {
             m_vOutputImages.append(image);
+            m_tImagesAdded.wakeOne();
         }
     }
 }
@@ -185,16 +343,18 @@ void CMJPEGServer::sendRaw(const QByteArray& baData, int iWidth, int iHeight)
 */
 void CMJPEGServer::sendImage(const QImage& image)
 {
-    if (m_pOutputFile != nullptr || hasConnections())
+    // The image is copied only if it is needed
+    if (admitFrame())
     {
         if (image.width() > 0 && image.height() > 0)
         {
-            // Verrouillage du mutex de buffer
-            QMutexLocker locker(&m_tMutex);
+            // Verrouillage du mutex des images
+            QMutexLocker locker(&m_tImagesMutex);
 
             if (m_vOutputImages.count() < 10)
             {
                 m_vOutputImages.append(image.copy());
+                m_tImagesAdded.wakeOne();
             }
         }
     }
@@ -207,17 +367,192 @@ void CMJPEGServer::sendImage(const QImage& image)
 */
 bool CMJPEGServer::hasConnections() const
 {
-    return m_vSockets.count() > 0;
+    QMutexLocker locker(&m_tMutex);
+
+    return m_mSubscribers.count() > 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the policy applied to the frames of clients that can not keep up to \a ePolicy.
+*/
+void CMJPEGServer::setDropPolicy(EDropPolicy ePolicy)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_eDropPolicy = ePolicy;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the number of frames a client may have waiting to \a iFrames. \br\br
+    Applies to clients connecting afterwards.
+*/
+void CMJPEGServer::setRingSize(int iFrames)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_iRingSize = qMax(iFrames, 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iMilliseconds the age above which a waiting frame is skipped when the policy is \c eMaxLatency.
+*/
+void CMJPEGServer::setMaxLatency(int iMilliseconds)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_iMaxLatencyMS = iMilliseconds;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the chroma subsampling of the frames given to sendImage() and sendRaw() to \a eSubsampling. \br\br
+    Only the TurboJPEG backend of CJPEGCodec honours it, except for \c CJPEGCodec::eGray.
+*/
+void CMJPEGServer::setSubsampling(CJPEGCodec::ESubsampling eSubsampling)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_eSubsampling = eSubsampling;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iVariants the number of variants encoded at once. \br\br
+    Each variant costs a downscale and an encoding per frame. A client asking for a new variant
+    when the limit is reached receives the full stream. Applies to clients connecting afterwards.
+*/
+void CMJPEGServer::setMaximumVariants(int iVariants)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_iMaxVariants = qMax(iVariants, 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of variants currently encoded for the connected clients.
+*/
+int CMJPEGServer::variantCount() const
+{
+    QMutexLocker locker(&m_tMutex);
+
+    return m_mVariants.count();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iFramesPerSecond the highest frame rate accepted from the producer, 0 for no limit. \br\br
+    Frames given faster are dropped before being encoded, for all the outputs.
+*/
+void CMJPEGServer::setMaximumFrameRate(int iFramesPerSecond)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_iMaxFPS = qMax(iFramesPerSecond, 0);
+
+    updateRequiredFrameRate();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the frame rate needed by the outputs : 0 when there is no client, recording or output file,
+    \c MJPEG_UNLIMITED_FPS when an output takes every frame, and otherwise the highest \c fps asked for
+    by the clients, capped by setMaximumFrameRate(). \br\br
+    Frames given faster than this rate are skipped.
+*/
+int CMJPEGServer::requiredFrameRate() const
+{
+    QMutexLocker locker(&m_tMutex);
+
+    return m_iRequiredFPS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of frames given to the server and skipped because no output needed them.
+*/
+qint64 CMJPEGServer::skippedFrames() const
+{
+    QMutexLocker locker(&m_tMutex);
+
+    return m_iSkippedFrames;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the delivery statistics of each connected client.
+*/
+QVector<CMJPEGServer::CSubscriberStats> CMJPEGServer::subscriberStats() const
+{
+    QMutexLocker locker(&m_tMutex);
+    QVector<CSubscriberStats> vStats;
+
+    foreach (CSubscriber* pSubscriber, m_mSubscribers)
+    {
+        CSubscriberStats tStats = pSubscriber->m_tStats;
+        tStats.m_iQueuedFrames = pSubscriber->m_iCount;
+        vStats << tStats;
+    }
+
+    return vStats;
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Flushes the output.
+    Starts recording the frames to the segments of \a sBaseName, a path without extension, and returns
+    the recorder so that its segment duration, size and flush interval can be changed. \br\br
+    The recording is written along with the other outputs. It can be read with CMJPEGRecording
+    and served with CMJPEGPlaybackServer. A recording already started is stopped first.
+*/
+CMJPEGRecorder* CMJPEGServer::startRecording(const QString& sBaseName)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    delete m_pRecorder;
+    m_pRecorder = new CMJPEGRecorder(sBaseName);
+
+    updateRequiredFrameRate();
+
+    return m_pRecorder;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Stops the recording started by startRecording(), closing its current segment.
+*/
+void CMJPEGServer::stopRecording()
+{
+    QMutexLocker locker(&m_tMutex);
+
+    delete m_pRecorder;
+    m_pRecorder = nullptr;
+
+    updateRequiredFrameRate();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sends the encoded frames waiting for delivery. Must be called from the server's thread.
 */
 void CMJPEGServer::flush()
 {
-    onTimeout();
+    onFramesReady();
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -234,24 +569,43 @@ void CMJPEGServer::getContent(const CWebContext& tContext, QString& sHead, QStri
     Q_UNUSED(sHead);
     Q_UNUSED(sBody);
 
-    // Ajout de la socket au vecteur
+    // Ajout de la socket aux abonns
     QMutexLocker locker(&m_tMutex);
 
-    if (m_vSockets.contains(tContext.m_pSocket) == false)
+    if (m_mSubscribers.contains(tContext.m_pSocket) == false)
     {
-        m_vSockets.append(tContext.m_pSocket);
-    }
+        CVariant tVariant = variantFromArguments(tContext.m_mArguments);
 
-    CClientData* pData = CClientData::getFromSocket(tContext.m_pSocket);
+        // Share the variant with the clients that already asked for it, if the limit allows a new one
+        if (m_mVariants.contains(tVariant.key()) == false)
+        {
+            if (m_mVariants.count() >= m_iMaxVariants)
+            {
+                qWarning() << QString("CMJPEGServer::getContent() : too many variants, sending the full stream");
+                tVariant = CVariant();
+            }
 
-    if (pData != nullptr)
-    {
-        pData->m_vUserData["BytesToWrite"] = QVariant((qlonglong) 0);
+            if (m_mVariants.contains(tVariant.key()) == false)
+            {
+                m_mVariants[tVariant.key()] = tVariant;
+            }
+        }
+
+        m_mVariants[tVariant.key()].m_iSubscribers++;
 
-        pData->m_vUserData["IsFirstImage"] = QVariant(true);
+        // The response header is written while holding the mutex, so that no frame can precede it
+        QByteArray baHeader(HTTP_HEADER HTTP_200_OK HTML_NL);
+        baHeader.append(getHeader().toLatin1());
+
+        tContext.m_pSocket->write(baHeader);
+
+        m_mSubscribers[tContext.m_pSocket] = new CSubscriber(tContext.m_pSocket, m_iRingSize, tVariant);
+
+        updateRequiredFrameRate();
     }
 
-    sCustomResponse = getHeader();
+    // The response is already written
+    sCustomResponse.clear();
     sCustomResponseMIME = MIME_Content_Custom;
 }
 
@@ -262,12 +616,15 @@ void CMJPEGServer::getContent(const CWebContext& tContext, QString& sHead, QStri
 */
 void CMJPEGServer::handleSocketDisconnection(QTcpSocket* pSocket)
 {
-    // Retrait de la socket du vecteur
+    // Retrait de la socket des abonns
     QMutexLocker locker(&m_tMutex);
 
-    if (m_vSockets.contains(pSocket))
+    if (m_mSubscribers.contains(pSocket))
     {
-        m_vSockets.remove(m_vSockets.indexOf(pSocket));
+        CSubscriber* pSubscriber = m_mSubscribers.take(pSocket);
+
+        releaseVariant(pSubscriber->m_iVariant);
+        delete pSubscriber;
     }
 }
 
@@ -279,107 +636,98 @@ void CMJPEGServer::handleSocketDisconnection(QTcpSocket* pSocket)
 */
 void CMJPEGServer::handleSocketBytesWritten(QTcpSocket* pSocket, qint64 iBytes)
 {
-    CClientData* pData = CClientData::getFromSocket(pSocket);
+    Q_UNUSED(iBytes);
 
-    if (pData != nullptr)
-    {
-        qlonglong iBytesToWrite = pData->m_vUserData["BytesToWrite"].toLongLong();
+    QMutexLocker locker(&m_tMutex);
 
-        iBytesToWrite -= (qlonglong) iBytes;
+    // The client has room again, send it its next frame
+    CSubscriber* pSubscriber = m_mSubscribers.value(pSocket, nullptr);
 
-        if (iBytesToWrite < 0)
-        {
-            iBytesToWrite = 0;
-        }
-
-        pData->m_vUserData["BytesToWrite"] = QVariant(iBytesToWrite);
+    if (pSubscriber != nullptr)
+    {
+        deliver(pSubscriber);
     }
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Does timed processing.
+    Hands the new frames to the output file or to the clients. \br\br
+    Called in the server's thread each time frames are ready, see notifyFramesReady().
 */
-void CMJPEGServer::onTimeout()
+void CMJPEGServer::onFramesReady()
 {
+    m_iFramesReadyPending.store(0);
+
+    // Lock the buffer mutex
+    QMutexLocker locker(&m_tMutex);
+
     if (m_vOutput.count() > 0)
     {
+        // The recording and the output file hold the full stream
+        quint32 iFullStream = CVariant().key();
+
+        if (m_pRecorder != nullptr)
+        {
+            foreach (const COutputPacket& tOutput, m_vOutput)
+            {
+                if (tOutput.m_iVariant == iFullStream || tOutput.m_iVariant == MJPEG_ALL_VARIANTS)
+                {
+                    m_pRecorder->write(tOutput.m_pPacket);
+                }
+            }
+        }
+
         if (m_pOutputFile != nullptr)
         {
             if (m_pOutputFile->isOpen())
             {
-                // Lock the buffer mutex
-                QMutexLocker locker(&m_tMutex);
-
-                // Iterate through each output buffer
-
-                foreach (const QByteArray& baOutput, m_vOutput)
+                // Iterate through each output packet
+                foreach (const COutputPacket& tOutput, m_vOutput)
                 {
-                    // Compose the outgoing message :
-                    // - Boundary marker
-                    // - HTML header
-                    // - Image
-                    QString sMessage = getImageDescriptor(baOutput.count());
-
-                    // Write data
-                    m_pOutputFile->write(sMessage.toLatin1());
-                    m_pOutputFile->write(baOutput);
-                    m_pOutputFile->flush();
+                    if (tOutput.m_iVariant == iFullStream || tOutput.m_iVariant == MJPEG_ALL_VARIANTS)
+                    {
+                        // The packet holds the boundary marker, the part header and the image
+                        m_pOutputFile->write(tOutput.m_pPacket->part());
+                        m_pOutputFile->flush();
+                    }
                 }
 
                 m_vOutput.clear();
             }
             else
-            {	// Lock the buffer mutex
-                QMutexLocker locker(&m_tMutex);
-
+            {
                 m_vOutput.clear();
             }
         }
         else
         {
-            // Lock the buffer mutex
-            QMutexLocker locker(&m_tMutex);
+            QMutableMapIterator<QTcpSocket*, CSubscriber*> iSubscriber(m_mSubscribers);
 
-            // Iterate through each connected client
-            foreach (QTcpSocket* pSocket, m_vSockets)
+            // Give the new frames to each client, then send what each one can take
+            while (iSubscriber.hasNext())
             {
-                CClientData* pData = CClientData::getFromSocket(pSocket);
+                CSubscriber* pSubscriber = iSubscriber.next().value();
 
-                if (pData != nullptr)
+                // Forget the clients whose socket was destroyed without a disconnection
+                if (pSubscriber->m_pSocket.isNull())
                 {
-                    // Is the socket ready?
-                    if (pSocket->state() == QTcpSocket::ConnectedState)
+                    releaseVariant(pSubscriber->m_iVariant);
+                    delete pSubscriber;
+                    iSubscriber.remove();
+                    continue;
+                }
+
+                // A client gets the frames of its variant, which are shared with the other clients of the variant
+                foreach (const COutputPacket& tOutput, m_vOutput)
+                {
+                    if (tOutput.m_iVariant == pSubscriber->m_iVariant || tOutput.m_iVariant == MJPEG_ALL_VARIANTS)
                     {
-                        foreach (const QByteArray& baOutput, m_vOutput)
-                        {
-                            qlonglong iBytesToWrite = pData->m_vUserData["BytesToWrite"].toULongLong();
-
-                            // Si la socket a un buffer de sortie suffisament petit
-                            if (iBytesToWrite < baOutput.count() * 4)
-                            {
-                                // Compose the outgoing message :
-                                // - Boundary marker
-                                // - HTML header
-                                // - Image
-                                QByteArray sMessage = getImageDescriptor(baOutput.count()).toLatin1();
-
-                                // Write data
-                                pSocket->write(sMessage);
-                                pSocket->write(baOutput);
-
-                                pData->m_vUserData["BytesToWrite"] = iBytesToWrite + (qlonglong) (sMessage.count() + baOutput.count());
-                            }
-
-                            if (pSocket->state() == QTcpSocket::ConnectedState)
-                            {
-                                // Flush output
-                                pSocket->flush();
-                            }
-                        }
+                        pSubscriber->push(tOutput.m_pPacket, m_eDropPolicy);
                     }
                 }
+
+                deliver(pSubscriber);
             }
 
             m_vOutput.clear();
@@ -387,26 +735,324 @@ void CMJPEGServer::onTimeout()
     }
 }
 
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Writes the next frames of \a pSubscriber to its socket. \br\br
+    A frame is written only when the socket has nothing left to write, the others wait in the
+    subscriber's ring. The buffer mutex must be locked.
+*/
+void CMJPEGServer::deliver(CSubscriber* pSubscriber)
+{
+    QTcpSocket* pSocket = pSubscriber->m_pSocket.data();
+
+    if (pSocket == nullptr || pSocket->state() != QTcpSocket::ConnectedState)
+    {
+        return;
+    }
+
+    qint64 iNow = QDateTime::currentMSecsSinceEpoch();
+
+    while (pSocket->bytesToWrite() == 0)
+    {
+        CMJPEGPacketPtr pPacket = pSubscriber->pop(m_eDropPolicy, m_iMaxLatencyMS, iNow);
+
+        if (pPacket.isNull())
+        {
+            break;
+        }
+
+        // The packet holds the boundary marker, the part header and the image
+        pSocket->write(pPacket->part());
+
+        pSubscriber->m_tStats.m_iFramesSent++;
+        pSubscriber->m_tStats.m_iBytesSent += pPacket->part().count();
+    }
+}
+
 //-------------------------------------------------------------------------------------------------
 // Careful : this method must be thread-safe
 
 /*!
-    Called by a thread to convert output images.
+    Called by a thread to convert output images. \br\br
+    Each image is encoded once per variant into a packet shared by the clients of the variant. Images are
+    downscaled once per scale factor, and a variant with a maximum frame rate only gets the newest image
+    when it is due. Encoding is done without holding the buffer mutex, so that clients can connect and
+    frames can be sent meanwhile.
 */
 void CMJPEGServer::processOutputImages()
 {
-    // Lock the buffer mutex
+    QVector<QImage> vImages;
+    QVector<CVariant> vVariants;
+    qint64 iSequence = 0;
+    int iCompressionRate = -1;
+    CJPEGCodec::ESubsampling eSubsampling = CJPEGCodec::e420;
+
+    {
+        // Lock the images mutex
+        QMutexLocker locker(&m_tImagesMutex);
+
+        vImages.swap(m_vOutputImages);
+    }
+
+    if (vImages.isEmpty())
+    {
+        return;
+    }
+
+    {
+        // Lock the buffer mutex
+        QMutexLocker locker(&m_tMutex);
+
+        iSequence = m_iSequence;
+        m_iSequence += vImages.count();
+        iCompressionRate = m_iCompressionRate;
+        eSubsampling = m_eSubsampling;
+
+        vVariants = m_mVariants.values().toVector();
+
+        // The recording and the output file need the full stream even without clients
+        if ((m_pOutputFile != nullptr || m_pRecorder != nullptr) && m_mVariants.contains(CVariant().key()) == false)
+        {
+            vVariants.append(CVariant());
+        }
+    }
+
+    // Nothing needs the images anymore
+    if (vVariants.isEmpty())
+    {
+        return;
+    }
+
+    qint64 iNow = QDateTime::currentMSecsSinceEpoch();
+    QVector<COutputPacket> vPackets;
+
+    for (int iImage = 0; iImage < vImages.count(); iImage++, iSequence++)
+    {
+        const QImage& image = vImages[iImage];
+
+        if (image.width() <= 0 || image.height() <= 0)
+        {
+            continue;
+        }
+
+        // Images downscaled for this frame, by divisor
+        QMap<int, QImage> mScaled;
+
+        foreach (const CVariant& tVariant, vVariants)
+        {
+            quint32 iKey = tVariant.key();
+
+            if (tVariant.m_iMaxFPS > 0)
+            {
+                qint64 iInterval = 1000 / tVariant.m_iMaxFPS;
+                qint64 iNext = m_mNextFrameTimes.value(iKey, 0);
+
+                // Only the newest image of the batch is considered, and only when the variant is due,
+                // with some slack so that input decimated to the same rate is not halved
+                if (iImage < vImages.count() - 1 || iNow + iInterval / 4 < iNext)
+                {
+                    continue;
+                }
+
+                // Keep the rate steady despite jitter, without bursting after a pause
+                m_mNextFrameTimes[iKey] = qMax(iNext + iInterval, iNow - iInterval / 2);
+            }
+
+            if (mScaled.contains(tVariant.m_iScaleDivisor) == false)
+            {
+                mScaled[tVariant.m_iScaleDivisor] = downscale(image, tVariant.m_iScaleDivisor);
+            }
+
+            const QImage& scaled = mScaled[tVariant.m_iScaleDivisor];
+
+            if (scaled.isNull() == false)
+            {
+                int iQuality = tVariant.m_iQuality >= 0 ? tVariant.m_iQuality : iCompressionRate;
+
+                vPackets.append(COutputPacket(iKey, CMJPEGPacket::fromImage(scaled, iQuality, m_baPartPrefix, iSequence, eSubsampling)));
+            }
+        }
+    }
+
+    // Forget the rate-limited variants that are gone
+    QMutableMapIterator<quint32, qint64> iNextFrameTime(m_mNextFrameTimes);
+
+    while (iNextFrameTime.hasNext())
+    {
+        quint32 iKey = iNextFrameTime.next().key();
+        bool bFound = false;
+
+        foreach (const CVariant& tVariant, vVariants)
+        {
+            bFound = bFound || tVariant.key() == iKey;
+        }
+
+        if (bFound == false)
+        {
+            iNextFrameTime.remove();
+        }
+    }
+
+    {
+        // Lock the buffer mutex
+        QMutexLocker locker(&m_tMutex);
+
+        m_vOutput += vPackets;
+    }
+
+    notifyFramesReady();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the variant asked for by \a mArguments, the query arguments of a request :
+    \list
+    \li \c scale - A fraction of the width and height, rounded to 1/2, 1/3... up to 1/8
+    \li \c quality - The JPEG quality, from 1 to 100, rounded to a multiple of 5
+    \li \c fps - The maximum frame rate, up to 100
+    \endlist
+    Values are rounded so that clients asking for nearly the same stream share it.
+*/
+CMJPEGServer::CVariant CMJPEGServer::variantFromArguments(const QMap<QString, QString>& mArguments) const
+{
+    CVariant tVariant;
+    bool bOK = false;
+
+    double dScale = mArguments.value("scale").toDouble(&bOK);
+
+    if (bOK && dScale > 0.0 && dScale < 1.0)
+    {
+        tVariant.m_iScaleDivisor = qBound(1, qRound(1.0 / dScale), 8);
+    }
+
+    int iQuality = mArguments.value("quality").toInt(&bOK);
+
+    if (bOK && iQuality > 0)
+    {
+        tVariant.m_iQuality = qBound(5, qRound((double) iQuality / 5.0) * 5, 100);
+    }
+
+    int iFPS = mArguments.value("fps").toInt(&bOK);
+
+    if (bOK && iFPS > 0)
+    {
+        tVariant.m_iMaxFPS = qMin(iFPS, 100);
+    }
+
+    return tVariant;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Removes a client from the variant whose key is \a iVariant. The variant is no longer encoded
+    once it has no client. The buffer mutex must be locked.
+*/
+void CMJPEGServer::releaseVariant(quint32 iVariant)
+{
+    if (m_mVariants.contains(iVariant))
+    {
+        if (--m_mVariants[iVariant].m_iSubscribers <= 0)
+        {
+            m_mVariants.remove(iVariant);
+
+            updateRequiredFrameRate();
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if a frame given now must be encoded. \br\br
+    Frames are refused while nothing needs them, and decimated to the required frame rate,
+    keeping the rate steady despite jitter in the producer. This method is thread-safe.
+*/
+bool CMJPEGServer::admitFrame()
+{
     QMutexLocker locker(&m_tMutex);
 
-    foreach (const QImage& image, m_vOutputImages)
+    if (m_iRequiredFPS == 0)
     {
-        if (image.width() > 0 && image.height() > 0)
+        m_iSkippedFrames++;
+        return false;
+    }
+
+    if (m_iRequiredFPS > 0)
+    {
+        qint64 iNow = QDateTime::currentMSecsSinceEpoch();
+        qint64 iInterval = 1000 / m_iRequiredFPS;
+
+        if (iNow < m_iNextInputTime)
         {
-            m_vOutput.append(CImageUtilities::getInstance()->convertQImageToByteArray(image, "JPG", m_iCompressionRate));
+            m_iSkippedFrames++;
+            return false;
         }
+
+        m_iNextInputTime = qMax(m_iNextInputTime + iInterval, iNow - iInterval / 2);
     }
 
-    m_vOutputImages.clear();
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Computes the frame rate needed by the outputs, see requiredFrameRate(), and emits
+    requiredFrameRateChanged() if it changed. The buffer mutex must be locked.
+*/
+void CMJPEGServer::updateRequiredFrameRate()
+{
+    int iFPS = 0;
+
+    if (m_pOutputFile != nullptr || m_pRecorder != nullptr)
+    {
+        iFPS = MJPEG_UNLIMITED_FPS;
+    }
+    else
+    {
+        foreach (const CVariant& tVariant, m_mVariants)
+        {
+            if (tVariant.m_iMaxFPS == 0)
+            {
+                iFPS = MJPEG_UNLIMITED_FPS;
+                break;
+            }
+
+            iFPS = qMax(iFPS, tVariant.m_iMaxFPS);
+        }
+    }
+
+    // The server's own limit applies when something is watching
+    if (m_iMaxFPS > 0 && iFPS != 0 && (iFPS == MJPEG_UNLIMITED_FPS || iFPS > m_iMaxFPS))
+    {
+        iFPS = m_iMaxFPS;
+    }
+
+    if (iFPS != m_iRequiredFPS)
+    {
+        m_iRequiredFPS = iFPS;
+        m_iNextInputTime = 0;
+
+        emit requiredFrameRateChanged(iFPS);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Schedules a call to onFramesReady() in the server's thread. \br\br
+    Notifications are coalesced : nothing is posted if a call is already pending.
+    This method is thread-safe.
+*/
+void CMJPEGServer::notifyFramesReady()
+{
+    if (m_iFramesReadyPending.testAndSetOrdered(0, 1))
+    {
+        QMetaObject::invokeMethod(this, "onFramesReady", Qt::QueuedConnection);
+    }
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -427,22 +1073,71 @@ QString CMJPEGServer::getHeader()
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns an image descriptor for HTTP. \br
-    \a iSize is the size of the content.
+    Deletes \a pData, the QByteArray sharing the pixels of an image built in sendRaw().
 */
-QString CMJPEGServer::getImageDescriptor(int iSize)
+void CMJPEGServer::releaseRawData(void* pData)
 {
-    // Compose an outgoing message
-    // - Boundary marker
-    // - HTML header
+    delete static_cast<QByteArray*>(pData);
+}
 
-    return QString(
-                "--%1\r\n"
-                "Content-Type: image/jpeg\r\n"
-                "Content-length: %2\r\n"
-                "\r\n")
-            .arg(MJPEGBoundaryMarker)
-            .arg(iSize);
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \a image with its width and height divided by \a iDivisor, as RGB888. \br\br
+    Each pixel is the average of a block of \a iDivisor x \a iDivisor pixels, summed a line at a time
+    with integers only. This is much faster than a smooth QImage::scaled() and looks as good for integer
+    factors. Returns \a image itself if \a iDivisor is 1, and a null image if it is too small.
+*/
+QImage CMJPEGServer::downscale(const QImage& image, int iDivisor)
+{
+    if (iDivisor <= 1)
+    {
+        return image;
+    }
+
+    int iWidth = image.width() / iDivisor;
+    int iHeight = image.height() / iDivisor;
+
+    if (iWidth <= 0 || iHeight <= 0)
+    {
+        return QImage();
+    }
+
+    QImage source = image.format() == QImage::Format_RGB888 ? image : image.convertToFormat(QImage::Format_RGB888);
+    QImage target(iWidth, iHeight, QImage::Format_RGB888);
+    QVector<int> vSums(iWidth * 3);
+    int iArea = iDivisor * iDivisor;
+
+    for (int y = 0; y < iHeight; y++)
+    {
+        vSums.fill(0);
+
+        for (int iLine = 0; iLine < iDivisor; iLine++)
+        {
+            const uchar* pSource = source.constScanLine(y * iDivisor + iLine);
+            int* pSum = vSums.data();
+
+            for (int x = 0; x < iWidth; x++, pSum += 3)
+            {
+                for (int iColumn = 0; iColumn < iDivisor; iColumn++, pSource += 3)
+                {
+                    pSum[0] += pSource[0];
+                    pSum[1] += pSource[1];
+                    pSum[2] += pSource[2];
+                }
+            }
+        }
+
+        uchar* pTarget = target.scanLine(y);
+        const int* pSum = vSums.constData();
+
+        for (int iIndex = 0; iIndex < iWidth * 3; iIndex++)
+        {
+            pTarget[iIndex] = (uchar) (pSum[iIndex] / iArea);
+        }
+    }
+
+    return target;
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -460,19 +1155,14 @@ void CMJPEGServer::saveMJPEG(const QVector<QImage>& vImages, QString sFileName)
         if (file.open(QIODevice::WriteOnly))
         {
             QString sMessage = getHeader();
+            QByteArray baPartPrefix = CMJPEGPacket::partPrefix(MJPEGBoundaryMarker.toLatin1());
+            qint64 iSequence = 0;
+
             file.write(sMessage.toLatin1());
 
             foreach (QImage image, vImages)
             {
-                QByteArray baImage;
-                QBuffer buffer(&baImage);
-                buffer.open(QIODevice::WriteOnly);
-                image.save(&buffer, "JPG");
-                buffer.close();
-
-                QString sMessage = getImageDescriptor(baImage.count());
-                file.write(sMessage.toLatin1());
-                file.write(baImage);
+                file.write(CMJPEGPacket::fromImage(image, -1, baPartPrefix, iSequence++)->part());
             }
 
             file.close();
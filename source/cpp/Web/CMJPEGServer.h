@@ -10,16 +10,30 @@
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QThread>
-#include <QTimer>
+#include <QWaitCondition>
+#include <QAtomicInt>
 #include <QFile>
+#include <QMap>
+#include <QPointer>
 
 // Application
 #include "CHTTPServer.h"
+#include "CMJPEGPacket.h"
+#include "CMJPEGRecorder.h"
+
+//-------------------------------------------------------------------------------------------------
+
+// Variant key of the frames given already encoded, which go to every client
+#define MJPEG_ALL_VARIANTS      0xFFFFFFFF
+
+// Frame rate asked for when the clients want every frame
+#define MJPEG_UNLIMITED_FPS     -1
 
 //-------------------------------------------------------------------------------------------------
 
 class CMJPEGServer;
 
+//! Encodes the images given to a CMJPEGServer, sleeping until there are some
 class CMJPEGThread : public QThread
 {
     Q_OBJECT
@@ -51,6 +65,117 @@ class QTPLUSSHARED_EXPORT CMJPEGServer : public CHTTPServer
 
 public:
 
+    //-------------------------------------------------------------------------------------------------
+    // Enumerators
+    //-------------------------------------------------------------------------------------------------
+
+    //! What to do with the frames of a client that can not keep up
+    enum EDropPolicy
+    {
+        eDropOldest,        // Frames queue up to the ring size, the oldest one is dropped when full
+        eLatestOnly,        // Only the newest frame is kept
+        eMaxLatency         // Like eDropOldest, and frames older than the maximum latency are skipped if newer ones are queued
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Inner classes
+    //-------------------------------------------------------------------------------------------------
+
+    //! Delivery statistics of a client
+    class CSubscriberStats
+    {
+    public:
+
+        CSubscriberStats()
+            : m_iPeerPort(0)
+            , m_iFramesSent(0)
+            , m_iFramesDropped(0)
+            , m_iBytesSent(0)
+            , m_iQueuedFrames(0)
+            , m_iScaleDivisor(1)
+            , m_iQuality(-1)
+            , m_iMaxFPS(0)
+        {
+        }
+
+        QString     m_sPeer;            // Address of the client
+        quint16     m_iPeerPort;
+        qint64      m_iFramesSent;
+        qint64      m_iFramesDropped;   // Frames skipped because the client was too slow
+        qint64      m_iBytesSent;
+        int         m_iQueuedFrames;    // Frames waiting in the client's ring
+        int         m_iScaleDivisor;    // Variant received by the client, see CVariant
+        int         m_iQuality;
+        int         m_iMaxFPS;
+    };
+
+    //! A version of the stream, encoded once per frame for all the clients that asked for it
+    class CVariant
+    {
+    public:
+
+        CVariant()
+            : m_iScaleDivisor(1)
+            , m_iQuality(-1)
+            , m_iMaxFPS(0)
+            , m_iSubscribers(0)
+        {
+        }
+
+        //! Returns the key identifying the variant
+        quint32 key() const { return (quint32) m_iScaleDivisor | ((quint32) (m_iQuality + 1) << 8) | ((quint32) m_iMaxFPS << 16); }
+
+        int         m_iScaleDivisor;    // Width and height are divided by this
+        int         m_iQuality;         // -1 for the server's quality
+        int         m_iMaxFPS;          // 0 for no limit
+        int         m_iSubscribers;
+    };
+
+    //! An encoded frame waiting for delivery, with the key of its variant
+    class COutputPacket
+    {
+    public:
+
+        COutputPacket()
+            : m_iVariant(0)
+        {
+        }
+
+        COutputPacket(quint32 iVariant, const CMJPEGPacketPtr& pPacket)
+            : m_iVariant(iVariant)
+            , m_pPacket(pPacket)
+        {
+        }
+
+        quint32             m_iVariant;     // MJPEG_ALL_VARIANTS for frames given already encoded
+        CMJPEGPacketPtr     m_pPacket;
+    };
+
+    //! A client of the stream, with its own ring of frames
+    class CSubscriber
+    {
+    public:
+
+        //! Constructor
+        CSubscriber(QTcpSocket* pSocket, int iRingSize, const CVariant& tVariant);
+
+        //! Adds a frame, dropping older ones according to ePolicy
+        void push(const CMJPEGPacketPtr& pPacket, EDropPolicy ePolicy);
+
+        //! Removes and returns the next frame to send, null if none
+        CMJPEGPacketPtr pop(EDropPolicy ePolicy, int iMaxLatencyMS, qint64 iNow);
+
+        //! Drops the oldest frame
+        void dropOldest();
+
+        QPointer<QTcpSocket>        m_pSocket;
+        quint32                     m_iVariant;         // Key of the variant received
+        QVector<CMJPEGPacketPtr>    m_vRing;            // Frames waiting to be sent, from m_iHead
+        int                         m_iHead;
+        int                         m_iCount;
+        CSubscriberStats            m_tStats;
+    };
+
     //-------------------------------------------------------------------------------------------------
     // Constructors and destructor
     //-------------------------------------------------------------------------------------------------
@@ -80,7 +205,43 @@ public:
     //! Returns true if there are connected clients
     bool hasConnections() const;
 
-    //! Flushes the output
+    //! Sets what to do with the frames of clients that can not keep up (eDropOldest by default)
+    void setDropPolicy(EDropPolicy ePolicy);
+
+    //! Sets the number of frames a client may have waiting (4 by default)
+    void setRingSize(int iFrames);
+
+    //! Sets the age above which a waiting frame is skipped with eMaxLatency, in milliseconds (500 by default)
+    void setMaxLatency(int iMilliseconds);
+
+    //! Sets the chroma subsampling of the frames encoded by the server (CJPEGCodec::e420 by default)
+    void setSubsampling(CJPEGCodec::ESubsampling eSubsampling);
+
+    //! Sets the number of variants encoded at once (8 by default), clients asking for more get the full stream
+    void setMaximumVariants(int iVariants);
+
+    //! Returns the number of variants currently encoded for the clients
+    int variantCount() const;
+
+    //! Sets the highest frame rate accepted from the producer, 0 for no limit (the default)
+    void setMaximumFrameRate(int iFramesPerSecond);
+
+    //! Returns the frame rate needed by the outputs, 0 when nobody watches, MJPEG_UNLIMITED_FPS for every frame
+    int requiredFrameRate() const;
+
+    //! Returns the number of frames given to the server and skipped by the governor
+    qint64 skippedFrames() const;
+
+    //! Returns the delivery statistics of each client
+    QVector<CSubscriberStats> subscriberStats() const;
+
+    //! Starts an indexed recording of the frames, see CMJPEGRecorder
+    CMJPEGRecorder* startRecording(const QString& sBaseName);
+
+    //! Stops the recording
+    void stopRecording();
+
+    //! Sends the encoded frames waiting for delivery
     void flush();
 
     //!
@@ -99,13 +260,23 @@ public:
     //! Saves a sequence of images as an MJPEG stream
     static void saveMJPEG(const QVector<QImage>& vImages, QString sFileName);
 
+    //-------------------------------------------------------------------------------------------------
+    // Signals
+    //-------------------------------------------------------------------------------------------------
+
+signals:
+
+    //! Emitted when the frame rate needed by the outputs changes, so that the producer can capture less
+    void requiredFrameRateChanged(int iFramesPerSecond);
+
     //-------------------------------------------------------------------------------------------------
     // Slots
     //-------------------------------------------------------------------------------------------------
 
 protected slots:
 
-    void onTimeout();
+    //! Hands the new frames to the clients
+    void onFramesReady();
 
     //-------------------------------------------------------------------------------------------------
     // Protected methods
@@ -113,14 +284,35 @@ protected slots:
 
 protected:
 
-    //!
+    //! Encodes the queued images, once per variant
     void processOutputImages();
 
+    //! Returns the variant asked for by the query arguments of a request
+    CVariant variantFromArguments(const QMap<QString, QString>& mArguments) const;
+
+    //! Removes a client from its variant, and the variant if it has no client left
+    void releaseVariant(quint32 iVariant);
+
+    //! Returns true if a frame given now must be encoded, according to the required frame rate
+    bool admitFrame();
+
+    //! Computes the frame rate needed by the outputs and emits requiredFrameRateChanged() if it changed
+    void updateRequiredFrameRate();
+
+    //! Writes the next frames of a client, as long as its socket has nothing left to write
+    void deliver(CSubscriber* pSubscriber);
+
+    //! Schedules a call to onFramesReady() in the server's thread, unless one is already pending
+    void notifyFramesReady();
+
     //!
     static QString getHeader();
 
-    //!
-    static QString getImageDescriptor(int iSize);
+    //! Releases the raw pixels shared by an image built in sendRaw()
+    static void releaseRawData(void* pData);
+
+    //! Returns an image whose width and height are divided by iDivisor, averaging blocks of pixels
+    static QImage downscale(const QImage& image, int iDivisor);
 
     //-------------------------------------------------------------------------------------------------
     // Properties
@@ -128,13 +320,29 @@ protected:
 
 protected:
 
-    QTimer					m_tTimer;
-    QMutex					m_tMutex;
+    mutable QMutex			m_tMutex;
+    QMutex					m_tImagesMutex;     // Protects m_vOutputImages
+    QWaitCondition			m_tImagesAdded;     // Wakes the encoding thread
+    QAtomicInt				m_iFramesReadyPending;
     QString					m_sFileName;
     QFile*					m_pOutputFile;
-    QVector<QByteArray>		m_vOutput;
+    CMJPEGRecorder*			m_pRecorder;        // Indexed recording, if started
+    QByteArray				m_baPartPrefix;     // Start of the part headers, built once
+    QVector<COutputPacket>	m_vOutput;          // Encoded frames waiting to be sent
     QVector<QImage>			m_vOutputImages;
-    QVector<QTcpSocket*>	m_vSockets;
+    QMap<QTcpSocket*, CSubscriber*>	m_mSubscribers;
+    QMap<quint32, CVariant>		m_mVariants;        // Variants asked for by the clients
+    QMap<quint32, qint64>		m_mNextFrameTimes;  // Time at which each rate-limited variant is due, used by the encoding thread only
     CMJPEGThread*			m_pThread;
     int						m_iCompressionRate;
+    qint64					m_iSequence;        // Sequence number of the next frame
+    EDropPolicy				m_eDropPolicy;
+    int						m_iRingSize;
+    int						m_iMaxLatencyMS;
+    CJPEGCodec::ESubsampling	m_eSubsampling;
+    int						m_iMaxVariants;
+    int						m_iMaxFPS;          // Highest frame rate accepted, 0 for no limit
+    int						m_iRequiredFPS;     // Frame rate needed by the outputs, see requiredFrameRate()
+    qint64					m_iNextInputTime;   // Time at which the next frame is accepted when decimating
+    qint64					m_iSkippedFrames;
 };
@@ -1,4 +1,7 @@
 
+// Qt
+#include <QThreadStorage>
+
 // Application
 #include "CHTTPServer.h"
 #include "CWebComposer.h"
@@ -9,14 +12,26 @@
     \class CWebComposer
     \inmodule qt-plus
     \brief A class that renders HTML components.
+
+    Each thread gets its own composer through getInstance(), so the worker threads of CHTTPServer
+    render pages in parallel without sharing the lists of files and scripts. \br
+    Markup is appended piece by piece to the page, which grows in place. The composer also remembers
+    the size of the last page it rendered, so that reserve() allocates the head and body of the next
+    page once.
 */
 
 //-------------------------------------------------------------------------------------------------
 
+static QThreadStorage<CWebComposer*> s_tComposers;
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Constructs a CWebComposer with default parameters.
 */
 CWebComposer::CWebComposer()
+    : m_iHeadCapacity(COMPOSER_HEAD_CAPACITY)
+    , m_iBodyCapacity(COMPOSER_BODY_CAPACITY)
 {
 }
 
@@ -31,6 +46,21 @@ CWebComposer::~CWebComposer()
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Returns the composer of the calling thread, which is created on first call and deleted when the thread ends.
+*/
+CWebComposer* CWebComposer::getInstance()
+{
+    if (s_tComposers.hasLocalData() == false)
+    {
+        s_tComposers.setLocalData(new CWebComposer());
+    }
+
+    return s_tComposers.localData();
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Returns the list of required JS files.
 */
@@ -73,6 +103,30 @@ void CWebComposer::reset()
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Reserves in \a sHead and \a sBody the sizes of the last page rendered with this composer,
+    so that they are allocated once.
+*/
+void CWebComposer::reserve(QString& sHead, QString& sBody) const
+{
+    sHead.reserve(m_iHeadCapacity);
+    sBody.reserve(m_iBodyCapacity);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Remembers the sizes of \a sHead and \a sBody, a rendered page, for the next call to reserve(). \br\br
+    The capacity follows the pages with some margin, and shrinks slowly after a big page.
+*/
+void CWebComposer::updateCapacity(const QString& sHead, const QString& sBody)
+{
+    m_iHeadCapacity = qMax(qMax(sHead.size() + sHead.size() / 4, (m_iHeadCapacity * 3) / 4), COMPOSER_HEAD_CAPACITY);
+    m_iBodyCapacity = qMax(qMax(sBody.size() + sBody.size() / 4, (m_iBodyCapacity * 3) / 4), COMPOSER_BODY_CAPACITY);
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Adds a javascript file name (\a sFileName) to the list.
 */
@@ -104,10 +158,7 @@ void CWebComposer::addCSSFile(QString sFileName)
 */
 void CWebComposer::addJSFileStatement(QString& sHead, QString sFileName)
 {
-    sHead.append(
-                QString("<script type='text/javascript' src='%1'></script>"HTML_NL)
-                .arg(sFileName)
-                );
+    sHead.append("<script type='text/javascript' src='").append(sFileName).append("'></script>"HTML_NL);
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -117,10 +168,7 @@ void CWebComposer::addJSFileStatement(QString& sHead, QString sFileName)
 */
 void CWebComposer::addCSSFileStatement(QString& sHead, QString sFileName)
 {
-    sHead.append(
-                QString("<link rel='stylesheet' href='%1' type='text/css'/>"HTML_NL)
-                .arg(sFileName)
-                );
+    sHead.append("<link rel='stylesheet' href='").append(sFileName).append("' type='text/css'/>"HTML_NL);
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -160,11 +208,7 @@ void CWebComposer::addNewLine(QString& sPage)
 */
 void CWebComposer::beginDiv(QString& sPage, QString sID, QString sClass)
 {
-    sPage.append(
-                QString("<div id='%1' class='%2'>")
-                .arg(sID)
-                .arg(sClass)
-                );
+    sPage.append("<div id='").append(sID).append("' class='").append(sClass).append("'>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -174,7 +218,7 @@ void CWebComposer::beginDiv(QString& sPage, QString sID, QString sClass)
 */
 void CWebComposer::endDiv(QString& sPage)
 {
-    sPage.append(QString("</div>"));
+    sPage.append("</div>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -184,7 +228,7 @@ void CWebComposer::endDiv(QString& sPage)
 */
 void CWebComposer::beginTable(QString& sPage, QString sID)
 {
-    sPage.append(QString("<table id='%1'>").arg(sID));
+    sPage.append("<table id='").append(sID).append("'>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -194,7 +238,7 @@ void CWebComposer::beginTable(QString& sPage, QString sID)
 */
 void CWebComposer::endTable(QString& sPage)
 {
-    sPage.append(QString("</table>"));
+    sPage.append("</table>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -204,7 +248,7 @@ void CWebComposer::endTable(QString& sPage)
 */
 void CWebComposer::beginTableRow(QString& sPage)
 {
-    sPage.append(QString("<tr>"));
+    sPage.append("<tr>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -214,7 +258,7 @@ void CWebComposer::beginTableRow(QString& sPage)
 */
 void CWebComposer::endTableRow(QString& sPage)
 {
-    sPage.append(QString("</tr>"));
+    sPage.append("</tr>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -224,7 +268,7 @@ void CWebComposer::endTableRow(QString& sPage)
 */
 void CWebComposer::beginTableCell(QString& sPage)
 {
-    sPage.append(QString("<td>"));
+    sPage.append("<td>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -234,7 +278,7 @@ void CWebComposer::beginTableCell(QString& sPage)
 */
 void CWebComposer::endTableCell(QString& sPage)
 {
-    sPage.append(QString("</td>"));
+    sPage.append("</td>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -245,7 +289,7 @@ void CWebComposer::endTableCell(QString& sPage)
 */
 void CWebComposer::addTableCell(QString& sPage, QString sValue)
 {
-    sPage.append(QString("<td>%1</td>").arg(sValue));
+    sPage.append("<td>").append(sValue).append("</td>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -257,11 +301,7 @@ void CWebComposer::addTableCell(QString& sPage, QString sValue)
 */
 void CWebComposer::addLink(QString& sPage, QString sText, QString sLink)
 {
-    sPage.append(
-                QString("<a href='http://%1'>%2</a>")
-                .arg(sLink)
-                .arg(sText)
-                );
+    sPage.append("<a href='http://").append(sLink).append("'>").append(sText).append("</a>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -275,20 +315,14 @@ void CWebComposer::addLink(QString& sPage, QString sText, QString sLink)
 */
 void CWebComposer::addSelector(QString& sPage, QString sID, QStringList lValues, QString sSelected, QString sOnChanged)
 {
-    sPage.append(QString("<select id='%1' onChange='%2(value)'>")
-                 .arg(sID)
-                 .arg(sOnChanged)
-                 );
+    sPage.append("<select id='").append(sID).append("' onChange='").append(sOnChanged).append("(value)'>");
 
-    foreach (QString sValue, lValues)
+    foreach (const QString& sValue, lValues)
     {
-        sPage.append(QString("<option %1>%2</option>")
-                     .arg(sValue == sSelected? "selected" : "")
-                     .arg(sValue)
-                     );
+        sPage.append(sValue == sSelected ? "<option selected>" : "<option >").append(sValue).append("</option>");
     }
 
-    sPage.append(QString("</select>"));
+    sPage.append("</select>");
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -311,19 +345,12 @@ void CWebComposer::addButton(QString& sPage, QString sID, QString sText, QSize s
 
     if (sOnClicked.isEmpty())
     {
-        sPage.append(QString("<input type='button' id='%1' value='%2'/>")
-                     .arg(sID)
-                     .arg(sText)
-                     );
+        sPage.append("<input type='button' id='").append(sID).append("' value='").append(sText).append("'/>");
     }
     else
     {
-        sPage.append(QString("<input type='button' id='%1' value='%2' onClick='%3(\"%4\")'/>")
-                     .arg(sID)
-                     .arg(sText)
-                     .arg(sOnClicked)
-                     .arg(sArgument)
-                     );
+        sPage.append("<input type='button' id='").append(sID).append("' value='").append(sText)
+             .append("' onClick='").append(sOnClicked).append("(\"").append(sArgument).append("\")'/>");
     }
 }
 
@@ -349,17 +376,11 @@ void CWebComposer::addTextInput(QString& sPage, QString sID, QString sText, QSiz
 
     if (sOnChanged.isEmpty())
     {
-        sPage.append(QString("<input type='text' id='%1' value='%2'/>")
-                     .arg(sID)
-                     .arg(sText)
-                     );
+        sPage.append("<input type='text' id='").append(sID).append("' value='").append(sText).append("'/>");
     }
     else
     {
-        sPage.append(QString("<input type='text' id='%1' value='%2' onChange='%3()'/>")
-                     .arg(sID)
-                     .arg(sText)
-                     .arg(sOnChanged)
-                     );
+        sPage.append("<input type='text' id='").append(sID).append("' value='").append(sText)
+             .append("' onChange='").append(sOnChanged).append("()'/>");
     }
 }
@@ -7,21 +7,41 @@
 
 // Qt
 #include <QString>
+#include <QStringList>
 #include <QVector>
 #include <QSize>
 
-// Application
-#include "../CSingleton.h"
+//-------------------------------------------------------------------------------------------------
+
+// Initial capacity of the head and body of a page, in characters
+#define COMPOSER_HEAD_CAPACITY  (16 * 1024)
+#define COMPOSER_BODY_CAPACITY  (32 * 1024)
 
 //-------------------------------------------------------------------------------------------------
 
 //! Defines a class that renders HTML components
-class QTPLUSSHARED_EXPORT CWebComposer : public CSingleton<CWebComposer>
+//! Each thread has its own instance, so pages can be rendered in parallel
+class QTPLUSSHARED_EXPORT CWebComposer
 {
-    friend class CSingleton<CWebComposer>;
-
 public:
 
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor
+    CWebComposer();
+
+    //! Destructor
+    virtual ~CWebComposer();
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the composer of the calling thread
+    static CWebComposer* getInstance();
+
     //-------------------------------------------------------------------------------------------------
     // Getters
     //-------------------------------------------------------------------------------------------------
@@ -42,6 +62,12 @@ public:
     //! Clears all lists
     void reset();
 
+    //! Reserves in a head and a body the sizes of the last page rendered by this composer
+    void reserve(QString& sHead, QString& sBody) const;
+
+    //! Remembers the sizes of a rendered page, for the next reserve()
+    void updateCapacity(const QString& sHead, const QString& sBody);
+
     //!
     void addJSFile(QString sFileName);
 
@@ -102,18 +128,6 @@ public:
     //!
     void addTextInput(QString& sPage, QString sID, QString sText, QSize sSize = QSize(0, 0), QString sPlaceHolder = "", QString sOnChanged = "");
 
-    //-------------------------------------------------------------------------------------------------
-    // Constructors and destructor
-    //-------------------------------------------------------------------------------------------------
-
-private:
-
-    //! Constructor
-    CWebComposer();
-
-    //! Destructor
-    virtual ~CWebComposer();
-
     //-------------------------------------------------------------------------------------------------
     // Properties
     //-------------------------------------------------------------------------------------------------
@@ -123,4 +137,6 @@ protected:
     QVector<QString>    m_vJSFiles;
     QVector<QString>    m_vCSSFiles;
     QVector<QString>    m_vReadyScriptLines;
+    int                 m_iHeadCapacity;
+    int                 m_iBodyCapacity;
 };
@@ -6,6 +6,7 @@
 
 CWebContext::CWebContext()
     : m_pSocket(nullptr)
+    , m_bKeepAlive(false)
 {
 }
 
@@ -17,6 +18,7 @@ CWebContext::CWebContext(QTcpSocket* pSocket, QString sPeer, QString sHost, QStr
     , m_sHost(sHost)
     , m_lPath(lPath)
     , m_mArguments(mArguments)
+    , m_bKeepAlive(false)
 {
 }
 
@@ -29,6 +31,10 @@ CWebContext::CWebContext(const CWebContext& target)
     , m_lPath(target.m_lPath)
     , m_mArguments(target.m_mArguments)
     , m_baPostContent(target.m_baPostContent)
+    , m_baRequest(target.m_baRequest)
+    , m_tRequest(target.m_tRequest)
+    , m_bKeepAlive(target.m_bKeepAlive)
+    , m_lParts(target.m_lParts)
 {
 }
 
@@ -37,3 +43,32 @@ CWebContext::CWebContext(const CWebContext& target)
 CWebContext::~CWebContext()
 {
 }
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the value of the request header named \a szName, or an empty array if the request has no such header.
+*/
+QByteArray CWebContext::header(const char* szName) const
+{
+    return m_tRequest.headerValue(m_baRequest, szName);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the part of a multipart request body whose form field name is \a sName, or \c nullptr if there is none. \br\br
+    Small parts are held in memory, big ones in temporary files (see CHTTPMultipartParser::CPart).
+*/
+const CHTTPMultipartParser::CPart* CWebContext::part(const QString& sName) const
+{
+    for (int iIndex = 0; iIndex < m_lParts.count(); iIndex++)
+    {
+        if (m_lParts[iIndex].m_sName == sName)
+        {
+            return &m_lParts[iIndex];
+        }
+    }
+
+    return nullptr;
+}
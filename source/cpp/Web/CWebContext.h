@@ -11,6 +11,10 @@
 #include <QMap>
 #include <QTcpSocket>
 
+// Application
+#include "CHTTPRequestParser.h"
+#include "CHTTPMultipartParser.h"
+
 //-------------------------------------------------------------------------------------------------
 
 //! Defines a HTTP server context
@@ -34,6 +38,16 @@ public:
     //! Destructor
     virtual ~CWebContext();
 
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the value of a request header, empty if not present
+    QByteArray header(const char* szName) const;
+
+    //! Returns the multipart part named sName, nullptr if not present
+    const CHTTPMultipartParser::CPart* part(const QString& sName) const;
+
     //-------------------------------------------------------------------------------------------------
     // Properties
     //-------------------------------------------------------------------------------------------------
@@ -46,4 +60,8 @@ public:
     QStringList             m_lPath;
     QMap<QString, QString>  m_mArguments;
     QByteArray              m_baPostContent;
+    QByteArray              m_baRequest;        // Raw request, as received
+    CHTTPRequestParser      m_tRequest;         // Parser holding the offsets of the request items in m_baRequest
+    bool                    m_bKeepAlive;       // Tells if the connection stays open after the response
+    QList<CHTTPMultipartParser::CPart> m_lParts;  // Parts of a multipart body, big ones are in temporary files
 };
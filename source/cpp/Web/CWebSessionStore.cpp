@@ -0,0 +1,485 @@
+
+// Qt
+#include <QIODevice>
+#include <QDataStream>
+#include <QUuid>
+#include <QDebug>
+
+// Application
+#include "CWebSessionStore.h"
+#include "WebControls/CWebPage.h"
+
+//-------------------------------------------------------------------------------------------------
+
+// Time a request waits for a page used by another request of the same session
+#define SESSION_WAIT_TIMEOUT_MS     10000
+
+// Requests handled between two measures of a page
+#define SESSION_MEASURE_INTERVAL    16
+
+// Ratio between the memory used by a page and its serialized size
+#define SESSION_SIZE_FACTOR         2
+
+//-------------------------------------------------------------------------------------------------
+
+//! Counts the bytes written to it, used to measure a serialized page without storing it
+class CByteCounter : public QIODevice
+{
+public:
+
+    CByteCounter()
+        : m_iCount(0)
+    {
+        open(QIODevice::WriteOnly);
+    }
+
+    qint64 m_iCount;
+
+protected:
+
+    virtual qint64 readData(char* pData, qint64 iMaxSize) Q_DECL_OVERRIDE
+    {
+        Q_UNUSED(pData);
+        Q_UNUSED(iMaxSize);
+
+        return -1;
+    }
+
+    virtual qint64 writeData(const char* pData, qint64 iSize) Q_DECL_OVERRIDE
+    {
+        Q_UNUSED(pData);
+
+        m_iCount += iSize;
+        return iSize;
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CWebSessionStore
+    \inmodule qt-plus
+    \brief Keeps live web pages on the server, each under a session token.
+
+    When CDynamicHTTPServer uses a session store (see CDynamicHTTPServer::useSessionStore()), a page is kept
+    alive after it is rendered, and the client receives a short token instead of the serialized page.
+    Events are handled by the live page : there is no deserialization, and only the controls concerned
+    by an event do any work. \br
+    A page is reserved by acquire() for the duration of a request, so the requests of a session are handled
+    one at a time. Pages are evicted when they have been idle for too long (see setIdleTimeout()), and the
+    least recently used ones when there are too many (see setMaximumSessions()) or when they use more
+    than the memory budget (see setMemoryBudget()). The size of a page is estimated from its serialized
+    size, measured when it is inserted and every few requests. The most recently used page is never
+    evicted for the budget, so a single big page still works. \br\br
+    The methods are thread-safe.
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CWebSessionStore. \a pTracker is given to the pages when they are serialized to be measured.
+*/
+CWebSessionStore::CWebSessionStore(CObjectTracker* pTracker)
+    : m_pTracker(pTracker)
+    , m_iNextStamp(0)
+    , m_iMemoryUsage(0)
+    , m_iEvictions(0)
+    , m_iMaxSessions(1000)
+    , m_iMemoryBudget(64 * 1024 * 1024)
+    , m_iIdleTimeoutMS(20 * 60 * 1000)
+{
+    m_tClock.start();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CWebSessionStore and the pages it holds.
+*/
+CWebSessionStore::~CWebSessionStore()
+{
+    clear();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iSessions the maximum number of pages kept.
+*/
+void CWebSessionStore::setMaximumSessions(int iSessions)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_iMaxSessions = qMax(iSessions, 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iBytes the memory the pages may use.
+*/
+void CWebSessionStore::setMemoryBudget(qint64 iBytes)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_iMemoryBudget = iBytes;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iMilliseconds the time after which a page that received no request is evicted. 0 keeps idle pages.
+*/
+void CWebSessionStore::setIdleTimeout(int iMilliseconds)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_iIdleTimeoutMS = iMilliseconds;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of pages kept.
+*/
+int CWebSessionStore::count() const
+{
+    QMutexLocker locker(&m_tMutex);
+
+    return m_mSessions.count();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the estimated memory used by the pages, in bytes.
+*/
+qint64 CWebSessionStore::memoryUsage() const
+{
+    QMutexLocker locker(&m_tMutex);
+
+    return m_iMemoryUsage;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of pages evicted since the store was constructed.
+*/
+qint64 CWebSessionStore::evictions() const
+{
+    QMutexLocker locker(&m_tMutex);
+
+    return m_iEvictions;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Stores \a pPage as the session \a sToken, usually obtained from generateToken(). The store owns the page from now on.
+*/
+void CWebSessionStore::insert(const QString& sToken, CWebPage* pPage)
+{
+    qint64 iSize = measure(pPage);
+    QVector<CWebPage*> vEvicted;
+
+    {
+        QMutexLocker locker(&m_tMutex);
+
+        CSession& tSession = m_mSessions[sToken];
+
+        tSession.m_pPage = pPage;
+        tSession.m_iSize = iSize;
+        tSession.m_iLastAccess = m_tClock.elapsed();
+
+        touch(sToken, tSession);
+
+        m_iMemoryUsage += iSize;
+
+        vEvicted = evict();
+    }
+
+    qDeleteAll(vEvicted);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the page of the session \a sToken and reserves it until release() is called. \br\br
+    If another request of the session holds the page, waits until it is released.
+    Returns \c nullptr if the session does not exist, has expired, or if the wait times out.
+*/
+CWebPage* CWebSessionStore::acquire(const QString& sToken)
+{
+    CWebPage* pExpired = nullptr;
+
+    {
+        QMutexLocker locker(&m_tMutex);
+        QElapsedTimer tWait;
+
+        tWait.start();
+
+        // The requests of a session are handled one at a time
+        while (m_mSessions.contains(sToken) && m_mSessions[sToken].m_bInUse)
+        {
+            qint64 iRemaining = SESSION_WAIT_TIMEOUT_MS - tWait.elapsed();
+
+            if (iRemaining <= 0 || m_tReleased.wait(&m_tMutex, (unsigned long) iRemaining) == false)
+            {
+                qWarning() << QString("CWebSessionStore::acquire() : timed out waiting for session %1").arg(sToken);
+                return nullptr;
+            }
+        }
+
+        if (m_mSessions.contains(sToken) == false)
+        {
+            return nullptr;
+        }
+
+        CSession& tSession = m_mSessions[sToken];
+        qint64 iNow = m_tClock.elapsed();
+
+        if (m_iIdleTimeoutMS > 0 && iNow - tSession.m_iLastAccess > m_iIdleTimeoutMS)
+        {
+            pExpired = tSession.m_pPage;
+
+            m_iMemoryUsage -= tSession.m_iSize;
+            m_iEvictions++;
+            m_mLRU.remove(tSession.m_iStamp);
+            m_mSessions.remove(sToken);
+        }
+        else
+        {
+            tSession.m_bInUse = true;
+            tSession.m_iLastAccess = iNow;
+
+            touch(sToken, tSession);
+
+            return tSession.m_pPage;
+        }
+    }
+
+    delete pExpired;
+
+    return nullptr;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Gives back the page of the session \a sToken, reserved by acquire(). \br\br
+    The page is measured again every few requests, and the sessions over the limits are evicted.
+*/
+void CWebSessionStore::release(const QString& sToken)
+{
+    CWebPage* pPage = nullptr;
+    qint64 iSize = -1;
+    QVector<CWebPage*> vEvicted;
+
+    {
+        QMutexLocker locker(&m_tMutex);
+
+        if (m_mSessions.contains(sToken) == false)
+        {
+            return;
+        }
+
+        CSession& tSession = m_mSessions[sToken];
+
+        if (++tSession.m_iUses >= SESSION_MEASURE_INTERVAL)
+        {
+            pPage = tSession.m_pPage;
+        }
+    }
+
+    // The page is still reserved, so it can be measured without the lock
+    if (pPage != nullptr)
+    {
+        iSize = measure(pPage);
+    }
+
+    {
+        QMutexLocker locker(&m_tMutex);
+
+        if (m_mSessions.contains(sToken))
+        {
+            CSession& tSession = m_mSessions[sToken];
+
+            if (iSize >= 0)
+            {
+                m_iMemoryUsage += iSize - tSession.m_iSize;
+                tSession.m_iSize = iSize;
+                tSession.m_iUses = 0;
+            }
+
+            tSession.m_bInUse = false;
+            tSession.m_iLastAccess = m_tClock.elapsed();
+
+            touch(sToken, tSession);
+        }
+
+        m_tReleased.wakeAll();
+
+        vEvicted = evict();
+    }
+
+    qDeleteAll(vEvicted);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Deletes the session \a sToken and its page, waiting for a request that holds it.
+*/
+void CWebSessionStore::remove(const QString& sToken)
+{
+    CWebPage* pPage = acquire(sToken);
+
+    if (pPage != nullptr)
+    {
+        {
+            QMutexLocker locker(&m_tMutex);
+
+            CSession tSession = m_mSessions.take(sToken);
+
+            m_mLRU.remove(tSession.m_iStamp);
+            m_iMemoryUsage -= tSession.m_iSize;
+            m_tReleased.wakeAll();
+        }
+
+        delete pPage;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Evicts the pages that have been idle for longer than the idle timeout. \br\br
+    Expired pages are also evicted as requests come, this method frees them on a quiet server.
+*/
+void CWebSessionStore::expire()
+{
+    QVector<CWebPage*> vEvicted;
+
+    {
+        QMutexLocker locker(&m_tMutex);
+
+        vEvicted = evict();
+    }
+
+    qDeleteAll(vEvicted);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Deletes all sessions and their pages. No request may hold a page.
+*/
+void CWebSessionStore::clear()
+{
+    QVector<CWebPage*> vPages;
+
+    {
+        QMutexLocker locker(&m_tMutex);
+
+        foreach (const CSession& tSession, m_mSessions)
+        {
+            vPages << tSession.m_pPage;
+        }
+
+        m_mSessions.clear();
+        m_mLRU.clear();
+        m_iMemoryUsage = 0;
+    }
+
+    qDeleteAll(vPages);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns a new random session token, 32 hexadecimal digits.
+*/
+QString CWebSessionStore::generateToken()
+{
+    return QString(QUuid::createUuid().toRfc4122().toHex());
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Makes \a tSession, whose token is \a sToken, the most recently used. The mutex must be locked.
+*/
+void CWebSessionStore::touch(const QString& sToken, CSession& tSession)
+{
+    m_mLRU.remove(tSession.m_iStamp);
+
+    tSession.m_iStamp = ++m_iNextStamp;
+    m_mLRU[tSession.m_iStamp] = sToken;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Removes the idle sessions, then the least recently used ones while over the limits,
+    skipping the pages in use and the most recently used one. Returns the pages of the removed
+    sessions, to be deleted once the mutex is unlocked. The mutex must be locked.
+*/
+QVector<CWebPage*> CWebSessionStore::evict()
+{
+    QVector<CWebPage*> vEvicted;
+    qint64 iNow = m_tClock.elapsed();
+    QMutableMapIterator<quint64, QString> iLRU(m_mLRU);
+
+    while (iLRU.hasNext())
+    {
+        QString sToken = iLRU.next().value();
+
+        // Keep the most recently used page
+        if (iLRU.hasNext() == false)
+        {
+            break;
+        }
+
+        CSession& tSession = m_mSessions[sToken];
+
+        bool bIdle = m_iIdleTimeoutMS > 0 && iNow - tSession.m_iLastAccess > m_iIdleTimeoutMS;
+        bool bOverLimits = m_mSessions.count() > m_iMaxSessions || m_iMemoryUsage > m_iMemoryBudget;
+
+        // Sessions are in access order, the next ones are neither idle nor needed to get under the limits
+        if (bIdle == false && bOverLimits == false)
+        {
+            break;
+        }
+
+        if (tSession.m_bInUse)
+        {
+            continue;
+        }
+
+        vEvicted << tSession.m_pPage;
+
+        m_iMemoryUsage -= tSession.m_iSize;
+        m_iEvictions++;
+        m_mSessions.remove(sToken);
+        iLRU.remove();
+    }
+
+    return vEvicted;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the estimated memory used by \a pPage : its serialized size, times a factor for the
+    overhead of the objects.
+*/
+qint64 CWebSessionStore::measure(const CWebPage* pPage) const
+{
+    CByteCounter tCounter;
+    QDataStream stream(&tCounter);
+
+    pPage->serialize(stream, m_pTracker);
+
+    return tCounter.m_iCount * SESSION_SIZE_FACTOR;
+}
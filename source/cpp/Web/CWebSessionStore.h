@@ -0,0 +1,154 @@
+#pragma once
+
+#include "../qtplus_global.h"
+
+// Qt
+#include <QString>
+#include <QMap>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+// Application
+#include "../ISerializable.h"
+
+//-------------------------------------------------------------------------------------------------
+// Forward declarations
+
+class CWebPage;
+
+//-------------------------------------------------------------------------------------------------
+
+//! Keeps live web pages on the server, each under a session token
+//! Clients carry the token instead of the viewstate, idle and least recently used pages are evicted
+class QTPLUSSHARED_EXPORT CWebSessionStore
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Inner classes
+    //-------------------------------------------------------------------------------------------------
+
+    //! A page kept in the store
+    class CSession
+    {
+    public:
+
+        CSession()
+            : m_pPage(nullptr)
+            , m_iLastAccess(0)
+            , m_iStamp(0)
+            , m_iSize(0)
+            , m_iUses(0)
+            , m_bInUse(false)
+        {
+        }
+
+        CWebPage*   m_pPage;
+        qint64      m_iLastAccess;      // Milliseconds on the store's clock
+        quint64     m_iStamp;           // Key of the session in the LRU order
+        qint64      m_iSize;            // Estimated size of the page, in bytes
+        int         m_iUses;            // Requests handled since the size was measured
+        bool        m_bInUse;           // Tells if a request is handling the page
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor, pTracker is used to serialize the pages when measuring them
+    CWebSessionStore(CObjectTracker* pTracker);
+
+    //! Destructor, deletes the pages
+    virtual ~CWebSessionStore();
+
+    //-------------------------------------------------------------------------------------------------
+    // Setters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Sets the maximum number of pages kept (1000 by default)
+    void setMaximumSessions(int iSessions);
+
+    //! Sets the memory the pages may use, in bytes (64 MB by default)
+    void setMemoryBudget(qint64 iBytes);
+
+    //! Sets the time after which an unused page is evicted, in milliseconds (20 minutes by default)
+    void setIdleTimeout(int iMilliseconds);
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the number of pages kept
+    int count() const;
+
+    //! Returns the estimated memory used by the pages, in bytes
+    qint64 memoryUsage() const;
+
+    //! Returns the number of pages evicted since construction
+    qint64 evictions() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Stores a page under a token, the store now owns the page
+    void insert(const QString& sToken, CWebPage* pPage);
+
+    //! Returns the page of a session and reserves it for the caller, nullptr if the session does not exist
+    CWebPage* acquire(const QString& sToken);
+
+    //! Gives back a page reserved by acquire()
+    void release(const QString& sToken);
+
+    //! Deletes a session and its page
+    void remove(const QString& sToken);
+
+    //! Evicts the pages that have been idle for too long
+    void expire();
+
+    //! Deletes all sessions
+    void clear();
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns a new random session token
+    static QString generateToken();
+
+    //-------------------------------------------------------------------------------------------------
+    // Protected methods
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Moves a session to the most recently used end, the mutex must be locked
+    void touch(const QString& sToken, CSession& tSession);
+
+    //! Removes the sessions over the limits, returns their pages, the mutex must be locked
+    QVector<CWebPage*> evict();
+
+    //! Returns the size of a page serialized
+    qint64 measure(const CWebPage* pPage) const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    mutable QMutex              m_tMutex;
+    QWaitCondition              m_tReleased;        // Wakes the requests waiting for a page in use
+    QElapsedTimer               m_tClock;
+    CObjectTracker*             m_pTracker;
+    QMap<QString, CSession>     m_mSessions;
+    QMap<quint64, QString>      m_mLRU;             // Tokens by stamp, least recently used first
+    quint64                     m_iNextStamp;
+    qint64                      m_iMemoryUsage;
+    qint64                      m_iEvictions;
+    int                         m_iMaxSessions;
+    qint64                      m_iMemoryBudget;
+    int                         m_iIdleTimeoutMS;
+};
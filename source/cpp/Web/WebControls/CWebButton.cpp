@@ -67,13 +67,12 @@ void CWebButton::addHTML(QString& sHead, QString& sBody)
 {
     QString sFunction = addHTMLEvent(sHead, EVENT_CLICKED, m_sEventParameter);
 
-    sBody.append(QString("<input type='button' id='%1' class='%2' style.visibility='%3' value='%4' onClick='%5'/>"HTML_NL)
-                 .arg(getCodeName())
-                 .arg(m_sStyleClass)
-                 .arg(m_bVisible ? "visible" : "hidden")
-                 .arg(m_sCaption)
-                 .arg(sFunction)
-                 );
+    sBody.append("<input type='button' id='").append(getCodeName())
+         .append("' class='").append(m_sStyleClass)
+         .append("' style.visibility='").append(m_bVisible ? "visible" : "hidden")
+         .append("' value='").append(m_sCaption)
+         .append("' onClick='").append(sFunction)
+         .append("'/>"HTML_NL);
 }
 
 //-------------------------------------------------------------------------------------------------
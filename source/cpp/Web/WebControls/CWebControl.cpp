@@ -20,7 +20,7 @@
 
 //-------------------------------------------------------------------------------------------------
 
-qint32 CWebControl::m_iNextID = 0;
+QAtomicInt CWebControl::m_iNextID(0);
 
 //-------------------------------------------------------------------------------------------------
 
@@ -485,13 +485,12 @@ CWebControl* CWebControl::addObserver(IWebControlObserver* pObserver)
 */
 void CWebControl::addHTML(QString& sHead, QString& sBody)
 {
-    sBody.append(
-                QString("<div id='%1' class='%2' style='%3' style.visibility='%4'>"HTML_NL)
-                .arg(getCodeName())
-                .arg(m_sStyleClass)
-                .arg(m_sStyle)
-                .arg(m_bVisible ? "visible" : "hidden")
-                );
+    sBody.append("<div id='").append(getCodeName())
+         .append("' class='").append(m_sStyleClass)
+         .append("' style='").append(m_sStyle)
+         .append("' style.visibility='").append(m_bVisible ? "visible" : "hidden")
+         .append("'").append(getHTMLAttributes(sHead))
+         .append(">"HTML_NL);
 
     sBody.append(m_sCaption);
 
@@ -500,7 +499,21 @@ void CWebControl::addHTML(QString& sHead, QString& sBody)
         pControl->addHTML(sHead, sBody);
     }
 
-    sBody.append(QString("</div>"HTML_NL));
+    sBody.append("</div>"HTML_NL);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns extra attributes for the <div> written by addHTML(), each one preceded by a space. \br\br
+    This method is meant to be overridden by subclasses that keep the default markup, for instance to add event handlers.
+    \a sHead can receive the scripts they need. The default implementation returns an empty string.
+*/
+QString CWebControl::getHTMLAttributes(QString& sHead) const
+{
+    Q_UNUSED(sHead);
+
+    return QString();
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -512,10 +525,7 @@ void CWebControl::addHTML(QString& sHead, QString& sBody)
 */
 QString CWebControl::addHTMLEvent(QString& sHead, QString sEvent, QString sEventParam) const
 {
-    return QString("emitWebEvent(&quot;%1&quot;, &quot;%2&quot;, &quot;%3&quot;)")
-            .arg(getCodeName())
-            .arg(sEvent)
-            .arg(sEventParam);
+    return QString("emitWebEvent(&quot;") + getCodeName() + "&quot;, &quot;" + sEvent + "&quot;, &quot;" + sEventParam + "&quot;)";
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -527,9 +537,9 @@ QString CWebControl::addHTMLEvent(QString& sHead, QString sEvent, QString sEvent
 */
 QString CWebControl::addHTMLEventWithControlValue(QString& sHead, QString sEvent) const
 {
-    return QString("emitWebEvent(&quot;%1&quot;, &quot;%2&quot;, %1.value)")
-            .arg(getCodeName())
-            .arg(sEvent);
+    QString sCodeName = getCodeName();
+
+    return QString("emitWebEvent(&quot;") + sCodeName + "&quot;, &quot;" + sEvent + "&quot;, " + sCodeName + ".value)";
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -716,13 +726,75 @@ void CWebControl::addScriptFromResources(QString& sHead, const QString& sFileNam
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Serializes the control to a stream. \br\br
+    Serializes the control and its children to a stream. \br\br
     \a stream specifies the stream to use for output. \br
     \a pTracker is an object that is used to serialize pointers, it keeps track of valid pointers.
 */
 void CWebControl::serialize(QDataStream& stream, CObjectTracker *pTracker) const
 {
     stream << QString(metaObject()->className());
+
+    serializeProperties(stream, pTracker);
+
+    stream << (qint32)m_vControls.count();
+    foreach (CWebControl* control, m_vControls)
+    {
+        control->serialize(stream, pTracker);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Deserializes the control and its children from a stream. \br\br
+    \a stream specifies the stream to use for input. \br
+    \a pTracker is an object that is used to serialize pointers, it keeps track of valid pointers. \br
+    \a pRootObject specifies the root control of the page being deserialized
+*/
+void CWebControl::deserialize(QDataStream& stream, CObjectTracker *pTracker, QObject* pRootObject)
+{
+    CWebControl* pRootControl = dynamic_cast<CWebControl*>(pRootObject);
+
+    if (pRootControl != nullptr)
+    {
+        qint32 iControlsCount = 0;
+
+        deserializeProperties(stream, pTracker, pRootObject);
+
+        // Read child controls
+
+        stream >> iControlsCount;
+        for (qint32 iIndex = 0; iIndex < iControlsCount; iIndex++)
+        {
+            QString sClassName;
+            stream >> sClassName;
+
+            CWebControl* pControl = CWebFactory::getInstance()->instanciateProduct(sClassName);
+
+            if (pControl != nullptr)
+            {
+                pControl->deserialize(stream, pTracker, pRootObject);
+
+                addControl(pControl);
+            }
+        }
+
+        resolveObservers();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Serializes the properties of the control to a stream, without its class name and its children. \br\br
+    Subclasses that have data to save override this method and call the base implementation first. \br
+    \a stream specifies the stream to use for output. \br
+    \a pTracker is an object that is used to serialize pointers, it keeps track of valid pointers.
+*/
+void CWebControl::serializeProperties(QDataStream& stream, CObjectTracker* pTracker) const
+{
+    Q_UNUSED(pTracker);
+
     stream << m_iID;
     stream << m_sName;
     stream << m_sCaption;
@@ -736,29 +808,25 @@ void CWebControl::serialize(QDataStream& stream, CObjectTracker *pTracker) const
     {
         stream << observer->getObserverID();
     }
-
-    stream << (qint32)m_vControls.count();
-    foreach (CWebControl* control, m_vControls)
-    {
-        control->serialize(stream, pTracker);
-    }
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Deserializes the control from a stream. \br\br
+    Deserializes the properties of the control from a stream. \br\br
+    The IDs of the observers are stored in the root control, resolveObservers() connects them once all controls are read. \br
     \a stream specifies the stream to use for input. \br
     \a pTracker is an object that is used to serialize pointers, it keeps track of valid pointers. \br
     \a pRootObject specifies the root control of the page being deserialized
 */
-void CWebControl::deserialize(QDataStream& stream, CObjectTracker *pTracker, QObject* pRootObject)
+void CWebControl::deserializeProperties(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootObject)
 {
+    Q_UNUSED(pTracker);
+
     CWebControl* pRootControl = dynamic_cast<CWebControl*>(pRootObject);
 
     if (pRootControl != nullptr)
     {
-        qint32 iControlsCount = 0;
         qint32 iObserverCount = 0;
 
         // Read properties
@@ -774,66 +842,55 @@ void CWebControl::deserialize(QDataStream& stream, CObjectTracker *pTracker, QOb
         // Read this object's observers IDs
 
         stream >> iObserverCount;
-        for (qint32 iIndex = 0; iIndex < iObserverCount; iIndex++)
+        for (qint32 iIndex = 0; iIndex < iObserverCount && stream.status() == QDataStream::Ok; iIndex++)
         {
             qint32 iID;
             stream >> iID;
 
             pRootControl->m_mObservers[m_iID].append(iID);
         }
+    }
+}
 
-        // Read child controls
-
-        stream >> iControlsCount;
-        for (qint32 iIndex = 0; iIndex < iControlsCount; iIndex++)
-        {
-            QString sClassName;
-            stream >> sClassName;
-
-            CWebControl* pControl = CWebFactory::getInstance()->instanciateProduct(sClassName);
-
-            if (pControl != nullptr)
-            {
-                pControl->deserialize(stream, pTracker, pRootObject);
-
-                addControl(pControl);
-            }
-        }
+//-------------------------------------------------------------------------------------------------
 
-        // Resolve observers
+/*!
+    Connects the observers whose IDs were read by deserializeProperties(). Does something only on the root control.
+*/
+void CWebControl::resolveObservers()
+{
+    foreach (qint32 iObservedID, m_mObservers.keys())
+    {
+        CWebControl* pObservedControl = findControl(iObservedID);
 
-        foreach (qint32 iObservedID, m_mObservers.keys())
+        if (pObservedControl != nullptr)
         {
-            CWebControl* pObservedControl = pRootControl->findControl(iObservedID);
-
-            if (pObservedControl != nullptr)
+            foreach(qint32 iObserverID, m_mObservers[iObservedID])
             {
-                foreach(qint32 iObserverID, m_mObservers[iObservedID])
+                CWebControl* pObserverControl = findControl(iObserverID);
+
+                if (pObserverControl != nullptr)
                 {
-                    CWebControl* pObserverControl = pRootControl->findControl(iObserverID);
+                    IWebControlObserver* pObserver = dynamic_cast<IWebControlObserver*>(pObserverControl);
 
-                    if (pObserverControl != nullptr)
+                    if (pObserver != nullptr)
                     {
-                        IWebControlObserver* pObserver = dynamic_cast<IWebControlObserver*>(pObserverControl);
-
-                        if (pObserver != nullptr)
-                        {
-                            pObservedControl->addObserver(pObserver);
-                        }
+                        pObservedControl->addObserver(pObserver);
                     }
                 }
             }
         }
     }
+
+    m_mObservers.clear();
 }
 
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns a unique ID for a web control.
+    Returns a unique ID for a web control. This method is thread-safe.
 */
 qint32 CWebControl::generateID()
 {
-    m_iNextID++;
-    return m_iNextID;
+    return m_iNextID.fetchAndAddRelaxed(1) + 1;
 }
@@ -9,6 +9,7 @@
 #include <QString>
 #include <QVector>
 #include <QDataStream>
+#include <QAtomicInt>
 
 // Application
 #include "../../ISerializable.h"
@@ -23,6 +24,8 @@
 #define TOKEN_CONTROL   "control"
 #define TOKEN_UPLOAD    "upload"
 #define TOKEN_PARAM     "param"
+#define TOKEN_SESSION   "session"
+#define TOKEN_VIEWSTATE_DATA "viewstatedata"
 
 //-------------------------------------------------------------------------------------------------
 
@@ -75,7 +78,7 @@ public:
     CWebControl* setName(const QString& value);
 
     //!
-    CWebControl* setCaption(const QString& value);
+    virtual CWebControl* setCaption(const QString& value);
 
     //!
     CWebControl* setStyleClass(const QString& value);
@@ -163,6 +166,15 @@ public:
     //!
     virtual void deserialize(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootObject) Q_DECL_OVERRIDE;
 
+    //! Serializes the properties of this control only, without its class name and children
+    virtual void serializeProperties(QDataStream& stream, CObjectTracker* pTracker) const;
+
+    //! Deserializes the properties of this control only
+    virtual void deserializeProperties(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootObject);
+
+    //! Connects the observers read by deserializeProperties(), on the root control
+    void resolveObservers();
+
     //-------------------------------------------------------------------------------------------------
     // Mthodes de construction de page
     //-------------------------------------------------------------------------------------------------
@@ -188,6 +200,9 @@ public:
     //!
     QString addCustomHTMLEvent(QString& sHead, QString sEvent, QString sFunctionBody) const;
 
+    //! Returns extra attributes for the <div> written by addHTML(), each preceded by a space
+    virtual QString getHTMLAttributes(QString& sHead) const;
+
     //-------------------------------------------------------------------------------------------------
     // Mthodes de gestion d'vnements
     //-------------------------------------------------------------------------------------------------
@@ -249,5 +264,5 @@ protected:
     QVector<IWebControlObserver*>	m_vObservers;				// Observateurs de ce contrle
     QMap<qint32, QVector<qint32> >	m_mObservers;				// Cl = observ, valeur = observateurs
 
-    static qint32					m_iNextID;
+    static QAtomicInt				m_iNextID;                  // Pages can be built by several threads at once
 };
@@ -8,6 +8,7 @@
 #include "CWebTextEdit.h"
 #include "CWebFileInput.h"
 #include "CWebListView.h"
+#include "CWebSlider.h"
 #include "CWebPage.h"
 
 //-------------------------------------------------------------------------------------------------
@@ -46,6 +47,7 @@ CWebFactory::CWebFactory()
     registerProduct(CWebFileInput::staticMetaObject.className(), CWebFileInput::instantiator);
     registerProduct(CWebListView::staticMetaObject.className(), CWebListView::instantiator);
     registerProduct(CWebPage::staticMetaObject.className(), CWebPage::instantiator);
+    registerProduct(CWebSlider::staticMetaObject.className(), CWebSlider::instantiator);
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -56,3 +58,47 @@ CWebFactory::CWebFactory()
 CWebFactory::~CWebFactory()
 {
 }
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Registers the control class \a sClassName, instantiated by \a pInstanciator. \br\br
+    Each class gets the next type code, used by CWebViewState instead of the class name.
+    Codes depend on the order of registration, so applications should register their controls
+    in the same order at each start.
+*/
+void CWebFactory::registerProduct(const QString& sClassName, MProductInstanciator pInstanciator)
+{
+    if (m_mTypeCodes.contains(sClassName) == false)
+    {
+        m_vClassNames << sClassName;
+        m_mTypeCodes[sClassName] = (quint16) m_vClassNames.count();
+    }
+
+    CFactory<CWebControl>::registerProduct(sClassName, pInstanciator);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the type code of the control class \a sClassName, or 0 if the class is not registered.
+*/
+quint16 CWebFactory::typeCode(const QString& sClassName) const
+{
+    return m_mTypeCodes.value(sClassName, 0);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the name of the control class whose type code is \a iTypeCode, or an empty string if the code is unknown.
+*/
+QString CWebFactory::className(quint16 iTypeCode) const
+{
+    if (iTypeCode < 1 || iTypeCode > m_vClassNames.count())
+    {
+        return QString();
+    }
+
+    return m_vClassNames[iTypeCode - 1];
+}
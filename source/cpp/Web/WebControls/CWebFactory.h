@@ -25,6 +25,15 @@ public:
     // Mthodes de contrle
     //-------------------------------------------------------------------------------------------------
 
+    //! Registers a control class and gives it the next type code
+    void registerProduct(const QString& sClassName, MProductInstanciator pInstanciator);
+
+    //! Returns the type code of a control class, 0 if it is not registered
+    quint16 typeCode(const QString& sClassName) const;
+
+    //! Returns the control class of a type code, empty if unknown
+    QString className(quint16 iTypeCode) const;
+
     //-------------------------------------------------------------------------------------------------
     // Constructeurs et destructeur
     //-------------------------------------------------------------------------------------------------
@@ -36,4 +45,13 @@ protected:
 
     //! Destructeur
     virtual ~CWebFactory();
+
+    //-------------------------------------------------------------------------------------------------
+    // Proprits
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    QMap<QString, quint16>  m_mTypeCodes;       // Type codes by class name
+    QVector<QString>        m_vClassNames;      // Class names by type code - 1
 };
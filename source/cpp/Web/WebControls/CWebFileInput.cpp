@@ -68,13 +68,12 @@ void CWebFileInput::addHTML(QString& sHead, QString& sBody)
                 QString("httpUpload('%1');").arg(getCodeName())
                 );
 
-    sBody.append(QString("<input type='file' id='%1' class='%2' style='%3' style.visibility='%4' onChange='%5()'/>"HTML_NL)
-                 .arg(getCodeName())
-                 .arg(m_sStyleClass)
-                 .arg(m_sStyle)
-                 .arg(m_bVisible ? "visible" : "hidden")
-                 .arg(sFunction)
-                 );
+    sBody.append("<input type='file' id='").append(getCodeName())
+         .append("' class='").append(m_sStyleClass)
+         .append("' style='").append(m_sStyle)
+         .append("' style.visibility='").append(m_bVisible ? "visible" : "hidden")
+         .append("' onChange='").append(sFunction)
+         .append("()'/>"HTML_NL);
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -52,3 +52,16 @@ CWebLabel::CWebLabel(const QString& sName, const QString& sCaption)
 CWebLabel::~CWebLabel()
 {
 }
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the caption of the label to \a value. \br\br
+    A label is rendered as a <div> holding its caption, so the client updates the content of the element.
+*/
+CWebControl* CWebLabel::setCaption(const QString& value)
+{
+    m_sCaption = value;
+    propertyModified("innerHTML", value);
+    return this;
+}
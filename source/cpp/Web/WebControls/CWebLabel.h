@@ -46,6 +46,9 @@ public:
     // Mthodes hrites
     //-------------------------------------------------------------------------------------------------
 
+    //!
+    virtual CWebControl* setCaption(const QString& value) Q_DECL_OVERRIDE;
+
     //-------------------------------------------------------------------------------------------------
     // Proprits
     //-------------------------------------------------------------------------------------------------
@@ -5,6 +5,8 @@
 #include "CWebButton.h"
 #include "CWebLabel.h"
 #include "CWebTextBox.h"
+#include "CWebSlider.h"
+#include "CWebPage.h"
 
 //-------------------------------------------------------------------------------------------------
 
@@ -15,8 +17,15 @@
 #define CONTROLNAME_CURRENT_PAGE_INDEX  "CurrentPageIndex"
 #define CONTROLNAME_TOTAL_PAGE_COUNT    "TotalPageCount"
 #define CONTROLNAME_CONTENT             "Content"
+#define CONTROLNAME_CONTROLS            "Controls"
+#define CONTROLNAME_POSITION            "Position"
 
 #define EVENT_UPDATE                    "update"
+#define EVENT_SCROLL                    "scroll"
+#define EVENT_SCROLL_BY                 "scrollby"
+
+#define WHEEL_ROWS                      3       // Rows moved by a wheel step in virtualized mode
+#define WHEEL_INTERVAL_MS               100     // Minimum time between two wheel events sent to the server
 
 //-------------------------------------------------------------------------------------------------
 
@@ -24,6 +33,19 @@
     \class CWebListView
     \inmodule qt-plus
     \brief A list view for a web page.
+
+    By default, each move rebuilds the content with one control per cell.
+    In virtualized mode (see setVirtualized()), the content is a fixed pool of rows, created once.
+    Moves only change the captions of the cells whose value differs, so the client receives property changes
+    for those cells alone. When the page is kept alive by the session store (see CWebSessionStore), the items are
+    fetched in a window that covers the visible rows and a prefetch margin on each side, and moves inside that window
+    do not query the model. Otherwise the page is rebuilt on each event, so only the visible rows are fetched.
+    Items are read with IJSONModelProvider::modelColumns(), and a provider that implements IJSONModelProvider::modelVersion()
+    lets the list view skip unchanged pages. \br\br
+    In virtualized mode, a slider next to the paging buttons moves the list view to any item, and the mouse wheel
+    over the list view moves it by a few rows, at most once every 100 ms. Pages can also move it with their own javascript : the \c scroll event shows the items starting at its parameter,
+    and the \c scrollby event moves by the number of rows given as parameter, for instance
+    \c {emitWebEvent(listViewCodeName, "scroll", 5000)}.
     \sa CWebFactory
 */
 
@@ -45,6 +67,12 @@ CWebControl* CWebListView::instantiator()
 CWebListView::CWebListView()
     : m_iItemsPerPage(10)
     , m_iCurrentPage(0)
+    , m_bVirtualized(false)
+    , m_iPrefetchMargin(50)
+    , m_iFirstItem(0)
+    , m_iShownFirstItem(0)
+    , m_iShownVersion(0)
+    , m_iWindowItemCount(0)
 {
 }
 
@@ -60,8 +88,14 @@ CWebListView::CWebListView(const QString& sName, const QString& sCaption, IJSONM
     : CWebModelControl(sName, sCaption, pModelProvider)
     , m_iItemsPerPage(10)
     , m_iCurrentPage(0)
+    , m_bVirtualized(false)
+    , m_iPrefetchMargin(50)
+    , m_iFirstItem(0)
+    , m_iShownFirstItem(0)
+    , m_iShownVersion(0)
+    , m_iWindowItemCount(0)
 {
-    CWebControl* pControlDiv = addControl(new CWebDiv("Controls", ""));
+    CWebControl* pControlDiv = addControl(new CWebDiv(CONTROLNAME_CONTROLS, ""));
 
     pControlDiv->addControl(new CWebButton(CONTROLNAME_FIRST_PAGE, "|<"))
             ->addObserver(this)
@@ -112,12 +146,117 @@ CWebListView::~CWebListView()
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Sets the virtualized mode to \a value. \br\br
+    When \c true, the content becomes a fixed pool of rows that is reused on each move,
+    and a slider is added to the paging controls to show and set the first visible item.
+*/
+CWebControl* CWebListView::setVirtualized(bool value)
+{
+    if (m_bVirtualized != value)
+    {
+        m_bVirtualized = value;
+        m_iFirstItem = m_iCurrentPage * m_iItemsPerPage;
+        m_tWindow = CModelColumns();
+
+        if (m_pModelProvider.get() != nullptr)
+        {
+            CWebControl* pContent = findControlByName(CONTROLNAME_CONTENT);
+            CWebControl* pControlDiv = findControlByName(CONTROLNAME_CONTROLS);
+            CWebControl* pPosition = findControlByName(CONTROLNAME_POSITION);
+
+            // Both modes build their content from scratch
+            if (pContent != nullptr)
+                deleteControl(pContent);
+
+            if (pControlDiv != nullptr)
+            {
+                if (m_bVirtualized && pPosition == nullptr)
+                {
+                    int iTotalCount = m_pModelProvider.get()->modelItemCount();
+
+                    pControlDiv->addControl(new CWebSlider(CONTROLNAME_POSITION, 0, qMax(iTotalCount - 1, 0), m_iFirstItem))
+                            ->addObserver(this);
+                }
+                else if (m_bVirtualized == false && pPosition != nullptr)
+                {
+                    pControlDiv->deleteControl(pPosition);
+                }
+            }
+
+            setModel();
+        }
+    }
+
+    return this;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a value the number of items fetched before and after the visible rows in virtualized mode.
+*/
+CWebControl* CWebListView::setPrefetchMargin(int value)
+{
+    m_iPrefetchMargin = qMax(value, 0);
+    return this;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if the list view is in virtualized mode.
+*/
+bool CWebListView::isVirtualized() const
+{
+    return m_bVirtualized;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of items fetched before and after the visible rows in virtualized mode. \br\br
+    The margin only applies when the page has a session token, since the window is lost when the page is rebuilt.
+*/
+int CWebListView::prefetchMargin() const
+{
+    return m_iPrefetchMargin;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Shows the items starting at \a iFirstItem. \br\br
+    Outside of virtualized mode, the list view shows the page that holds \a iFirstItem.
+*/
+void CWebListView::scrollTo(int iFirstItem)
+{
+    if (m_pModelProvider.get() != nullptr)
+    {
+        int iTotalCount = m_pModelProvider.get()->modelItemCount();
+
+        m_iFirstItem = qBound(0, iFirstItem, qMax(iTotalCount - 1, 0));
+        m_iCurrentPage = m_iFirstItem / m_iItemsPerPage;
+
+        updatePaging();
+        setModel();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Creates the control according to the model provided by the given IJSONModelProvider.
 */
 void CWebListView::setModel()
 {
-    CXMLNode xModel = m_pModelProvider.get()->modelItems(m_iCurrentPage * m_iItemsPerPage, m_iItemsPerPage);
+    if (m_bVirtualized)
+    {
+        updateRows();
+        return;
+    }
+
+    CModelColumns tModel = m_pModelProvider.get()->modelColumns(m_iCurrentPage * m_iItemsPerPage, m_iItemsPerPage);
 
     CWebControl* pContent = findControlByName(CONTROLNAME_CONTENT);
 
@@ -126,41 +265,74 @@ void CWebListView::setModel()
 
     CWebControl* pContentDiv = addControl(new CWebDiv(CONTROLNAME_CONTENT, ""));
 
-    CXMLNode xHeader = xModel.getNodeByTagName("header");
-    QVector<CXMLNode> xProperties = xHeader.getNodesByTagName("property");
+    {
+        CWebControl* pLineDiv = pContentDiv->addControl(new CWebDiv("", ""))->setStyleClass("listview-header-line");
 
-    QStringList lPropertyNames;
-    QStringList lPropertyTypes;
+        foreach (QString sProperty, tModel.names())
+        {
+            pLineDiv->addControl(new CWebLabel("", sProperty));
+        }
+    }
 
-    foreach (CXMLNode xProperty, xProperties)
+    for (int iItem = 0; iItem < tModel.count(); iItem++)
     {
-        QString sType = xProperty.attributes()["type"];
-        QString sText = xProperty.attributes()["name"];
+        CWebControl* pLineDiv = pContentDiv->addControl(new CWebDiv("", ""))->setStyleClass("listview-data-line");
 
-        lPropertyTypes << sType;
-        lPropertyNames << sText;
+        for (int index = 0; index < tModel.names().count(); index++)
+        {
+            QString sType = tModel.types()[index];
+            QString sText = tModel.value(iItem, index);
+
+            if (sType == "string")
+            {
+                pLineDiv->addControl(new CWebLabel("", sText));
+            }
+            else if (sType == "button")
+            {
+                pLineDiv->addControl(new CWebButton("", sText));
+            }
+        }
     }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Builds the content of the virtualized mode : a header line and one line per visible row. \br\br
+    The cells match the columns of the model header and are filled from the window.
+*/
+void CWebListView::createRows()
+{
+    CWebControl* pContent = findControlByName(CONTROLNAME_CONTENT);
+
+    if (pContent != nullptr)
+        deleteControl(pContent);
+
+    CWebControl* pContentDiv = addControl(new CWebDiv(CONTROLNAME_CONTENT, ""));
 
     {
         CWebControl* pLineDiv = pContentDiv->addControl(new CWebDiv("", ""))->setStyleClass("listview-header-line");
 
-        foreach (QString sProperty, lPropertyNames)
+        foreach (QString sProperty, m_lPropertyNames)
         {
             pLineDiv->addControl(new CWebLabel("", sProperty));
         }
     }
 
-    CXMLNode xData = xModel.getNodeByTagName("data");
-    QVector<CXMLNode> xItems = xData.getNodesByTagName("item");
-
-    foreach (CXMLNode xItem, xItems)
+    for (int iRow = 0; iRow < m_iItemsPerPage; iRow++)
     {
+        int iItem = m_iFirstItem + iRow - m_tWindow.startIndex();
+        bool bPresent = iItem >= 0 && iItem < m_tWindow.count();
+
         CWebControl* pLineDiv = pContentDiv->addControl(new CWebDiv("", ""))->setStyleClass("listview-data-line");
 
-        for (int index = 0; index < lPropertyNames.count(); index++)
+        if (bPresent == false)
+            pLineDiv->setVisible(false);
+
+        for (int index = 0; index < m_lPropertyTypes.count(); index++)
         {
-            QString sType = index < lPropertyTypes.count() ? lPropertyTypes[index] : "string";
-            QString sText = xItem.attributes()[lPropertyNames[index]];
+            QString sType = m_lPropertyTypes[index];
+            QString sText = bPresent ? m_tWindow.value(iItem, index) : "";
 
             if (sType == "string")
             {
@@ -176,6 +348,198 @@ void CWebListView::setModel()
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Shows the items starting at m_iFirstItem in the row pool. \br\br
+    Only the cells whose caption differs from the model are modified, and the lines past the end of the model are hidden.
+    The pool is rebuilt if it does not exist or if the columns of the model changed. \br
+    If the provider tracks changes (see IJSONModelProvider::modelVersion()) and neither the model nor the position
+    changed since the rows were filled, nothing is fetched.
+*/
+void CWebListView::updateRows()
+{
+    quint64 iVersion = m_pModelProvider.get()->modelVersion();
+
+    CWebControl* pContent = findControlByName(CONTROLNAME_CONTENT);
+
+    if (pContent != nullptr && iVersion != 0 && iVersion == m_iShownVersion && m_iFirstItem == m_iShownFirstItem)
+    {
+        return;
+    }
+
+    fetchWindow(m_iFirstItem, m_iItemsPerPage, iVersion);
+
+    if (pContent == nullptr || m_tWindow.names() != m_lPropertyNames || m_tWindow.types() != m_lPropertyTypes)
+    {
+        m_lPropertyNames = m_tWindow.names();
+        m_lPropertyTypes = m_tWindow.types();
+
+        createRows();
+    }
+    else
+    {
+        QVector<CWebControl*> vLines = pContent->getControls();
+
+        // The first line is the header
+        for (int iRow = 0; iRow < m_iItemsPerPage && iRow + 1 < vLines.count(); iRow++)
+        {
+            CWebControl* pLineDiv = vLines[iRow + 1];
+            int iItem = m_iFirstItem + iRow - m_tWindow.startIndex();
+            bool bPresent = iItem >= 0 && iItem < m_tWindow.count();
+
+            if (pLineDiv->isVisible() != bPresent)
+                pLineDiv->setVisible(bPresent);
+
+            if (bPresent)
+            {
+                QVector<CWebControl*> vCells = pLineDiv->getControls();
+                int iCell = 0;
+
+                for (int index = 0; index < m_lPropertyTypes.count() && iCell < vCells.count(); index++)
+                {
+                    if (m_lPropertyTypes[index] == "string" || m_lPropertyTypes[index] == "button")
+                    {
+                        QString sText = m_tWindow.value(iItem, index);
+
+                        if (vCells[iCell]->getCaption() != sText)
+                        {
+                            vCells[iCell]->setCaption(sText);
+                        }
+
+                        iCell++;
+                    }
+                }
+            }
+        }
+    }
+
+    m_iShownVersion = iVersion;
+    m_iShownFirstItem = m_iFirstItem;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Makes sure the window holds the \a iCount items starting at \a iFirstItem. \br\br
+    If it does not, or if the model changed, the window is fetched again. The prefetch margin is added on each side
+    only if the page is kept alive by the session store ; otherwise the window would not outlive the event.
+    \a iVersion is the change stamp of the model ; if it is 0, a change of the item count is taken as a change of the model.
+*/
+void CWebListView::fetchWindow(int iFirstItem, int iCount, quint64 iVersion)
+{
+    int iTotalCount = m_pModelProvider.get()->modelItemCount();
+    int iLastItem = qMin(iFirstItem + iCount, iTotalCount);
+    bool bChanged = iVersion != 0 ? iVersion != m_tWindow.version() : iTotalCount != m_iWindowItemCount;
+
+    if (m_tWindow.count() > 0
+            && bChanged == false
+            && iFirstItem >= m_tWindow.startIndex()
+            && iLastItem <= m_tWindow.startIndex() + m_tWindow.count())
+    {
+        return;
+    }
+
+    CWebPage* pPage = dynamic_cast<CWebPage*>(getRoot());
+    int iMargin = pPage != nullptr && pPage->sessionToken().isEmpty() == false ? m_iPrefetchMargin : 0;
+
+    int iStart = qMax(iFirstItem - iMargin, 0);
+    int iFetchCount = (iFirstItem - iStart) + iCount + iMargin;
+
+    m_tWindow = m_pModelProvider.get()->modelColumns(iStart, iFetchCount);
+    m_iWindowItemCount = iTotalCount;
+
+    if (m_tWindow.version() == 0)
+        m_tWindow.setVersion(iVersion);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Updates the boxes that show the current page index and the page count.
+*/
+void CWebListView::updatePaging()
+{
+    int iTotalCount = m_pModelProvider.get()->modelItemCount();
+    int iTotalPages = iTotalCount % m_iItemsPerPage == 0 ? iTotalCount / m_iItemsPerPage : (iTotalCount / m_iItemsPerPage) + 1;
+
+    QString sCurrentPage = QString::number(m_iCurrentPage + 1);
+    QString sTotalPages = QString::number(iTotalPages);
+
+    CWebControl* pCurrentPageLabel = findControlByName(CONTROLNAME_CURRENT_PAGE_INDEX);
+    CWebControl* pTotalPageLabel = findControlByName(CONTROLNAME_TOTAL_PAGE_COUNT);
+
+    if (pCurrentPageLabel != nullptr && pCurrentPageLabel->getCaption() != sCurrentPage)
+        pCurrentPageLabel->setCaption(sCurrentPage);
+
+    if (pTotalPageLabel != nullptr && pTotalPageLabel->getCaption() != sTotalPages)
+        pTotalPageLabel->setCaption(sTotalPages);
+
+    CWebSlider* pPosition = dynamic_cast<CWebSlider*>(findControlByName(CONTROLNAME_POSITION));
+
+    if (pPosition != nullptr)
+    {
+        QString sFirstItem = QString::number(m_iFirstItem);
+
+        pPosition->setRange(0, qMax(iTotalCount - 1, 0));
+
+        if (pPosition->getCaption() != sFirstItem)
+            pPosition->setCaption(sFirstItem);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the attributes added to the <div> of this list view. \br\br
+    In virtualized mode, the mouse wheel over the list view sends \c EVENT_SCROLL_BY events to the server.
+    \a sHead is unused.
+*/
+QString CWebListView::getHTMLAttributes(QString& sHead) const
+{
+    Q_UNUSED(sHead);
+
+    if (m_bVirtualized == false)
+    {
+        return QString();
+    }
+
+    // Wheel events come in bursts, only send one every WHEEL_INTERVAL_MS
+    return QString(
+                " onwheel='"
+                "var now = Date.now();"
+                " if (!this.lastWheel || now - this.lastWheel &gt; %4)"
+                " { this.lastWheel = now; emitWebEvent(&quot;%1&quot;, &quot;%2&quot;, event.deltaY &gt; 0 ? %3 : -%3); }"
+                " event.preventDefault(); return false;'"
+                )
+            .arg(getCodeName())
+            .arg(EVENT_SCROLL_BY)
+            .arg(WHEEL_ROWS)
+            .arg(WHEEL_INTERVAL_MS);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Handles events for this list view. \br\br
+    \a sControl is unused. \br
+    If \a sEvent is \c EVENT_SCROLL, the list view shows the items starting at the index given in \a sParam. \br
+    If \a sEvent is \c EVENT_SCROLL_BY, the list view moves by the number of rows given in \a sParam.
+*/
+void CWebListView::handleEvent(QString sControl, QString sEvent, QString sParam)
+{
+    CWebModelControl::handleEvent(sControl, sEvent, sParam);
+
+    if (sEvent == EVENT_SCROLL)
+    {
+        scrollTo(sParam.toInt());
+    }
+    else if (sEvent == EVENT_SCROLL_BY)
+    {
+        scrollTo(m_iFirstItem + sParam.toInt());
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Handles events from child controls. \br\br
     \a pControl is the control which triggered the event. \br
@@ -189,6 +553,13 @@ void CWebListView::controlEvent(CWebControl* pControl, QString sEvent, QString s
         int iTotalCount = m_pModelProvider.get()->modelItemCount();
         int iTotalPages = iTotalCount % m_iItemsPerPage == 0 ? iTotalCount / m_iItemsPerPage : (iTotalCount / m_iItemsPerPage) + 1;
 
+        // The slider works like the scroll event
+        if (pControl->getName() == CONTROLNAME_POSITION)
+        {
+            scrollTo(sParam.toInt());
+            return;
+        }
+
         if (pControl->getName() == CONTROLNAME_FIRST_PAGE)
         {
             m_iCurrentPage = 0;
@@ -212,37 +583,45 @@ void CWebListView::controlEvent(CWebControl* pControl, QString sEvent, QString s
             m_iCurrentPage = iTotalPages - 1;
         }
 
-        CWebTextBox* pCurrentPageLabel = dynamic_cast<CWebTextBox*>(findControlByName(CONTROLNAME_CURRENT_PAGE_INDEX));
-        CWebTextBox* pTotalPageLabel = dynamic_cast<CWebTextBox*>(findControlByName(CONTROLNAME_TOTAL_PAGE_COUNT));
-
-        if (pCurrentPageLabel != nullptr)
-            pCurrentPageLabel->setCaption(QString::number(m_iCurrentPage + 1));
-
-        if (pTotalPageLabel != nullptr)
-            pTotalPageLabel->setCaption(QString::number(iTotalPages));
+        m_iFirstItem = qMax(m_iCurrentPage, 0) * m_iItemsPerPage;
 
+        updatePaging();
         setModel();
     }
 }
 
 //-------------------------------------------------------------------------------------------------
 
-void CWebListView::serialize(QDataStream& stream, CObjectTracker* pTracker) const
+void CWebListView::serializeProperties(QDataStream& stream, CObjectTracker* pTracker) const
 {
-    CWebModelControl::serialize(stream, pTracker);
+    CWebModelControl::serializeProperties(stream, pTracker);
 
     stream << m_sUpdateFunction;
     stream << m_iItemsPerPage;
     stream << m_iCurrentPage;
+    stream << m_bVirtualized;
+    stream << m_iPrefetchMargin;
+    stream << m_iFirstItem;
+    stream << m_lPropertyNames;
+    stream << m_lPropertyTypes;
+    stream << m_iShownFirstItem;
+    stream << m_iShownVersion;
 }
 
 //-------------------------------------------------------------------------------------------------
 
-void CWebListView::deserialize(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootControl)
+void CWebListView::deserializeProperties(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootControl)
 {
-    CWebModelControl::deserialize(stream, pTracker, pRootControl);
+    CWebModelControl::deserializeProperties(stream, pTracker, pRootControl);
 
     stream >> m_sUpdateFunction;
     stream >> m_iItemsPerPage;
     stream >> m_iCurrentPage;
+    stream >> m_bVirtualized;
+    stream >> m_iPrefetchMargin;
+    stream >> m_iFirstItem;
+    stream >> m_lPropertyNames;
+    stream >> m_lPropertyTypes;
+    stream >> m_iShownFirstItem;
+    stream >> m_iShownVersion;
 }
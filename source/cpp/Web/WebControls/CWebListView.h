@@ -3,6 +3,9 @@
 
 //-------------------------------------------------------------------------------------------------
 
+// Qt
+#include <QStringList>
+
 // Application
 #include "CWebModelControl.h"
 
@@ -34,10 +37,29 @@ public:
     // Setters
     //-------------------------------------------------------------------------------------------------
 
+    //! Reuses a fixed pool of row controls instead of rebuilding the content on each move
+    CWebControl* setVirtualized(bool value);
+
+    //! Sets the number of items fetched before and after the visible rows in virtualized mode, when the page has a session
+    CWebControl* setPrefetchMargin(int value);
+
     //-------------------------------------------------------------------------------------------------
     // Getters
     //-------------------------------------------------------------------------------------------------
 
+    //!
+    bool isVirtualized() const;
+
+    //!
+    int prefetchMargin() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Shows the items starting at iFirstItem
+    void scrollTo(int iFirstItem);
+
     //-------------------------------------------------------------------------------------------------
     // Protected control methods
     //-------------------------------------------------------------------------------------------------
@@ -46,18 +68,36 @@ protected:
 
     void setModel();
 
+    //! Builds the content, one line per visible row, with cells matching the model header
+    void createRows();
+
+    //! Updates the captions of the row pool that differ from the model
+    void updateRows();
+
+    //! Makes sure the window holds the visible rows, fetching them with the prefetch margin if needed
+    void fetchWindow(int iFirstItem, int iCount, quint64 iVersion);
+
+    //! Updates the page index and count boxes
+    void updatePaging();
+
     //-------------------------------------------------------------------------------------------------
     // Inherited methods
     //-------------------------------------------------------------------------------------------------
 
+    //!
+    virtual QString getHTMLAttributes(QString& sHead) const Q_DECL_OVERRIDE;
+
+    //!
+    virtual void handleEvent(QString sControl, QString sEvent, QString sParam) Q_DECL_OVERRIDE;
+
     //!
     virtual void controlEvent(CWebControl* pControl, QString sEvent, QString sParam) Q_DECL_OVERRIDE;
 
     //!
-    virtual void serialize(QDataStream& stream, CObjectTracker* pTracker) const Q_DECL_OVERRIDE;
+    virtual void serializeProperties(QDataStream& stream, CObjectTracker* pTracker) const Q_DECL_OVERRIDE;
 
     //!
-    virtual void deserialize(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootControl) Q_DECL_OVERRIDE;
+    virtual void deserializeProperties(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootControl) Q_DECL_OVERRIDE;
 
     //-------------------------------------------------------------------------------------------------
     // Proprits
@@ -68,4 +108,15 @@ protected:
     QString     m_sUpdateFunction;
     qint32      m_iItemsPerPage;
     qint32      m_iCurrentPage;
+    bool        m_bVirtualized;
+    qint32      m_iPrefetchMargin;
+    qint32      m_iFirstItem;           // First visible item in virtualized mode
+    QStringList m_lPropertyNames;       // Columns of the row pool
+    QStringList m_lPropertyTypes;
+    qint32      m_iShownFirstItem;      // First item shown by the row pool
+    quint64     m_iShownVersion;        // Change stamp of the model shown by the row pool
+
+    // Window of fetched items, not serialized : it lives as long as the page
+    CModelColumns   m_tWindow;
+    qint32          m_iWindowItemCount;     // Item count of the model when the window was fetched
 };
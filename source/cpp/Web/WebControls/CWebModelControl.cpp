@@ -69,18 +69,18 @@ void CWebModelControl::handleEvent(QString sControl, QString sEvent, QString sPa
 
 //-------------------------------------------------------------------------------------------------
 
-void CWebModelControl::serialize(QDataStream& stream, CObjectTracker* pTracker) const
+void CWebModelControl::serializeProperties(QDataStream& stream, CObjectTracker* pTracker) const
 {
-    CWebControl::serialize(stream, pTracker);
+    CWebControl::serializeProperties(stream, pTracker);
 
     m_pModelProvider.serialize(stream, pTracker);
 }
 
 //-------------------------------------------------------------------------------------------------
 
-void CWebModelControl::deserialize(QDataStream& stream, CObjectTracker *pTracker, QObject* pRootControl)
+void CWebModelControl::deserializeProperties(QDataStream& stream, CObjectTracker *pTracker, QObject* pRootControl)
 {
-    CWebControl::deserialize(stream, pTracker, pRootControl);
+    CWebControl::deserializeProperties(stream, pTracker, pRootControl);
 
     m_pModelProvider.deserialize(stream, pTracker, pRootControl);
 }
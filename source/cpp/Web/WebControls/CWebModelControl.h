@@ -47,10 +47,10 @@ public:
     virtual void handleEvent(QString sControl, QString sEvent, QString sParam) Q_DECL_OVERRIDE;
 
     //!
-    virtual void serialize(QDataStream& stream, CObjectTracker* pTracker) const Q_DECL_OVERRIDE;
+    virtual void serializeProperties(QDataStream& stream, CObjectTracker* pTracker) const Q_DECL_OVERRIDE;
 
     //!
-    virtual void deserialize(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootControl) Q_DECL_OVERRIDE;
+    virtual void deserializeProperties(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootControl) Q_DECL_OVERRIDE;
 
     //-------------------------------------------------------------------------------------------------
     // Properties
@@ -6,6 +6,7 @@
 #include "../CDynamicHTTPServer.h"
 #include "CWebFactory.h"
 #include "CWebPage.h"
+#include "CWebViewState.h"
 
 //-------------------------------------------------------------------------------------------------
 
@@ -25,7 +26,7 @@
     \li The CDynamicHTTPServer calls the page's getContent() method.
     \list
     \li The page orders all its child controls to render as HTML.
-    \li It then serializes itself and places the result in the 'viewstate' property of the DOM document, via Javascript.
+    \li It then takes a snapshot of itself (see CWebViewState), keeps it in the server's cache, and gives it to the client via Javascript.
     \endlist
     \li The CDynamicHTTPServer gives back control to the CHTTPServer.
     \li The CHTTPServer sends the generated content to the client.
@@ -34,12 +35,17 @@
     \list
     \li The client emits an event via a XMLHTTPRequest object, in the form "action='event'&control='CTRL_nnn'&event='clicked'".
     \li The CHTTPServer calls its getContent() method.
-    \li The CDynamicHTTPServer decides to process the request as an event because of the 'action' argument. Instead of creating a new page, it uses the 'viewstate' argument and deserializes the original page.
+    \li The CDynamicHTTPServer decides to process the request as an event because of the 'action' argument. Instead of creating a new page, it finds the snapshot named by the 'viewstate' argument and deserializes the original page.
     \li The CDynamicHTTPServer calls the handleEvent() method of the concerned control.
     \li Javascript code is generated in order to apply any control state change in client's browser.
-    \li The CDynamicHTTPServer serializes the page and calls its getPropertyChanges() method. This returns javascript that will be executed client-side.
+    \li The CDynamicHTTPServer takes a new snapshot of the page, adds the delta from the previous one to the page's changes and calls its getPropertyChanges() method. This returns javascript that will be executed client-side.
     \li The result is sent back to the CHTTPServer, and to the client brower.
     \endlist
+    \section1 Session store
+    When the CDynamicHTTPServer uses a session store (see CDynamicHTTPServer::useSessionStore()), the page is not serialized.
+    It is kept alive on the server after being rendered, and the client receives its session token in the 'session' property
+    of the DOM document. Events carry that token : the CDynamicHTTPServer finds the live page, calls handleEvent() on it and
+    sends back the changes, and the page waits for the next event.
     \section1 What you should do when subclassing CWebPage
     The page can be filled with controls in its constructor, like in the following example.
     \code
@@ -61,18 +67,18 @@
         }
     }
     \endcode
-    If the page contains special objects that should be saved with it, you have to override the serialization methods, like so:
+    If the page contains special objects that should be saved with it, you have to override the property serialization methods, like so:
     \code
-    void CHomePage::serialize(QDataStream& stream, CObjectTracker* pTracker) const
+    void CHomePage::serializeProperties(QDataStream& stream, CObjectTracker* pTracker) const
     {
-        CWebPage::serialize(stream, pTracker);
+        CWebPage::serializeProperties(stream, pTracker);
 
         stream << someData;
     }
 
-    void CHomePage::deserialize(QDataStream& stream, CObjectTracker *pTracker, QObject* pRootControl)
+    void CHomePage::deserializeProperties(QDataStream& stream, CObjectTracker *pTracker, QObject* pRootControl)
     {
-        CWebPage::deserialize(stream, pTracker, pRootControl);
+        CWebPage::deserializeProperties(stream, pTracker, pRootControl);
 
         stream >> someData;
     }
@@ -123,6 +129,17 @@ CWebPage::~CWebPage()
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Sets to \a sToken the token of the session that keeps this page on the server. \br\br
+    A page with a token is not serialized when rendered, the client receives the token instead.
+*/
+void CWebPage::setSessionToken(const QString& sToken)
+{
+    m_sSessionToken = sToken;
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Returns javascript that reflects all changes made to the page and its controls. \br\br
     It is used to update the page client-side.
@@ -135,7 +152,7 @@ QString CWebPage::getPropertyChanges()
 //-------------------------------------------------------------------------------------------------
 
 /*!
-    Returns \c true if the page was constructed by deserialization
+    Returns \c true if the page was constructed by deserialization, or if it was rendered and kept in a session store.
 */
 bool CWebPage::isDeserialized() const
 {
@@ -144,6 +161,16 @@ bool CWebPage::isDeserialized() const
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Returns the token of the session that keeps this page on the server, or an empty string if the page uses a viewstate.
+*/
+QString CWebPage::sessionToken() const
+{
+    return m_sSessionToken;
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     This method returns a HTML rendering of the page and its child controls. \br\br
     \a pServer is the server requesting the contents. \br
@@ -156,34 +183,55 @@ void CWebPage::getContent(CDynamicHTTPServer* pServer, const CWebContext& tConte
     Q_UNUSED(tContext);
     Q_UNUSED(xmlResponse);
 
-    sHead += QString("<meta charset=\"UTF-8\">"HTML_NL);
+    sHead.append("<meta charset=\"UTF-8\">"HTML_NL);
+
+    CWebComposer* pComposer = pServer->composer();
 
-    foreach (QString sFileName, pServer->composer()->getCSSFiles())
+    foreach (const QString& sFileName, pComposer->getCSSFiles())
     {
-        pServer->composer()->addCSSFileStatement(sHead, sFileName);
+        pComposer->addCSSFileStatement(sHead, sFileName);
     }
 
-    foreach (QString sFileName, pServer->composer()->getJSFiles())
+    foreach (const QString& sFileName, pComposer->getJSFiles())
     {
-        pServer->composer()->addJSFileStatement(sHead, sFileName);
+        pComposer->addJSFileStatement(sHead, sFileName);
     }
 
     addHTML(sHead, sBody);
 
-    sHead += QString(
+    sHead.append(
                 "<script type='text/javascript' language='javascript'>"HTML_NL
                 "window.onload = function()"HTML_NL
                 "{"HTML_NL
                 );
 
-    sHead += m_sPropertyChanges;
+    sHead.append(m_sPropertyChanges);
+
+    if (m_sSessionToken.isEmpty())
+    {
+        CWebViewState tState = CWebViewState::fromPage(this, pServer);
+
+        pServer->viewStates()->insert(tState);
 
-    sHead += "document.viewstate='" + getViewState(pServer) + "';"HTML_NL;
+        sHead.append(tState.script(CWebViewState())).append(HTML_NL);
+    }
+    else
+    {
+        sHead.append("document.session='").append(m_sSessionToken).append("';"HTML_NL);
+    }
 
-    sHead += QString(
+    sHead.append(
                 "};"HTML_NL
                 "</script>"HTML_NL
                 );
+
+    // A page kept alive now only reports the changes made by events, like a deserialized page
+    if (m_sSessionToken.isEmpty() == false)
+    {
+        m_bDeserialized = true;
+
+        resetPropertyChanges();
+    }
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -290,12 +338,23 @@ void CWebPage::setViewstate(const QString& sViewState)
 
 //-------------------------------------------------------------------------------------------------
 
+/*!
+    Clears the javascript of the changes, once it has been sent to the client.
+*/
+void CWebPage::resetPropertyChanges()
+{
+    m_sPropertyChanges = QString("var newElement;"HTML_NL);
+}
+
+//-------------------------------------------------------------------------------------------------
+
 /*!
     Appends the HTML text that represents this control to \a sHead and \a sBody.
 */
 void CWebPage::addHTML(QString& sHead, QString& sBody)
 {
-    sHead += QString(
+    // The script is the same for all pages, it is built once
+    static const QString s_sScript = QString(
                 "<script type='text/javascript' language='javascript'>%1"
                 "function htmlToElement(html)%1"
                 "{%1"
@@ -345,7 +404,8 @@ void CWebPage::addHTML(QString& sHead, QString& sBody)
                 "    }%1"
                 "  }%1"
                 "  xmlHttp.open('%9', getUploadURL(control));%1"
-                "  formData.append('%6', document.%6);%1"
+                "  formData.append(document.%10 ? '%10' : '%6', document.%10 ? document.%10 : document.%6);%1"
+                "  if (!document.%10) formData.append('%11', getFullViewState());%1"
                 "  formData.append(control, actualControl.files[0]);%1"
                 "  xmlHttp.send(formData);%1"
                 "  actualControl.value = '';%1"
@@ -358,9 +418,65 @@ void CWebPage::addHTML(QString& sHead, QString& sBody)
                 "{%1"
                 "  return '?%2=%7' + '&%4=' + control;%1"
                 "}%1"
+                "function getWebState()%1"
+                "{%1"
+                "  if (document.%10) return '%10=' + document.%10;%1"
+                "  return '%6=' + document.%6;%1"
+                "}%1"
                 "function emitWebEvent(control, event, param)%1"
                 "{%1"
-                "  httpWebEventPOST(getWebEventURL(control, event, param), '%6=' + document.%6);%1"
+                "  document.lastWebEventURL = getWebEventURL(control, event, param);%1"
+                "  httpWebEventPOST(document.lastWebEventURL, getWebState());%1"
+                "}%1"
+                "function resendWebEvent()%1"
+                "{%1"
+                "  httpWebEventPOST(document.lastWebEventURL, getWebState() + '&%11=' + getFullViewState());%1"
+                "}%1"
+                // Keeps the records of the view state, see CWebViewState for the format
+                "function readViewState32(data, index)%1"
+                "{%1"
+                "  return ((data.charCodeAt(index) << 24) | (data.charCodeAt(index + 1) << 16) | (data.charCodeAt(index + 2) << 8) | data.charCodeAt(index + 3)) >>> 0;%1"
+                "}%1"
+                "function writeViewState32(value)%1"
+                "{%1"
+                "  return String.fromCharCode((value >>> 24) & 255, (value >>> 16) & 255, (value >>> 8) & 255, value & 255);%1"
+                "}%1"
+                "function applyViewState(version, delta)%1"
+                "{%1"
+                "  var data = atob(delta);%1"
+                "  var flags = data.charCodeAt(1);%1"
+                "  var index = 2;%1"
+                "  var count = 0;%1"
+                "  if ((flags & %13) || !document.viewRecords) document.viewRecords = {};%1"
+                "  if (flags & %12)%1"
+                "  {%1"
+                "    count = readViewState32(data, index);%1"
+                "    index += 4;%1"
+                "    document.viewLayout = [];%1"
+                "    for (var i = 0; i < count; i++, index += 4) document.viewLayout.push(readViewState32(data, index));%1"
+                "  }%1"
+                "  count = readViewState32(data, index);%1"
+                "  index += 4;%1"
+                "  for (var i = 0; i < count; i++)%1"
+                "  {%1"
+                "    var size = readViewState32(data, index + 4);%1"
+                "    document.viewRecords[readViewState32(data, index)] = data.substr(index + 8, size);%1"
+                "    index += 8 + size;%1"
+                "  }%1"
+                "  document.%6 = version;%1"
+                "}%1"
+                "function getFullViewState()%1"
+                "{%1"
+                "  var layout = document.viewLayout;%1"
+                "  var data = String.fromCharCode(%14, %12 | %13) + writeViewState32(layout.length);%1"
+                "  for (var i = 0; i < layout.length; i++) data += writeViewState32(layout[i]);%1"
+                "  data += writeViewState32(layout.length);%1"
+                "  for (var i = 0; i < layout.length; i++)%1"
+                "  {%1"
+                "    var record = document.viewRecords[layout[i]];%1"
+                "    data += writeViewState32(layout[i]) + writeViewState32(record.length) + record;%1"
+                "  }%1"
+                "  return btoa(data);%1"
                 "}%1"
                 "function processRequestReturnValue(value)%1"
                 "{%1"
@@ -381,7 +497,14 @@ void CWebPage::addHTML(QString& sHead, QString& sBody)
             .arg(TOKEN_VIEWSTATE)
             .arg(TOKEN_UPLOAD)
             .arg(HTTP_GET)
-            .arg(HTTP_POST);
+            .arg(HTTP_POST)
+            .arg(TOKEN_SESSION)
+            .arg(TOKEN_VIEWSTATE_DATA)
+            .arg(VIEWSTATE_FLAG_LAYOUT)
+            .arg(VIEWSTATE_FLAG_FULL)
+            .arg(VIEWSTATE_FORMAT);
+
+    sHead.append(s_sScript);
 
     // Debug out
     // sBody.append(QString("<div width='100%' style='div1'><textarea id='DebugOut'></textarea></div>"HTML_NL));
@@ -23,6 +23,8 @@ class QTPLUSSHARED_EXPORT CWebPage : public CWebControl
 {
     Q_OBJECT
 
+    friend class CWebViewState;
+
 public:
 
     //-------------------------------------------------------------------------------------------------
@@ -41,6 +43,13 @@ public:
     //! Destructor
     virtual ~CWebPage();
 
+    //-------------------------------------------------------------------------------------------------
+    // Setters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Sets the token of the session that keeps this page on the server
+    void setSessionToken(const QString& sToken);
+
     //-------------------------------------------------------------------------------------------------
     // Getters
     //-------------------------------------------------------------------------------------------------
@@ -51,6 +60,9 @@ public:
     //!
     bool isDeserialized() const;
 
+    //! Returns the token of the session that keeps this page on the server, empty if none
+    QString sessionToken() const;
+
     //-------------------------------------------------------------------------------------------------
     // Control methods
     //-------------------------------------------------------------------------------------------------
@@ -76,6 +88,9 @@ public:
     //!
     void setViewstate(const QString& sViewState);
 
+    //! Clears the javascript of the changes already sent to the client
+    void resetPropertyChanges();
+
     //-------------------------------------------------------------------------------------------------
     // Inherited methods
     //-------------------------------------------------------------------------------------------------
@@ -111,5 +126,6 @@ protected:
 protected:
 
     QString     m_sPropertyChanges;
+    QString     m_sSessionToken;
     bool        m_bDeserialized;
 };
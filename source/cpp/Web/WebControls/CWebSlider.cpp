@@ -0,0 +1,160 @@
+
+// Application
+#include "CWebSlider.h"
+
+#define EVENT_CHANGED	"changed"
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CWebSlider
+    \inmodule qt-plus
+    \brief A slider for a web page, rendered as a range input. Its caption holds the value.
+    \sa CWebFactory
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Instantiates a new CWebSlider.
+*/
+CWebControl* CWebSlider::instantiator()
+{
+    return new CWebSlider();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CWebSlider with default parameters.
+*/
+CWebSlider::CWebSlider()
+    : m_iMinimum(0)
+    , m_iMaximum(100)
+{
+    setStyleClass("slider1");
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CWebSlider with basic parameters. \br\br
+    \a sName specifies the name of the control. \br
+    \a iMinimum and \a iMaximum specify the range of values. \br
+    \a iValue specifies the initial value.
+*/
+CWebSlider::CWebSlider(const QString& sName, int iMinimum, int iMaximum, int iValue)
+    : CWebControl(sName, QString::number(iValue))
+    , m_iMinimum(iMinimum)
+    , m_iMaximum(iMaximum)
+{
+    setStyleClass("slider1");
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Destroys a CWebSlider.
+*/
+CWebSlider::~CWebSlider()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets the range of values to \a iMinimum and \a iMaximum.
+*/
+CWebControl* CWebSlider::setRange(int iMinimum, int iMaximum)
+{
+    if (m_iMinimum != iMinimum)
+    {
+        m_iMinimum = iMinimum;
+        propertyModified("min", QString::number(iMinimum));
+    }
+
+    if (m_iMaximum != iMaximum)
+    {
+        m_iMaximum = iMaximum;
+        propertyModified("max", QString::number(iMaximum));
+    }
+
+    return this;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the minimum value.
+*/
+int CWebSlider::minimum() const
+{
+    return m_iMinimum;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the maximum value.
+*/
+int CWebSlider::maximum() const
+{
+    return m_iMaximum;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Appends the HTML text that represents this slider to \a sHead and \a sBody. \br\br
+    The value is sent when the user releases the slider.
+*/
+void CWebSlider::addHTML(QString& sHead, QString& sBody)
+{
+    QString sFunction = addHTMLEventWithControlValue(sHead, EVENT_CHANGED);
+
+    sBody.append("<input type='range' id='").append(getCodeName())
+         .append("' class='").append(m_sStyleClass)
+         .append("' style.visibility='").append(m_bVisible ? "visible" : "hidden")
+         .append("' min='").append(QString::number(m_iMinimum))
+         .append("' max='").append(QString::number(m_iMaximum))
+         .append("' value='").append(m_sCaption)
+         .append("' onChange='").append(sFunction)
+         .append("'/>"HTML_NL);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Handles any event for this slider. \br\br
+    \a sControl is unused. \br
+    If \a sEvent is \c EVENT_CHANGED, the caption is set to \a sParam.
+*/
+void CWebSlider::handleEvent(QString sControl, QString sEvent, QString sParam)
+{
+    Q_UNUSED(sControl);
+
+    if (sEvent == EVENT_CHANGED)
+    {
+        m_sCaption = sParam;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void CWebSlider::serializeProperties(QDataStream& stream, CObjectTracker* pTracker) const
+{
+    CWebControl::serializeProperties(stream, pTracker);
+
+    stream << m_iMinimum;
+    stream << m_iMaximum;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void CWebSlider::deserializeProperties(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootControl)
+{
+    CWebControl::deserializeProperties(stream, pTracker, pRootControl);
+
+    stream >> m_iMinimum;
+    stream >> m_iMaximum;
+}
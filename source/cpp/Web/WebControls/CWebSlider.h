@@ -0,0 +1,69 @@
+#pragma once
+
+// Application
+#include "CWebControl.h"
+
+class QTPLUSSHARED_EXPORT CWebSlider : public CWebControl
+{
+    Q_OBJECT
+
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Factory instanciator
+    static CWebControl* instantiator();
+
+    //! Default constructor
+    CWebSlider();
+
+    //! Constructor with parameters, the caption holds the value
+    CWebSlider(const QString& sName, int iMinimum, int iMaximum, int iValue);
+
+    //! Destructor
+    virtual ~CWebSlider();
+
+    //-------------------------------------------------------------------------------------------------
+    // Setters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Sets the range of values
+    CWebControl* setRange(int iMinimum, int iMaximum);
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //!
+    int minimum() const;
+
+    //!
+    int maximum() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Inherited methods
+    //-------------------------------------------------------------------------------------------------
+
+    //!
+    virtual void addHTML(QString& sHead, QString& sBody) Q_DECL_OVERRIDE;
+
+    //!
+    virtual void handleEvent(QString sControl, QString sEvent, QString sParam) Q_DECL_OVERRIDE;
+
+    //!
+    virtual void serializeProperties(QDataStream& stream, CObjectTracker* pTracker) const Q_DECL_OVERRIDE;
+
+    //!
+    virtual void deserializeProperties(QDataStream& stream, CObjectTracker* pTracker, QObject* pRootControl) Q_DECL_OVERRIDE;
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    qint32      m_iMinimum;
+    qint32      m_iMaximum;
+};
@@ -64,13 +64,11 @@ void CWebTextBox::addHTML(QString& sHead, QString& sBody)
 {
     QString sFunction = addHTMLEventWithControlValue(sHead, EVENT_CHANGED);
 
-    sBody.append(QString("<input type='text' id='%1' class='%2' value='%3' onChange='%4' %5/>"HTML_NL)
-                 .arg(getCodeName())
-                 .arg(m_sStyleClass)
-                 .arg(m_sCaption)
-                 .arg(sFunction)
-                 .arg(m_bReadOnly ? "readonly" : "")
-                 );
+    sBody.append("<input type='text' id='").append(getCodeName())
+         .append("' class='").append(m_sStyleClass)
+         .append("' value='").append(m_sCaption)
+         .append("' onChange='").append(sFunction)
+         .append(m_bReadOnly ? "' readonly/>"HTML_NL : "' />"HTML_NL);
 }
 
 //-------------------------------------------------------------------------------------------------
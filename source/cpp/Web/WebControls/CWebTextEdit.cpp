@@ -64,11 +64,10 @@ void CWebTextEdit::addHTML(QString& sHead, QString& sBody)
 {
     QString sFunction = addHTMLEventWithControlValue(sHead, EVENT_CHANGED);
 
-    sBody.append(QString("<textarea id='%1' class='%2' onChange='%3'>"HTML_NL)
-                 .arg(getCodeName())
-                 .arg(m_sStyleClass)
-                 .arg(sFunction)
-                 );
+    sBody.append("<textarea id='").append(getCodeName())
+         .append("' class='").append(m_sStyleClass)
+         .append("' onChange='").append(sFunction)
+         .append("'>"HTML_NL);
 
     sBody.append(m_sCaption.toLatin1());
     sBody.append("</textarea>");
@@ -0,0 +1,463 @@
+
+// Qt
+#include <QDataStream>
+#include <QSet>
+#include <QUuid>
+#include <QDebug>
+
+// Application
+#include "CWebViewState.h"
+#include "CWebFactory.h"
+#include "CWebPage.h"
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CWebViewState
+    \inmodule qt-plus
+    \brief A versioned snapshot of a web page, made of one binary record per control.
+
+    A record holds the type code of the control's class (see CWebFactory::typeCode()), the ID of its parent
+    and the properties written by CWebControl::serializeProperties(). The layout lists the control IDs in tree order.
+    Since controls keep their IDs between requests, two snapshots of a page can be compared record by record : a delta
+    holds the layout only if controls were added or removed, and the records that changed.
+
+    The encoded form of a delta, in network byte order, is :
+    \list
+    \li quint8 : the format, \c VIEWSTATE_FORMAT
+    \li quint8 : flags, \c VIEWSTATE_FLAG_LAYOUT and \c VIEWSTATE_FLAG_FULL
+    \li If the layout is present : quint32 count, then count qint32 control IDs
+    \li quint32 count, then for each record : qint32 control ID, quint32 size, the record
+    \endlist
+
+    The client keeps the records it received and applies each delta with the javascript of CWebPage.
+    It sends back the version of its snapshot, and the server finds the snapshot in its CWebViewStateCache.
+    If the snapshot is no longer cached, the client sends its whole state, encoded as a full delta.
+    \sa CWebPage
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs an empty CWebViewState.
+*/
+CWebViewState::CWebViewState()
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the version of this snapshot.
+*/
+QString CWebViewState::version() const
+{
+    return m_sVersion;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns \c true if the snapshot holds no control.
+*/
+bool CWebViewState::isEmpty() const
+{
+    return m_vLayout.isEmpty();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the number of controls in the snapshot.
+*/
+int CWebViewState::count() const
+{
+    return m_vLayout.count();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the size of the records, in bytes.
+*/
+int CWebViewState::size() const
+{
+    int iSize = m_vLayout.count() * (int) sizeof(qint32);
+
+    foreach (const QByteArray& baRecord, m_mRecords)
+    {
+        iSize += baRecord.size();
+    }
+
+    return iSize;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns a new page built from the records, or \c nullptr if a record is missing or invalid. \br\br
+    \a pTracker is an object that is used to deserialize pointers, it keeps track of valid pointers.
+*/
+CWebPage* CWebViewState::toPage(CObjectTracker* pTracker) const
+{
+    CWebFactory* pFactory = CWebFactory::getInstance();
+    QMap<qint32, CWebControl*> mControls;
+    CWebControl* pRoot = nullptr;
+
+    foreach (qint32 iID, m_vLayout)
+    {
+        QByteArray baRecord = m_mRecords.value(iID);
+        QDataStream stream(baRecord);
+        quint16 iTypeCode = 0;
+        qint32 iParentID = 0;
+
+        stream >> iTypeCode;
+        stream >> iParentID;
+
+        CWebControl* pControl = pFactory->instanciateProduct(pFactory->className(iTypeCode));
+        CWebControl* pParent = mControls.value(iParentID, nullptr);
+
+        if (pControl == nullptr || (pRoot != nullptr && pParent == nullptr))
+        {
+            qWarning() << QString("CWebViewState::toPage() : invalid record for control %1").arg(iID);
+
+            delete pControl;
+            delete pRoot;
+            return nullptr;
+        }
+
+        if (pRoot == nullptr)
+        {
+            pRoot = pControl;
+        }
+
+        pControl->deserializeProperties(stream, pTracker, pRoot);
+
+        if (pParent != nullptr)
+        {
+            pParent->addControl(pControl);
+        }
+
+        mControls[pControl->getID()] = pControl;
+    }
+
+    if (pRoot == nullptr)
+    {
+        return nullptr;
+    }
+
+    pRoot->resolveObservers();
+
+    CWebPage* pPage = dynamic_cast<CWebPage*>(pRoot);
+
+    if (pPage == nullptr)
+    {
+        delete pRoot;
+        return nullptr;
+    }
+
+    pPage->m_bDeserialized = true;
+
+    return pPage;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the binary delta that turns \a tBase into this snapshot. \br\br
+    If \a tBase is empty, all records are encoded and the delta is flagged as full.
+*/
+QByteArray CWebViewState::encodeDelta(const CWebViewState& tBase) const
+{
+    QByteArray baDelta;
+    QDataStream stream(&baDelta, QIODevice::WriteOnly);
+    bool bFull = tBase.isEmpty();
+    bool bLayout = bFull || tBase.m_vLayout != m_vLayout;
+    quint8 iFlags = 0;
+
+    if (bFull)
+        iFlags |= VIEWSTATE_FLAG_FULL;
+
+    if (bLayout)
+        iFlags |= VIEWSTATE_FLAG_LAYOUT;
+
+    stream << (quint8) VIEWSTATE_FORMAT;
+    stream << iFlags;
+
+    if (bLayout)
+    {
+        stream << (quint32) m_vLayout.count();
+
+        foreach (qint32 iID, m_vLayout)
+        {
+            stream << iID;
+        }
+    }
+
+    QVector<qint32> vChanged;
+
+    foreach (qint32 iID, m_vLayout)
+    {
+        const QByteArray baRecord = m_mRecords.value(iID);
+
+        if (bFull || tBase.m_mRecords.value(iID) != baRecord)
+        {
+            vChanged << iID;
+        }
+    }
+
+    stream << (quint32) vChanged.count();
+
+    foreach (qint32 iID, vChanged)
+    {
+        const QByteArray baRecord = m_mRecords.value(iID);
+
+        stream << iID;
+        stream.writeBytes(baRecord.constData(), (uint) baRecord.size());
+    }
+
+    return baDelta;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns the javascript that updates the snapshot held by the client from \a tBase to this one. \br\br
+    The client applies the delta with applyViewState(), defined by CWebPage::addHTML().
+*/
+QString CWebViewState::script(const CWebViewState& tBase) const
+{
+    return QString("applyViewState('%1', '%2');")
+            .arg(m_sVersion)
+            .arg(QString(encodeDelta(tBase).toBase64()));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns a snapshot of \a pPage with a new version. \br\br
+    \a pTracker is an object that is used to serialize pointers, it keeps track of valid pointers.
+*/
+CWebViewState CWebViewState::fromPage(const CWebPage* pPage, CObjectTracker* pTracker)
+{
+    CWebViewState tState;
+
+    tState.m_sVersion = generateVersion();
+
+    if (pPage != nullptr)
+    {
+        tState.addControl(pPage, 0, pTracker);
+    }
+
+    return tState;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Applies the binary delta \a baDelta to \a tBase and stores the result in \a tResult. \br\br
+    Returns \c false if the delta is malformed, if it needs a base and \a tBase is empty,
+    or if a control of the layout has no record. The version of \a tResult is left empty.
+*/
+bool CWebViewState::applyDelta(const CWebViewState& tBase, const QByteArray& baDelta, CWebViewState& tResult)
+{
+    QDataStream stream(baDelta);
+    quint8 iFormat = 0;
+    quint8 iFlags = 0;
+    quint32 iCount = 0;
+
+    stream >> iFormat;
+    stream >> iFlags;
+
+    if (stream.status() != QDataStream::Ok || iFormat != VIEWSTATE_FORMAT)
+    {
+        return false;
+    }
+
+    if ((iFlags & VIEWSTATE_FLAG_FULL) == 0 && tBase.isEmpty())
+    {
+        return false;
+    }
+
+    CWebViewState tState;
+
+    if ((iFlags & VIEWSTATE_FLAG_FULL) == 0)
+    {
+        tState.m_vLayout = tBase.m_vLayout;
+        tState.m_mRecords = tBase.m_mRecords;
+    }
+
+    if (iFlags & VIEWSTATE_FLAG_LAYOUT)
+    {
+        stream >> iCount;
+
+        // Each ID takes 4 bytes, a bigger count comes from a corrupt delta
+        if (iCount > (quint32) (baDelta.size() / 4))
+        {
+            return false;
+        }
+
+        tState.m_vLayout.resize((int) iCount);
+
+        for (quint32 iIndex = 0; iIndex < iCount; iIndex++)
+        {
+            stream >> tState.m_vLayout[(int) iIndex];
+        }
+    }
+
+    stream >> iCount;
+
+    for (quint32 iIndex = 0; iIndex < iCount && stream.status() == QDataStream::Ok; iIndex++)
+    {
+        qint32 iID = 0;
+        quint32 iSize = 0;
+
+        stream >> iID;
+        stream >> iSize;
+
+        if (iSize > (quint32) (baDelta.size() - stream.device()->pos()))
+        {
+            return false;
+        }
+
+        QByteArray baRecord((int) iSize, Qt::Uninitialized);
+
+        if (stream.readRawData(baRecord.data(), (int) iSize) != (int) iSize)
+        {
+            return false;
+        }
+
+        tState.m_mRecords[iID] = baRecord;
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        return false;
+    }
+
+    // Drop the records of removed controls, and check that every control has one
+    if (iFlags & VIEWSTATE_FLAG_LAYOUT)
+    {
+        QSet<qint32> sLayout = tState.m_vLayout.toList().toSet();
+
+        foreach (qint32 iID, tState.m_mRecords.keys())
+        {
+            if (sLayout.contains(iID) == false)
+            {
+                tState.m_mRecords.remove(iID);
+            }
+        }
+    }
+
+    if (tState.m_mRecords.count() != tState.m_vLayout.count())
+    {
+        return false;
+    }
+
+    tResult = tState;
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Returns a new random version, 16 hexadecimal digits. \br\br
+    Versions are random so that a client can not name the snapshot of another client.
+*/
+QString CWebViewState::generateVersion()
+{
+    return QString(QUuid::createUuid().toRfc4122().left(8).toHex());
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Adds the records of \a pControl, whose parent's ID is \a iParentID, and of its children.
+*/
+void CWebViewState::addControl(const CWebControl* pControl, qint32 iParentID, CObjectTracker* pTracker)
+{
+    QByteArray baRecord;
+    QDataStream stream(&baRecord, QIODevice::WriteOnly);
+
+    stream << CWebFactory::getInstance()->typeCode(pControl->metaObject()->className());
+    stream << iParentID;
+
+    pControl->serializeProperties(stream, pTracker);
+
+    m_vLayout << pControl->getID();
+    m_mRecords[pControl->getID()] = baRecord;
+
+    foreach (const CWebControl* pChild, pControl->getControls())
+    {
+        addControl(pChild, pControl->getID(), pTracker);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    \class CWebViewStateCache
+    \inmodule qt-plus
+    \brief Keeps the recent snapshots sent to clients, by version.
+
+    The least recently used snapshots are dropped when their total size goes over the maximum size.
+    The methods are thread-safe.
+    \sa CWebViewState
+*/
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Constructs a CWebViewStateCache.
+*/
+CWebViewStateCache::CWebViewStateCache()
+    : m_cStates(16 * 1024 * 1024)
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Sets to \a iBytes the maximum size of the kept snapshots.
+*/
+void CWebViewStateCache::setMaximumSize(int iBytes)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_cStates.setMaxCost(iBytes);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Keeps the snapshot \a tState.
+*/
+void CWebViewStateCache::insert(const CWebViewState& tState)
+{
+    QMutexLocker locker(&m_tMutex);
+
+    m_cStates.insert(tState.version(), new CWebViewState(tState), qMax(tState.size(), 1));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/*!
+    Finds the snapshot whose version is \a sVersion and stores it in \a tState. \br\br
+    Returns \c false if the snapshot is not kept.
+*/
+bool CWebViewStateCache::find(const QString& sVersion, CWebViewState& tState) const
+{
+    QMutexLocker locker(&m_tMutex);
+
+    CWebViewState* pState = m_cStates.object(sVersion);
+
+    if (pState == nullptr)
+    {
+        return false;
+    }
+
+    tState = *pState;
+
+    return true;
+}
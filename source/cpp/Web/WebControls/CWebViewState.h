@@ -0,0 +1,150 @@
+
+#pragma once
+
+#include "../../qtplus_global.h"
+
+//-------------------------------------------------------------------------------------------------
+
+// Qt
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QMap>
+#include <QCache>
+#include <QMutex>
+
+// Application
+#include "../../ISerializable.h"
+
+//-------------------------------------------------------------------------------------------------
+
+// Version of the binary format
+#define VIEWSTATE_FORMAT            2
+
+// Flags of an encoded delta
+#define VIEWSTATE_FLAG_LAYOUT       0x01    // The layout follows
+#define VIEWSTATE_FLAG_FULL         0x02    // The delta does not depend on a base
+
+//-------------------------------------------------------------------------------------------------
+// Forward declarations
+
+class CWebControl;
+class CWebPage;
+
+//-------------------------------------------------------------------------------------------------
+
+//! A versioned snapshot of a page, as one binary record per control
+//! Records reference controls by ID and classes by type code, so a delta only holds the records that changed
+class QTPLUSSHARED_EXPORT CWebViewState
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructs an empty view state
+    CWebViewState();
+
+    //-------------------------------------------------------------------------------------------------
+    // Getters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns the version of this snapshot
+    QString version() const;
+
+    //! Returns true if the snapshot holds no control
+    bool isEmpty() const;
+
+    //! Returns the number of controls
+    int count() const;
+
+    //! Returns the size of the records, in bytes
+    int size() const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns a new page built from the records, nullptr on error
+    CWebPage* toPage(CObjectTracker* pTracker) const;
+
+    //! Returns the binary delta that turns tBase into this snapshot, a full encoding if tBase is empty
+    QByteArray encodeDelta(const CWebViewState& tBase) const;
+
+    //! Returns the javascript that gives the client this snapshot, knowing it holds tBase
+    QString script(const CWebViewState& tBase) const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Static methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Returns a snapshot of a page, with a new version
+    static CWebViewState fromPage(const CWebPage* pPage, CObjectTracker* pTracker);
+
+    //! Applies a binary delta to tBase and stores the result in tResult, returns false if the delta is invalid
+    static bool applyDelta(const CWebViewState& tBase, const QByteArray& baDelta, CWebViewState& tResult);
+
+    //! Returns a new random version
+    static QString generateVersion();
+
+    //-------------------------------------------------------------------------------------------------
+    // Protected methods
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    //! Adds the records of a control and its children
+    void addControl(const CWebControl* pControl, qint32 iParentID, CObjectTracker* pTracker);
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+public:
+
+    QString                     m_sVersion;
+    QVector<qint32>             m_vLayout;      // Control IDs in tree order, the page first
+    QMap<qint32, QByteArray>    m_mRecords;     // Type code, parent ID and properties, by control ID
+};
+
+//-------------------------------------------------------------------------------------------------
+
+//! Keeps the recent snapshots sent to clients, so events only need to carry a version
+class QTPLUSSHARED_EXPORT CWebViewStateCache
+{
+public:
+
+    //-------------------------------------------------------------------------------------------------
+    // Constructors and destructor
+    //-------------------------------------------------------------------------------------------------
+
+    //! Constructor
+    CWebViewStateCache();
+
+    //-------------------------------------------------------------------------------------------------
+    // Setters
+    //-------------------------------------------------------------------------------------------------
+
+    //! Sets the maximum size of the kept snapshots, in bytes (16 MB by default)
+    void setMaximumSize(int iBytes);
+
+    //-------------------------------------------------------------------------------------------------
+    // Control methods
+    //-------------------------------------------------------------------------------------------------
+
+    //! Keeps a snapshot
+    void insert(const CWebViewState& tState);
+
+    //! Finds a snapshot by version, returns false if it is not kept
+    bool find(const QString& sVersion, CWebViewState& tState) const;
+
+    //-------------------------------------------------------------------------------------------------
+    // Properties
+    //-------------------------------------------------------------------------------------------------
+
+protected:
+
+    mutable QMutex                              m_tMutex;
+    mutable QCache<QString, CWebViewState>      m_cStates;
+};